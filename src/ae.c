@@ -30,6 +30,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "fmacros.h"
 #include <stdio.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -46,6 +47,27 @@
 
 /* Include the best multiplexing layer supported by this system.
  * The following should be ordered by performances, descending. */
+#ifdef HAVE_IOURING
+/* The epoll backend, renamed, is the fallback of io_uring. */
+#define aeApiState aeEpollState
+#define aeApiCreate aeEpollApiCreate
+#define aeApiResize aeEpollApiResize
+#define aeApiFree aeEpollApiFree
+#define aeApiAddEvent aeEpollApiAddEvent
+#define aeApiDelEvent aeEpollApiDelEvent
+#define aeApiPoll aeEpollApiPoll
+#define aeApiName aeEpollApiName
+#include "ae_epoll.c"
+#undef aeApiState
+#undef aeApiCreate
+#undef aeApiResize
+#undef aeApiFree
+#undef aeApiAddEvent
+#undef aeApiDelEvent
+#undef aeApiPoll
+#undef aeApiName
+#include "ae_iouring.c"
+#else
 #ifdef HAVE_EVPORT
 #include "ae_evport.c"
 #else
@@ -59,6 +81,7 @@
         #endif
     #endif
 #endif
+#endif
 
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
@@ -70,7 +93,10 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
     eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEvents = NULL;
+    eventLoop->timeEventsNum = 0;
+    eventLoop->timeEventsSize = 0;
+    eventLoop->timeEventsFired = NULL;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
@@ -123,7 +149,12 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
     aeApiFree(eventLoop);
+    for (j = 0; j < eventLoop->timeEventsNum; j++)
+        zfree(eventLoop->timeEvents[j]);
+    zfree(eventLoop->timeEvents);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
     zfree(eventLoop);
@@ -187,18 +218,72 @@ static void aeGetTime(long *seconds, long *milliseconds)
     *milliseconds = tv.tv_usec/1000;
 }
 
-static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-    long cur_sec, cur_ms, when_sec, when_ms;
+static long long aeMilliseconds(void) {
+    long sec, ms;
+
+    aeGetTime(&sec, &ms);
+    return (long long)sec*1000 + ms;
+}
+
+/* Time events are kept in a binary min-heap ordered by fire time, so that
+ * the nearest timer is always the root, and adding, rescheduling or
+ * removing the first timer is O(log(N)). Timers firing at the same
+ * millisecond are ordered by ID, that is, by creation time. */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static void aeTimeEventsSiftUp(aeEventLoop *eventLoop, int j) {
+    aeTimeEvent **heap = eventLoop->timeEvents, *te = heap[j];
+
+    while (j > 0) {
+        int parent = (j-1)/2;
+        if (!aeTimeEventBefore(te,heap[parent])) break;
+        heap[j] = heap[parent];
+        j = parent;
+    }
+    heap[j] = te;
+}
 
-    aeGetTime(&cur_sec, &cur_ms);
-    when_sec = cur_sec + milliseconds/1000;
-    when_ms = cur_ms + milliseconds%1000;
-    if (when_ms >= 1000) {
-        when_sec ++;
-        when_ms -= 1000;
+static void aeTimeEventsSiftDown(aeEventLoop *eventLoop, int j) {
+    aeTimeEvent **heap = eventLoop->timeEvents, *te = heap[j];
+    int num = eventLoop->timeEventsNum;
+
+    while (1) {
+        int child = j*2+1;
+        if (child >= num) break;
+        if (child+1 < num && aeTimeEventBefore(heap[child+1],heap[child]))
+            child++;
+        if (!aeTimeEventBefore(heap[child],te)) break;
+        heap[j] = heap[child];
+        j = child;
     }
-    *sec = when_sec;
-    *ms = when_ms;
+    heap[j] = te;
+}
+
+static int aeTimeEventsPush(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (eventLoop->timeEventsNum == eventLoop->timeEventsSize) {
+        int size = eventLoop->timeEventsSize ? eventLoop->timeEventsSize*2 : 16;
+        aeTimeEvent **heap = zrealloc(eventLoop->timeEvents,sizeof(*heap)*size);
+        if (heap == NULL) return AE_ERR;
+        eventLoop->timeEvents = heap;
+        eventLoop->timeEventsSize = size;
+    }
+    eventLoop->timeEvents[eventLoop->timeEventsNum++] = te;
+    aeTimeEventsSiftUp(eventLoop,eventLoop->timeEventsNum-1);
+    return AE_OK;
+}
+
+/* Remove and return the nearest time event. The heap must not be empty. */
+static aeTimeEvent *aeTimeEventsPop(aeEventLoop *eventLoop) {
+    aeTimeEvent *te = eventLoop->timeEvents[0];
+
+    if (--eventLoop->timeEventsNum > 0) {
+        eventLoop->timeEvents[0] =
+            eventLoop->timeEvents[eventLoop->timeEventsNum];
+        aeTimeEventsSiftDown(eventLoop,0);
+    }
+    return te;
 }
 
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
@@ -211,60 +296,68 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
     te = zmalloc(sizeof(*te));
     if (te == NULL) return AE_ERR;
     te->id = id;
-    aeAddMillisecondsToNow(milliseconds,&te->when_sec,&te->when_ms);
+    te->when = aeMilliseconds() + milliseconds;
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
+    te->next = NULL;
+    if (aeTimeEventsPush(eventLoop,te) == AE_ERR) {
+        zfree(te);
+        return AE_ERR;
+    }
     return id;
 }
 
+/* Events are not released here, since this may be called by the event
+ * itself or by another event firing in the same iteration: the event is
+ * just marked as deleted. If it is in the heap it is also moved to the
+ * root, so that processTimeEvents() finalizes it at the next iteration.
+ *
+ * Note that looking up the ID is O(N), however deleting timers is rare
+ * compared to creating and firing them. */
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    while(te) {
+    aeTimeEvent *te;
+    int j;
+
+    for (j = 0; j < eventLoop->timeEventsNum; j++) {
+        te = eventLoop->timeEvents[j];
+        if (te->id == id) {
+            te->id = AE_DELETED_EVENT_ID;
+            te->when = 0;
+            aeTimeEventsSiftUp(eventLoop,j);
+            return AE_OK;
+        }
+    }
+    for (te = eventLoop->timeEventsFired; te; te = te->next) {
         if (te->id == id) {
             te->id = AE_DELETED_EVENT_ID;
             return AE_OK;
         }
-        te = te->next;
     }
     return AE_ERR; /* NO event with the specified ID found */
 }
 
-/* Search the first timer to fire.
- * This operation is useful to know how many time the select can be
- * put in sleep without to delay any event.
- * If there are no timers NULL is returned.
- *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
+/* Return the first timer to fire, or NULL if there are no timers.
+ * This is used in order to know how many time the select can be
+ * put in sleep without to delay any event. */
 static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
-    }
-    return nearest;
+    return eventLoop->timeEventsNum ? eventLoop->timeEvents[0] : NULL;
+}
+
+static void aeFreeTimeEvent(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (te->finalizerProc)
+        te->finalizerProc(eventLoop, te->clientData);
+    zfree(te);
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
-    int processed = 0;
-    aeTimeEvent *te, *prev;
-    long long maxId;
-    time_t now = time(NULL);
+    int processed = 0, j;
+    aeTimeEvent *te, **tail;
+    long long now;
+    time_t now_sec = time(NULL);
 
     /* If the system clock is moved to the future, and then set back to the
      * right value, time events may be delayed in a random way. Often this
@@ -273,63 +366,51 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
      * Here we try to detect system clock skews, and force all the time
      * events to be processed ASAP when this happens: the idea is that
      * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
-    if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
-        }
+     * indefinitely, and practice suggests it is. With all the fire times
+     * set to zero the heap is no longer ordered by (when,id), since the
+     * events are placed according to their old fire times, but this is
+     * harmless: every event is now due, so the loop below pops all of
+     * them, and the ones that are kept are pushed back with a new fire
+     * time. */
+    if (now_sec < eventLoop->lastTime) {
+        for (j = 0; j < eventLoop->timeEventsNum; j++)
+            eventLoop->timeEvents[j]->when = 0;
+    }
+    eventLoop->lastTime = now_sec;
+
+    /* Take the events to fire out of the heap first, in firing order. This
+     * way events created or rescheduled by the callbacks are not processed
+     * again in this iteration, and the heap is never modified while we
+     * are walking it. */
+    now = aeMilliseconds();
+    tail = &eventLoop->timeEventsFired;
+    while (eventLoop->timeEventsNum &&
+           eventLoop->timeEvents[0]->when <= now)
+    {
+        te = aeTimeEventsPop(eventLoop);
+        te->next = NULL;
+        *tail = te;
+        tail = &te->next;
     }
-    eventLoop->lastTime = now;
 
-    prev = NULL;
-    te = eventLoop->timeEventHead;
-    maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
+    while ((te = eventLoop->timeEventsFired) != NULL) {
+        int retval;
 
         /* Remove events scheduled for deletion. */
         if (te->id == AE_DELETED_EVENT_ID) {
-            aeTimeEvent *next = te->next;
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            te = next;
+            eventLoop->timeEventsFired = te->next;
+            aeFreeTimeEvent(eventLoop, te);
             continue;
         }
 
-        /* Make sure we don't process time events created by time events in
-         * this iteration. Note that this check is currently useless: we always
-         * add new timers on the head, however if we change the implementation
-         * detail, this check may be useful again: we keep it here for future
-         * defense. */
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
+        retval = te->timeProc(eventLoop, te->id, te->clientData);
+        processed++;
+        eventLoop->timeEventsFired = te->next;
+        if (retval != AE_NOMORE && te->id != AE_DELETED_EVENT_ID) {
+            te->when = aeMilliseconds() + retval;
+            if (aeTimeEventsPush(eventLoop,te) == AE_OK) continue;
         }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                te->id = AE_DELETED_EVENT_ID;
-            }
-        }
-        prev = te;
-        te = te->next;
+        aeFreeTimeEvent(eventLoop, te);
     }
     return processed;
 }
@@ -368,16 +449,11 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
         if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT))
             shortest = aeSearchNearestTimer(eventLoop);
         if (shortest) {
-            long now_sec, now_ms;
-
-            aeGetTime(&now_sec, &now_ms);
             tvp = &tv;
 
             /* How many milliseconds we need to wait for the next
              * time event to fire? */
-            long long ms =
-                (shortest->when_sec - now_sec)*1000 +
-                shortest->when_ms - now_ms;
+            long long ms = shortest->when - aeMilliseconds();
 
             if (ms > 0) {
                 tvp->tv_sec = ms/1000;
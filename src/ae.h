@@ -73,12 +73,11 @@ typedef struct aeFileEvent {
 /* Time event structure */
 typedef struct aeTimeEvent {
     long long id; /* time event identifier. */
-    long when_sec; /* seconds */
-    long when_ms; /* milliseconds */
+    long long when; /* unix time in milliseconds */
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    struct aeTimeEvent *next; /* Next event firing in this iteration. */
 } aeTimeEvent;
 
 /* A fired event */
@@ -95,7 +94,10 @@ typedef struct aeEventLoop {
     time_t lastTime;     /* Used to detect system clock skew */
     aeFileEvent *events; /* Registered events */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeEvent **timeEvents; /* Min-heap of the time events by 'when' */
+    int timeEventsNum;        /* Number of time events in the heap */
+    int timeEventsSize;       /* Allocated slots in the heap */
+    aeTimeEvent *timeEventsFired; /* Events being fired, see processTimeEvents */
     int stop;
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
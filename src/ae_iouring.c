@@ -0,0 +1,378 @@
+/* Linux io_uring(7) based ae.c module.
+ *
+ * File events are implemented with IORING_OP_POLL_ADD requests. Instead of
+ * calling epoll_ctl() every time the events of a file descriptor change,
+ * the changes are just recorded, and the requests needed to apply them are
+ * submitted in batch by the same io_uring_enter() call that waits for the
+ * events. Poll requests are one shot: when a file descriptor fires it is
+ * armed again at the next aeApiPoll() call if the event is still wanted,
+ * so that the semantics is the same as the level triggered epoll backend.
+ * Idle file descriptors cost nothing after they are armed.
+ *
+ * Every request carries in its user_data the file descriptor and the
+ * generation of its poll request: replacing or removing a request bumps the
+ * generation, so completions of stale requests are ignored.
+ *
+ * This backend is used only when Redis is built with USE_IOURING=yes, and
+ * requires Linux 5.11 or greater: when io_uring is not available the event
+ * loop falls back to the epoll backend.
+ */
+
+
+
+#include <endian.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define AE_IOURING_ENTRIES 1024   /* Submission queue size. */
+
+/* Per file descriptor flags. The AE_READABLE and AE_WRITABLE bits are the
+ * events of the poll request in flight, if any. */
+#define AE_IOURING_DIRTY 4        /* Poll request must be updated. */
+
+/* user_data of the requests removing a poll request. */
+#define AE_IOURING_REMOVE (1ULL<<63)
+
+typedef struct aeApiState {
+    int ringfd;
+    /* Submission queue. */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries, sqe_tail;
+    struct io_uring_sqe *sqes;
+    /* Completion queue. */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Mappings of the rings shared with the kernel. */
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    /* Per file descriptor state. */
+    unsigned char *fdflags;
+    unsigned int *fdgen;
+    int *dirty;                   /* File descriptors flagged as dirty. */
+    int numdirty;
+    int setsize;
+    aeEpollState *epoll;          /* Not NULL if io_uring is not available. */
+} aeApiState;
+
+/* Set when an event loop falls back to epoll, for aeApiName(). */
+static int aeIouringFallback = 0;
+
+/* Call the epoll backend with its own state as the loop state. */
+#define aeIouringUseEpoll(eventLoop,state,call) do { \
+    (eventLoop)->apidata = (state)->epoll; \
+    call; \
+    (eventLoop)->apidata = (state); \
+} while(0)
+
+static int aeIouringEnter(aeApiState *state, unsigned to_submit,
+                          unsigned min_complete, struct timeval *tvp)
+{
+    struct io_uring_getevents_arg arg = {0};
+    struct __kernel_timespec ts;
+
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec*1000;
+        arg.ts = (unsigned long)&ts;
+    }
+    return syscall(__NR_io_uring_enter,state->ringfd,to_submit,min_complete,
+                   IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                   &arg,sizeof(arg));
+}
+
+/* Make the queued requests visible to the kernel, and return how many of
+ * them were not consumed yet. */
+static unsigned aeIouringFlushSq(aeApiState *state) {
+    __atomic_store_n(state->sq_tail,state->sqe_tail,__ATOMIC_RELEASE);
+    return state->sqe_tail - __atomic_load_n(state->sq_head,__ATOMIC_ACQUIRE);
+}
+
+/* Return a free submission queue entry, submitting the queued requests
+ * first if the queue is full. */
+static struct io_uring_sqe *aeIouringGetSqe(aeApiState *state) {
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    while (state->sqe_tail - __atomic_load_n(state->sq_head,__ATOMIC_ACQUIRE)
+           == state->sq_entries)
+    {
+        struct timeval tv = {0,0};
+        if (aeIouringEnter(state,aeIouringFlushSq(state),0,&tv) == -1 &&
+            errno != EINTR && errno != ETIME && errno != EBUSY) break;
+    }
+    idx = state->sqe_tail++ & *state->sq_mask;
+    sqe = &state->sqes[idx];
+    memset(sqe,0,sizeof(*sqe));
+    state->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void aeIouringMarkDirty(aeApiState *state, int fd) {
+    if (state->fdflags[fd] & AE_IOURING_DIRTY) return;
+    state->fdflags[fd] |= AE_IOURING_DIRTY;
+    state->dirty[state->numdirty++] = fd;
+}
+
+/* Queue the removal of the poll request in flight for 'fd', if any. The
+ * generation is bumped, so the completion of the removed request, or of
+ * the request itself if it fired meanwhile, is ignored. */
+static void aeIouringRemovePoll(aeApiState *state, int fd) {
+    struct io_uring_sqe *sqe;
+
+    if (state->fdflags[fd] & (AE_READABLE|AE_WRITABLE)) {
+        sqe = aeIouringGetSqe(state);
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = ((unsigned long long)state->fdgen[fd] << 32) | fd;
+        sqe->user_data = AE_IOURING_REMOVE;
+        state->fdgen[fd] = (state->fdgen[fd]+1) & 0x7fffffff;
+        state->fdflags[fd] &= ~(AE_READABLE|AE_WRITABLE);
+    }
+}
+
+static void aeIouringUnmap(aeApiState *state) {
+    if (state->sq_ring && state->sq_ring != MAP_FAILED)
+        munmap(state->sq_ring,state->sq_ring_size);
+    if (state->cq_ring && state->cq_ring != MAP_FAILED &&
+        state->cq_ring != state->sq_ring)
+        munmap(state->cq_ring,state->cq_ring_size);
+    if (state->sqes && state->sqes != MAP_FAILED)
+        munmap(state->sqes,state->sqes_size);
+}
+
+static int aeApiCreate(aeEventLoop *eventLoop) {
+    aeApiState *state = zcalloc(sizeof(aeApiState));
+    struct io_uring_params p = {0};
+
+    if (!state) return -1;
+    state->setsize = eventLoop->setsize;
+    state->fdflags = zcalloc(eventLoop->setsize);
+    state->fdgen = zcalloc(sizeof(unsigned int)*eventLoop->setsize);
+    state->dirty = zmalloc(sizeof(int)*eventLoop->setsize);
+    state->ringfd = syscall(__NR_io_uring_setup,AE_IOURING_ENTRIES,&p);
+    if (state->ringfd == -1) goto fallback;
+    if (!(p.features & IORING_FEAT_EXT_ARG) ||
+        !(p.features & IORING_FEAT_NODROP))
+    {
+        goto fallback;
+    }
+
+    state->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cq_ring_size = p.cq_off.cqes +
+                          p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_ring_size > state->sq_ring_size)
+            state->sq_ring_size = state->cq_ring_size;
+        state->cq_ring_size = state->sq_ring_size;
+    }
+    state->sq_ring = mmap(NULL,state->sq_ring_size,PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQ_RING);
+    if (state->sq_ring == MAP_FAILED) goto err;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cq_ring = state->sq_ring;
+    } else {
+        state->cq_ring = mmap(NULL,state->cq_ring_size,PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_CQ_RING);
+        if (state->cq_ring == MAP_FAILED) goto err;
+    }
+    state->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL,state->sqes_size,PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE,state->ringfd,IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) goto err;
+
+    state->sq_head = (unsigned*)((char*)state->sq_ring+p.sq_off.head);
+    state->sq_tail = (unsigned*)((char*)state->sq_ring+p.sq_off.tail);
+    state->sq_mask = (unsigned*)((char*)state->sq_ring+p.sq_off.ring_mask);
+    state->sq_array = (unsigned*)((char*)state->sq_ring+p.sq_off.array);
+    state->sq_entries = p.sq_entries;
+    state->sqe_tail = *state->sq_tail;
+    state->cq_head = (unsigned*)((char*)state->cq_ring+p.cq_off.head);
+    state->cq_tail = (unsigned*)((char*)state->cq_ring+p.cq_off.tail);
+    state->cq_mask = (unsigned*)((char*)state->cq_ring+p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)
+                  ((char*)state->cq_ring+p.cq_off.cqes);
+    eventLoop->apidata = state;
+    return 0;
+
+fallback:
+    /* The kernel is too old, or io_uring is disabled or restricted: use
+     * epoll instead of refusing to start. */
+    aeIouringUnmap(state);
+    if (state->ringfd != -1) close(state->ringfd);
+    state->ringfd = -1;
+    if (aeEpollApiCreate(eventLoop) == 0) {
+        state->epoll = eventLoop->apidata;
+        eventLoop->apidata = state;
+        aeIouringFallback = 1;
+        return 0;
+    }
+
+err:
+    aeIouringUnmap(state);
+    if (state->ringfd != -1) close(state->ringfd);
+    zfree(state->fdflags);
+    zfree(state->fdgen);
+    zfree(state->dirty);
+    zfree(state);
+    return -1;
+}
+
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        int retval;
+        aeIouringUseEpoll(eventLoop,state,
+            retval = aeEpollApiResize(eventLoop,setsize));
+        return retval;
+    }
+
+    state->fdflags = zrealloc(state->fdflags,setsize);
+    state->fdgen = zrealloc(state->fdgen,sizeof(unsigned int)*setsize);
+    state->dirty = zrealloc(state->dirty,sizeof(int)*setsize);
+    if (setsize > state->setsize) {
+        memset(state->fdflags+state->setsize,0,setsize-state->setsize);
+        memset(state->fdgen+state->setsize,0,
+               sizeof(unsigned int)*(setsize-state->setsize));
+    }
+    state->setsize = setsize;
+    return 0;
+}
+
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        eventLoop->apidata = state->epoll;
+        aeEpollApiFree(eventLoop);
+    } else {
+        aeIouringUnmap(state);
+        close(state->ringfd);
+    }
+    zfree(state->fdflags);
+    zfree(state->fdgen);
+    zfree(state->dirty);
+    zfree(state);
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        int retval;
+        aeIouringUseEpoll(eventLoop,state,
+            retval = aeEpollApiAddEvent(eventLoop,fd,mask));
+        return retval;
+    }
+    if ((eventLoop->events[fd].mask | mask) != eventLoop->events[fd].mask)
+        aeIouringMarkDirty(state,fd);
+    return 0;
+}
+
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        aeIouringUseEpoll(eventLoop,state,
+            aeEpollApiDelEvent(eventLoop,fd,delmask));
+        return;
+    }
+    if (!(eventLoop->events[fd].mask & delmask)) return;
+    if ((eventLoop->events[fd].mask & ~delmask) == AE_NONE) {
+        /* The file descriptor is likely about to be closed, and its number
+         * may be reused by a new one before the next aeApiPoll(). Remove
+         * the poll request right away, so that the new file descriptor is
+         * armed like any other, and the request does not keep the closed
+         * file open. */
+        aeIouringRemovePoll(state,fd);
+    } else {
+        aeIouringMarkDirty(state,fd);
+    }
+}
+
+/* Queue the requests needed so that the poll request in flight for every
+ * dirty file descriptor matches the events in eventLoop->events. */
+static void aeIouringUpdatePolls(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+    struct io_uring_sqe *sqe;
+    int j;
+
+    for (j = 0; j < state->numdirty; j++) {
+        int fd = state->dirty[j];
+        int mask = eventLoop->events[fd].mask;
+        int armed = state->fdflags[fd] & (AE_READABLE|AE_WRITABLE);
+
+        state->fdflags[fd] = armed;
+        if (armed == mask) continue;
+        aeIouringRemovePoll(state,fd);
+        if (mask) {
+            unsigned int events = 0;
+
+            sqe = aeIouringGetSqe(state);
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            if (mask & AE_READABLE) events |= POLLIN;
+            if (mask & AE_WRITABLE) events |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+            events = (events << 16) | (events >> 16); /* Word-reversed. */
+#endif
+            sqe->poll32_events = events;
+            sqe->user_data = ((unsigned long long)state->fdgen[fd] << 32) | fd;
+        }
+        state->fdflags[fd] = mask;
+    }
+    state->numdirty = 0;
+}
+
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    unsigned head, tail;
+    int numevents = 0;
+
+    if (state->epoll) {
+        aeIouringUseEpoll(eventLoop,state,
+            numevents = aeEpollApiPoll(eventLoop,tvp));
+        return numevents;
+    }
+
+    /* Submit the pending changes and wait for at least one completion,
+     * unless we should not block at all. */
+    aeIouringUpdatePolls(eventLoop);
+    aeIouringEnter(state,aeIouringFlushSq(state),
+        (tvp && tvp->tv_sec == 0 && tvp->tv_usec == 0) ? 0 : 1,tvp);
+
+    head = *state->cq_head;
+    tail = __atomic_load_n(state->cq_tail,__ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &state->cqes[head++ & *state->cq_mask];
+        unsigned long long ud = cqe->user_data;
+        int fd = ud & 0xffffffff, mask = 0;
+
+        if (ud & AE_IOURING_REMOVE) continue;
+        if (fd >= state->setsize || (ud >> 32) != state->fdgen[fd] ||
+            !(state->fdflags[fd] & (AE_READABLE|AE_WRITABLE))) continue;
+
+        /* The request was consumed: arm it again in the next call if
+         * the file descriptor still has events. */
+        if (cqe->res < 0) {
+            mask = state->fdflags[fd]; /* Let the handlers get the error. */
+        } else {
+            if (cqe->res & POLLIN) mask |= AE_READABLE;
+            if (cqe->res & POLLOUT) mask |= AE_WRITABLE;
+            if (cqe->res & POLLERR) mask |= AE_WRITABLE;
+            if (cqe->res & POLLHUP) mask |= AE_WRITABLE;
+        }
+        state->fdflags[fd] &= ~(AE_READABLE|AE_WRITABLE);
+        aeIouringMarkDirty(state,fd);
+        eventLoop->fired[numevents].fd = fd;
+        eventLoop->fired[numevents].mask = mask;
+        numevents++;
+    }
+    __atomic_store_n(state->cq_head,head,__ATOMIC_RELEASE);
+    return numevents;
+}
+
+static char *aeApiName(void) {
+    return aeIouringFallback ? aeEpollApiName() : "io_uring";
+}
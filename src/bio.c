@@ -24,6 +24,12 @@
  * recently inserted to the most recently inserted (older jobs processed
  * first).
  *
+ * The only exception is BIO_LAZY_FREE, that can be served by multiple
+ * threads (see the lazyfree-threads option), every one with its own queue.
+ * New jobs are queued to the worker with fewer pending jobs, so the order
+ * is only guaranteed among the jobs that end in the same queue. This is
+ * fine for lazy freeing as the objects released are no longer reachable.
+ *
  * Currently there is no way for the creator of the job to be notified about
  * the completion of the operation, this will only be added when/if needed.
  *
@@ -61,18 +67,27 @@
 #include "server.h"
 #include "bio.h"
 
-static pthread_t bio_threads[BIO_NUM_OPS];
-static pthread_mutex_t bio_mutex[BIO_NUM_OPS];
-static pthread_cond_t bio_newjob_cond[BIO_NUM_OPS];
-static pthread_cond_t bio_step_cond[BIO_NUM_OPS];
-static list *bio_jobs[BIO_NUM_OPS];
+/* Every job type is served by one worker thread, except BIO_LAZY_FREE that
+ * is served by server.lazyfree_threads_num workers. All the state below is
+ * per worker: bio_type_first[] and bio_type_workers[] map a job type to
+ * the range of workers serving it. */
+#define BIO_MAX_WORKERS (BIO_NUM_OPS-1+LAZYFREE_THREADS_MAX_NUM)
+static pthread_t bio_threads[BIO_MAX_WORKERS];
+static pthread_mutex_t bio_mutex[BIO_MAX_WORKERS];
+static pthread_cond_t bio_newjob_cond[BIO_MAX_WORKERS];
+static pthread_cond_t bio_step_cond[BIO_MAX_WORKERS];
+static list *bio_jobs[BIO_MAX_WORKERS];
+static int bio_worker_type[BIO_MAX_WORKERS];
+static int bio_type_first[BIO_NUM_OPS];
+static int bio_type_workers[BIO_NUM_OPS];
+static int bio_num_workers;
 /* The following array is used to hold the number of pending jobs for every
- * OP type. This allows us to export the bioPendingJobsOfType() API that is
+ * worker. This allows us to export the bioPendingJobsOfType() API that is
  * useful when the main thread wants to perform some operation that may involve
  * objects shared with the background thread. The main thread will just wait
  * that there are no longer jobs of this type to be executed before performing
  * the sensible operation. This data is also useful for reporting. */
-static unsigned long long bio_pending[BIO_NUM_OPS];
+static unsigned long long bio_pending[BIO_MAX_WORKERS];
 
 /* This structure represents a background Job. It is only used locally to this
  * file as the API does not expose the internals at all. */
@@ -85,22 +100,33 @@ struct bio_job {
 
 void *bioProcessBackgroundJobs(void *arg);
 void lazyfreeFreeObjectFromBioThread(robj *o);
-void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2);
+void lazyfreeFreeDatabaseFromBioThread(void *job, long part);
 void lazyfreeFreeSlotsMapFromBioThread(zskiplist *sl);
+void stringCompressionTrainFromBioThread(void *job);
 
 /* Make sure we have enough stack to perform all the things we do in the
  * main thread. */
 #define REDIS_THREAD_STACK_SIZE (1024*1024*4)
 
-/* Initialize the background system, spawning the thread. */
+/* Initialize the background system, spawning the threads. */
 void bioInit(void) {
     pthread_attr_t attr;
     pthread_t thread;
     size_t stacksize;
-    int j;
+    int j, type;
+
+    /* Assign the workers to the job types. */
+    bio_num_workers = 0;
+    for (type = 0; type < BIO_NUM_OPS; type++) {
+        int workers = (type == BIO_LAZY_FREE) ? server.lazyfree_threads_num : 1;
+
+        bio_type_first[type] = bio_num_workers;
+        bio_type_workers[type] = workers;
+        while(workers--) bio_worker_type[bio_num_workers++] = type;
+    }
 
     /* Initialization of state vars and objects */
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         pthread_mutex_init(&bio_mutex[j],NULL);
         pthread_cond_init(&bio_newjob_cond[j],NULL);
         pthread_cond_init(&bio_step_cond[j],NULL);
@@ -116,9 +142,9 @@ void bioInit(void) {
     pthread_attr_setstacksize(&attr, stacksize);
 
     /* Ready to spawn our threads. We use the single argument the thread
-     * function accepts in order to pass the job ID the thread is
+     * function accepts in order to pass the worker ID the thread is
      * responsible of. */
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         void *arg = (void*)(unsigned long) j;
         if (pthread_create(&thread,&attr,bioProcessBackgroundJobs,arg) != 0) {
             serverLog(LL_WARNING,"Fatal: Can't initialize Background Jobs.");
@@ -128,38 +154,95 @@ void bioInit(void) {
     }
 }
 
+/* Return the number of threads serving jobs of the specified type. */
+int bioWorkersOfType(int type) {
+    return bio_type_workers[type];
+}
+
+/* Return the worker of the specified type with fewer pending jobs. */
+static int bioLeastLoadedWorker(int type) {
+    int j, best = bio_type_first[type];
+    unsigned long long min = ULLONG_MAX;
+
+    if (bio_type_workers[type] == 1) return best;
+    for (j = bio_type_first[type];
+         j < bio_type_first[type]+bio_type_workers[type]; j++)
+    {
+        unsigned long long pending;
+
+        pthread_mutex_lock(&bio_mutex[j]);
+        pending = bio_pending[j];
+        pthread_mutex_unlock(&bio_mutex[j]);
+        if (pending < min) {
+            min = pending;
+            best = j;
+        }
+    }
+    return best;
+}
+
 void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3) {
-    struct bio_job *job = zmalloc(sizeof(*job));
-
-    job->time = time(NULL);
-    job->arg1 = arg1;
-    job->arg2 = arg2;
-    job->arg3 = arg3;
-    pthread_mutex_lock(&bio_mutex[type]);
-    listAddNodeTail(bio_jobs[type],job);
-    bio_pending[type]++;
-    pthread_cond_signal(&bio_newjob_cond[type]);
-    pthread_mutex_unlock(&bio_mutex[type]);
+    bioCreateBackgroundJobs(type,1,&arg1,&arg2,&arg3);
+}
+
+/* Create 'numjobs' jobs of the specified type at once, the arguments of the
+ * job 'j' being arg1[j], arg2[j] and arg3[j] (a NULL array means that the
+ * argument is NULL for all the jobs).
+ *
+ * When the type is served by multiple workers the jobs are spread among
+ * them, starting from the least loaded worker, so that a batch of N jobs
+ * is processed in parallel by N threads. Every involved worker is locked
+ * and signaled only once for the whole batch. */
+void bioCreateBackgroundJobs(int type, int numjobs, void **arg1, void **arg2,
+                             void **arg3)
+{
+    int first = bio_type_first[type], workers = bio_type_workers[type];
+    int start = bioLeastLoadedWorker(type)-first, w, j;
+    time_t now = time(NULL);
+
+    for (w = 0; w < workers && w < numjobs; w++) {
+        int worker = first+(start+w)%workers;
+        list *batch = listCreate();
+
+        /* Jobs are allocated before taking the lock. */
+        for (j = w; j < numjobs; j += workers) {
+            struct bio_job *job = zmalloc(sizeof(*job));
+
+            job->time = now;
+            job->arg1 = arg1 ? arg1[j] : NULL;
+            job->arg2 = arg2 ? arg2[j] : NULL;
+            job->arg3 = arg3 ? arg3[j] : NULL;
+            listAddNodeTail(batch,job);
+        }
+        pthread_mutex_lock(&bio_mutex[worker]);
+        bio_pending[worker] += listLength(batch);
+        listJoin(bio_jobs[worker],batch);
+        pthread_cond_signal(&bio_newjob_cond[worker]);
+        pthread_mutex_unlock(&bio_mutex[worker]);
+        listRelease(batch);
+    }
 }
 
 void *bioProcessBackgroundJobs(void *arg) {
     struct bio_job *job;
-    unsigned long type = (unsigned long) arg;
+    unsigned long worker = (unsigned long) arg;
+    unsigned long type;
     sigset_t sigset;
 
-    /* Check that the type is within the right interval. */
-    if (type >= BIO_NUM_OPS) {
+    /* Check that the worker is within the right interval. */
+    if (worker >= (unsigned long)bio_num_workers) {
         serverLog(LL_WARNING,
-            "Warning: bio thread started with wrong type %lu",type);
+            "Warning: bio thread started with wrong worker %lu",worker);
         return NULL;
     }
+    type = bio_worker_type[worker];
 
     /* Make the thread killable at any time, so that bioKillThreads()
      * can work reliably. */
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
-    pthread_mutex_lock(&bio_mutex[type]);
+    pthread_mutex_lock(&bio_mutex[worker]);
     /* Block SIGALRM so we are sure that only the main thread will
      * receive the watchdog signal. */
     sigemptyset(&sigset);
@@ -172,16 +255,16 @@ void *bioProcessBackgroundJobs(void *arg) {
         listNode *ln;
 
         /* The loop always starts with the lock hold. */
-        if (listLength(bio_jobs[type]) == 0) {
-            pthread_cond_wait(&bio_newjob_cond[type],&bio_mutex[type]);
+        if (listLength(bio_jobs[worker]) == 0) {
+            pthread_cond_wait(&bio_newjob_cond[worker],&bio_mutex[worker]);
             continue;
         }
         /* Pop the job from the queue. */
-        ln = listFirst(bio_jobs[type]);
+        ln = listFirst(bio_jobs[worker]);
         job = ln->value;
         /* It is now possible to unlock the background system as we know have
          * a stand alone job structure to process.*/
-        pthread_mutex_unlock(&bio_mutex[type]);
+        pthread_mutex_unlock(&bio_mutex[worker]);
 
         /* Process the job accordingly to its type. */
         if (type == BIO_CLOSE_FILE) {
@@ -191,42 +274,52 @@ void *bioProcessBackgroundJobs(void *arg) {
         } else if (type == BIO_LAZY_FREE) {
             /* What we free changes depending on what arguments are set:
              * arg1 -> free the object at pointer.
-             * arg2 & arg3 -> free two dictionaries (a Redis DB).
+             * arg2 -> free a part of a Redis DB, arg3 is the part index.
              * only arg3 -> free the skiplist. */
             if (job->arg1)
                 lazyfreeFreeObjectFromBioThread(job->arg1);
-            else if (job->arg2 && job->arg3)
-                lazyfreeFreeDatabaseFromBioThread(job->arg2,job->arg3);
+            else if (job->arg2)
+                lazyfreeFreeDatabaseFromBioThread(job->arg2,
+                                                  (long)job->arg3);
             else if (job->arg3)
                 lazyfreeFreeSlotsMapFromBioThread(job->arg3);
+        } else if (type == BIO_TRAIN_DICT) {
+            stringCompressionTrainFromBioThread(job->arg1);
         } else {
             serverPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
         zfree(job);
 
         /* Unblock threads blocked on bioWaitStepOfType() if any. */
-        pthread_cond_broadcast(&bio_step_cond[type]);
+        pthread_cond_broadcast(&bio_step_cond[worker]);
 
         /* Lock again before reiterating the loop, if there are no longer
          * jobs to process we'll block again in pthread_cond_wait(). */
-        pthread_mutex_lock(&bio_mutex[type]);
-        listDelNode(bio_jobs[type],ln);
-        bio_pending[type]--;
+        pthread_mutex_lock(&bio_mutex[worker]);
+        listDelNode(bio_jobs[worker],ln);
+        bio_pending[worker]--;
     }
 }
 
 /* Return the number of pending jobs of the specified type. */
 unsigned long long bioPendingJobsOfType(int type) {
-    unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
-    pthread_mutex_unlock(&bio_mutex[type]);
+    unsigned long long val = 0;
+    int j;
+
+    for (j = bio_type_first[type];
+         j < bio_type_first[type]+bio_type_workers[type]; j++)
+    {
+        pthread_mutex_lock(&bio_mutex[j]);
+        val += bio_pending[j];
+        pthread_mutex_unlock(&bio_mutex[j]);
+    }
     return val;
 }
 
 /* If there are pending jobs for the specified type, the function blocks
  * and waits that the next job was processed. Otherwise the function
- * does not block and returns ASAP.
+ * does not block and returns ASAP. When the type is served by multiple
+ * workers, we wait for the first worker that has pending jobs.
  *
  * The function returns the number of jobs still to process of the
  * requested type.
@@ -235,15 +328,22 @@ unsigned long long bioPendingJobsOfType(int type) {
  * a bio.c thread to do more work in a blocking way.
  */
 unsigned long long bioWaitStepOfType(int type) {
-    unsigned long long val;
-    pthread_mutex_lock(&bio_mutex[type]);
-    val = bio_pending[type];
-    if (val != 0) {
-        pthread_cond_wait(&bio_step_cond[type],&bio_mutex[type]);
-        val = bio_pending[type];
+    int j;
+
+    for (j = bio_type_first[type];
+         j < bio_type_first[type]+bio_type_workers[type]; j++)
+    {
+        int waited = 0;
+
+        pthread_mutex_lock(&bio_mutex[j]);
+        if (bio_pending[j] != 0) {
+            pthread_cond_wait(&bio_step_cond[j],&bio_mutex[j]);
+            waited = 1;
+        }
+        pthread_mutex_unlock(&bio_mutex[j]);
+        if (waited) break;
     }
-    pthread_mutex_unlock(&bio_mutex[type]);
-    return val;
+    return bioPendingJobsOfType(type);
 }
 
 /* Kill the running bio threads in an unclean way. This function should be
@@ -253,15 +353,16 @@ unsigned long long bioWaitStepOfType(int type) {
 void bioKillThreads(void) {
     int err, j;
 
-    for (j = 0; j < BIO_NUM_OPS; j++) {
+    for (j = 0; j < bio_num_workers; j++) {
         if (pthread_cancel(bio_threads[j]) == 0) {
             if ((err = pthread_join(bio_threads[j],NULL)) != 0) {
                 serverLog(LL_WARNING,
-                    "Bio thread for job type #%d can be joined: %s",
-                        j, strerror(err));
+                    "Bio thread #%d for job type #%d can be joined: %s",
+                        j, bio_worker_type[j], strerror(err));
             } else {
                 serverLog(LL_WARNING,
-                    "Bio thread for job type #%d terminated",j);
+                    "Bio thread #%d for job type #%d terminated",
+                        j, bio_worker_type[j]);
             }
         }
     }
@@ -30,6 +30,8 @@
 /* Exported API */
 void bioInit(void);
 void bioCreateBackgroundJob(int type, void *arg1, void *arg2, void *arg3);
+void bioCreateBackgroundJobs(int type, int numjobs, void **arg1, void **arg2, void **arg3);
+int bioWorkersOfType(int type);
 unsigned long long bioPendingJobsOfType(int type);
 unsigned long long bioWaitStepOfType(int type);
 time_t bioOlderJobOfType(int type);
@@ -39,4 +41,5 @@ void bioKillThreads(void);
 #define BIO_CLOSE_FILE    0 /* Deferred close(2) syscall. */
 #define BIO_AOF_FSYNC     1 /* Deferred AOF fsync. */
 #define BIO_LAZY_FREE     2 /* Deferred objects freeing. */
-#define BIO_NUM_OPS       3
+#define BIO_TRAIN_DICT    3 /* String compression dictionary training. */
+#define BIO_NUM_OPS       4
@@ -0,0 +1,208 @@
+/* Compression codecs used for RDB strings and quicklist nodes.
+ *
+ * Every codec implements the same interface as LZF, that Redis historically
+ * used everywhere: compression fails when the output does not fit the
+ * target buffer, so callers can request a minimum saving simply by
+ * passing a smaller buffer, and decompression needs the exact size of the
+ * original data, that the callers store along with the compressed data.
+ */
+
+#include "codec.h"
+#include "lzf.h"
+#include "zmalloc.h"
+
+#include <pthread.h>
+#define ZSTD_STATIC_LINKING_ONLY /* For ZSTD_c_format. */
+#include <zstd.h>
+#include <zdict.h>
+
+/* Zstandard allocates through zmalloc, so that its contexts and
+ * dictionaries are accounted in the used memory. */
+static void *codecZstdAlloc(void *opaque, size_t size) {
+    ((void) opaque);
+    return zmalloc(size);
+}
+
+static void codecZstdFree(void *opaque, void *ptr) {
+    ((void) opaque);
+    zfree(ptr);
+}
+
+static const ZSTD_customMem codec_zstd_mem = {
+    codecZstdAlloc, codecZstdFree, NULL
+};
+
+/* Zstandard contexts are expensive to create, so every thread keeps its
+ * own pair, created the first time the thread uses the codec and released
+ * when it exits. */
+typedef struct codecZstdContext {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} codecZstdContext;
+
+static pthread_key_t codec_zstd_key;
+static pthread_once_t codec_zstd_once = PTHREAD_ONCE_INIT;
+
+static void codecZstdFreeContext(void *ptr) {
+    codecZstdContext *ctx = ptr;
+
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    zfree(ctx);
+}
+
+static void codecZstdCreateKey(void) {
+    pthread_key_create(&codec_zstd_key,codecZstdFreeContext);
+}
+
+/* Return the contexts of the calling thread, or NULL if they can't be
+ * created. */
+static codecZstdContext *codecZstdGetContext(void) {
+    codecZstdContext *ctx;
+
+    pthread_once(&codec_zstd_once,codecZstdCreateKey);
+    if ((ctx = pthread_getspecific(codec_zstd_key)) != NULL) return ctx;
+    ctx = zmalloc(sizeof(*ctx));
+    ctx->cctx = ZSTD_createCCtx_advanced(codec_zstd_mem);
+    ctx->dctx = ZSTD_createDCtx_advanced(codec_zstd_mem);
+    if (ctx->cctx == NULL || ctx->dctx == NULL ||
+        pthread_setspecific(codec_zstd_key,ctx) != 0)
+    {
+        codecZstdFreeContext(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* Compress 'inlen' bytes at 'in' into the 'outlen' bytes buffer at 'out'.
+ * Returns the compressed length, or 0 if the compressed data does not fit
+ * into the buffer. */
+size_t codecCompress(int codec, const void *in, size_t inlen, void *out,
+                     size_t outlen)
+{
+    codecZstdContext *ctx;
+    size_t retval;
+
+    switch(codec) {
+    case CODEC_LZF:
+        return lzf_compress(in,inlen,out,outlen);
+    case CODEC_ZSTD:
+        if ((ctx = codecZstdGetContext()) == NULL) return 0;
+        retval = ZSTD_compressCCtx(ctx->cctx,out,outlen,in,inlen,
+                                   CODEC_ZSTD_LEVEL);
+        return ZSTD_isError(retval) ? 0 : retval;
+    default:
+        return 0;
+    }
+}
+
+/* Decompress 'inlen' bytes at 'in' into the buffer at 'out', that must be
+ * exactly as big as the original data, 'outlen' bytes. Returns 'outlen',
+ * or 0 if the compressed data is corrupted. */
+size_t codecDecompress(int codec, const void *in, size_t inlen, void *out,
+                       size_t outlen)
+{
+    codecZstdContext *ctx;
+    size_t retval;
+
+    switch(codec) {
+    case CODEC_LZF:
+        retval = lzf_decompress(in,inlen,out,outlen);
+        break;
+    case CODEC_ZSTD:
+        if ((ctx = codecZstdGetContext()) == NULL) return 0;
+        retval = ZSTD_decompressDCtx(ctx->dctx,out,outlen,in,inlen);
+        if (ZSTD_isError(retval)) return 0;
+        break;
+    default:
+        return 0;
+    }
+    return retval == outlen ? retval : 0;
+}
+
+/* ---------------------------- Dictionaries -------------------------------- */
+
+struct codecDict {
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+};
+
+/* Train a dictionary of at most 'maxsize' bytes from 'count' samples, stored
+ * one after the other at 'samples', with the lengths in 'sizes'. Returns
+ * NULL if there are not enough samples or they are not similar enough. */
+codecDict *codecDictTrain(const void *samples, const size_t *sizes,
+                          unsigned int count, size_t maxsize)
+{
+    codecDict *dict;
+    void *buf = zmalloc(maxsize);
+    size_t len;
+
+    len = ZDICT_trainFromBuffer(buf,maxsize,samples,sizes,count);
+    if (ZDICT_isError(len)) {
+        zfree(buf);
+        return NULL;
+    }
+    dict = zmalloc(sizeof(*dict));
+    dict->cdict = ZSTD_createCDict_advanced(buf,len,ZSTD_dlm_byCopy,
+        ZSTD_dct_auto,ZSTD_getCParams(CODEC_ZSTD_LEVEL,0,len),codec_zstd_mem);
+    dict->ddict = ZSTD_createDDict_advanced(buf,len,ZSTD_dlm_byCopy,
+        ZSTD_dct_auto,codec_zstd_mem);
+    zfree(buf);
+    if (dict->cdict == NULL || dict->ddict == NULL) {
+        codecDictFree(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+void codecDictFree(codecDict *dict) {
+    ZSTD_freeCDict(dict->cdict);
+    ZSTD_freeDDict(dict->ddict);
+    zfree(dict);
+}
+
+/* Return the memory used by the dictionary, in bytes. */
+size_t codecDictMemory(const codecDict *dict) {
+    return sizeof(*dict)+ZSTD_sizeof_CDict(dict->cdict)+
+           ZSTD_sizeof_DDict(dict->ddict);
+}
+
+/* Like codecCompress() but using the specified dictionary. The values are
+ * small, so the frames are stored without magic, dictionary ID and
+ * uncompressed size: the caller already knows all of them. */
+size_t codecCompressWithDict(const codecDict *dict, const void *in,
+                             size_t inlen, void *out, size_t outlen)
+{
+    codecZstdContext *ctx;
+    size_t retval;
+
+    if ((ctx = codecZstdGetContext()) == NULL) return 0;
+    ZSTD_CCtx_reset(ctx->cctx,ZSTD_reset_session_and_parameters);
+    ZSTD_CCtx_setParameter(ctx->cctx,ZSTD_c_compressionLevel,
+                           CODEC_ZSTD_LEVEL);
+    ZSTD_CCtx_setParameter(ctx->cctx,ZSTD_c_format,ZSTD_f_zstd1_magicless);
+    ZSTD_CCtx_setParameter(ctx->cctx,ZSTD_c_contentSizeFlag,0);
+    ZSTD_CCtx_setParameter(ctx->cctx,ZSTD_c_dictIDFlag,0);
+    ZSTD_CCtx_refCDict(ctx->cctx,dict->cdict);
+    retval = ZSTD_compress2(ctx->cctx,out,outlen,in,inlen);
+    ZSTD_CCtx_reset(ctx->cctx,ZSTD_reset_session_and_parameters);
+    return ZSTD_isError(retval) ? 0 : retval;
+}
+
+/* Like codecDecompress() but for data compressed with
+ * codecCompressWithDict() using the same dictionary. */
+size_t codecDecompressWithDict(const codecDict *dict, const void *in,
+                               size_t inlen, void *out, size_t outlen)
+{
+    codecZstdContext *ctx;
+    size_t retval;
+
+    if ((ctx = codecZstdGetContext()) == NULL) return 0;
+    ZSTD_DCtx_reset(ctx->dctx,ZSTD_reset_session_and_parameters);
+    ZSTD_DCtx_setParameter(ctx->dctx,ZSTD_d_format,ZSTD_f_zstd1_magicless);
+    ZSTD_DCtx_refDDict(ctx->dctx,dict->ddict);
+    retval = ZSTD_decompressDCtx(ctx->dctx,out,outlen,in,inlen);
+    ZSTD_DCtx_reset(ctx->dctx,ZSTD_reset_session_and_parameters);
+    if (ZSTD_isError(retval)) return 0;
+    return retval == outlen ? retval : 0;
+}
@@ -0,0 +1,36 @@
+/* Compression codecs used for RDB strings and quicklist nodes. */
+
+#ifndef __CODEC_H
+#define __CODEC_H
+
+#include <stddef.h>
+
+/* Codecs. The values are only used in memory, the on disk formats have
+ * their own identifiers (see RDB_ENC_* in rdb.h). */
+#define CODEC_LZF 0     /* Fast, the historical codec. */
+#define CODEC_ZSTD 1    /* Zstandard: better ratio, faster decompression. */
+
+/* Zstandard compression level. Level 1 is about as fast as LZF while
+ * compressing much better, higher levels are too slow for values that are
+ * compressed again every time they change, like quicklist nodes. */
+#define CODEC_ZSTD_LEVEL 1
+
+size_t codecCompress(int codec, const void *in, size_t inlen, void *out,
+                     size_t outlen);
+size_t codecDecompress(int codec, const void *in, size_t inlen, void *out,
+                       size_t outlen);
+
+/* A Zstandard dictionary, trained from samples of many small values that
+ * are similar to each other, but too small to be compressed on their own. */
+typedef struct codecDict codecDict;
+
+codecDict *codecDictTrain(const void *samples, const size_t *sizes,
+                          unsigned int count, size_t maxsize);
+void codecDictFree(codecDict *dict);
+size_t codecDictMemory(const codecDict *dict);
+size_t codecCompressWithDict(const codecDict *dict, const void *in,
+                             size_t inlen, void *out, size_t outlen);
+size_t codecDecompressWithDict(const codecDict *dict, const void *in,
+                               size_t inlen, void *out, size_t outlen);
+
+#endif
@@ -0,0 +1,348 @@
+/* In-memory compression of string values.
+ *
+ * Small string values are usually too short to be compressed on their own,
+ * however in many datasets they are very similar to each other, like JSON
+ * documents with the same fields. When string-compression is enabled, such
+ * values are compressed with Zstandard using a dictionary shared by all the
+ * values, and trained from samples of the values themselves.
+ *
+ * - A cron job scans the keyspace incrementally, compressing in place the
+ *   string values with a length between string-compression-min-size and
+ *   string-compression-max-size, that were not accessed in the last second.
+ * - The same job collects samples of the values, that are used to train
+ *   the dictionary in a bio thread. The dictionary is retrained from time
+ *   to time, and values compressed with an old dictionary are compressed
+ *   again with the new one when the job finds them.
+ * - lookupKey() decompresses values in place, so commands always see plain
+ *   strings. Hot values stay uncompressed, cold values are compressed again
+ *   by the cron job.
+ *
+ * Compressed values use the OBJ_ENCODING_COMPRESSED encoding, and their
+ * 'ptr' points to a compressedString structure. Persistence always uses
+ * the uncompressed value.
+ */
+
+#include "server.h"
+#include "bio.h"
+
+#define STRING_COMPRESSION_CYCLE_PERC 10 /* Max % of CPU per cron call. */
+#define STRING_COMPRESSION_MIN_IDLE 1000 /* Don't compress values accessed
+                                            in the last milliseconds. */
+#define STRING_COMPRESSION_DICT_SIZE (16*1024)
+#define STRING_COMPRESSION_SAMPLES_MIN 256
+#define STRING_COMPRESSION_SAMPLES_MAX 4096
+#define STRING_COMPRESSION_RETRAIN_PERIOD 3600 /* Seconds between trainings. */
+#define STRING_COMPRESSION_RETRY_PERIOD 60 /* Seconds after a failure. */
+
+/* A dictionary, referenced by the values compressed with it. */
+typedef struct compressionDict {
+    codecDict *codec;
+    unsigned long refcount;
+} compressionDict;
+
+typedef struct compressedString {
+    compressionDict *dict;  /* Dictionary used to compress the value. */
+    uint32_t len;           /* Length of the uncompressed value. */
+    uint32_t clen;          /* Length of 'data'. */
+    char data[];
+} compressedString;
+
+/* A dictionary training job. The samples are collected by the cron job,
+ * then the dictionary is trained by the bio thread. */
+typedef struct compressionTrainJob {
+    sds samples;            /* The samples, one after the other. */
+    size_t *sizes;          /* Length of every sample. */
+    unsigned int count;     /* Number of samples. */
+    codecDict *result;      /* Trained dictionary, NULL on failure. */
+} compressionTrainJob;
+
+static struct {
+    compressionDict *dict;          /* Dictionary used to compress, if any. */
+    compressionTrainJob *sampling;  /* Job collecting samples, if any. */
+    compressionTrainJob *trained;   /* Job completed by the bio thread. */
+    int training;                   /* A job was sent to the bio thread. */
+    time_t next_training;           /* Collect samples again after it. */
+    int db;                         /* DB being scanned. */
+    unsigned long cursor;           /* Scan cursor in the DB. */
+    sds buf;                        /* Buffer used to compress values. */
+    size_t values;                  /* Number of compressed values. */
+    size_t bytes;                   /* Uncompressed size of the values. */
+    size_t compressed_bytes;        /* Compressed size of the values. */
+} compression;
+
+/* Protects 'trained', the dictionaries refcount and the stats, since
+ * compressed values can be released by the lazyfree threads. */
+static pthread_mutex_t compression_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Release a reference to a compressed string. Must be called with the
+ * mutex locked. */
+static void compressionRelease(compressedString *cs) {
+    if (--cs->dict->refcount == 0) {
+        codecDictFree(cs->dict->codec);
+        zfree(cs->dict);
+    }
+    compression.values--;
+    compression.bytes -= cs->len;
+    compression.compressed_bytes -= cs->clen;
+}
+
+/* Free the 'ptr' of an OBJ_ENCODING_COMPRESSED object. Called by
+ * freeStringObject(), possibly from a lazyfree thread. */
+void freeCompressedString(void *ptr) {
+    pthread_mutex_lock(&compression_mutex);
+    compressionRelease(ptr);
+    pthread_mutex_unlock(&compression_mutex);
+    zfree(ptr);
+}
+
+/* Return the uncompressed value of an OBJ_ENCODING_COMPRESSED object as a
+ * new sds string. */
+sds compressedStringToSds(const robj *o) {
+    compressedString *cs = o->ptr;
+    sds s = sdsnewlen(NULL,cs->len);
+
+    if (codecDecompressWithDict(cs->dict->codec,cs->data,cs->clen,
+                                s,cs->len) != cs->len)
+    {
+        serverPanic("Corrupted compressed string value");
+    }
+    return s;
+}
+
+/* Decompress in place an OBJ_ENCODING_COMPRESSED object, that becomes an
+ * OBJ_ENCODING_RAW object. */
+void decompressStringObject(robj *o) {
+    sds s = compressedStringToSds(o);
+
+    freeCompressedString(o->ptr);
+    o->ptr = s;
+    o->encoding = OBJ_ENCODING_RAW;
+}
+
+/* Compress in place an OBJ_ENCODING_RAW object with the current dictionary.
+ * Returns 1 if the object was compressed, 0 if it was not worth it. */
+static int compressStringObject(robj *o) {
+    size_t len = sdslen(o->ptr), clen, outlen;
+    compressedString *cs;
+
+    /* Compressing must save at least 1/8 of the length, net of the
+     * additional header. */
+    outlen = len-len/8;
+    if (outlen <= sizeof(*cs)) return 0;
+    outlen -= sizeof(*cs);
+    if (sdsalloc(compression.buf) < outlen)
+        compression.buf = sdsMakeRoomFor(compression.buf,outlen);
+    clen = codecCompressWithDict(compression.dict->codec,o->ptr,len,
+                                 compression.buf,outlen);
+    if (clen == 0) return 0;
+
+    cs = zmalloc(sizeof(*cs)+clen);
+    cs->dict = compression.dict;
+    cs->len = len;
+    cs->clen = clen;
+    memcpy(cs->data,compression.buf,clen);
+
+    pthread_mutex_lock(&compression_mutex);
+    compression.dict->refcount++;
+    compression.values++;
+    compression.bytes += len;
+    compression.compressed_bytes += clen;
+    pthread_mutex_unlock(&compression_mutex);
+
+    sdsfree(o->ptr);
+    o->ptr = cs;
+    o->encoding = OBJ_ENCODING_COMPRESSED;
+    return 1;
+}
+
+/* Train a dictionary with the samples collected by the cron job. */
+void stringCompressionTrainFromBioThread(void *arg) {
+    compressionTrainJob *job = arg;
+
+    job->result = codecDictTrain(job->samples,job->sizes,job->count,
+                                 STRING_COMPRESSION_DICT_SIZE);
+    pthread_mutex_lock(&compression_mutex);
+    compression.trained = job;
+    pthread_mutex_unlock(&compression_mutex);
+}
+
+static void compressionFreeJob(compressionTrainJob *job) {
+    sdsfree(job->samples);
+    zfree(job->sizes);
+    zfree(job);
+}
+
+/* Install the dictionary trained by the bio thread, if any. */
+static void compressionInstallTrainedDict(void) {
+    compressionTrainJob *job;
+    compressionDict *dict, *old;
+
+    pthread_mutex_lock(&compression_mutex);
+    job = compression.trained;
+    compression.trained = NULL;
+    pthread_mutex_unlock(&compression_mutex);
+    if (job == NULL) return;
+
+    compression.training = 0;
+    if (job->result == NULL) {
+        serverLog(LL_VERBOSE,
+            "Can't train a string compression dictionary from %u samples",
+            job->count);
+        compression.next_training = server.unixtime+
+                                    STRING_COMPRESSION_RETRY_PERIOD;
+        compressionFreeJob(job);
+        return;
+    }
+
+    dict = zmalloc(sizeof(*dict));
+    dict->codec = job->result;
+    dict->refcount = 1;
+    pthread_mutex_lock(&compression_mutex);
+    old = compression.dict;
+    compression.dict = dict;
+    if (old && --old->refcount == 0) {
+        codecDictFree(old->codec);
+        zfree(old);
+    }
+    pthread_mutex_unlock(&compression_mutex);
+    serverLog(LL_NOTICE,
+        "String compression dictionary trained from %u samples.", job->count);
+    compression.next_training = server.unixtime+
+                                STRING_COMPRESSION_RETRAIN_PERIOD;
+    compressionFreeJob(job);
+}
+
+/* Add a value to the samples collected for the next training. */
+static void compressionAddSample(const char *s, size_t len) {
+    compressionTrainJob *job = compression.sampling;
+
+    if (job->count == STRING_COMPRESSION_SAMPLES_MAX) return;
+    job->samples = sdscatlen(job->samples,s,len);
+    job->sizes[job->count++] = len;
+}
+
+/* Send the samples to the bio thread if there are enough of them. */
+static void compressionSubmitSamples(void) {
+    compressionTrainJob *job = compression.sampling;
+
+    compression.sampling = NULL;
+    if (job->count < STRING_COMPRESSION_SAMPLES_MIN) {
+        compression.next_training = server.unixtime+
+                                    STRING_COMPRESSION_RETRY_PERIOD;
+        compressionFreeJob(job);
+        return;
+    }
+    compression.training = 1;
+    bioCreateBackgroundJob(BIO_TRAIN_DICT,job,NULL,NULL);
+}
+
+static void compressionScanCallback(void *privdata, const dictEntry *de) {
+    robj *o = dictGetVal(de);
+    int sampled = 0;
+    size_t len;
+    UNUSED(privdata);
+
+    /* Shared objects, or objects referenced by client replies, must not
+     * change encoding. */
+    if (o->type != OBJ_STRING || o->refcount != 1) return;
+
+    if (o->encoding == OBJ_ENCODING_COMPRESSED) {
+        compressedString *cs = o->ptr;
+
+        if (compression.sampling) {
+            sds s = compressedStringToSds(o);
+            compressionAddSample(s,sdslen(s));
+            sdsfree(s);
+            sampled = 1;
+        }
+        /* Values compressed with an old dictionary are decompressed, and
+         * compressed again with the current one below. */
+        if (cs->dict == compression.dict) return;
+        decompressStringObject(o);
+    }
+    if (o->encoding != OBJ_ENCODING_RAW) return;
+
+    len = sdslen(o->ptr);
+    if (len < server.string_compression_min_size ||
+        len > server.string_compression_max_size ||
+        len > UINT32_MAX) return;
+    if (compression.sampling && !sampled) compressionAddSample(o->ptr,len);
+    if (compression.dict == NULL) return;
+    if (!(server.maxmemory_policy & MAXMEMORY_FLAG_LFU) &&
+        estimateObjectIdleTime(o) < STRING_COMPRESSION_MIN_IDLE) return;
+    compressStringObject(o);
+}
+
+static long long compressionKeyspaceSize(void) {
+    long long keys = 0;
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) keys += dictSize(server.db[j].dict);
+    return keys;
+}
+
+/* Called by databasesCron(): scan a part of the keyspace compressing the
+ * eligible values, and collecting samples to train the dictionary. */
+void stringCompressionCycle(void) {
+    long long start = ustime(), timelimit;
+    unsigned int iterations = 0;
+    int passes = 0;
+
+    compressionInstallTrainedDict();
+    if (compression.buf == NULL) compression.buf = sdsempty();
+
+    /* Start collecting samples if the dictionary must be (re)trained, and
+     * there are enough keys to possibly collect them. */
+    if (compression.sampling == NULL && !compression.training &&
+        server.unixtime >= compression.next_training &&
+        compressionKeyspaceSize() >= STRING_COMPRESSION_SAMPLES_MIN)
+    {
+        compressionTrainJob *job = zmalloc(sizeof(*job));
+
+        job->samples = sdsempty();
+        job->sizes = zmalloc(sizeof(size_t)*STRING_COMPRESSION_SAMPLES_MAX);
+        job->count = 0;
+        job->result = NULL;
+        compression.sampling = job;
+    }
+
+    timelimit = STRING_COMPRESSION_CYCLE_PERC*1000000/server.hz/100;
+    if (timelimit <= 0) timelimit = 1;
+
+    while (passes == 0) {
+        redisDb *db = server.db+compression.db;
+
+        compression.cursor = dictScan(db->dict,compression.cursor,
+                                      compressionScanCallback,NULL,NULL);
+        if (compression.cursor == 0) {
+            compression.db = (compression.db+1) % server.dbnum;
+            /* A whole pass over the keyspace: use the samples we have. */
+            if (compression.db == 0) {
+                passes++;
+                if (compression.sampling) compressionSubmitSamples();
+            }
+        }
+        if (compression.sampling &&
+            compression.sampling->count == STRING_COMPRESSION_SAMPLES_MAX)
+            compressionSubmitSamples();
+        if ((++iterations & 15) == 0 && ustime()-start > timelimit) break;
+    }
+}
+
+/* Return the memory used by the current dictionary, in bytes. */
+size_t stringCompressionDictMemory(void) {
+    return compression.dict ? codecDictMemory(compression.dict->codec) : 0;
+}
+
+/* Return the number of compressed values, and the ratio between their
+ * uncompressed and compressed sizes. */
+size_t stringCompressionStats(double *ratio) {
+    size_t values;
+
+    pthread_mutex_lock(&compression_mutex);
+    values = compression.values;
+    *ratio = compression.compressed_bytes ?
+             (double)compression.bytes/compression.compressed_bytes : 0;
+    pthread_mutex_unlock(&compression_mutex);
+    return values;
+}
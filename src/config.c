@@ -91,6 +91,12 @@ configEnum aof_fsync_enum[] = {
     {NULL, 0}
 };
 
+configEnum codec_enum[] = {
+    {"lzf", CODEC_LZF},
+    {"zstd", CODEC_ZSTD},
+    {NULL, 0}
+};
+
 /* Output buffer limits presets. */
 clientBufferLimitsConfig clientBufferLimitsDefaults[CLIENT_TYPE_OBUF_COUNT] = {
     {0, 0, 0}, /* normal */
@@ -406,14 +412,58 @@ void loadServerConfigFromString(char *config) {
             if ((server.rdb_compression = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"rdb-compression-codec") &&
+                   argc == 2)
+        {
+            server.rdb_compression_codec =
+                configEnumGetValue(codec_enum,argv[1]);
+            if (server.rdb_compression_codec == INT_MIN) {
+                err = "argument must be 'lzf' or 'zstd'";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"rdbchecksum") && argc == 2) {
             if ((server.rdb_checksum = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"rdb-forkless") && argc == 2) {
+            if ((server.rdb_forkless = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rdb-forkless-step-us") && argc == 2) {
+            server.rdb_forkless_step_us = strtoll(argv[1],NULL,10);
+            if (server.rdb_forkless_step_us <= 0) {
+                err = "rdb-forkless-step-us must be positive";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rdb-chunked") && argc == 2) {
+            if ((server.rdb_chunked = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rdb-chunk-size") && argc == 2) {
+            server.rdb_chunk_size = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"rdb-load-threads") && argc == 2) {
+            server.rdb_load_threads_num = atoi(argv[1]);
+            if (server.rdb_load_threads_num < 1 ||
+                server.rdb_load_threads_num > RDB_LOAD_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of RDB loading threads"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"activerehashing") && argc == 2) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"activerehashing-budget-us") &&
+                   argc == 2)
+        {
+            server.active_rehashing_budget_us = strtoll(argv[1],NULL,10);
+            if (server.active_rehashing_budget_us < 0) {
+                err = "activerehashing-budget-us can't be negative";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"keyspace-index") && argc == 2) {
+            if ((server.keyspace_index = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lazyfree-lazy-eviction") && argc == 2) {
             if ((server.lazyfree_lazy_eviction = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -426,6 +476,33 @@ void loadServerConfigFromString(char *config) {
             if ((server.lazyfree_lazy_server_del = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-user-del") && argc == 2){
+            if ((server.lazyfree_lazy_user_del = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-threads") && argc == 2) {
+            server.lazyfree_threads_num = atoi(argv[1]);
+            if (server.lazyfree_threads_num < 1 ||
+                server.lazyfree_threads_num > LAZYFREE_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of lazyfree threads"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads") && argc == 2) {
+            server.io_threads_num = atoi(argv[1]);
+            if (server.io_threads_num < 1 ||
+                server.io_threads_num > IO_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of I/O threads"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"querybuf-pool-size") && argc == 2) {
+            server.querybuf_pool_size = atoi(argv[1]);
+            if (server.querybuf_pool_size < 0) {
+                err = "Invalid query buffers pool size"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads-do-reads") && argc == 2) {
+            if ((server.io_threads_do_reads = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slave-lazy-flush") && argc == 2) {
             if ((server.repl_slave_lazy_flush = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -434,6 +511,18 @@ void loadServerConfigFromString(char *config) {
             if ((server.active_defrag_enabled = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"string-compression") && argc == 2) {
+            if ((server.string_compression = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"string-compression-min-size") &&
+                   argc == 2)
+        {
+            server.string_compression_min_size = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"string-compression-max-size") &&
+                   argc == 2)
+        {
+            server.string_compression_max_size = memtoll(argv[1],NULL);
         } else if (!strcasecmp(argv[0],"daemonize") && argc == 2) {
             if ((server.daemonize = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -552,8 +641,22 @@ void loadServerConfigFromString(char *config) {
             server.list_max_ziplist_size = atoi(argv[1]);
         } else if (!strcasecmp(argv[0],"list-compress-depth") && argc == 2) {
             server.list_compress_depth = atoi(argv[1]);
+        } else if (!strcasecmp(argv[0],"list-compress-codec") && argc == 2) {
+            server.list_compress_codec = configEnumGetValue(codec_enum,argv[1]);
+            if (server.list_compress_codec == INT_MIN) {
+                err = "argument must be 'lzf' or 'zstd'";
+                goto loaderr;
+            }
+            quicklistSetCompressCodec(server.list_compress_codec);
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"set-ops-threads") && argc == 2) {
+            server.set_ops_threads_num = atoi(argv[1]);
+            if (server.set_ops_threads_num < 1 ||
+                server.set_ops_threads_num > SET_OPS_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of set operations threads"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
             server.zset_max_ziplist_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-value") && argc == 2) {
@@ -1001,6 +1104,10 @@ void configSetCommand(client *c) {
      * config_set_bool_field(name,var). */
     } config_set_bool_field(
       "rdbcompression", server.rdb_compression) {
+    } config_set_bool_field(
+      "rdb-forkless", server.rdb_forkless) {
+    } config_set_bool_field(
+      "rdb-chunked", server.rdb_chunked) {
     } config_set_bool_field(
       "repl-disable-tcp-nodelay",server.repl_disable_tcp_nodelay) {
     } config_set_bool_field(
@@ -1019,6 +1126,11 @@ void configSetCommand(client *c) {
       "slave-read-only",server.repl_slave_ro) {
     } config_set_bool_field(
       "activerehashing",server.activerehashing) {
+    } config_set_bool_field(
+      "string-compression",server.string_compression) {
+    } config_set_bool_field(
+      "keyspace-index",server.keyspace_index) {
+        keyIndexSetEnabled(server.keyspace_index);
     } config_set_bool_field(
       "activedefrag",server.active_defrag_enabled) {
 #ifndef HAVE_DEFRAG
@@ -1041,6 +1153,8 @@ void configSetCommand(client *c) {
       "lazyfree-lazy-expire",server.lazyfree_lazy_expire) {
     } config_set_bool_field(
       "lazyfree-lazy-server-del",server.lazyfree_lazy_server_del) {
+    } config_set_bool_field(
+      "lazyfree-lazy-user-del",server.lazyfree_lazy_user_del) {
     } config_set_bool_field(
       "slave-lazy-flush",server.repl_slave_lazy_flush) {
     } config_set_bool_field(
@@ -1064,6 +1178,12 @@ void configSetCommand(client *c) {
       "active-defrag-threshold-upper",server.active_defrag_threshold_upper,0,1000) {
     } config_set_memory_field(
       "active-defrag-ignore-bytes",server.active_defrag_ignore_bytes) {
+    } config_set_memory_field(
+      "rdb-chunk-size",server.rdb_chunk_size) {
+    } config_set_memory_field(
+      "string-compression-min-size",server.string_compression_min_size) {
+    } config_set_memory_field(
+      "string-compression-max-size",server.string_compression_max_size) {
     } config_set_numerical_field(
       "active-defrag-cycle-min",server.active_defrag_cycle_min,1,99) {
     } config_set_numerical_field(
@@ -1080,6 +1200,9 @@ void configSetCommand(client *c) {
       "list-compress-depth",server.list_compress_depth,0,INT_MAX) {
     } config_set_numerical_field(
       "set-max-intset-entries",server.set_max_intset_entries,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "set-ops-threads",server.set_ops_threads_num,1,SET_OPS_THREADS_MAX_NUM) {
+        setOpsThreadsStart();
     } config_set_numerical_field(
       "zset-max-ziplist-entries",server.zset_max_ziplist_entries,0,LLONG_MAX) {
     } config_set_numerical_field(
@@ -1124,6 +1247,15 @@ void configSetCommand(client *c) {
       "cluster-migration-barrier",server.cluster_migration_barrier,0,LLONG_MAX){
     } config_set_numerical_field(
       "cluster-slave-validity-factor",server.cluster_slave_validity_factor,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "activerehashing-budget-us",server.active_rehashing_budget_us,0,LLONG_MAX) {
+    } config_set_numerical_field(
+      "rdb-forkless-step-us",server.rdb_forkless_step_us,1,LLONG_MAX) {
+    } config_set_numerical_field(
+      "rdb-load-threads",server.rdb_load_threads_num,1,RDB_LOAD_THREADS_MAX_NUM) {
+    } config_set_numerical_field(
+      "querybuf-pool-size",server.querybuf_pool_size,0,INT_MAX) {
+        resizeQueryBufferPool();
     } config_set_numerical_field(
       "hz",server.hz,0,LLONG_MAX) {
         /* Hz is more an hint from the user, so we accept values out of range
@@ -1163,6 +1295,11 @@ void configSetCommand(client *c) {
       "maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum) {
     } config_set_enum_field(
       "appendfsync",server.aof_fsync,aof_fsync_enum) {
+    } config_set_enum_field(
+      "rdb-compression-codec",server.rdb_compression_codec,codec_enum) {
+    } config_set_enum_field(
+      "list-compress-codec",server.list_compress_codec,codec_enum) {
+        quicklistSetCompressCodec(server.list_compress_codec);
 
     /* Everyhing else is an error... */
     } config_set_else {
@@ -1263,6 +1400,8 @@ void configGetCommand(client *c) {
             server.list_compress_depth);
     config_get_numerical_field("set-max-intset-entries",
             server.set_max_intset_entries);
+    config_get_numerical_field("set-ops-threads",
+            server.set_ops_threads_num);
     config_get_numerical_field("zset-max-ziplist-entries",
             server.zset_max_ziplist_entries);
     config_get_numerical_field("zset-max-ziplist-value",
@@ -1292,6 +1431,21 @@ void configGetCommand(client *c) {
     config_get_numerical_field("min-slaves-to-write",server.repl_min_slaves_to_write);
     config_get_numerical_field("min-slaves-max-lag",server.repl_min_slaves_max_lag);
     config_get_numerical_field("hz",server.hz);
+    config_get_numerical_field("activerehashing-budget-us",
+            server.active_rehashing_budget_us);
+    config_get_numerical_field("rdb-forkless-step-us",
+            server.rdb_forkless_step_us);
+    config_get_numerical_field("rdb-load-threads",
+            server.rdb_load_threads_num);
+    config_get_numerical_field("rdb-chunk-size",server.rdb_chunk_size);
+    config_get_numerical_field("string-compression-min-size",
+            server.string_compression_min_size);
+    config_get_numerical_field("string-compression-max-size",
+            server.string_compression_max_size);
+    config_get_numerical_field("io-threads",server.io_threads_num);
+    config_get_numerical_field("querybuf-pool-size",
+            server.querybuf_pool_size);
+    config_get_numerical_field("lazyfree-threads",server.lazyfree_threads_num);
     config_get_numerical_field("cluster-node-timeout",server.cluster_node_timeout);
     config_get_numerical_field("cluster-migration-barrier",server.cluster_migration_barrier);
     config_get_numerical_field("cluster-slave-validity-factor",server.cluster_slave_validity_factor);
@@ -1312,8 +1466,12 @@ void configGetCommand(client *c) {
     config_get_bool_field("daemonize", server.daemonize);
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
+    config_get_bool_field("rdb-forkless", server.rdb_forkless);
+    config_get_bool_field("rdb-chunked", server.rdb_chunked);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("keyspace-index", server.keyspace_index);
     config_get_bool_field("activedefrag", server.active_defrag_enabled);
+    config_get_bool_field("string-compression", server.string_compression);
     config_get_bool_field("protected-mode", server.protected_mode);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
@@ -1331,6 +1489,10 @@ void configGetCommand(client *c) {
             server.lazyfree_lazy_expire);
     config_get_bool_field("lazyfree-lazy-server-del",
             server.lazyfree_lazy_server_del);
+    config_get_bool_field("lazyfree-lazy-user-del",
+            server.lazyfree_lazy_user_del);
+    config_get_bool_field("io-threads-do-reads",
+            server.io_threads_do_reads);
     config_get_bool_field("slave-lazy-flush",
             server.repl_slave_lazy_flush);
 
@@ -1345,6 +1507,10 @@ void configGetCommand(client *c) {
             server.aof_fsync,aof_fsync_enum);
     config_get_enum_field("syslog-facility",
             server.syslog_facility,syslog_facility_enum);
+    config_get_enum_field("rdb-compression-codec",
+            server.rdb_compression_codec,codec_enum);
+    config_get_enum_field("list-compress-codec",
+            server.list_compress_codec,codec_enum);
 
     /* Everything we can't handle with macros follows. */
 
@@ -1990,7 +2156,13 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"databases",server.dbnum,CONFIG_DEFAULT_DBNUM);
     rewriteConfigYesNoOption(state,"stop-writes-on-bgsave-error",server.stop_writes_on_bgsave_err,CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR);
     rewriteConfigYesNoOption(state,"rdbcompression",server.rdb_compression,CONFIG_DEFAULT_RDB_COMPRESSION);
+    rewriteConfigEnumOption(state,"rdb-compression-codec",server.rdb_compression_codec,codec_enum,CONFIG_DEFAULT_RDB_COMPRESSION_CODEC);
     rewriteConfigYesNoOption(state,"rdbchecksum",server.rdb_checksum,CONFIG_DEFAULT_RDB_CHECKSUM);
+    rewriteConfigYesNoOption(state,"rdb-forkless",server.rdb_forkless,CONFIG_DEFAULT_RDB_FORKLESS);
+    rewriteConfigNumericalOption(state,"rdb-forkless-step-us",server.rdb_forkless_step_us,CONFIG_DEFAULT_RDB_FORKLESS_STEP_US);
+    rewriteConfigNumericalOption(state,"rdb-load-threads",server.rdb_load_threads_num,CONFIG_DEFAULT_RDB_LOAD_THREADS_NUM);
+    rewriteConfigYesNoOption(state,"rdb-chunked",server.rdb_chunked,CONFIG_DEFAULT_RDB_CHUNKED);
+    rewriteConfigBytesOption(state,"rdb-chunk-size",server.rdb_chunk_size,CONFIG_DEFAULT_RDB_CHUNK_SIZE);
     rewriteConfigStringOption(state,"dbfilename",server.rdb_filename,CONFIG_DEFAULT_RDB_FILENAME);
     rewriteConfigDirOption(state);
     rewriteConfigSlaveofOption(state);
@@ -2044,12 +2216,19 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"hash-max-ziplist-value",server.hash_max_ziplist_value,OBJ_HASH_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"list-max-ziplist-size",server.list_max_ziplist_size,OBJ_LIST_MAX_ZIPLIST_SIZE);
     rewriteConfigNumericalOption(state,"list-compress-depth",server.list_compress_depth,OBJ_LIST_COMPRESS_DEPTH);
+    rewriteConfigEnumOption(state,"list-compress-codec",server.list_compress_codec,codec_enum,OBJ_LIST_COMPRESS_CODEC);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,OBJ_SET_MAX_INTSET_ENTRIES);
+    rewriteConfigNumericalOption(state,"set-ops-threads",server.set_ops_threads_num,CONFIG_DEFAULT_SET_OPS_THREADS_NUM);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,OBJ_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,OBJ_ZSET_MAX_ZIPLIST_VALUE);
     rewriteConfigNumericalOption(state,"hll-sparse-max-bytes",server.hll_sparse_max_bytes,CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,CONFIG_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigNumericalOption(state,"activerehashing-budget-us",server.active_rehashing_budget_us,CONFIG_DEFAULT_ACTIVE_REHASHING_BUDGET_US);
+    rewriteConfigYesNoOption(state,"keyspace-index",server.keyspace_index,CONFIG_DEFAULT_KEYSPACE_INDEX);
     rewriteConfigYesNoOption(state,"activedefrag",server.active_defrag_enabled,CONFIG_DEFAULT_ACTIVE_DEFRAG);
+    rewriteConfigYesNoOption(state,"string-compression",server.string_compression,CONFIG_DEFAULT_STRING_COMPRESSION);
+    rewriteConfigBytesOption(state,"string-compression-min-size",server.string_compression_min_size,CONFIG_DEFAULT_STRING_COMPRESSION_MIN_SIZE);
+    rewriteConfigBytesOption(state,"string-compression-max-size",server.string_compression_max_size,CONFIG_DEFAULT_STRING_COMPRESSION_MAX_SIZE);
     rewriteConfigYesNoOption(state,"protected-mode",server.protected_mode,CONFIG_DEFAULT_PROTECTED_MODE);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,CONFIG_DEFAULT_HZ);
@@ -2060,6 +2239,11 @@ int rewriteConfig(char *path) {
     rewriteConfigYesNoOption(state,"lazyfree-lazy-eviction",server.lazyfree_lazy_eviction,CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-user-del",server.lazyfree_lazy_user_del,CONFIG_DEFAULT_LAZYFREE_LAZY_USER_DEL);
+    rewriteConfigNumericalOption(state,"lazyfree-threads",server.lazyfree_threads_num,CONFIG_DEFAULT_LAZYFREE_THREADS_NUM);
+    rewriteConfigNumericalOption(state,"io-threads",server.io_threads_num,CONFIG_DEFAULT_IO_THREADS_NUM);
+    rewriteConfigYesNoOption(state,"io-threads-do-reads",server.io_threads_do_reads,CONFIG_DEFAULT_IO_THREADS_DO_READS);
+    rewriteConfigNumericalOption(state,"querybuf-pool-size",server.querybuf_pool_size,CONFIG_DEFAULT_QUERYBUF_POOL_SIZE);
     rewriteConfigYesNoOption(state,"slave-lazy-flush",server.repl_slave_lazy_flush,CONFIG_DEFAULT_SLAVE_LAZY_FLUSH);
 
     /* Rewrite Sentinel config if in Sentinel mode. */
@@ -170,7 +170,36 @@ static const uint64_t crc64_tab[256] = {
     UINT64_C(0x536fa08fdfd90e51), UINT64_C(0x29b7d047efec8728),
 };
 
-uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
+/* The polynomial in reflected form, that is crc64_tab[128]. */
+#define CRC64_POLY_REFLECTED UINT64_C(0x95ac9329ac4bc9b5)
+
+/* Tables for the slice-by-8 algorithm: crc64_slice_tab[k][n] is the CRC of
+ * the byte 'n' followed by 'k' zero bytes, so that eight bytes of input can
+ * be processed with eight independent lookups. crc64_slice_tab[0] is the
+ * same as crc64_tab. Filled by crc64_init(). */
+static uint64_t crc64_slice_tab[8][256];
+static int crc64_slice_ready = 0;
+
+/* Initialize the tables used by crc64() to process 8 bytes at a time. Must
+ * be called before any thread uses crc64(). Without calling it the CRC is
+ * computed one byte at a time, with the same results. */
+void crc64_init(void) {
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        uint64_t crc = crc64_tab[n];
+
+        crc64_slice_tab[0][n] = crc;
+        for (k = 1; k < 8; k++) {
+            crc = crc64_tab[(uint8_t)crc] ^ (crc >> 8);
+            crc64_slice_tab[k][n] = crc;
+        }
+    }
+    crc64_slice_ready = 1;
+}
+
+static uint64_t crc64_bytewise(uint64_t crc, const unsigned char *s,
+                               uint64_t l) {
     uint64_t j;
 
     for (j = 0; j < l; j++) {
@@ -180,16 +209,124 @@ uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
     return crc;
 }
 
+uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l) {
+    if (!crc64_slice_ready) return crc64_bytewise(crc,s,l);
+
+    while (l >= 8) {
+        /* Little endian load, regardless of alignment and host order:
+         * compilers turn it into a single load where possible. */
+        uint64_t v = crc ^ ((uint64_t)s[0] | (uint64_t)s[1] << 8 |
+                            (uint64_t)s[2] << 16 | (uint64_t)s[3] << 24 |
+                            (uint64_t)s[4] << 32 | (uint64_t)s[5] << 40 |
+                            (uint64_t)s[6] << 48 | (uint64_t)s[7] << 56);
+        crc = crc64_slice_tab[7][v & 0xff] ^
+              crc64_slice_tab[6][(v >> 8) & 0xff] ^
+              crc64_slice_tab[5][(v >> 16) & 0xff] ^
+              crc64_slice_tab[4][(v >> 24) & 0xff] ^
+              crc64_slice_tab[3][(v >> 32) & 0xff] ^
+              crc64_slice_tab[2][(v >> 40) & 0xff] ^
+              crc64_slice_tab[1][(v >> 48) & 0xff] ^
+              crc64_slice_tab[0][v >> 56];
+        s += 8;
+        l -= 8;
+    }
+    return crc64_bytewise(crc,s,l);
+}
+
+/* Multiply the 64x64 matrix over GF(2) 'mat' by the vector 'vec'. */
+static uint64_t crc64_matrix_times(const uint64_t *mat, uint64_t vec) {
+    uint64_t sum = 0;
+
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void crc64_matrix_square(uint64_t *square, const uint64_t *mat) {
+    int n;
+
+    for (n = 0; n < 64; n++) square[n] = crc64_matrix_times(mat,mat[n]);
+}
+
+/* Given crc1 = crc64(0,A,len(A)) and crc2 = crc64(0,B,len2), return
+ * crc64(0,AB,len(A)+len2), where AB is B appended to A, without accessing
+ * the data. This allows to checksum separate parts of a stream in parallel
+ * and merge the results. The cost is O(log(len2)).
+ *
+ * Since Redis uses this CRC without initial and final xor, the result is
+ * crc1 multiplied by x^(8*len2) modulo the polynomial, xored with crc2: the
+ * multiplication is performed by applying the operator that feeds a zero
+ * bit to the CRC register, squared as needed, like zlib's crc32_combine(). */
+uint64_t crc64_combine(uint64_t crc1, uint64_t crc2, uint64_t len2) {
+    uint64_t even[64];  /* Operator for an even power of two zero bits. */
+    uint64_t odd[64];   /* Operator for an odd power of two zero bits. */
+    uint64_t row;
+    int n;
+
+    if (len2 == 0) return crc1;
+
+    /* Operator for a single zero bit. */
+    odd[0] = CRC64_POLY_REFLECTED;
+    row = 1;
+    for (n = 1; n < 64; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    crc64_matrix_square(even,odd);  /* Two zero bits. */
+    crc64_matrix_square(odd,even);  /* Four zero bits. */
+
+    /* Apply len2 zero bytes to crc1: the first squaring below gives the
+     * operator for one zero byte. */
+    do {
+        crc64_matrix_square(even,odd);
+        if (len2 & 1) crc1 = crc64_matrix_times(even,crc1);
+        len2 >>= 1;
+        if (len2 == 0) break;
+
+        crc64_matrix_square(odd,even);
+        if (len2 & 1) crc1 = crc64_matrix_times(odd,crc1);
+        len2 >>= 1;
+    } while (len2 != 0);
+    return crc1 ^ crc2;
+}
+
 /* Test main */
 #ifdef REDIS_TEST
 #include <stdio.h>
 
 #define UNUSED(x) (void)(x)
 int crc64Test(int argc, char *argv[]) {
+    unsigned char buf[1024];
+    uint64_t expected;
+    int j, len, off, errors = 0;
+
     UNUSED(argc);
     UNUSED(argv);
     printf("e9c6d914c4b8d9ca == %016llx\n",
         (unsigned long long) crc64(0,(unsigned char*)"123456789",9));
-    return 0;
+
+    /* The slice-by-8 implementation must match the bytewise one, for any
+     * alignment and length, and the combined CRC of two parts must match
+     * the CRC of the whole buffer. */
+    crc64_init();
+    printf("e9c6d914c4b8d9ca == %016llx\n",
+        (unsigned long long) crc64(0,(unsigned char*)"123456789",9));
+    for (j = 0; j < (int)sizeof(buf); j++) buf[j] = (j*31+7)^(j>>3);
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len < (int)sizeof(buf)-off; len += 13) {
+            expected = crc64_bytewise(0,buf+off,len);
+            if (crc64(0,buf+off,len) != expected) errors++;
+            for (j = 0; j <= len; j += 29) {
+                uint64_t crc1 = crc64(0,buf+off,j);
+                uint64_t crc2 = crc64(0,buf+off+j,len-j);
+                if (crc64_combine(crc1,crc2,len-j) != expected) errors++;
+            }
+        }
+    }
+    printf("slice-by-8 and combine errors: %d\n", errors);
+    return errors != 0;
 }
 #endif
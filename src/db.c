@@ -55,6 +55,11 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
     if (de) {
         robj *val = dictGetVal(de);
 
+        /* Commands only deal with plain strings: values compressed by
+         * string-compression are decompressed when accessed. */
+        if (val->encoding == OBJ_ENCODING_COMPRESSED)
+            decompressStringObject(val);
+
         /* Update the access time for the ageing algorithm.
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
@@ -154,6 +159,9 @@ robj *lookupKeyRead(redisDb *db, robj *key) {
  *      指定key对应的值V,如果不存在或者键key已经过期则返回NULL
  */
 robj *lookupKeyWrite(redisDb *db, robj *key) {
+    /* The key is about to be modified: a forkless BGSAVE in progress must
+     * save its current value first. */
+    rdbForklessTouchKey(db,key->ptr);
     // 首先判断键key是不是已经在过期列表里
     expireIfNeeded(db,key);
     return lookupKey(db,key,LOOKUP_NONE);
@@ -176,12 +184,14 @@ robj *lookupKeyWriteOrReply(client *c, robj *key, robj *reply) {
  *
  * The program is aborted if the key already exists. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
+    rdbForklessTouchKey(db,key->ptr);
     sds copy = sdsdup(key->ptr);
     int retval = dictAdd(db->dict, copy, val);
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
     if (val->type == OBJ_LIST) signalListAsReady(db, key);
     if (server.cluster_enabled) slotToKeyAdd(key);
+    keyIndexAdd(db,key);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -193,17 +203,22 @@ void dbOverwrite(redisDb *db, robj *key, robj *val) {
     dictEntry *de = dictFind(db->dict,key->ptr);
 
     serverAssertWithInfo(NULL,key,de != NULL);
+    rdbForklessTouchKey(db,key->ptr);
+    robj *old = dictGetVal(de);
     if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
-        robj *old = dictGetVal(de);
-        int saved_lru = old->lru;
-        dictReplace(db->dict, key->ptr, val);
-        val->lru = saved_lru;
+        val->lru = old->lru;
         /* LFU should be not only copied but also updated
          * when a key is overwritten. */
         updateLFU(val);
-    } else {
-        dictReplace(db->dict, key->ptr, val);
     }
+    /* Install the new value before releasing the old one, like
+     * dictReplace() does, then release the old value in the background
+     * if lazy freeing of server side deletes is enabled. */
+    dictSetVal(db->dict, de, val);
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(old);
+    else
+        decrRefCount(old);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -270,11 +285,13 @@ robj *dbRandomKey(redisDb *db) {
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
 int dbSyncDelete(redisDb *db, robj *key) {
+    rdbForklessTouchKey(db,key->ptr);
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
     if (dictDelete(db->dict,key->ptr) == DICT_OK) {
         if (server.cluster_enabled) slotToKeyDel(key);
+        keyIndexDel(db,key);
         return 1;
     } else {
         return 0;
@@ -349,14 +366,22 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
         return -1;
     }
 
+    /* Like a saving child is killed by FLUSHALL, a forkless BGSAVE can't
+     * continue once the keys it did not save yet are gone. */
+    rdbForklessStop();
     for (j = 0; j < server.dbnum; j++) {
         if (dbnum != -1 && dbnum != j) continue;
         removed += dictSize(server.db[j].dict);
         if (async) {
             emptyDbAsync(&server.db[j]);
+            if (server.db[j].keys_index) keyIndexFlushAsync(&server.db[j]);
         } else {
             dictEmpty(server.db[j].dict,callback);
             dictEmpty(server.db[j].expires,callback);
+            if (server.db[j].keys_index) {
+                raxFree(server.db[j].keys_index);
+                server.db[j].keys_index = raxNew();
+            }
         }
     }
     if (server.cluster_enabled) {
@@ -478,7 +503,7 @@ void delGenericCommand(client *c, int lazy) {
 }
 
 void delCommand(client *c) {
-    delGenericCommand(c,0);
+    delGenericCommand(c,server.lazyfree_lazy_user_del);
 }
 
 void unlinkCommand(client *c) {
@@ -528,14 +553,57 @@ void randomkeyCommand(client *c) {
     decrRefCount(key);
 }
 
+/* Reply to KEYS using the ordered index of the DB: only the keys starting
+ * with the literal prefix of the pattern are visited. Returns the number
+ * of keys emitted. */
+static unsigned long keysFromIndex(client *c, sds pattern, int plen,
+                                   int prefixlen)
+{
+    raxIterator ri;
+    unsigned long numkeys = 0;
+    int allkeys = (prefixlen == plen-1 && pattern[prefixlen] == '*');
+
+    raxStart(&ri,c->db->keys_index);
+    raxSeek(&ri,">=",(unsigned char*)pattern,prefixlen);
+    while(raxNext(&ri)) {
+        robj *keyobj;
+
+        if (ri.key_len < (size_t)prefixlen ||
+            memcmp(ri.key,pattern,prefixlen) != 0) break;
+        if (!allkeys &&
+            !stringmatchlen(pattern,plen,(char*)ri.key,ri.key_len,0))
+            continue;
+        keyobj = createStringObject((char*)ri.key,ri.key_len);
+        if (expireIfNeeded(c->db,keyobj) == 0) {
+            addReplyBulk(c,keyobj);
+            numkeys++;
+        } else {
+            /* The key may have been removed from the index, that
+             * invalidates the iterator: seek again after it. */
+            raxSeek(&ri,">",(unsigned char*)keyobj->ptr,
+                    sdslen(keyobj->ptr));
+        }
+        decrRefCount(keyobj);
+    }
+    raxStop(&ri);
+    return numkeys;
+}
+
 void keysCommand(client *c) {
     dictIterator *di;
     dictEntry *de;
     sds pattern = c->argv[1]->ptr;
-    int plen = sdslen(pattern), allkeys;
+    int plen = sdslen(pattern), allkeys, prefixlen;
     unsigned long numkeys = 0;
     void *replylen = addDeferredMultiBulkLength(c);
 
+    prefixlen = stringmatchPrefixLen(pattern,plen);
+    if (c->db->keys_index && prefixlen > 0) {
+        numkeys = keysFromIndex(c,pattern,plen,prefixlen);
+        setDeferredMultiBulkLength(c,replylen,numkeys);
+        return;
+    }
+
     di = dictGetSafeIterator(c->db->dict);
     allkeys = (pattern[0] == '*' && pattern[1] == '\0');
     while((de = dictNext(di)) != NULL) {
@@ -586,6 +654,35 @@ void scanCallback(void *privdata, const dictEntry *de) {
     if (val) listAddNodeTail(keys, val);
 }
 
+/* Collect in 'keys' the keys of the DB starting with the specified prefix
+ * using the ordered index. If more than 'limit' keys have the prefix C_ERR
+ * is returned and 'keys' is left empty, otherwise C_OK is returned. */
+static int scanKeysIndex(redisDb *db, sds prefix, int prefixlen, list *keys,
+                         unsigned long limit)
+{
+    raxIterator ri;
+    int retval = C_OK;
+
+    raxStart(&ri,db->keys_index);
+    raxSeek(&ri,">=",(unsigned char*)prefix,prefixlen);
+    while(raxNext(&ri)) {
+        if (ri.key_len < (size_t)prefixlen ||
+            memcmp(ri.key,prefix,prefixlen) != 0) break;
+        if (listLength(keys) == limit) {
+            retval = C_ERR;
+            break;
+        }
+        listAddNodeTail(keys,createStringObject((char*)ri.key,ri.key_len));
+    }
+    raxStop(&ri);
+    if (retval == C_ERR) {
+        listSetFreeMethod(keys,decrRefCountVoid);
+        while (listLength(keys)) listDelNode(keys,listFirst(keys));
+        listSetFreeMethod(keys,NULL);
+    }
+    return retval;
+}
+
 /* Try to parse a SCAN cursor stored at object 'o':
  * if the cursor is valid, store it as unsigned integer into *cursor and
  * returns C_OK. Otherwise return C_ERR and send an error to the
@@ -622,7 +719,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
     listNode *node, *nextnode;
     long count = 10;
     sds pat = NULL;
-    int patlen = 0, use_pattern = 0;
+    int patlen = 0, prefixlen, use_pattern = 0;
     dict *ht;
 
     /* Object must be NULL (to iterate keys names), or the type of the object
@@ -666,7 +763,7 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not a hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
@@ -674,7 +771,14 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
 
     /* Handle the case of a hash table. */
     ht = NULL;
-    if (o == NULL) {
+    if (o == NULL && cursor == 0 && use_pattern && c->db->keys_index &&
+        (prefixlen = stringmatchPrefixLen(pat,patlen)) > 0 &&
+        scanKeysIndex(c->db,pat,prefixlen,keys,count*10) == C_OK)
+    {
+        /* When the keys with the literal prefix of the pattern are not
+         * more than the iterations we would perform on the hash table,
+         * they are returned in a single call using the ordered index. */
+    } else if (o == NULL) {
         ht = c->db->dict;
     } else if (o->type == OBJ_SET && o->encoding == OBJ_ENCODING_HT) {
         ht = o->ptr;
@@ -705,6 +809,8 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
         } while (cursor &&
               maxiterations-- &&
               listLength(keys) < (unsigned long)count);
+    } else if (o == NULL) {
+        cursor = 0; /* Collected from the keys index. */
     } else if (o->type == OBJ_SET) {
         int pos = 0;
         int64_t ll;
@@ -713,17 +819,17 @@ void scanGenericCommand(client *c, robj *o, unsigned long cursor) {
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
     } else if (o->type == OBJ_HASH || o->type == OBJ_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpFirst(o->ptr);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            vstr = lpGetValue(p,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -800,6 +906,124 @@ void scanCommand(client *c) {
     scanGenericCommand(c,NULL,cursor);
 }
 
+/* SCANRANGE min max [MATCH pattern] [COUNT count]
+ *
+ * Iterate the keys between min and max in lexicographical order, using the
+ * ordered index of the keys. The range is specified like in ZRANGEBYLEX.
+ * Every call visits at most COUNT keys of the index, and replies with the
+ * min argument to use in order to continue the iteration, or "0" when the
+ * iteration is complete, followed by the keys found. When a pattern with a
+ * literal prefix is given, only the keys having such prefix are visited. */
+void scanrangeCommand(client *c) {
+    zlexrangespec range;
+    raxIterator ri;
+    list *keys;
+    listNode *node, *nextnode;
+    long count = 10;
+    sds pat = NULL, next = NULL;
+    int patlen = 0, prefixlen = 0, seekprefix = 0, j;
+
+    if (c->db->keys_index == NULL) {
+        addReplyError(c,"SCANRANGE requires keyspace-index to be enabled");
+        return;
+    }
+
+    for (j = 3; j < c->argc; j += 2) {
+        if (!strcasecmp(c->argv[j]->ptr,"count") && j+1 < c->argc) {
+            if (getLongFromObjectOrReply(c,c->argv[j+1],&count,NULL)
+                != C_OK) return;
+            if (count < 1) {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        } else if (!strcasecmp(c->argv[j]->ptr,"match") && j+1 < c->argc) {
+            pat = c->argv[j+1]->ptr;
+            patlen = sdslen(pat);
+            if (pat[0] == '*' && patlen == 1) pat = NULL;
+        } else {
+            addReply(c,shared.syntaxerr);
+            return;
+        }
+    }
+
+    if (zslParseLexRange(c->argv[1],c->argv[2],&range) != C_OK) {
+        addReplyError(c,"min or max not valid string range item");
+        return;
+    }
+    if (pat) prefixlen = stringmatchPrefixLen(pat,patlen);
+
+    /* Seek the first key of the range, or the first key having the prefix
+     * of the pattern if it comes later. When min is "+" the iterator is
+     * not seeked at all, so the range is empty. */
+    if (prefixlen && range.min == shared.minstring) {
+        seekprefix = 1;
+    } else if (prefixlen && range.min != shared.maxstring) {
+        size_t minlen = sdslen(range.min), plen = prefixlen;
+        int cmp = memcmp(range.min,pat,minlen < plen ? minlen : plen);
+        seekprefix = cmp < 0 || (cmp == 0 && minlen < plen);
+    }
+
+    keys = listCreate();
+    raxStart(&ri,c->db->keys_index);
+    if (seekprefix) {
+        raxSeek(&ri,">=",(unsigned char*)pat,prefixlen);
+    } else if (range.min == shared.minstring) {
+        raxSeek(&ri,"^",NULL,0);
+    } else if (range.min != shared.maxstring) {
+        raxSeek(&ri,range.minex ? ">" : ">=",(unsigned char*)range.min,
+                sdslen(range.min));
+    }
+
+    while(raxNext(&ri)) {
+        robj *key;
+
+        if (prefixlen && (ri.key_len < (size_t)prefixlen ||
+                          memcmp(ri.key,pat,prefixlen) != 0)) break;
+        key = createStringObject((char*)ri.key,ri.key_len);
+        if (!zslLexValueLteMax(key->ptr,&range)) {
+            decrRefCount(key);
+            break;
+        }
+        listAddNodeTail(keys,key);
+        if (listLength(keys) == (unsigned long)count) {
+            next = sdscatsds(sdsnewlen("(",1),key->ptr);
+            break;
+        }
+    }
+    raxStop(&ri);
+    zslFreeLexRange(&range);
+
+    /* Filter the keys not matching the pattern and the expired ones. This
+     * is done after the iteration since expiring keys modifies the index. */
+    node = listFirst(keys);
+    while (node) {
+        robj *key = listNodeValue(node);
+        nextnode = listNextNode(node);
+        if ((pat && !stringmatchlen(pat,patlen,key->ptr,sdslen(key->ptr),0))
+            || expireIfNeeded(c->db,key))
+        {
+            decrRefCount(key);
+            listDelNode(keys,node);
+        }
+        node = nextnode;
+    }
+
+    addReplyMultiBulkLen(c,2);
+    if (next) {
+        addReplyBulkSds(c,next);
+    } else {
+        addReplyBulkCBuffer(c,"0",1);
+    }
+    addReplyMultiBulkLen(c,listLength(keys));
+    while ((node = listFirst(keys)) != NULL) {
+        robj *key = listNodeValue(node);
+        addReplyBulk(c,key);
+        decrRefCount(key);
+        listDelNode(keys,node);
+    }
+    listRelease(keys);
+}
+
 void dbsizeCommand(client *c) {
     addReplyLongLong(c,dictSize(c->db->dict));
 }
@@ -993,6 +1217,7 @@ int dbSwapDatabases(int id1, int id2) {
     if (id1 < 0 || id1 >= server.dbnum ||
         id2 < 0 || id2 >= server.dbnum) return C_ERR;
     if (id1 == id2) return C_OK;
+    rdbForklessStop();
     redisDb aux = server.db[id1];
     redisDb *db1 = &server.db[id1], *db2 = &server.db[id2];
 
@@ -1001,10 +1226,12 @@ int dbSwapDatabases(int id1, int id2) {
      * remain in the same DB they were. */
     db1->dict = db2->dict;
     db1->expires = db2->expires;
+    db1->keys_index = db2->keys_index;
     db1->avg_ttl = db2->avg_ttl;
 
     db2->dict = aux.dict;
     db2->expires = aux.expires;
+    db2->keys_index = aux.keys_index;
     db2->avg_ttl = aux.avg_ttl;
 
     /* Now we need to handle clients blocked on lists: as an effect
@@ -1054,11 +1281,39 @@ void swapdbCommand(client *c) {
  * Expires API
  *----------------------------------------------------------------------------*/
 
+/* The expire of a key is stored together with the key itself: the first time
+ * a key gets an expire, its sds string in the main dictionary is replaced by
+ * a prefixed sds string (see sdsnewlenprefixed()), holding the unix time in
+ * milliseconds of the expire in the prefix. So the expire of a key is found
+ * with the same lookup of the value, without accessing db->expires, that is
+ * only used to sample and count the volatile keys, and shares the key sds
+ * with the main dictionary. A key whose expire was removed keeps its prefix,
+ * set to -1. */
+
+/* Return the expire stored with the key 'key' of the main dictionary, or -1
+ * if the key has no expire. */
+long long keyGetExpire(sds key) {
+    long long when;
+
+    if (!sdsisprefixed(key)) return -1;
+    memcpy(&when,sdsprefix(key),sizeof(when));
+    return when;
+}
+
+static void keySetExpire(sds key, long long when) {
+    memcpy(sdsprefix(key),&when,sizeof(when));
+}
+
 int removeExpire(redisDb *db, robj *key) {
+    rdbForklessTouchKey(db,key->ptr);
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
-    serverAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    dictEntry *kde = dictFind(db->dict,key->ptr);
+
+    serverAssertWithInfo(NULL,key,kde != NULL);
+    if (dictDelete(db->expires,key->ptr) != DICT_OK) return 0;
+    keySetExpire(dictGetKey(kde),-1);
+    return 1;
 }
 
 /* Set an expire to the specified key. If the expire is set in the context
@@ -1066,13 +1321,25 @@ int removeExpire(redisDb *db, robj *key) {
  * to NULL. The 'when' parameter is the absolute unix time in milliseconds
  * after which the key will no longer be considered valid. */
 void setExpire(client *c, redisDb *db, robj *key, long long when) {
-    dictEntry *kde, *de;
+    dictEntry *kde;
+    sds keysds;
 
-    /* Reuse the sds from the main dict in the expire dict */
+    rdbForklessTouchKey(db,key->ptr);
     kde = dictFind(db->dict,key->ptr);
     serverAssertWithInfo(NULL,key,kde != NULL);
-    de = dictAddOrFind(db->expires,dictGetKey(kde));
-    dictSetSignedIntegerVal(de,when);
+    keysds = dictGetKey(kde);
+    if (!sdsisprefixed(keysds)) {
+        /* The key never had an expire, so it is not referenced by the
+         * expire dict and we are free to reallocate it. */
+        sds newkey = sdsnewlenprefixed(keysds,sdslen(keysds));
+        dictSetKey(db->dict,kde,newkey);
+        sdsfree(keysds);
+        keysds = newkey;
+    }
+    keySetExpire(keysds,when);
+
+    /* Reuse the sds from the main dict in the expire dict */
+    dictAddOrFind(db->expires,keysds);
 
     int writable_slave = server.masterhost && server.repl_slave_ro == 0;
     if (c && writable_slave && !(c->flags & CLIENT_MASTER))
@@ -1086,12 +1353,8 @@ long long getExpire(redisDb *db, robj *key) {
 
     /* No expire? return ASAP */
     if (dictSize(db->expires) == 0 ||
-       (de = dictFind(db->expires,key->ptr)) == NULL) return -1;
-
-    /* The entry was found in the expire dict, this means it should also
-     * be present in the main dict (safety check). */
-    serverAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictGetSignedIntegerVal(de);
+       (de = dictFind(db->dict,key->ptr)) == NULL) return -1;
+    return keyGetExpire(dictGetKey(de));
 }
 
 /* Propagate expires into slaves and the AOF file.
@@ -1120,7 +1383,8 @@ void propagateExpire(redisDb *db, robj *key, int lazy) {
 
 int expireIfNeeded(redisDb *db, robj *key) {
     mstime_t when = getExpire(db,key);
-    mstime_t now;
+    mstime_t now, expire_latency;
+    int deleted;
 
     if (when < 0) return 0; /* No expire for this key */
 
@@ -1151,8 +1415,12 @@ int expireIfNeeded(redisDb *db, robj *key) {
     propagateExpire(db,key,server.lazyfree_lazy_expire);
     notifyKeyspaceEvent(NOTIFY_EXPIRED,
         "expired",key,db->id);
-    return server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
-                                         dbSyncDelete(db,key);
+    latencyStartMonitor(expire_latency);
+    deleted = server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
+                                            dbSyncDelete(db,key);
+    latencyEndMonitor(expire_latency);
+    latencyAddSampleIfNeeded("expire-del",expire_latency);
+    return deleted;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1472,3 +1740,44 @@ unsigned int delKeysInSlot(unsigned int hashslot) {
 unsigned int countKeysInSlot(unsigned int hashslot) {
     return server.cluster->slots_keys_count[hashslot];
 }
+
+/* Ordered index of the keys. When keyspace-index is enabled every DB keeps
+ * its keys in a radix tree, so that KEYS and SCAN with a pattern having a
+ * literal prefix, and SCANRANGE, only visit the keys in the requested
+ * range instead of the whole keyspace. */
+void keyIndexAdd(redisDb *db, robj *key) {
+    if (db->keys_index == NULL) return;
+    raxInsert(db->keys_index,(unsigned char*)key->ptr,sdslen(key->ptr),
+              NULL,NULL);
+}
+
+void keyIndexDel(redisDb *db, robj *key) {
+    if (db->keys_index == NULL) return;
+    raxRemove(db->keys_index,(unsigned char*)key->ptr,sdslen(key->ptr),NULL);
+}
+
+/* Build or release the index of every DB when keyspace-index is changed
+ * at runtime. Building it requires visiting the whole keyspace. */
+void keyIndexSetEnabled(int enabled) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (enabled && db->keys_index == NULL) {
+            dictIterator *di = dictGetIterator(db->dict);
+            dictEntry *de;
+
+            db->keys_index = raxNew();
+            while((de = dictNext(di)) != NULL) {
+                sds key = dictGetKey(de);
+                raxInsert(db->keys_index,(unsigned char*)key,sdslen(key),
+                          NULL,NULL);
+            }
+            dictReleaseIterator(di);
+        } else if (!enabled && db->keys_index) {
+            raxFree(db->keys_index);
+            db->keys_index = NULL;
+        }
+    }
+}
@@ -117,6 +117,12 @@ robj *activeDefragStringOb(robj* ob, int *defragged) {
                 ob->ptr = newsds;
                 (*defragged)++;
             }
+        } else if (ob->encoding==OBJ_ENCODING_COMPRESSED) {
+            void *newptr = activeDefragAlloc(ob->ptr);
+            if (newptr) {
+                ob->ptr = newptr;
+                (*defragged)++;
+            }
         } else if (ob->encoding==OBJ_ENCODING_EMBSTR) {
             /* The sds is embedded in the object allocation, calculate the
              * offset and update the pointer in the new allocation. */
@@ -325,9 +331,6 @@ int defragKey(redisDb *db, dictEntry *de) {
                     defragged++, node->zl = newzl;
                 node = node->next;
             }
-        } else if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
-            if ((newzl = activeDefragAlloc(ob->ptr)))
-                defragged++, ob->ptr = newzl;
         } else {
             serverPanic("Unknown list encoding");
         }
@@ -345,14 +348,22 @@ int defragKey(redisDb *db, dictEntry *de) {
             dictDefragTables((dict**)&ob->ptr);
         } else if (ob->encoding == OBJ_ENCODING_INTSET) {
             intset *is = ob->ptr;
-            intset *newis = activeDefragAlloc(is);
-            if (newis)
+            intset *newis;
+            if (intsetIsChunked(is)) {
+                intsetChunks *ic = (intsetChunks*)is;
+                uint32_t j;
+                for (j = 0; j < ic->count; j++) {
+                    if ((newis = activeDefragAlloc(ic->chunks[j])))
+                        defragged++, ic->chunks[j] = newis;
+                }
+            }
+            if ((newis = activeDefragAlloc(is)))
                 defragged++, ob->ptr = newis;
         } else {
             serverPanic("Unknown set encoding");
         }
     } else if (ob->type == OBJ_ZSET) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_SKIPLIST) {
@@ -386,7 +397,7 @@ int defragKey(redisDb *db, dictEntry *de) {
             serverPanic("Unknown sorted set encoding");
         }
     } else if (ob->type == OBJ_HASH) {
-        if (ob->encoding == OBJ_ENCODING_ZIPLIST) {
+        if (ob->encoding == OBJ_ENCODING_LISTPACK) {
             if ((newzl = activeDefragAlloc(ob->ptr)))
                 defragged++, ob->ptr = newzl;
         } else if (ob->encoding == OBJ_ENCODING_HT) {
@@ -3,7 +3,9 @@
  * This file implements in memory hash tables with insert/del/replace/find/
  * get-random-element operations. Hash tables will auto resize if needed
  * tables of power of two in size are used, collisions are handled by
- * chaining. See the source code for more information... :)
+ * chaining. Dictionaries can optionally use an open addressing layout with
+ * the entries stored inline into the buckets, see the "Open addressing
+ * tables" section. See the source code for more information... :)
  *
  * Copyright (c) 2006-2012, Salvatore Sanfilippo <antirez at gmail dot com>
  * All rights reserved.
@@ -81,6 +83,24 @@ static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
 static long _dictKeyIndex(dict *ht, const void *key, uint64_t hash, dictEntry **existing);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+static void _dictRehashStep(dict *d);
+long long dictFingerprint(dict *d);
+static int _dictOAExpand(dict *d, unsigned long size);
+static int _dictOARehash(dict *d, int n);
+static dictEntry *_dictOAAddRaw(dict *d, void *key, dictEntry **existing);
+static dictEntry *_dictOAFind(dict *d, const void *key);
+static dictEntry *_dictOADelete(dict *d, const void *key, int nofree);
+static unsigned long _dictOAFreeBuckets(dict *d, dictht *ht,
+    unsigned long start, unsigned long end, void(callback)(void *));
+static void _dictOAFreeTable(dict *d, dictht *ht, unsigned long start,
+                             void(callback)(void *));
+static dictEntry *_dictOANext(dictIterator *iter);
+static dictEntry *_dictOAGetRandomKey(dict *d);
+static unsigned int _dictOAGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count);
+static unsigned long _dictOAScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata);
+static unsigned long _dictOABuckets(dictht *ht);
 
 /* -------------------------- hash functions -------------------------------- */
 
@@ -203,6 +223,9 @@ int dictExpand(dict *d, unsigned long size)
     if (dictIsRehashing(d) || d->ht[0].used > size)
         return DICT_ERR;
 
+    /* Open addressing tables are sized by number of buckets. */
+    if (dictIsOpenAddressing(d)) return _dictOAExpand(d, size);
+
     /* Rehashing to the same table size is not useful. */
     // 如果本来就是这个大小了则没有必要扩展了
     if (realsize == d->ht[0].size) return DICT_ERR;
@@ -253,6 +276,7 @@ int dictExpand(dict *d, unsigned long size)
 int dictRehash(dict *d, int n) {
     int empty_visits = n*10; /* Max number of empty buckets to visit. */
     if (!dictIsRehashing(d)) return 0;
+    if (dictIsOpenAddressing(d)) return _dictOARehash(d,n);
 
     while(n-- && d->ht[0].used != 0) {
         dictEntry *de, *nextde;
@@ -306,6 +330,13 @@ long long timeInMilliseconds(void) {
     return (((long long)tv.tv_sec)*1000)+(tv.tv_usec/1000);
 }
 
+long long timeInMicroseconds(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
 /* Rehash for an amount of time between ms milliseconds and ms+1 milliseconds */
 int dictRehashMilliseconds(dict *d, int ms) {
     long long start = timeInMilliseconds();
@@ -318,6 +349,33 @@ int dictRehashMilliseconds(dict *d, int ms) {
     return rehashes;
 }
 
+/* Like dictRehashMilliseconds() but with a microseconds budget, so that
+ * it can be called very often (for instance at every event loop iteration)
+ * with a small time slice. We may go over the budget by the time needed to
+ * rehash 100 buckets. */
+int dictRehashMicroseconds(dict *d, long long us) {
+    long long start = timeInMicroseconds();
+    int rehashes = 0;
+
+    while(dictRehash(d,100)) {
+        rehashes += 100;
+        if (timeInMicroseconds()-start > us) break;
+    }
+    return rehashes;
+}
+
+/* Return the percentage of buckets of the old table that were already
+ * moved to the new table, or 100 if the dictionary is not rehashing. */
+double dictRehashProgress(dict *d) {
+    unsigned long buckets;
+
+    if (!dictIsRehashing(d)) return 100;
+    buckets = dictIsOpenAddressing(d) ? _dictOABuckets(&d->ht[0]) :
+                                        d->ht[0].size;
+    if (buckets == 0) return 100;
+    return (double)d->rehashidx*100/buckets;
+}
+
 /* This function performs just a step of rehashing, and only if there are
  * no safe iterators bound to our hash table. When we have iterators in the
  * middle of a rehashing we can't mess with the two hash tables otherwise
@@ -400,6 +458,8 @@ dictEntry *dictAddRaw(dict *d, void *key, dictEntry **existing)
     dictEntry *entry;
     dictht *ht;
 
+    if (dictIsOpenAddressing(d)) return _dictOAAddRaw(d,key,existing);
+
     // 是否超过重新hash的阈值
     if (dictIsRehashing(d)) _dictRehashStep(d);
 
@@ -461,7 +521,7 @@ int dictReplace(dict *d, void *key, void *val)
      * you want to increment (set), and then decrement (free), and not the
      * reverse. */
     // 表中已经有键K对应的entry则更新该entry的即可
-    auxentry = *existing;
+    auxentry.v = existing->v;
     // 之所以要先设置新值是考虑到极端情况：新值和旧值其实是同一个内存地址(完全指向的同一块内存)
     dictSetVal(d, existing, val);
     dictFreeVal(d, &auxentry);
@@ -514,6 +574,7 @@ static dictEntry *dictGenericDelete(dict *d, const void *key, int nofree) {
     dictEntry *he, *prevHe;
     int table;
 
+    if (dictIsOpenAddressing(d)) return _dictOADelete(d,key,nofree);
     if (d->ht[0].used == 0 && d->ht[1].used == 0) return NULL;
 
     // 所有涉及到修改哈希表结构的都需要判断是否处于重hash状态
@@ -618,6 +679,11 @@ void dictFreeUnlinkedEntry(dict *d, dictEntry *he) {
 int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
     unsigned long i;
 
+    if (dictIsOpenAddressing(d)) {
+        _dictOAFreeTable(d,ht,0,callback);
+        return DICT_OK;
+    }
+
     /* Free all the elements */
     for (i = 0; i < ht->size && ht->used > 0; i++) {
         dictEntry *he, *nextHe;
@@ -651,6 +717,43 @@ void dictRelease(dict *d)
     zfree(d);
 }
 
+/* Release the elements stored in the part 'part' of 'parts' equal slices of
+ * the buckets of the dictionary, leaving the slice empty but without
+ * updating the number of elements. Different threads may release different
+ * parts of the same dictionary at the same time, as long as nobody else is
+ * accessing it: this is used in order to release huge dictionaries in
+ * parallel. Once all the parts were released, the dictionary itself should
+ * be freed with dictRelease(). */
+void dictEmptyPart(dict *d, int part, int parts) {
+    int table;
+
+    for (table = 0; table <= 1; table++) {
+        dictht *ht = &d->ht[table];
+        unsigned long buckets, start, end, i;
+
+        if (ht->table == NULL) continue;
+        buckets = dictIsOpenAddressing(d) ? _dictOABuckets(ht) : ht->size;
+        start = buckets*part/parts;
+        end = buckets*(part+1)/parts;
+        if (dictIsOpenAddressing(d)) {
+            _dictOAFreeBuckets(d,ht,start,end,NULL);
+            continue;
+        }
+        for (i = start; i < end; i++) {
+            dictEntry *he = ht->table[i], *nextHe;
+
+            while(he) {
+                nextHe = he->next;
+                dictFreeKey(d, he);
+                dictFreeVal(d, he);
+                zfree(he);
+                he = nextHe;
+            }
+            ht->table[i] = NULL;
+        }
+    }
+}
+
 /*
  * 在哈希表中查找键K对应的entry
  *
@@ -667,6 +770,7 @@ dictEntry *dictFind(dict *d, const void *key)
     dictEntry *he;
     uint64_t h, idx, table;
 
+    if (dictIsOpenAddressing(d)) return _dictOAFind(d,key);
     // 如果哈希表本身是个空表则不用查了
     if (d->ht[0].used + d->ht[1].used == 0) return NULL; /* dict is empty */
     if (dictIsRehashing(d)) _dictRehashStep(d);
@@ -753,6 +857,8 @@ dictIterator *dictGetIterator(dict *d)
     iter->safe = 0;
     iter->entry = NULL;
     iter->nextEntry = NULL;
+    iter->bucket = NULL;
+    iter->slot = 0;
     return iter;
 }
 
@@ -765,6 +871,7 @@ dictIterator *dictGetSafeIterator(dict *d) {
 
 dictEntry *dictNext(dictIterator *iter)
 {
+    if (dictIsOpenAddressing(iter->d)) return _dictOANext(iter);
     while (1) {
         if (iter->entry == NULL) {
             dictht *ht = &iter->d->ht[iter->table];
@@ -817,6 +924,7 @@ dictEntry *dictGetRandomKey(dict *d)
     unsigned long h;
     int listlen, listele;
 
+    if (dictIsOpenAddressing(d)) return _dictOAGetRandomKey(d);
     if (dictSize(d) == 0) return NULL;
     if (dictIsRehashing(d)) _dictRehashStep(d);
     if (dictIsRehashing(d)) {
@@ -880,6 +988,7 @@ unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
     unsigned long stored = 0, maxsizemask;
     unsigned long maxsteps;
 
+    if (dictIsOpenAddressing(d)) return _dictOAGetSomeKeys(d,des,count);
     if (dictSize(d) < count) count = dictSize(d);
     maxsteps = count*10;
 
@@ -1063,6 +1172,7 @@ unsigned long dictScan(dict *d,
     unsigned long m0, m1;
 
     if (dictSize(d) == 0) return 0;
+    if (dictIsOpenAddressing(d)) return _dictOAScan(d,v,fn,privdata);
 
     // 当前字典未处于重hash状态,
     if (!dictIsRehashing(d)) {
@@ -1132,6 +1242,539 @@ unsigned long dictScan(dict *d,
     return v;
 }
 
+/* Return the position of the cursor 'v', or of an element having hash 'v',
+ * in the order dictScan() visits the elements. Once dictScan() returned
+ * the cursor 'v', all the elements present since the start of the scan
+ * with a position lower than the position of 'v' were already returned.
+ * Elements with a lower position are returned again only if the table was
+ * shrunk in the meantime. */
+unsigned long dictScanPosition(unsigned long v) {
+    return rev(v);
+}
+
+/* ------------------------ Open addressing tables ---------------------------
+ *
+ * Dictionaries created with a dictType having the 'openAddressing' flag set
+ * don't allocate a dictEntry for every element. Instead every hash table is
+ * an array of 128 bytes buckets, and every bucket stores up to
+ * DICT_BUCKET_SLOTS entries inline, together with one metadata byte per
+ * slot holding the higher 8 bits of the hash of the key (the "tag").
+ *
+ * A lookup touches the bucket selected by the lower bits of the hash, and
+ * compares the key only in the slots where the tag matches, so on a miss
+ * the key is almost never dereferenced, and on a hit we access exactly the
+ * bucket and the key, instead of the bucket pointer, the dictEntry and the
+ * key of the chained layout. With the average fill we keep, the memory
+ * used per element is about the same of the dictEntry allocation plus the
+ * bucket pointer, but there is no allocation per element at all.
+ *
+ * When a bucket is full, new elements of the same bucket are stored into
+ * an overflow bucket linked to it. An element never lives outside the
+ * chain of its home bucket, this is what makes dictScan() work exactly
+ * like with the chained layout: the reverse binary cursor is applied to
+ * the bucket index, and all the chain is emitted at once.
+ *
+ * The table size reported in ht->size is the number of slots, so that
+ * dictSlots() and the resize heuristics of the callers keep working, while
+ * ht->sizemask is the mask of the bucket index.
+ *
+ * The dictEntry pointers returned by the API point directly inside the
+ * buckets: they are valid until the next operation that may rehash the
+ * dictionary, or until the element is deleted. The 'next' field of such
+ * entries must never be accessed, and dictFindEntryRefByPtrAndHash() is
+ * not supported. Entries returned by dictUnlink() are a copy of the
+ * element, allocated on the heap, and must be released as usually with
+ * dictFreeUnlinkedEntry(). */
+
+#define DICT_BUCKET_SLOTS 7
+/* Average number of elements per bucket that triggers an expansion. */
+#define DICT_BUCKET_FILL 6
+#define dictHashTag(h) ((uint8_t)((h) >> 56))
+#define dictHtBuckets(ht) ((dictBucket*)(ht)->table)
+
+/* A slot has the same layout of the first two fields of dictEntry, and it
+ * is always accessed as a dictEntry. */
+typedef struct dictSlot {
+    void *key;
+    union {
+        void *val;
+        uint64_t u64;
+        int64_t s64;
+        double d;
+    } v;
+} dictSlot;
+
+typedef struct dictBucket {
+    uint8_t presence;                   /* Bit N set if slot N is used. */
+    uint8_t tags[DICT_BUCKET_SLOTS];    /* Hash tag of every used slot. */
+    dictSlot slots[DICT_BUCKET_SLOTS];
+    struct dictBucket *child;           /* Overflow bucket, or NULL. */
+} dictBucket;
+
+static inline dictEntry *dictBucketEntry(dictBucket *b, int j) {
+    return (dictEntry*)(void*)&b->slots[j];
+}
+
+/* Number of buckets of the table, zero if it was never allocated. */
+static unsigned long _dictOABuckets(dictht *ht) {
+    return ht->table ? ht->sizemask+1 : 0;
+}
+
+/* Return the number of elements stored in the chain starting at 'b'. */
+static int _dictOAChainLen(dictBucket *b) {
+    int len = 0, j;
+
+    for (; b; b = b->child) {
+        for (j = 0; j < DICT_BUCKET_SLOTS; j++)
+            if (b->presence & (1<<j)) len++;
+    }
+    return len;
+}
+
+/* Search 'key', having hash 'h', in the table 'ht'. On success the bucket
+ * holding the key is returned and the slot index is stored in '*slot',
+ * otherwise NULL is returned. */
+static dictBucket *_dictOALookup(dict *d, dictht *ht, const void *key,
+                                 uint64_t h, int *slot)
+{
+    uint8_t tag = dictHashTag(h);
+    dictBucket *b;
+    int j;
+
+    if (ht->used == 0) return NULL;
+    b = dictHtBuckets(ht) + (h & ht->sizemask);
+    do {
+        for (j = 0; j < DICT_BUCKET_SLOTS; j++) {
+            if ((b->presence & (1<<j)) && b->tags[j] == tag) {
+                void *k = dictBucketEntry(b,j)->key;
+                if (key == k || dictCompareKeys(d, key, k)) {
+                    *slot = j;
+                    return b;
+                }
+            }
+        }
+        b = b->child;
+    } while(b);
+    return NULL;
+}
+
+/* Reserve a slot for an element with hash 'h' in the table 'ht', allocating
+ * an overflow bucket if the whole chain is full. The caller must populate
+ * the returned entry. */
+static dictEntry *_dictOAInsert(dictht *ht, uint64_t h) {
+    dictBucket *b = dictHtBuckets(ht) + (h & ht->sizemask);
+    int j;
+
+    while (b->presence == (1<<DICT_BUCKET_SLOTS)-1) {
+        if (b->child == NULL) b->child = zcalloc(sizeof(dictBucket));
+        b = b->child;
+    }
+    for (j = 0; j < DICT_BUCKET_SLOTS; j++)
+        if (!(b->presence & (1<<j))) break;
+    b->presence |= 1<<j;
+    b->tags[j] = dictHashTag(h);
+    ht->used++;
+    return dictBucketEntry(b,j);
+}
+
+/* Mark the slot 'j' of the bucket 'b' as free. If 'b' is an overflow
+ * bucket of 'home' and it is now empty, it is released, unless there are
+ * safe iterators that may be positioned on it. */
+static void _dictOARemove(dict *d, dictht *ht, dictBucket *home,
+                          dictBucket *b, int j)
+{
+    b->presence &= ~(1<<j);
+    ht->used--;
+    if (b->presence == 0 && b != home && d->iterators == 0) {
+        while (home->child != b) home = home->child;
+        home->child = b->child;
+        zfree(b);
+    }
+}
+
+static int _dictOAExpand(dict *d, unsigned long size) {
+    dictht n;
+    unsigned long buckets;
+
+    buckets = _dictNextPower((size+DICT_BUCKET_FILL-1)/DICT_BUCKET_FILL);
+    if (buckets == _dictOABuckets(&d->ht[0])) return DICT_ERR;
+
+    n.size = buckets*DICT_BUCKET_SLOTS;
+    n.sizemask = buckets-1;
+    n.table = zcalloc(buckets*sizeof(dictBucket));
+    n.used = 0;
+
+    if (d->ht[0].table == NULL) {
+        d->ht[0] = n;
+        return DICT_OK;
+    }
+    d->ht[1] = n;
+    d->rehashidx = 0;
+    return DICT_OK;
+}
+
+/* Release the elements stored in the buckets [start,end) of the table and
+ * their overflow buckets, leaving the home buckets empty. The number of
+ * elements released is returned, 'ht->used' is not updated. */
+static unsigned long _dictOAFreeBuckets(dict *d, dictht *ht,
+    unsigned long start, unsigned long end, void(callback)(void *))
+{
+    unsigned long i, freed = 0;
+
+    for (i = start; i < end; i++) {
+        dictBucket *home = dictHtBuckets(ht)+i, *b = home, *child;
+        int j;
+
+        if (callback && (i & 65535) == 0) callback(d->privdata);
+        while (b) {
+            for (j = 0; j < DICT_BUCKET_SLOTS; j++) {
+                if (!(b->presence & (1<<j))) continue;
+                dictFreeKey(d, dictBucketEntry(b,j));
+                dictFreeVal(d, dictBucketEntry(b,j));
+                freed++;
+            }
+            child = b->child;
+            if (b != home) zfree(b);
+            b = child;
+        }
+        home->presence = 0;
+        home->child = NULL;
+    }
+    return freed;
+}
+
+/* Release the elements stored in the table starting from the bucket
+ * 'start', every overflow bucket from there, and the table itself. */
+static void _dictOAFreeTable(dict *d, dictht *ht, unsigned long start,
+                             void(callback)(void *))
+{
+    ht->used -= _dictOAFreeBuckets(d,ht,start,_dictOABuckets(ht),callback);
+    zfree(ht->table);
+    _dictReset(ht);
+}
+
+static int _dictOARehash(dict *d, int n) {
+    int empty_visits = n*10; /* Max number of empty buckets to visit. */
+    dictht *t0 = &d->ht[0], *t1 = &d->ht[1];
+
+    while(n-- && t0->used != 0) {
+        dictBucket *home, *b, *child;
+        int j;
+
+        assert(_dictOABuckets(t0) > (unsigned long)d->rehashidx);
+        home = dictHtBuckets(t0) + d->rehashidx;
+        while(home->presence == 0 && home->child == NULL) {
+            d->rehashidx++;
+            if (--empty_visits == 0) return 1;
+            home++;
+        }
+        /* Move all the elements of this chain to the new table. */
+        for (b = home; b; b = child) {
+            for (j = 0; j < DICT_BUCKET_SLOTS; j++) {
+                dictEntry *src, *dst;
+
+                if (!(b->presence & (1<<j))) continue;
+                src = dictBucketEntry(b,j);
+                dst = _dictOAInsert(t1, dictHashKey(d, src->key));
+                dst->key = src->key;
+                dst->v = src->v;
+                t0->used--;
+            }
+            child = b->child;
+            if (b != home) zfree(b);
+        }
+        home->presence = 0;
+        home->child = NULL;
+        d->rehashidx++;
+    }
+
+    if (t0->used == 0) {
+        /* Empty overflow buckets may still exist in the part of the table
+         * we did not visit yet. */
+        _dictOAFreeTable(d, t0, d->rehashidx, NULL);
+        *t0 = *t1;
+        _dictReset(t1);
+        d->rehashidx = -1;
+        return 0;
+    }
+    return 1;
+}
+
+static dictEntry *_dictOAAddRaw(dict *d, void *key, dictEntry **existing) {
+    dictBucket *b;
+    dictEntry *entry;
+    uint64_t h;
+    int table, j;
+
+    if (existing) *existing = NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    if (_dictExpandIfNeeded(d) == DICT_ERR) return NULL;
+
+    h = dictHashKey(d, key);
+    for (table = 0; table <= 1; table++) {
+        if ((b = _dictOALookup(d, &d->ht[table], key, h, &j)) != NULL) {
+            if (existing) *existing = dictBucketEntry(b,j);
+            return NULL;
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    entry = _dictOAInsert(dictIsRehashing(d) ? &d->ht[1] : &d->ht[0], h);
+    dictSetKey(d, entry, key);
+    return entry;
+}
+
+static dictEntry *_dictOAFind(dict *d, const void *key) {
+    dictBucket *b;
+    uint64_t h;
+    int table, j;
+
+    if (dictSize(d) == 0) return NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    h = dictHashKey(d, key);
+    for (table = 0; table <= 1; table++) {
+        if ((b = _dictOALookup(d, &d->ht[table], key, h, &j)) != NULL)
+            return dictBucketEntry(b,j);
+        if (!dictIsRehashing(d)) break;
+    }
+    return NULL;
+}
+
+static dictEntry *_dictOADelete(dict *d, const void *key, int nofree) {
+    dictBucket *b;
+    uint64_t h;
+    int table, j;
+
+    if (dictSize(d) == 0) return NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    h = dictHashKey(d, key);
+    for (table = 0; table <= 1; table++) {
+        dictht *ht = &d->ht[table];
+
+        if ((b = _dictOALookup(d, ht, key, h, &j)) != NULL) {
+            dictEntry *slot = dictBucketEntry(b,j), *he;
+
+            if (nofree) {
+                /* The slot may be reused at the next insertion, so give
+                 * the caller a copy it can own. */
+                he = zmalloc(sizeof(*he));
+                he->key = slot->key;
+                he->v = slot->v;
+                he->next = NULL;
+            } else {
+                dictFreeKey(d, slot);
+                dictFreeVal(d, slot);
+                he = slot;
+            }
+            _dictOARemove(d, ht, dictHtBuckets(ht) + (h & ht->sizemask), b, j);
+            return he;
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    return NULL;
+}
+
+static dictEntry *_dictOANext(dictIterator *iter) {
+    while (1) {
+        dictBucket *b = iter->bucket;
+
+        if (b == NULL) {
+            dictht *ht = &iter->d->ht[iter->table];
+            if (iter->index == -1 && iter->table == 0) {
+                if (iter->safe)
+                    iter->d->iterators++;
+                else
+                    iter->fingerprint = dictFingerprint(iter->d);
+            }
+            iter->index++;
+            if (iter->index >= (long) _dictOABuckets(ht)) {
+                if (dictIsRehashing(iter->d) && iter->table == 0) {
+                    iter->table++;
+                    iter->index = 0;
+                    ht = &iter->d->ht[1];
+                } else {
+                    break;
+                }
+            }
+            b = iter->bucket = dictHtBuckets(ht) + iter->index;
+            iter->slot = 0;
+        }
+        /* The user may delete the returned entry, so we remember the
+         * position of the next slot to inspect, not the current entry. */
+        while (iter->slot < DICT_BUCKET_SLOTS) {
+            int j = iter->slot++;
+            if (b->presence & (1<<j)) {
+                iter->entry = dictBucketEntry(b,j);
+                return iter->entry;
+            }
+        }
+        iter->bucket = b->child;
+        iter->slot = 0;
+    }
+    return NULL;
+}
+
+static dictEntry *_dictOAGetRandomKey(dict *d) {
+    dictBucket *b;
+    unsigned long h, b0, b1;
+    int len, pick, j;
+
+    if (dictSize(d) == 0) return NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    b0 = _dictOABuckets(&d->ht[0]);
+    if (dictIsRehashing(d)) {
+        b1 = _dictOABuckets(&d->ht[1]);
+        do {
+            /* No elements in buckets from 0 to rehashidx-1 of ht[0]. */
+            h = d->rehashidx + (random() % (b0 + b1 - d->rehashidx));
+            b = (h >= b0) ? dictHtBuckets(&d->ht[1]) + (h - b0) :
+                            dictHtBuckets(&d->ht[0]) + h;
+        } while((len = _dictOAChainLen(b)) == 0);
+    } else {
+        do {
+            h = random() & d->ht[0].sizemask;
+            b = dictHtBuckets(&d->ht[0]) + h;
+        } while((len = _dictOAChainLen(b)) == 0);
+    }
+
+    /* Pick a random element among the ones of the chain. */
+    pick = random() % len;
+    for (; b; b = b->child) {
+        for (j = 0; j < DICT_BUCKET_SLOTS; j++) {
+            if ((b->presence & (1<<j)) && pick-- == 0)
+                return dictBucketEntry(b,j);
+        }
+    }
+    return NULL; /* Unreachable. */
+}
+
+static unsigned int _dictOAGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count)
+{
+    unsigned long j; /* internal hash table id, 0 or 1. */
+    unsigned long tables; /* 1 or 2 tables? */
+    unsigned long stored = 0, maxsizemask;
+    unsigned long maxsteps;
+
+    if (dictSize(d) < count) count = dictSize(d);
+    maxsteps = count*10;
+
+    /* Try to do a rehashing work proportional to 'count'. */
+    for (j = 0; j < count; j++) {
+        if (dictIsRehashing(d))
+            _dictRehashStep(d);
+        else
+            break;
+    }
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < d->ht[1].sizemask)
+        maxsizemask = d->ht[1].sizemask;
+
+    /* Pick a random point inside the larger table, and walk the buckets
+     * from there, see dictGetSomeKeys() for the details. */
+    unsigned long i = random() & maxsizemask;
+    unsigned long emptylen = 0;
+    while(stored < count && maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            dictBucket *b;
+            int found = 0, k;
+
+            if (tables == 2 && j == 0 && i < (unsigned long) d->rehashidx) {
+                if (i >= _dictOABuckets(&d->ht[1])) i = d->rehashidx;
+                continue;
+            }
+            if (i >= _dictOABuckets(&d->ht[j])) continue;
+            for (b = dictHtBuckets(&d->ht[j]) + i; b; b = b->child) {
+                for (k = 0; k < DICT_BUCKET_SLOTS; k++) {
+                    if (!(b->presence & (1<<k))) continue;
+                    *des++ = dictBucketEntry(b,k);
+                    found = 1;
+                    stored++;
+                    if (stored == count) return stored;
+                }
+            }
+            if (!found) {
+                emptylen++;
+                if (emptylen >= 5 && emptylen > count) {
+                    i = random() & maxsizemask;
+                    emptylen = 0;
+                }
+            } else {
+                emptylen = 0;
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
+/* Call 'fn' for every element of the chain starting at 'b'. */
+static void _dictOAScanChain(dictBucket *b, dictScanFunction *fn,
+                             void *privdata)
+{
+    int j;
+
+    while (b) {
+        /* The callback can't delete elements, but read 'child' first
+         * anyway, like dictScan() does for the chained layout. */
+        dictBucket *child = b->child;
+        for (j = 0; j < DICT_BUCKET_SLOTS; j++)
+            if (b->presence & (1<<j)) fn(privdata, dictBucketEntry(b,j));
+        b = child;
+    }
+}
+
+/* Same as dictScan(), but working on buckets. There are no chain pointers
+ * that can be reallocated by the caller, so 'bucketfn' is not used. */
+static unsigned long _dictOAScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata)
+{
+    dictht *t0, *t1;
+    unsigned long m0, m1;
+
+    if (!dictIsRehashing(d)) {
+        t0 = &(d->ht[0]);
+        m0 = t0->sizemask;
+        _dictOAScanChain(dictHtBuckets(t0) + (v & m0), fn, privdata);
+    } else {
+        t0 = &d->ht[0];
+        t1 = &d->ht[1];
+
+        /* Make sure t0 is the smaller and t1 is the bigger table */
+        if (t0->size > t1->size) {
+            t0 = &d->ht[1];
+            t1 = &d->ht[0];
+        }
+
+        m0 = t0->sizemask;
+        m1 = t1->sizemask;
+        _dictOAScanChain(dictHtBuckets(t0) + (v & m0), fn, privdata);
+
+        /* Iterate over indices in larger table that are the expansion
+         * of the index pointed to by the cursor in the smaller table */
+        do {
+            _dictOAScanChain(dictHtBuckets(t1) + (v & m1), fn, privdata);
+
+            /* Increment bits not covered by the smaller mask */
+            v = (((v | m0) + 1) & ~m0) | (v & m0);
+
+            /* Continue while bits covered by mask difference is non-zero */
+        } while (v & (m0 ^ m1));
+    }
+
+    /* Set unmasked bits so incrementing the reversed cursor
+     * operates on the masked bits of the smaller table */
+    v |= ~m0;
+
+    /* Increment the reverse cursor */
+    v = rev(v);
+    v++;
+    v = rev(v);
+
+    return v;
+}
+
 /* ------------------------- private functions ------------------------------ */
 
 /* Expand the hash table if needed */
@@ -1152,6 +1795,20 @@ static int _dictExpandIfNeeded(dict *d)
     // 如果目前哈希表是空的则扩展至默认的初始化大小
     if (d->ht[0].size == 0) return dictExpand(d, DICT_HT_INITIAL_SIZE);
 
+    /* Open addressing tables are expanded when the buckets reach an average
+     * of DICT_BUCKET_FILL elements, so that overflow buckets are rare. */
+    if (dictIsOpenAddressing(d)) {
+        unsigned long buckets = _dictOABuckets(&d->ht[0]);
+
+        if (d->ht[0].used >= buckets*DICT_BUCKET_FILL &&
+            (dict_can_resize ||
+             d->ht[0].used/buckets > DICT_BUCKET_FILL*dict_force_resize_ratio))
+        {
+            return dictExpand(d, d->ht[0].used*2);
+        }
+        return DICT_OK;
+    }
+
     /* If we reached the 1:1 ratio, and we are allowed to resize the hash
      * table (global setting) or we should avoid it but the ratio between
      * elements/buckets is over the "safe" threshold, we resize doubling
@@ -1270,11 +1927,13 @@ uint64_t dictGetHash(dict *d, const void *key) {
  * oldkey is a dead pointer and should not be accessed.
  * the hash value should be provided using dictGetHash.
  * no string / key comparison is performed.
- * return value is the reference to the dictEntry if found, or NULL if not found. */
+ * return value is the reference to the dictEntry if found, or NULL if not found.
+ * Open addressing dicts have no entry references, NULL is always returned. */
 dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, uint64_t hash) {
     dictEntry *he, **heref;
     unsigned long idx, table;
 
+    if (dictIsOpenAddressing(d)) return NULL;
     if (d->ht[0].used + d->ht[1].used == 0) return NULL; /* dict is empty */
     for (table = 0; table <= 1; table++) {
         idx = hash & d->ht[table].sizemask;
@@ -1355,16 +2014,77 @@ size_t _dictGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
     return strlen(buf);
 }
 
+/* Like _dictGetStatsHt() but for open addressing tables, where the chain
+ * length is the number of elements stored in the bucket and in its
+ * overflow buckets. */
+size_t _dictOAGetStatsHt(char *buf, size_t bufsize, dictht *ht, int tableid) {
+    unsigned long i, buckets, slots = 0, overflow = 0, chainlen;
+    unsigned long maxchainlen = 0, totchainlen = 0;
+    unsigned long clvector[DICT_STATS_VECTLEN];
+    size_t l = 0;
+
+    if (ht->used == 0) {
+        return snprintf(buf,bufsize,
+            "No stats available for empty dictionaries\n");
+    }
+
+    /* Compute stats. */
+    buckets = _dictOABuckets(ht);
+    for (i = 0; i < DICT_STATS_VECTLEN; i++) clvector[i] = 0;
+    for (i = 0; i < buckets; i++) {
+        dictBucket *b;
+
+        for (b = dictHtBuckets(ht)[i].child; b; b = b->child) overflow++;
+        chainlen = _dictOAChainLen(dictHtBuckets(ht)+i);
+        clvector[(chainlen < DICT_STATS_VECTLEN) ? chainlen : (DICT_STATS_VECTLEN-1)]++;
+        if (chainlen == 0) continue;
+        slots++;
+        if (chainlen > maxchainlen) maxchainlen = chainlen;
+        totchainlen += chainlen;
+    }
+
+    /* Generate human readable stats. */
+    l += snprintf(buf+l,bufsize-l,
+        "Hash table %d stats (%s, open addressing):\n"
+        " table size: %ld\n"
+        " number of buckets: %ld\n"
+        " number of overflow buckets: %ld\n"
+        " number of elements: %ld\n"
+        " different slots: %ld\n"
+        " max chain length: %ld\n"
+        " avg chain length (counted): %.02f\n"
+        " avg chain length (computed): %.02f\n"
+        " Chain length distribution:\n",
+        tableid, (tableid == 0) ? "main hash table" : "rehashing target",
+        ht->size, buckets, overflow, ht->used, slots, maxchainlen,
+        (float)totchainlen/slots, (float)ht->used/slots);
+
+    for (i = 0; i < DICT_STATS_VECTLEN-1; i++) {
+        if (clvector[i] == 0) continue;
+        if (l >= bufsize) break;
+        l += snprintf(buf+l,bufsize-l,
+            "   %s%ld: %ld (%.02f%%)\n",
+            (i == DICT_STATS_VECTLEN-1)?">= ":"",
+            i, clvector[i], ((float)clvector[i]/buckets)*100);
+    }
+
+    /* Unlike snprintf(), teturn the number of characters actually written. */
+    if (bufsize) buf[bufsize-1] = '\0';
+    return strlen(buf);
+}
+
 void dictGetStats(char *buf, size_t bufsize, dict *d) {
     size_t l;
     char *orig_buf = buf;
     size_t orig_bufsize = bufsize;
+    size_t (*getstats)(char*,size_t,dictht*,int) =
+        dictIsOpenAddressing(d) ? _dictOAGetStatsHt : _dictGetStatsHt;
 
-    l = _dictGetStatsHt(buf,bufsize,&d->ht[0],0);
+    l = getstats(buf,bufsize,&d->ht[0],0);
     buf += l;
     bufsize -= l;
     if (dictIsRehashing(d) && bufsize > 0) {
-        _dictGetStatsHt(buf,bufsize,&d->ht[1],1);
+        getstats(buf,bufsize,&d->ht[1],1);
     }
     /* Make sure there is a NULL term at the end. */
     if (orig_bufsize) orig_buf[orig_bufsize-1] = '\0';
@@ -1405,24 +2125,38 @@ dictType BenchmarkDictType = {
     NULL
 };
 
+dictType BenchmarkOADictType = {
+    hashCallback,
+    NULL,
+    NULL,
+    compareCallback,
+    freeCallback,
+    NULL,
+    1
+};
+
 #define start_benchmark() start = timeInMilliseconds()
 #define end_benchmark(msg) do { \
     elapsed = timeInMilliseconds()-start; \
     printf(msg ": %ld items in %lld ms\n", count, elapsed); \
 } while(0);
 
-/* dict-benchmark [count] */
+/* dict-benchmark [count] [oa] */
 int main(int argc, char **argv) {
     long j;
     long long start, elapsed;
-    dict *dict = dictCreate(&BenchmarkDictType,NULL);
+    dict *dict;
     long count = 0;
 
-    if (argc == 2) {
+    if (argc >= 2) {
         count = strtol(argv[1],NULL,10);
     } else {
         count = 5000000;
     }
+    if (argc >= 3 && !strcmp(argv[2],"oa"))
+        dict = dictCreate(&BenchmarkOADictType,NULL);
+    else
+        dict = dictCreate(&BenchmarkDictType,NULL);
 
     start_benchmark();
     for (j = 0; j < count; j++) {
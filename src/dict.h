@@ -66,6 +66,11 @@ typedef struct dictType {
     // 键与值的析构函数
     void (*keyDestructor)(void *privdata, void *key);
     void (*valDestructor)(void *privdata, void *obj);
+    /* When set the dictionary stores its entries inline in cache line sized
+     * buckets (open addressing with hash tags) instead of allocating a
+     * dictEntry for every key. See the comment in dict.c for the details
+     * and for the API restrictions of this layout. */
+    int openAddressing;
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -105,6 +110,9 @@ typedef struct dictIterator {
     long index;
     int table, safe;
     dictEntry *entry, *nextEntry;
+    /* Current bucket and slot, only used by open addressing dicts. */
+    void *bucket;
+    int slot;
     /* unsafe iterator fingerprint for misuse detection. */
     long long fingerprint;
 } dictIterator;
@@ -166,6 +174,12 @@ typedef void (dictScanBucketFunction)(void *privdata, dictEntry **bucketref);
 // 判断哈希表是否需要重哈希
 // Redis哈希表的重哈希是逐桶进行的
 #define dictIsRehashing(d) ((d)->rehashidx != -1)
+#define dictIsOpenAddressing(d) ((d)->type->openAddressing)
+/* Incremental rehashing is not performed while there are safe iterators:
+ * pausing it allows other threads to look up keys without modifying the
+ * table, as long as nothing else accesses the dict meanwhile. */
+#define dictPauseRehashing(d) ((d)->iterators++)
+#define dictResumeRehashing(d) ((d)->iterators--)
 
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
@@ -178,6 +192,7 @@ int dictDelete(dict *d, const void *key);
 dictEntry *dictUnlink(dict *ht, const void *key);
 void dictFreeUnlinkedEntry(dict *d, dictEntry *he);
 void dictRelease(dict *d);
+void dictEmptyPart(dict *d, int part, int parts);
 dictEntry * dictFind(dict *d, const void *key);
 void *dictFetchValue(dict *d, const void *key);
 int dictResize(dict *d);
@@ -195,9 +210,12 @@ void dictEnableResize(void);
 void dictDisableResize(void);
 int dictRehash(dict *d, int n);
 int dictRehashMilliseconds(dict *d, int ms);
+int dictRehashMicroseconds(dict *d, long long us);
+double dictRehashProgress(dict *d);
 void dictSetHashFunctionSeed(uint8_t *seed);
 uint8_t *dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, dictScanBucketFunction *bucketfn, void *privdata);
+unsigned long dictScanPosition(unsigned long v);
 uint64_t dictGetHash(dict *d, const void *key);
 dictEntry **dictFindEntryRefByPtrAndHash(dict *d, const void *oldptr, uint64_t hash);
 
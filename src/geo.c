@@ -229,7 +229,7 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
     size_t origincount = ga->used;
     sds member;
 
-    if (zobj->encoding == OBJ_ENCODING_ZIPLIST) {
+    if (zobj->encoding == OBJ_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr = NULL;
@@ -242,7 +242,7 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             return 0;
         }
 
-        sptr = ziplistNext(zl, eptr);
+        sptr = lpNext(zl, eptr);
         while (eptr) {
             score = zzlGetScore(sptr);
 
@@ -250,8 +250,8 @@ int geoGetPointsInRange(robj *zobj, double min, double max, double lon, double l
             if (!zslValueLteMax(score, &range))
                 break;
 
-            /* We know the element exists. ziplistGet should always succeed */
-            ziplistGet(eptr, &vstr, &vlen, &vlong);
+            /* We know the element exists. lpGetValue should always succeed */
+            vstr = lpGetValue(eptr, &vlen, &vlong);
             member = (vstr == NULL) ? sdsfromlonglong(vlong) :
                                       sdsnewlen(vstr,vlen);
             if (geoAppendIfWithinRadius(ga,lon,lat,radius,score,member)
@@ -456,6 +456,28 @@ void geoaddCommand(client *c) {
 #define RADIUS_MEMBER (1<<1)    /* Search around member. */
 #define RADIUS_NOSTORE (1<<2)   /* Do not acceot STORE/STOREDIST option. */
 
+/* Options of GEORADIUS and GEORADIUSBYMEMBER. */
+#define RADIUS_OPT_WITHDIST 0
+#define RADIUS_OPT_WITHHASH 1
+#define RADIUS_OPT_WITHCOORD 2
+#define RADIUS_OPT_ASC 3
+#define RADIUS_OPT_DESC 4
+#define RADIUS_OPT_COUNT 5
+#define RADIUS_OPT_STORE 6
+#define RADIUS_OPT_STOREDIST 7
+
+static const commandOption radiusOptions[] = {
+    COMMAND_OPTION("withdist",RADIUS_OPT_WITHDIST),
+    COMMAND_OPTION("withhash",RADIUS_OPT_WITHHASH),
+    COMMAND_OPTION("withcoord",RADIUS_OPT_WITHCOORD),
+    COMMAND_OPTION("asc",RADIUS_OPT_ASC),
+    COMMAND_OPTION("desc",RADIUS_OPT_DESC),
+    COMMAND_OPTION("count",RADIUS_OPT_COUNT),
+    COMMAND_OPTION("store",RADIUS_OPT_STORE),
+    COMMAND_OPTION("storedist",RADIUS_OPT_STOREDIST),
+    COMMAND_OPTION_END
+};
+
 /* GEORADIUS key x y radius unit [WITHDIST] [WITHHASH] [WITHCOORD] [ASC|DESC]
  *                               [COUNT count] [STORE key] [STOREDIST key]
  * GEORADIUSBYMEMBER key member radius unit ... options ... */
@@ -504,18 +526,19 @@ void georadiusGeneric(client *c, int flags) {
     if (c->argc > base_args) {
         int remaining = c->argc - base_args;
         for (int i = 0; i < remaining; i++) {
-            char *arg = c->argv[base_args + i]->ptr;
-            if (!strcasecmp(arg, "withdist")) {
+            int opt = matchCommandOption(c->argv[base_args + i],
+                                         radiusOptions);
+            if (opt == RADIUS_OPT_WITHDIST) {
                 withdist = 1;
-            } else if (!strcasecmp(arg, "withhash")) {
+            } else if (opt == RADIUS_OPT_WITHHASH) {
                 withhash = 1;
-            } else if (!strcasecmp(arg, "withcoord")) {
+            } else if (opt == RADIUS_OPT_WITHCOORD) {
                 withcoords = 1;
-            } else if (!strcasecmp(arg, "asc")) {
+            } else if (opt == RADIUS_OPT_ASC) {
                 sort = SORT_ASC;
-            } else if (!strcasecmp(arg, "desc")) {
+            } else if (opt == RADIUS_OPT_DESC) {
                 sort = SORT_DESC;
-            } else if (!strcasecmp(arg, "count") && (i+1) < remaining) {
+            } else if (opt == RADIUS_OPT_COUNT && (i+1) < remaining) {
                 if (getLongLongFromObjectOrReply(c, c->argv[base_args+i+1],
                     &count, NULL) != C_OK) return;
                 if (count <= 0) {
@@ -523,14 +546,14 @@ void georadiusGeneric(client *c, int flags) {
                     return;
                 }
                 i++;
-            } else if (!strcasecmp(arg, "store") &&
+            } else if (opt == RADIUS_OPT_STORE &&
                        (i+1) < remaining &&
                        !(flags & RADIUS_NOSTORE))
             {
                 storekey = c->argv[base_args+i+1];
                 storedist = 0;
                 i++;
-            } else if (!strcasecmp(arg, "storedist") &&
+            } else if (opt == RADIUS_OPT_STOREDIST &&
                        (i+1) < remaining &&
                        !(flags & RADIUS_NOSTORE))
             {
@@ -656,7 +679,7 @@ void georadiusGeneric(client *c, int flags) {
         }
 
         if (returned_items) {
-            zsetConvertToZiplistIfNeeded(zobj,maxelelen);
+            zsetConvertToListpackIfNeeded(zobj,maxelelen);
             setKey(c->db,storekey,zobj);
             decrRefCount(zobj);
             notifyKeyspaceEvent(NOTIFY_LIST,"georadiusstore",storekey,
@@ -35,12 +35,27 @@
 #include "zmalloc.h"
 #include "endianconv.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Note that these encodings are ordered, so:
  * INTSET_ENC_INT16 < INTSET_ENC_INT32 < INTSET_ENC_INT64. */
 #define INTSET_ENC_INT16 (sizeof(int16_t))
 #define INTSET_ENC_INT32 (sizeof(int32_t))
 #define INTSET_ENC_INT64 (sizeof(int64_t))
 
+/* When the range of positions where a value can be is at most this many
+ * elements, the search stops bisecting and counts the elements smaller than
+ * the value, which with SSE2 takes one or two vector compares for the 16 and
+ * 32 bit encodings. */
+#define INTSET_SEARCH_WINDOW 16
+
+/* The same, when there are no vector compares for the encoding. */
+#define INTSET_SCALAR_WINDOW 4
+
+#define INTSET_CHUNKS(is) ((intsetChunks*)(is))
+
 /* Return the required encoding for the provided value. */
 static uint8_t _intsetValueEncoding(int64_t v) {
     if (v < INT32_MIN || v > INT32_MAX)
@@ -101,6 +116,11 @@ intset *intsetNew(void) {
     return is;
 }
 
+/* Return 1 if the intset is split into chunks, 0 if it is a flat intset. */
+int intsetIsChunked(const intset *is) {
+    return intrev32ifbe(is->encoding) == INTSET_ENC_CHUNKED;
+}
+
 /* Resize the intset */
 static intset *intsetResize(intset *is, uint32_t len) {
     uint32_t size = len*intrev32ifbe(is->encoding);
@@ -108,23 +128,89 @@ static intset *intsetResize(intset *is, uint32_t len) {
     return is;
 }
 
+/* Return the position of the first element in the range [lo,hi) of a flat
+ * intset that is greater than or equal to "value", or "hi" if there is no
+ * such element. */
+static uint32_t intsetLowerBound(intset *is, uint32_t lo, uint32_t hi,
+                                 int64_t value)
+{
+    uint8_t encoding = intrev32ifbe(is->encoding);
+    uint32_t window = INTSET_SCALAR_WINDOW;
+
+    /* A value that does not fit the encoding is either smaller or greater
+     * than every element of the intset. */
+    if (_intsetValueEncoding(value) > encoding) return value < 0 ? lo : hi;
+
+#if defined(__SSE2__)
+    if (encoding != INTSET_ENC_INT64) window = INTSET_SEARCH_WINDOW;
+#endif
+    while (hi-lo > window) {
+        uint32_t mid = lo+((hi-lo) >> 1);
+        if (_intsetGet(is,mid) < value)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+#if defined(__SSE2__)
+    /* The elements are sorted, so the ones smaller than the value are a
+     * prefix of every vector: count them, and stop at the first vector
+     * that is not entirely smaller. */
+    if (encoding == INTSET_ENC_INT16) {
+        const int16_t *p = (const int16_t*)is->contents;
+        __m128i v = _mm_set1_epi16((int16_t)value);
+        for (; hi-lo >= 8; lo += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(p+lo));
+            int mask = _mm_movemask_epi8(_mm_cmplt_epi16(x,v));
+            if (mask != 0xffff) return lo+__builtin_popcount(mask)/2;
+        }
+    } else if (encoding == INTSET_ENC_INT32) {
+        const int32_t *p = (const int32_t*)is->contents;
+        __m128i v = _mm_set1_epi32((int32_t)value);
+        for (; hi-lo >= 4; lo += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(p+lo));
+            int mask = _mm_movemask_epi8(_mm_cmplt_epi32(x,v));
+            if (mask != 0xffff) return lo+__builtin_popcount(mask)/4;
+        }
+    }
+#endif
+
+    while (lo < hi && _intsetGet(is,lo) < value) lo++;
+    return lo;
+}
+
+/* Like intsetLowerBound(), but optimized for values that are likely to be
+ * near "lo": the window is found by doubling its size, starting from
+ * INTSET_SEARCH_WINDOW elements. Used to merge sorted intsets. */
+static uint32_t intsetGallop(intset *is, uint32_t lo, uint32_t hi,
+                             int64_t value)
+{
+    uint32_t step = INTSET_SEARCH_WINDOW;
+
+    while (hi-lo > step && _intsetGet(is,lo+step-1) < value) {
+        lo += step;
+        step <<= 1;
+    }
+    if (hi-lo > step) hi = lo+step;
+    return intsetLowerBound(is,lo,hi,value);
+}
+
 /* Search for the position of "value". Return 1 when the value was found and
  * sets "pos" to the position of the value within the intset. Return 0 when
  * the value is not present in the intset and sets "pos" to the position
  * where "value" can be inserted. */
 static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
-    int min = 0, max = intrev32ifbe(is->length)-1, mid = -1;
-    int64_t cur = -1;
+    uint32_t len = intrev32ifbe(is->length), p;
 
     /* The value can never be found when the set is empty */
-    if (intrev32ifbe(is->length) == 0) {
+    if (len == 0) {
         if (pos) *pos = 0;
         return 0;
     } else {
         /* Check for the case where we know we cannot find the value,
          * but do know the insert position. */
-        if (value > _intsetGet(is,intrev32ifbe(is->length)-1)) {
-            if (pos) *pos = intrev32ifbe(is->length);
+        if (value > _intsetGet(is,len-1)) {
+            if (pos) *pos = len;
             return 0;
         } else if (value < _intsetGet(is,0)) {
             if (pos) *pos = 0;
@@ -132,25 +218,9 @@ static uint8_t intsetSearch(intset *is, int64_t value, uint32_t *pos) {
         }
     }
 
-    while(max >= min) {
-        mid = ((unsigned int)min + (unsigned int)max) >> 1;
-        cur = _intsetGet(is,mid);
-        if (value > cur) {
-            min = mid+1;
-        } else if (value < cur) {
-            max = mid-1;
-        } else {
-            break;
-        }
-    }
-
-    if (value == cur) {
-        if (pos) *pos = mid;
-        return 1;
-    } else {
-        if (pos) *pos = min;
-        return 0;
-    }
+    p = intsetLowerBound(is,0,len,value);
+    if (pos) *pos = p;
+    return p < len && _intsetGet(is,p) == value;
 }
 
 /* Upgrades the intset to a larger encoding and inserts the given integer. */
@@ -200,8 +270,8 @@ static void intsetMoveTail(intset *is, uint32_t from, uint32_t to) {
     memmove(dst,src,bytes);
 }
 
-/* Insert an integer in the intset */
-intset *intsetAdd(intset *is, int64_t value, uint8_t *success) {
+/* Insert an integer in a flat intset */
+static intset *intsetAddFlat(intset *is, int64_t value, uint8_t *success) {
     uint8_t valenc = _intsetValueEncoding(value);
     uint32_t pos;
     if (success) *success = 1;
@@ -230,8 +300,8 @@ intset *intsetAdd(intset *is, int64_t value, uint8_t *success) {
     return is;
 }
 
-/* Delete integer from intset */
-intset *intsetRemove(intset *is, int64_t value, int *success) {
+/* Delete integer from a flat intset */
+static intset *intsetRemoveFlat(intset *is, int64_t value, int *success) {
     uint8_t valenc = _intsetValueEncoding(value);
     uint32_t pos;
     if (success) *success = 0;
@@ -250,22 +320,388 @@ intset *intsetRemove(intset *is, int64_t value, int *success) {
     return is;
 }
 
-/* Determine whether a value belongs to this set */
-uint8_t intsetFind(intset *is, int64_t value) {
+/* Determine whether a value belongs to a flat intset */
+static uint8_t intsetFindFlat(intset *is, int64_t value) {
     uint8_t valenc = _intsetValueEncoding(value);
     return valenc <= intrev32ifbe(is->encoding) && intsetSearch(is,value,NULL);
 }
 
+/* ---------------------------------------------------------------------------
+ * Chunked intsets
+ * -------------------------------------------------------------------------*/
+
+/* Create a flat intset with the "len" sorted values of the array "v", using
+ * the smallest encoding that can represent all of them. */
+static intset *intsetFromArray(const int64_t *v, uint32_t len) {
+    intset *is = intsetNew();
+    uint8_t encoding = INTSET_ENC_INT16;
+
+    if (len) {
+        uint8_t first = _intsetValueEncoding(v[0]);
+        uint8_t last = _intsetValueEncoding(v[len-1]);
+        encoding = first > last ? first : last;
+    }
+    is->encoding = intrev32ifbe(encoding);
+    is = intsetResize(is,len);
+    for (uint32_t j = 0; j < len; j++) _intsetSet(is,j,v[j]);
+    is->length = intrev32ifbe(len);
+    return is;
+}
+
+/* Return a flat intset with the "len" elements of "is" starting at "from".
+ * Since the elements are sorted, the first and the last one are enough to
+ * know the smallest encoding the copy can use. */
+static intset *intsetSlice(intset *is, uint32_t from, uint32_t len) {
+    intset *slice = intsetNew();
+    uint8_t encoding = intrev32ifbe(is->encoding);
+    uint8_t first = _intsetValueEncoding(_intsetGet(is,from));
+    uint8_t last = _intsetValueEncoding(_intsetGet(is,from+len-1));
+    uint8_t newenc = first > last ? first : last;
+
+    slice->encoding = intrev32ifbe(newenc);
+    slice = intsetResize(slice,len);
+    if (newenc == encoding) {
+        memcpy(slice->contents,is->contents+(size_t)from*encoding,
+               (size_t)len*encoding);
+    } else {
+        for (uint32_t j = 0; j < len; j++)
+            _intsetSet(slice,j,_intsetGetEncoded(is,from+j,encoding));
+    }
+    slice->length = intrev32ifbe(len);
+    return slice;
+}
+
+/* Split a flat intset into chunks of INTSET_CHUNK_MAX_LEN/2 elements, so
+ * that every chunk has room to grow before it has to be split again. The
+ * flat intset is freed. */
+static intset *intsetSplit(intset *is) {
+    uint32_t len = intrev32ifbe(is->length);
+    uint32_t half = INTSET_CHUNK_MAX_LEN/2;
+    uint32_t count = (len+half-1)/half;
+    intsetChunks *ic = zmalloc(sizeof(*ic)+sizeof(intset*)*count);
+
+    ic->encoding = intrev32ifbe(INTSET_ENC_CHUNKED);
+    ic->length = intrev32ifbe(len);
+    ic->count = count;
+    ic->cache_idx = ic->cache_pos = 0;
+    for (uint32_t j = 0; j < count; j++) {
+        uint32_t from = j*half;
+        ic->chunks[j] = intsetSlice(is,from,len-from < half ? len-from : half);
+    }
+    zfree(is);
+    return (intset*)ic;
+}
+
+/* Return the encoding a flat copy of the chunked intset would use. */
+static uint8_t intsetChunksEncoding(intsetChunks *ic) {
+    uint8_t encoding = INTSET_ENC_INT16;
+    for (uint32_t j = 0; j < ic->count; j++) {
+        uint8_t e = intrev32ifbe(ic->chunks[j]->encoding);
+        if (e > encoding) encoding = e;
+    }
+    return encoding;
+}
+
+/* Return a flat intset with the elements of all the chunks of "ic". The
+ * chunked intset is not modified. */
+static intset *intsetChunksFlatten(intsetChunks *ic) {
+    intset *is = intsetNew();
+    uint8_t encoding = intsetChunksEncoding(ic);
+    uint32_t pos = 0;
+
+    is->encoding = intrev32ifbe(encoding);
+    is = intsetResize(is,intrev32ifbe(ic->length));
+    for (uint32_t j = 0; j < ic->count; j++) {
+        intset *c = ic->chunks[j];
+        uint32_t clen = intrev32ifbe(c->length);
+        uint8_t cenc = intrev32ifbe(c->encoding);
+
+        if (cenc == encoding) {
+            memcpy(is->contents+(size_t)pos*encoding,c->contents,
+                   (size_t)clen*encoding);
+        } else {
+            for (uint32_t i = 0; i < clen; i++)
+                _intsetSet(is,pos+i,_intsetGetEncoded(c,i,cenc));
+        }
+        pos += clen;
+    }
+    is->length = ic->length;
+    return is;
+}
+
+/* Return the index of the chunk that contains "value", or where "value"
+ * should be inserted: the first chunk whose last element is greater than or
+ * equal to the value, or the last chunk. */
+static uint32_t intsetChunksFind(intsetChunks *ic, int64_t value) {
+    uint32_t lo = 0, hi = ic->count-1;
+
+    while (lo < hi) {
+        uint32_t mid = (lo+hi) >> 1;
+        intset *c = ic->chunks[mid];
+        if (_intsetGet(c,intrev32ifbe(c->length)-1) < value)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the chunk holding the element at "*pos", and update "*pos" to the
+ * position of the element inside the chunk. The chunk found is remembered,
+ * so that accessing the elements in order, like iterators do, does not
+ * need to walk the chunks from the start at every call. */
+static intset *intsetChunksSeek(intsetChunks *ic, uint32_t *pos) {
+    uint32_t idx = 0, start = 0;
+
+    if (*pos >= ic->cache_pos) {
+        idx = ic->cache_idx;
+        start = ic->cache_pos;
+    }
+    while (*pos-start >= intrev32ifbe(ic->chunks[idx]->length)) {
+        start += intrev32ifbe(ic->chunks[idx]->length);
+        idx++;
+    }
+    ic->cache_idx = idx;
+    ic->cache_pos = start;
+    *pos -= start;
+    return ic->chunks[idx];
+}
+
+/* Replace the chunk at "idx" with the two halves of it. */
+static intsetChunks *intsetChunksSplitAt(intsetChunks *ic, uint32_t idx) {
+    intset *c = ic->chunks[idx];
+    uint32_t clen = intrev32ifbe(c->length);
+
+    ic = zrealloc(ic,sizeof(*ic)+sizeof(intset*)*(ic->count+1));
+    memmove(ic->chunks+idx+2,ic->chunks+idx+1,
+            sizeof(intset*)*(ic->count-idx-1));
+    ic->chunks[idx] = intsetSlice(c,0,clen/2);
+    ic->chunks[idx+1] = intsetSlice(c,clen/2,clen-clen/2);
+    ic->count++;
+    zfree(c);
+    return ic;
+}
+
+/* Remove the chunk at "idx" from the array of chunks, without freeing it. */
+static intsetChunks *intsetChunksDelAt(intsetChunks *ic, uint32_t idx) {
+    memmove(ic->chunks+idx,ic->chunks+idx+1,
+            sizeof(intset*)*(ic->count-idx-1));
+    ic->count--;
+    return zrealloc(ic,sizeof(*ic)+sizeof(intset*)*ic->count);
+}
+
+/* Merge the chunk at "idx" with the next one. */
+static intsetChunks *intsetChunksMergeAt(intsetChunks *ic, uint32_t idx) {
+    intset *a = ic->chunks[idx], *b = ic->chunks[idx+1], *c;
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    uint8_t aenc = intrev32ifbe(a->encoding), benc = intrev32ifbe(b->encoding);
+
+    c = intsetNew();
+    c->encoding = intrev32ifbe(aenc > benc ? aenc : benc);
+    c = intsetResize(c,alen+blen);
+    for (uint32_t j = 0; j < alen; j++)
+        _intsetSet(c,j,_intsetGetEncoded(a,j,aenc));
+    for (uint32_t j = 0; j < blen; j++)
+        _intsetSet(c,alen+j,_intsetGetEncoded(b,j,benc));
+    c->length = intrev32ifbe(alen+blen);
+    zfree(a);
+    zfree(b);
+    ic->chunks[idx] = c;
+    return intsetChunksDelAt(ic,idx+1);
+}
+
+static intset *intsetChunksAdd(intsetChunks *ic, int64_t value,
+                               uint8_t *success)
+{
+    uint32_t idx = intsetChunksFind(ic,value);
+    uint8_t added;
+
+    ic->chunks[idx] = intsetAddFlat(ic->chunks[idx],value,&added);
+    if (success) *success = added;
+    if (!added) return (intset*)ic;
+
+    ic->length = intrev32ifbe(intrev32ifbe(ic->length)+1);
+    ic->cache_idx = ic->cache_pos = 0;
+    if (intrev32ifbe(ic->chunks[idx]->length) > INTSET_CHUNK_MAX_LEN)
+        ic = intsetChunksSplitAt(ic,idx);
+    return (intset*)ic;
+}
+
+static intset *intsetChunksRemove(intsetChunks *ic, int64_t value,
+                                  int *success)
+{
+    uint32_t idx = intsetChunksFind(ic,value), clen;
+    int removed;
+
+    ic->chunks[idx] = intsetRemoveFlat(ic->chunks[idx],value,&removed);
+    if (success) *success = removed;
+    if (!removed) return (intset*)ic;
+
+    ic->length = intrev32ifbe(intrev32ifbe(ic->length)-1);
+    ic->cache_idx = ic->cache_pos = 0;
+
+    /* Go back to a flat intset once the set is small enough that moving
+     * its elements is cheap. Otherwise drop empty chunks, and merge small
+     * chunks with a neighbour so that the set does not degenerate into a
+     * lot of tiny chunks after many deletions. */
+    if (intrev32ifbe(ic->length) <= INTSET_CHUNK_MAX_LEN/2) {
+        intset *is = intsetChunksFlatten(ic);
+        intsetFree((intset*)ic);
+        return is;
+    }
+    clen = intrev32ifbe(ic->chunks[idx]->length);
+    if (clen == 0) {
+        zfree(ic->chunks[idx]);
+        ic = intsetChunksDelAt(ic,idx);
+    } else if (idx+1 < ic->count &&
+               clen+intrev32ifbe(ic->chunks[idx+1]->length) <=
+               INTSET_CHUNK_MAX_LEN/2)
+    {
+        ic = intsetChunksMergeAt(ic,idx);
+    } else if (idx > 0 &&
+               clen+intrev32ifbe(ic->chunks[idx-1]->length) <=
+               INTSET_CHUNK_MAX_LEN/2)
+    {
+        ic = intsetChunksMergeAt(ic,idx-1);
+    }
+    return (intset*)ic;
+}
+
+/* ---------------------------------------------------------------------------
+ * Merging intsets
+ * -------------------------------------------------------------------------*/
+
+/* A position in an intset, flat or chunked, used to walk the elements of
+ * intsets in order when computing intersections, unions and differences.
+ * Cursors don't use the position cache of chunked intsets. */
+typedef struct intsetCursor {
+    intset **chunks;    /* The chunks, or a pointer to a flat intset. */
+    uint32_t count;     /* Number of chunks. */
+    uint32_t idx;       /* Current chunk. */
+    uint32_t pos;       /* Current position inside the chunk. */
+} intsetCursor;
+
+static void intsetCursorInit(intsetCursor *c, intset **is) {
+    if (intsetIsChunked(*is)) {
+        c->chunks = INTSET_CHUNKS(*is)->chunks;
+        c->count = INTSET_CHUNKS(*is)->count;
+    } else {
+        c->chunks = is;
+        c->count = 1;
+    }
+    c->idx = 0;
+    c->pos = 0;
+}
+
+/* Return 1 if the cursor points to an element, moving it to the next chunk
+ * when it is at the end of the current one, or 0 at the end of the set. */
+static int intsetCursorValid(intsetCursor *c) {
+    while (c->idx < c->count &&
+           c->pos == intrev32ifbe(c->chunks[c->idx]->length))
+    {
+        c->idx++;
+        c->pos = 0;
+    }
+    return c->idx < c->count;
+}
+
+/* Return the element at the cursor, that must be valid. */
+static int64_t intsetCursorValue(intsetCursor *c) {
+    return _intsetGet(c->chunks[c->idx],c->pos);
+}
+
+/* Move the cursor forward to the first element greater than or equal to
+ * "value", or to the end of the set. Whole chunks are skipped checking only
+ * their last element, then the element is searched galloping from the
+ * current position, so seeking close values is cheap and seeking far values
+ * costs about a binary search. This makes merging two intsets adapt to
+ * their sizes: it is linear for sets of similar size, and close to a
+ * binary search per element of the smaller set when the other set is much
+ * larger. */
+static void intsetCursorSeek(intsetCursor *c, int64_t value) {
+    while (intsetCursorValid(c)) {
+        intset *is = c->chunks[c->idx];
+        uint32_t len = intrev32ifbe(is->length);
+
+        if (_intsetGet(is,len-1) < value) {
+            c->idx++;
+            c->pos = 0;
+            continue;
+        }
+        c->pos = intsetGallop(is,c->pos,len,value);
+        return;
+    }
+}
+
+/* Create an intset, flat or chunked according to its size, with the "len"
+ * sorted values of the array "v". The array is freed. */
+static intset *intsetFromSortedArray(int64_t *v, uint32_t len) {
+    intset *is = intsetFromArray(v,len);
+    zfree(v);
+    if (len > INTSET_CHUNK_MAX_LEN) is = intsetSplit(is);
+    return is;
+}
+
+/* ---------------------------------------------------------------------------
+ * Intset API
+ * -------------------------------------------------------------------------*/
+
+/* Free an intset, flat or chunked. */
+void intsetFree(intset *is) {
+    if (intsetIsChunked(is)) {
+        intsetChunks *ic = INTSET_CHUNKS(is);
+        for (uint32_t j = 0; j < ic->count; j++) zfree(ic->chunks[j]);
+    }
+    zfree(is);
+}
+
+/* Insert an integer in the intset */
+intset *intsetAdd(intset *is, int64_t value, uint8_t *success) {
+    if (intsetIsChunked(is))
+        return intsetChunksAdd(INTSET_CHUNKS(is),value,success);
+
+    is = intsetAddFlat(is,value,success);
+    if (intrev32ifbe(is->length) > INTSET_CHUNK_MAX_LEN) is = intsetSplit(is);
+    return is;
+}
+
+/* Delete integer from intset */
+intset *intsetRemove(intset *is, int64_t value, int *success) {
+    if (intsetIsChunked(is))
+        return intsetChunksRemove(INTSET_CHUNKS(is),value,success);
+    return intsetRemoveFlat(is,value,success);
+}
+
+/* Determine whether a value belongs to this set */
+uint8_t intsetFind(intset *is, int64_t value) {
+    if (intsetIsChunked(is)) {
+        intsetChunks *ic = INTSET_CHUNKS(is);
+        return intsetFindFlat(ic->chunks[intsetChunksFind(ic,value)],value);
+    }
+    return intsetFindFlat(is,value);
+}
+
 /* Return random member */
 int64_t intsetRandom(intset *is) {
-    return _intsetGet(is,rand()%intrev32ifbe(is->length));
+    uint32_t pos = rand()%intrev32ifbe(is->length);
+
+    if (intsetIsChunked(is)) {
+        intset *c = intsetChunksSeek(INTSET_CHUNKS(is),&pos);
+        return _intsetGet(c,pos);
+    }
+    return _intsetGet(is,pos);
 }
 
 /* Get the value at the given position. When this position is
  * out of range the function returns 0, when in range it returns 1. */
 uint8_t intsetGet(intset *is, uint32_t pos, int64_t *value) {
     if (pos < intrev32ifbe(is->length)) {
-        *value = _intsetGet(is,pos);
+        if (intsetIsChunked(is)) {
+            intset *c = intsetChunksSeek(INTSET_CHUNKS(is),&pos);
+            *value = _intsetGet(c,pos);
+        } else {
+            *value = _intsetGet(is,pos);
+        }
         return 1;
     }
     return 0;
@@ -276,9 +712,141 @@ uint32_t intsetLen(const intset *is) {
     return intrev32ifbe(is->length);
 }
 
-/* Return intset blob size in bytes. */
+/* Return intset blob size in bytes. For a chunked intset this is the size
+ * of the flat intset returned by intsetToBlob(). */
 size_t intsetBlobLen(intset *is) {
-    return sizeof(intset)+intrev32ifbe(is->length)*intrev32ifbe(is->encoding);
+    uint32_t encoding = intrev32ifbe(is->encoding);
+
+    if (encoding == INTSET_ENC_CHUNKED)
+        encoding = intsetChunksEncoding(INTSET_CHUNKS(is));
+    return sizeof(intset)+intrev32ifbe(is->length)*encoding;
+}
+
+/* Return the number of bytes used by the intset, chunks included. */
+size_t intsetAllocSize(intset *is) {
+    size_t size;
+
+    if (!intsetIsChunked(is)) return intsetBlobLen(is);
+
+    intsetChunks *ic = INTSET_CHUNKS(is);
+    size = sizeof(*ic)+sizeof(intset*)*ic->count;
+    for (uint32_t j = 0; j < ic->count; j++)
+        size += intsetBlobLen(ic->chunks[j]);
+    return size;
+}
+
+/* Return the intset as a flat intset, which is the serialized format of
+ * intsets, of intsetBlobLen() bytes. A flat intset is returned as it is,
+ * for a chunked intset a flat copy is created, that the caller should
+ * free with zfree() once done. */
+intset *intsetToBlob(intset *is) {
+    if (intsetIsChunked(is)) return intsetChunksFlatten(INTSET_CHUNKS(is));
+    return is;
+}
+
+/* Return a new intset with the elements both "a" and "b" contain. */
+intset *intsetIntersect(intset *a, intset *b) {
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    intsetCursor ac, bc;
+    int64_t *v;
+    uint32_t len = 0;
+
+    if (alen == 0 || blen == 0) return intsetNew();
+    v = zmalloc(sizeof(int64_t)*(alen < blen ? alen : blen));
+    intsetCursorInit(&ac,&a);
+    intsetCursorInit(&bc,&b);
+    while (intsetCursorValid(&ac) && intsetCursorValid(&bc)) {
+        int64_t aval = intsetCursorValue(&ac), bval;
+
+        intsetCursorSeek(&bc,aval);
+        if (!intsetCursorValid(&bc)) break;
+        bval = intsetCursorValue(&bc);
+        if (aval == bval) {
+            v[len++] = aval;
+            ac.pos++;
+            bc.pos++;
+        } else {
+            intsetCursorSeek(&ac,bval);
+        }
+    }
+    return intsetFromSortedArray(v,len);
+}
+
+/* Return a new intset with the elements of both "a" and "b". */
+intset *intsetUnion(intset *a, intset *b) {
+    uint32_t alen = intrev32ifbe(a->length), blen = intrev32ifbe(b->length);
+    intsetCursor ac, bc;
+    int64_t *v;
+    uint32_t len = 0;
+
+    if (alen == 0 && blen == 0) return intsetNew();
+    v = zmalloc(sizeof(int64_t)*((size_t)alen+blen));
+    intsetCursorInit(&ac,&a);
+    intsetCursorInit(&bc,&b);
+    while (intsetCursorValid(&ac) && intsetCursorValid(&bc)) {
+        int64_t aval = intsetCursorValue(&ac);
+        int64_t bval = intsetCursorValue(&bc);
+
+        if (aval <= bval) {
+            v[len++] = aval;
+            ac.pos++;
+            if (aval == bval) bc.pos++;
+        } else {
+            v[len++] = bval;
+            bc.pos++;
+        }
+    }
+    while (intsetCursorValid(&ac)) v[len++] = intsetCursorValue(&ac), ac.pos++;
+    while (intsetCursorValid(&bc)) v[len++] = intsetCursorValue(&bc), bc.pos++;
+    return intsetFromSortedArray(v,len);
+}
+
+/* Return a new intset with the elements of "a" that are not in "b". */
+intset *intsetDifference(intset *a, intset *b) {
+    uint32_t alen = intrev32ifbe(a->length);
+    intsetCursor ac, bc;
+    int64_t *v;
+    uint32_t len = 0;
+
+    if (alen == 0) return intsetNew();
+    v = zmalloc(sizeof(int64_t)*alen);
+    intsetCursorInit(&ac,&a);
+    intsetCursorInit(&bc,&b);
+    while (intsetCursorValid(&ac)) {
+        int64_t aval = intsetCursorValue(&ac);
+
+        intsetCursorSeek(&bc,aval);
+        if (!intsetCursorValid(&bc) || intsetCursorValue(&bc) != aval)
+            v[len++] = aval;
+        ac.pos++;
+    }
+    return intsetFromSortedArray(v,len);
+}
+
+/* Validate the integrity of a serialized intset of "size" bytes. When
+ * "deep" is 0 only the header is checked against the size, which is
+ * enough to access the intset safely, otherwise the elements are also
+ * checked to be sorted and unique. Return 1 if the intset is valid. */
+int intsetValidateIntegrity(const unsigned char *p, size_t size, int deep) {
+    intset *is = (intset*)p;
+    uint32_t encoding, len;
+
+    if (size < sizeof(*is)) return 0;
+
+    /* A chunked intset is never serialized. */
+    encoding = intrev32ifbe(is->encoding);
+    if (encoding != INTSET_ENC_INT64 &&
+        encoding != INTSET_ENC_INT32 &&
+        encoding != INTSET_ENC_INT16) return 0;
+
+    len = intrev32ifbe(is->length);
+    if (sizeof(*is)+(size_t)len*encoding != size) return 0;
+
+    if (deep) {
+        for (uint32_t j = 1; j < len; j++)
+            if (_intsetGet(is,j-1) >= _intsetGet(is,j)) return 0;
+    }
+    return 1;
 }
 
 #ifdef REDIS_TEST
@@ -332,7 +900,27 @@ static intset *createSet(int bits, int size) {
 }
 
 static void checkConsistency(intset *is) {
-    for (uint32_t i = 0; i < (intrev32ifbe(is->length)-1); i++) {
+    if (intsetIsChunked(is)) {
+        intsetChunks *ic = INTSET_CHUNKS(is);
+        uint32_t len = 0;
+        int64_t prev = 0, cur;
+
+        for (uint32_t j = 0; j < ic->count; j++) {
+            uint32_t clen = intrev32ifbe(ic->chunks[j]->length);
+            assert(clen > 0 && clen <= INTSET_CHUNK_MAX_LEN);
+            checkConsistency(ic->chunks[j]);
+            len += clen;
+        }
+        assert(len == intrev32ifbe(is->length));
+        for (uint32_t i = 0; i < len; i++) {
+            assert(intsetGet(is,i,&cur));
+            assert(i == 0 || prev < cur);
+            prev = cur;
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i+1 < intrev32ifbe(is->length); i++) {
         uint32_t encoding = intrev32ifbe(is->encoding);
 
         if (encoding == INTSET_ENC_INT16) {
@@ -348,6 +936,44 @@ static void checkConsistency(intset *is) {
     }
 }
 
+/* The scalar binary search intsetSearch() used before the SIMD window, as
+ * a reference for the tests and benchmarks. */
+static uint8_t intsetSearchSlow(intset *is, int64_t value, uint32_t *pos) {
+    int min = 0, max = intrev32ifbe(is->length)-1, mid = -1;
+    int64_t cur = -1;
+
+    if (_intsetValueEncoding(value) > intrev32ifbe(is->encoding) ||
+        intrev32ifbe(is->length) == 0)
+    {
+        *pos = value < 0 ? 0 : intrev32ifbe(is->length);
+        return 0;
+    }
+    while(max >= min) {
+        mid = ((unsigned int)min + (unsigned int)max) >> 1;
+        cur = _intsetGet(is,mid);
+        if (value > cur) {
+            min = mid+1;
+        } else if (value < cur) {
+            max = mid-1;
+        } else {
+            break;
+        }
+    }
+    if (value == cur) {
+        *pos = mid;
+        return 1;
+    } else {
+        *pos = min;
+        return 0;
+    }
+}
+
+static int64_t randomValue(int bits) {
+    int64_t v = ((int64_t)rand() << 32) ^ rand();
+    v &= ((uint64_t)1 << (bits-1))-1;
+    return rand()&1 ? v : -v;
+}
+
 #define UNUSED(x) (void)(x)
 int intsetTest(int argc, char **argv) {
     uint8_t success;
@@ -466,9 +1092,204 @@ int intsetTest(int argc, char **argv) {
         checkConsistency(is);
 
         start = usec();
-        for (i = 0; i < num; i++) intsetSearch(is,rand() % ((1<<bits)-1),NULL);
+        for (i = 0; i < num; i++) intsetFind(is,rand() % ((1<<bits)-1));
         printf("%ld lookups, %ld element set, %lldusec\n",
                num,size,usec()-start);
+        intsetFree(is);
+    }
+
+    printf("Search against a reference implementation: "); {
+        int bits[] = {16, 32, 64};
+        for (int b = 0; b < 3; b++) {
+            for (int iter = 0; iter < 200; iter++) {
+                int size = rand() % (INTSET_CHUNK_MAX_LEN+1);
+                uint32_t pos, slowpos;
+                uint8_t found, slowfound;
+
+                is = intsetNew();
+                for (i = 0; i < size; i++)
+                    is = intsetAdd(is,randomValue(bits[b]),NULL);
+                assert(!intsetIsChunked(is));
+                for (i = 0; i < 1000; i++) {
+                    int64_t v;
+                    if (intsetLen(is) && rand()&1)
+                        intsetGet(is,rand()%intsetLen(is),&v);
+                    else
+                        v = randomValue(bits[rand()%3]);
+                    found = intsetFind(is,v);
+                    slowfound = intsetSearchSlow(is,v,&slowpos);
+                    assert(found == slowfound);
+                    if (_intsetValueEncoding(v) <= intrev32ifbe(is->encoding)) {
+                        assert(intsetSearch(is,v,&pos) == slowfound);
+                        assert(pos == slowpos);
+                    }
+                }
+                intsetFree(is);
+            }
+        }
+        ok();
+    }
+
+    printf("Chunked intsets: "); {
+        int64_t v;
+        uint32_t len = 0;
+        is = intsetNew();
+        for (i = 0; i < 100000; i++) {
+            is = intsetAdd(is,(i*7919)%100000 - 50000,&success);
+            assert(success);
+            if (i == INTSET_CHUNK_MAX_LEN-1) assert(!intsetIsChunked(is));
+            if (i == INTSET_CHUNK_MAX_LEN) assert(intsetIsChunked(is));
+        }
+        assert(intsetLen(is) == 100000);
+        checkConsistency(is);
+        for (i = 0; i < 100000; i++) {
+            assert(intsetGet(is,i,&v) && v == i-50000);
+            assert(intsetFind(is,v));
+        }
+        assert(!intsetGet(is,100000,&v));
+        assert(!intsetFind(is,50000) && !intsetFind(is,-50001));
+
+        /* Chunks have their own encoding. */
+        is = intsetAdd(is,(int64_t)1<<40,NULL);
+        is = intsetAdd(is,-((int64_t)1<<40),NULL);
+        assert(intsetFind(is,(int64_t)1<<40) && intsetFind(is,-((int64_t)1<<40)));
+        assert(intsetAllocSize(is) < 100002*sizeof(int32_t));
+        checkConsistency(is);
+
+        /* The blob is a flat copy of the chunked intset. */
+        intset *blob = intsetToBlob(is);
+        assert(blob != is && !intsetIsChunked(blob));
+        assert(intsetBlobLen(blob) == intsetBlobLen(is));
+        assert(intsetBlobLen(blob) == sizeof(intset)+100002*sizeof(int64_t));
+        assert(intsetValidateIntegrity((unsigned char*)blob,intsetBlobLen(blob),1));
+        assert(!intsetValidateIntegrity((unsigned char*)blob,intsetBlobLen(blob)-1,1));
+        for (i = 0; i < 100002; i++) {
+            int64_t v1, v2;
+            assert(intsetGet(is,i,&v1) && intsetGet(blob,i,&v2) && v1 == v2);
+        }
+        zfree(blob);
+
+        /* Removing elements merges chunks, and eventually the intset goes
+         * back to a flat one. */
+        len = intsetLen(is);
+        for (i = 0; i < 100000; i += 2) {
+            int removed;
+            is = intsetRemove(is,i-50000,&removed);
+            assert(removed);
+            len--;
+        }
+        is = intsetRemove(is,-50000,&i);
+        assert(!i);
+        assert(intsetLen(is) == len);
+        checkConsistency(is);
+        for (i = 1; i < 100000-2000; i += 2)
+            is = intsetRemove(is,i-50000,NULL);
+        checkConsistency(is);
+        assert(intsetIsChunked(is));
+        for (; i < 100000; i += 2) is = intsetRemove(is,i-50000,NULL);
+        assert(intsetLen(is) == 2);
+        assert(!intsetIsChunked(is));
+        checkConsistency(is);
+        intsetFree(is);
+        ok();
+    }
+
+    printf("Intersection, union and difference: "); {
+        for (int iter = 0; iter < 100; iter++) {
+            int asize = rand() % 5000, bsize = rand() % 5000;
+            int range = 1 + rand() % 20000, bits = rand()&1 ? 16 : 64;
+            intset *a = intsetNew(), *b = intsetNew(), *inter;
+            int64_t v;
+            uint32_t j, expected = 0;
+
+            if (iter % 4 == 0) asize = rand() % 10;
+            for (i = 0; i < asize; i++) {
+                v = rand() % range;
+                if (bits == 64 && rand()%10 == 0) v = randomValue(64);
+                a = intsetAdd(a,v,NULL);
+            }
+            for (i = 0; i < bsize; i++) b = intsetAdd(b,rand() % range,NULL);
+            inter = intsetIntersect(a,b);
+            checkConsistency(inter);
+            for (j = 0; j < intsetLen(a); j++) {
+                intsetGet(a,j,&v);
+                if (intsetFind(b,v)) {
+                    assert(intsetFind(inter,v));
+                    expected++;
+                }
+            }
+            assert(intsetLen(inter) == expected);
+            intsetFree(inter);
+            inter = intsetIntersect(b,a);
+            assert(intsetLen(inter) == expected);
+            intsetFree(inter);
+
+            intset *uni = intsetUnion(a,b), *diff = intsetDifference(a,b);
+            checkConsistency(uni);
+            checkConsistency(diff);
+            assert(intsetLen(uni) == intsetLen(a)+intsetLen(b)-expected);
+            assert(intsetLen(diff) == intsetLen(a)-expected);
+            for (j = 0; j < intsetLen(uni); j++) {
+                intsetGet(uni,j,&v);
+                assert(intsetFind(a,v) || intsetFind(b,v));
+            }
+            for (j = 0; j < intsetLen(diff); j++) {
+                intsetGet(diff,j,&v);
+                assert(intsetFind(a,v) && !intsetFind(b,v));
+            }
+            intsetFree(uni);
+            intsetFree(diff);
+            intsetFree(a);
+            intsetFree(b);
+        }
+        ok();
+    }
+
+    printf("Benchmark search:\n"); {
+        int sizes[] = {16, 128, 512, 1024};
+        int bits[] = {16, 32, 64};
+        long num = 2000000;
+        int *idx = zmalloc(sizeof(int)*num);
+        for (int b = 0; b < 3; b++) {
+            for (int s = 0; s < 4; s++) {
+                long long start, fast, slow;
+                unsigned long hits = 0;
+                uint32_t pos;
+
+                is = intsetNew();
+                while (intsetLen(is) < (uint32_t)sizes[s])
+                    is = intsetAdd(is,randomValue(bits[b]),NULL);
+                for (i = 0; i < num; i++) idx[i] = rand() % sizes[s];
+                start = usec();
+                for (i = 0; i < num; i++) {
+                    int64_t v;
+                    intsetGet(is,idx[i],&v);
+                    hits += intsetSearch(is,v+(i&1),&pos);
+                }
+                fast = usec()-start;
+                start = usec();
+                for (i = 0; i < num; i++) {
+                    int64_t v;
+                    intsetGet(is,idx[i],&v);
+                    hits += intsetSearchSlow(is,v+(i&1),&pos);
+                }
+                slow = usec()-start;
+                printf("    int%d, %d elements: %lldusec, scalar %lldusec, "
+                       "%lu found\n",bits[b],sizes[s],fast,slow,hits);
+                intsetFree(is);
+            }
+        }
+        zfree(idx);
+    }
+
+    printf("Benchmark adds to a large intset: "); {
+        long long start = usec();
+        is = intsetNew();
+        for (i = 0; i < 200000; i++)
+            is = intsetAdd(is,rand() % 100000000,NULL);
+        printf("%u elements, %lldusec\n",intsetLen(is),usec()-start);
+        checkConsistency(is);
+        intsetFree(is);
     }
 
     printf("Stress add+delete: "); {
@@ -38,7 +38,27 @@ typedef struct intset {
     int8_t contents[];
 } intset;
 
+/* Intsets with more than INTSET_CHUNK_MAX_LEN elements are split into
+ * chunks, each one a flat intset with its own encoding, so that adding or
+ * removing an element only moves the elements of one chunk. The header of
+ * a chunked intset starts like a flat intset, with INTSET_ENC_CHUNKED as
+ * encoding and the total number of elements as length. Chunked intsets are
+ * never serialized, see intsetToBlob(). */
+#define INTSET_ENC_CHUNKED 0
+#define INTSET_CHUNK_MAX_LEN 1024
+
+typedef struct intsetChunks {
+    uint32_t encoding;
+    uint32_t length;
+    uint32_t count;     /* Number of chunks. */
+    uint32_t cache_idx; /* Last chunk accessed by position, and the */
+    uint32_t cache_pos; /* position of its first element. */
+    intset *chunks[];
+} intsetChunks;
+
 intset *intsetNew(void);
+void intsetFree(intset *is);
+int intsetIsChunked(const intset *is);
 intset *intsetAdd(intset *is, int64_t value, uint8_t *success);
 intset *intsetRemove(intset *is, int64_t value, int *success);
 uint8_t intsetFind(intset *is, int64_t value);
@@ -46,6 +66,12 @@ int64_t intsetRandom(intset *is);
 uint8_t intsetGet(intset *is, uint32_t pos, int64_t *value);
 uint32_t intsetLen(const intset *is);
 size_t intsetBlobLen(intset *is);
+size_t intsetAllocSize(intset *is);
+intset *intsetToBlob(intset *is);
+intset *intsetIntersect(intset *a, intset *b);
+intset *intsetUnion(intset *a, intset *b);
+intset *intsetDifference(intset *a, intset *b);
+int intsetValidateIntegrity(const unsigned char *is, size_t size, int deep);
 
 #ifdef REDIS_TEST
 int intsetTest(int argc, char *argv[]);
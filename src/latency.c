@@ -229,6 +229,7 @@ sds createLatencyReport(void) {
     int advise_hz = 0;              /* Use higher HZ. */
     int advise_large_objects = 0;   /* Deletion of large objects. */
     int advise_mass_eviction = 0;   /* Avoid mass eviction of keys. */
+    int advise_lazyfree = 0;        /* Release large objects lazily. */
     int advise_relax_fsync_policy = 0; /* appendfsync always is slow. */
     int advise_disable_thp = 0;     /* AnonHugePages detected. */
     int advices = 0;
@@ -364,9 +365,17 @@ sds createLatencyReport(void) {
             advices += 2;
         }
 
+        /* Deletion of expired keys. */
+        if (!strcasecmp(event,"expire-del")) {
+            advise_large_objects = 1;
+            if (!server.lazyfree_lazy_expire) advise_lazyfree = 1;
+            advices++;
+        }
+
         /* Eviction cycle. */
         if (!strcasecmp(event,"eviction-del")) {
             advise_large_objects = 1;
+            if (!server.lazyfree_lazy_eviction) advise_lazyfree = 1;
             advices++;
         }
 
@@ -458,6 +467,10 @@ sds createLatencyReport(void) {
             report = sdscat(report,"- Deleting, expiring or evicting (because of maxmemory policy) large objects is a blocking operation. If you have very large objects that are often deleted, expired, or evicted, try to fragment those objects into multiple smaller objects.\n");
         }
 
+        if (advise_lazyfree) {
+            report = sdscat(report,"- Expired or evicted keys are released synchronously. Large values can be released in a background thread, like the UNLINK command does, setting 'lazyfree-lazy-expire' and 'lazyfree-lazy-eviction' to 'yes' via CONFIG SET. The 'expire-del' and 'eviction-del' events will then only account for the time needed to unlink the keys.\n");
+        }
+
         if (advise_mass_eviction) {
             report = sdscat(report,"- Sudden changes to the 'maxmemory' setting via 'CONFIG SET', or allocation of large objects via sets or sorted sets intersections, STORE option of SORT, Redis Cluster large keys migrations (RESTORE command), may create sudden memory pressure forcing the server to block trying to evict keys. \n");
         }
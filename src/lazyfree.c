@@ -5,6 +5,20 @@
 
 static size_t lazyfree_objects = 0;
 pthread_mutex_t lazyfree_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t lazyfreed_objects = 0;
+pthread_mutex_t lazyfreed_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* A database released asynchronously. Big databases are split in parts
+ * that different lazyfree threads release in parallel: the last thread
+ * completing its part releases the hash tables themselves. */
+#define LAZYFREE_DB_PART_KEYS 65536 /* Min keys to assign to a thread. */
+typedef struct lazyfreeDbJob {
+    dict *ht1, *ht2;
+    size_t numkeys;
+    int parts;
+    int parts_left;
+    pthread_mutex_t parts_left_mutex;
+} lazyfreeDbJob;
 
 /* Return the number of currently pending objects to free. */
 size_t lazyfreeGetPendingObjectsCount(void) {
@@ -13,6 +27,13 @@ size_t lazyfreeGetPendingObjectsCount(void) {
     return aux;
 }
 
+/* Return the number of objects released by the lazyfree threads so far. */
+size_t lazyfreeGetFreedObjectsCount(void) {
+    size_t aux;
+    atomicGet(lazyfreed_objects,aux);
+    return aux;
+}
+
 /* Return the amount of work needed in order to free an object.
  * The return value is not always the actual number of allocations the
  * object is compoesd of, but a number proportional to it.
@@ -52,53 +73,75 @@ size_t lazyfreeGetFreeEffort(robj *obj) {
  * will be reclaimed in a different bio.c thread. */
 #define LAZYFREE_THRESHOLD 64
 int dbAsyncDelete(redisDb *db, robj *key) {
+    rdbForklessTouchKey(db,key->ptr);
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
     if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
 
-    /* If the value is composed of a few allocations, to free in a lazy way
-     * is actually just slower... So under a certain limit we just free
-     * the object synchronously. */
+    /* The value is handed to freeObjAsync(), that releases it in the
+     * background unless it is small, then the entry is released with
+     * just the key. */
     dictEntry *de = dictUnlink(db->dict,key->ptr);
     if (de) {
-        robj *val = dictGetVal(de);
-        size_t free_effort = lazyfreeGetFreeEffort(val);
-
-        /* If releasing the object is too much work, do it in the background
-         * by adding the object to the lazy free list.
-         * Note that if the object is shared, to reclaim it now it is not
-         * possible. This rarely happens, however sometimes the implementation
-         * of parts of the Redis core may call incrRefCount() to protect
-         * objects, and then call dbDelete(). In this case we'll fall
-         * through and reach the dictFreeUnlinkedEntry() call, that will be
-         * equivalent to just calling decrRefCount(). */
-        if (free_effort > LAZYFREE_THRESHOLD && val->refcount == 1) {
-            atomicIncr(lazyfree_objects,1);
-            bioCreateBackgroundJob(BIO_LAZY_FREE,val,NULL,NULL);
-            dictSetVal(db->dict,de,NULL);
-        }
-    }
-
-    /* Release the key-val pair, or just the key if we set the val
-     * field to NULL in order to lazy free it later. */
-    if (de) {
+        freeObjAsync(dictGetVal(de));
+        dictSetVal(db->dict,de,NULL);
         dictFreeUnlinkedEntry(db->dict,de);
         if (server.cluster_enabled) slotToKeyDel(key);
+        keyIndexDel(db,key);
         return 1;
     } else {
         return 0;
     }
 }
 
+/* Release the reference to the object 'o' owned by the caller. If the value
+ * is composed of a few allocations, to free in a lazy way is actually just
+ * slower... So under a certain limit we just free the object synchronously.
+ * Otherwise it is released in the background by the lazyfree threads.
+ *
+ * Note that if the object is shared, to reclaim it now it is not possible.
+ * This rarely happens, however sometimes the implementation of parts of the
+ * Redis core may call incrRefCount() to protect objects, and then delete
+ * the key. In this case we just call decrRefCount(). */
+void freeObjAsync(robj *o) {
+    size_t free_effort = lazyfreeGetFreeEffort(o);
+    if (free_effort > LAZYFREE_THRESHOLD && o->refcount == 1) {
+        atomicIncr(lazyfree_objects,1);
+        bioCreateBackgroundJob(BIO_LAZY_FREE,o,NULL,NULL);
+    } else {
+        decrRefCount(o);
+    }
+}
+
 /* Empty a Redis DB asynchronously. What the function does actually is to
  * create a new empty set of hash tables and scheduling the old ones for
- * lazy freeing. */
+ * lazy freeing, as a batch of jobs, one for every part of the DB. */
 void emptyDbAsync(redisDb *db) {
     dict *oldht1 = db->dict, *oldht2 = db->expires;
+    lazyfreeDbJob *job = zmalloc(sizeof(*job));
+    void *jobs[LAZYFREE_THREADS_MAX_NUM], *parts[LAZYFREE_THREADS_MAX_NUM];
+    int j;
+
+    /* Values sent to clients by reference can't be released by the
+     * lazyfree threads while the replies are pending. */
+    unshareClientsReplyObjects();
     db->dict = dictCreate(&dbDictType,NULL);
     db->expires = dictCreate(&keyptrDictType,NULL);
-    atomicIncr(lazyfree_objects,dictSize(oldht1));
-    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,oldht1,oldht2);
+    job->ht1 = oldht1;
+    job->ht2 = oldht2;
+    job->numkeys = dictSize(oldht1);
+    job->parts = bioWorkersOfType(BIO_LAZY_FREE);
+    if ((size_t)job->parts > job->numkeys/LAZYFREE_DB_PART_KEYS)
+        job->parts = job->numkeys/LAZYFREE_DB_PART_KEYS;
+    if (job->parts == 0) job->parts = 1;
+    job->parts_left = job->parts;
+    pthread_mutex_init(&job->parts_left_mutex,NULL);
+    for (j = 0; j < job->parts; j++) {
+        jobs[j] = job;
+        parts[j] = (void*)(long)j;
+    }
+    atomicIncr(lazyfree_objects,job->numkeys);
+    bioCreateBackgroundJobs(BIO_LAZY_FREE,job->parts,NULL,jobs,parts);
 }
 
 /* Empty the slots-keys map of Redis CLuster by creating a new empty one
@@ -113,23 +156,45 @@ void slotToKeyFlushAsync(void) {
     bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,NULL,old);
 }
 
+/* Empty the keys index of a DB by creating a new empty one and scheduling
+ * the old for lazy freeing. */
+void keyIndexFlushAsync(redisDb *db) {
+    rax *old = db->keys_index;
+
+    db->keys_index = raxNew();
+    atomicIncr(lazyfree_objects,old->numele);
+    bioCreateBackgroundJob(BIO_LAZY_FREE,NULL,NULL,old);
+}
+
 /* Release objects from the lazyfree thread. It's just decrRefCount()
  * updating the count of objects to release. */
 void lazyfreeFreeObjectFromBioThread(robj *o) {
     decrRefCount(o);
     atomicDecr(lazyfree_objects,1);
+    atomicIncr(lazyfreed_objects,1);
 }
 
-/* Release a database from the lazyfree thread. The 'db' pointer is the
- * database which was substitutied with a fresh one in the main thread
- * when the database was logically deleted. 'sl' is a skiplist used by
- * Redis Cluster in order to take the hash slots -> keys mapping. This
- * may be NULL if Redis Cluster is disabled. */
-void lazyfreeFreeDatabaseFromBioThread(dict *ht1, dict *ht2) {
-    size_t numkeys = dictSize(ht1);
-    dictRelease(ht1);
-    dictRelease(ht2);
-    atomicDecr(lazyfree_objects,numkeys);
+/* Release a part of a database from the lazyfree thread. The 'job' is the
+ * lazyfreeDbJob referencing the hash tables of the database which was
+ * substitutied with a fresh one in the main thread when the database was
+ * logically deleted. When a single part is used the tables are released
+ * as usually, otherwise every thread empties its part of the main table,
+ * and the last one to finish releases the tables. */
+void lazyfreeFreeDatabaseFromBioThread(void *ptr, long part) {
+    lazyfreeDbJob *job = ptr;
+    int parts_left;
+
+    if (job->parts > 1) {
+        dictEmptyPart(job->ht1,part,job->parts);
+        atomicGetIncr(job->parts_left,parts_left,-1);
+        if (parts_left != 1) return;
+    }
+    dictRelease(job->ht1);
+    dictRelease(job->ht2);
+    atomicDecr(lazyfree_objects,job->numkeys);
+    atomicIncr(lazyfreed_objects,job->numkeys);
+    pthread_mutex_destroy(&job->parts_left_mutex);
+    zfree(job);
 }
 
 /* Release the skiplist mapping Redis Cluster keys to slots in the
@@ -138,4 +203,5 @@ void lazyfreeFreeSlotsMapFromBioThread(rax *rt) {
     size_t len = rt->numele;
     raxFree(rt);
     atomicDecr(lazyfree_objects,len);
+    atomicIncr(lazyfreed_objects,len);
 }
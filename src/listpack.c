@@ -0,0 +1,1632 @@
+/* Listpack -- A lists of strings serialization format
+ *
+ * The listpack is a compact representation of a list of strings and
+ * integers, used for small hashes, sorted sets and for the nodes of
+ * quicklists. It replaces the ziplist: the two have similar memory usage,
+ * however every listpack entry only stores its own length, while a ziplist
+ * entry stores the length of the previous entry. Because of this in a
+ * ziplist an insertion or a deletion could change the size of the following
+ * entry, which could change the size of the entry after it, and so forth
+ * (the so called "cascading update"), making updates O(N^2) in the worst
+ * case. In a listpack an update never touches other entries.
+ *
+ * LISTPACK OVERALL LAYOUT
+ * =======================
+ *
+ * <tot-bytes> <num-elements> <element-1> ... <element-N> <listpack-end-byte>
+ *
+ * <tot-bytes> is a 32 bit unsigned integer holding the total amount of bytes
+ * of the listpack, including the header itself.
+ *
+ * <num-elements> is a 16 bit unsigned integer holding the number of elements.
+ * When the number of elements is 65535 or greater the field is set to 65535,
+ * meaning that the number is unknown, and lpLength() has to scan the whole
+ * listpack to compute it.
+ *
+ * <listpack-end-byte> is a single byte set to 255 (0xFF).
+ *
+ * Both the header fields are stored in little endian.
+ *
+ * ELEMENTS LAYOUT
+ * ===============
+ *
+ * <encoding-type><element-data><element-tot-len>
+ *
+ * The encoding type specifies if the element is an integer or a string, and
+ * how big it is. The first bits of the first byte tell the encoding:
+ *
+ * |0xxxxxxx| 7 bit unsigned integer, stored in the encoding byte itself.
+ * |10xxxxxx| String of up to 63 bytes, the length is in the 6 bits.
+ * |110xxxxx|yyyyyyyy| 13 bit signed integer.
+ * |1110xxxx|yyyyyyyy| String of up to 4095 bytes, the length is in the
+ *                     12 bits.
+ * |11110000|<4 bytes len>| String of up to 2^32-1 bytes.
+ * |11110001|<2 bytes>| 16 bit signed integer.
+ * |11110010|<3 bytes>| 24 bit signed integer.
+ * |11110011|<4 bytes>| 32 bit signed integer.
+ * |11110100|<8 bytes>| 64 bit signed integer.
+ * |11111111| End of the listpack.
+ *
+ * Multi byte lengths and integers are stored in little endian, negative
+ * integers in two's complement. Strings that can be represented as integers
+ * are always stored as integers.
+ *
+ * <element-tot-len> is the length of the encoding type plus the element data,
+ * and is what allows to traverse the listpack from right to left. It is
+ * stored in 1 to 5 bytes, each byte holding 7 bits of the length: the first
+ * byte is the most significant, and every byte except the first has the
+ * most significant bit set, so that the length can be parsed starting from
+ * its last byte, that is, from the start of the next element.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Copyright (c) 2018, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "zmalloc.h"
+#include "util.h"
+#include "listpack.h"
+#include "redisassert.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define LP_HDR_SIZE 6       /* 32 bit total len + 16 bit number of elements. */
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_MAX_INT_ENCODING_LEN 9
+#define LP_MAX_BACKLEN_SIZE 5
+#define LP_ENCODING_INT 0
+#define LP_ENCODING_STRING 1
+
+#define LP_ENCODING_7BIT_UINT 0
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_IS_7BIT_UINT(byte) (((byte)&LP_ENCODING_7BIT_UINT_MASK)==LP_ENCODING_7BIT_UINT)
+
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_IS_6BIT_STR(byte) (((byte)&LP_ENCODING_6BIT_STR_MASK)==LP_ENCODING_6BIT_STR)
+
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_IS_13BIT_INT(byte) (((byte)&LP_ENCODING_13BIT_INT_MASK)==LP_ENCODING_13BIT_INT)
+
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_IS_12BIT_STR(byte) (((byte)&LP_ENCODING_12BIT_STR_MASK)==LP_ENCODING_12BIT_STR)
+
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+#define LP_ENCODING_32BIT_STR 0xF0
+
+#define LP_EOF 0xFF
+
+#define LP_ENCODING_6BIT_STR_LEN(p) ((p)[0] & 0x3F)
+#define LP_ENCODING_12BIT_STR_LEN(p) ((((p)[0] & 0xF) << 8) | (p)[1])
+#define LP_ENCODING_32BIT_STR_LEN(p) (((uint32_t)(p)[1]<<0) | \
+                                      ((uint32_t)(p)[2]<<8) | \
+                                      ((uint32_t)(p)[3]<<16) | \
+                                      ((uint32_t)(p)[4]<<24))
+
+#define lpGetTotalBytes(p)           (((uint32_t)(p)[0]<<0) | \
+                                      ((uint32_t)(p)[1]<<8) | \
+                                      ((uint32_t)(p)[2]<<16) | \
+                                      ((uint32_t)(p)[3]<<24))
+
+#define lpGetNumElements(p)          (((uint32_t)(p)[4]<<0) | \
+                                      ((uint32_t)(p)[5]<<8))
+#define lpSetTotalBytes(p,v) do { \
+    (p)[0] = (v)&0xff; \
+    (p)[1] = ((v)>>8)&0xff; \
+    (p)[2] = ((v)>>16)&0xff; \
+    (p)[3] = ((v)>>24)&0xff; \
+} while(0)
+
+#define lpSetNumElements(p,v) do { \
+    (p)[4] = (v)&0xff; \
+    (p)[5] = ((v)>>8)&0xff; \
+} while(0)
+
+/* Create a new, empty listpack, with room for 'capacity' bytes before a
+ * reallocation is needed. */
+unsigned char *lpNew(size_t capacity) {
+    unsigned char *lp = zmalloc(capacity > LP_HDR_SIZE+1 ? capacity : LP_HDR_SIZE+1);
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* Free the specified listpack. */
+void lpFree(unsigned char *lp) {
+    zfree(lp);
+}
+
+/* Release the memory allocated in excess of the listpack size. */
+unsigned char *lpShrinkToFit(unsigned char *lp) {
+    size_t size = lpGetTotalBytes(lp);
+    if (size < zmalloc_size(lp)) return zrealloc(lp,size);
+    return lp;
+}
+
+/* Store in 'intenc' the smallest encoding of the integer 'v', and its
+ * length in '*enclen'. */
+static void lpEncodeIntegerGetType(int64_t v, unsigned char *intenc, uint64_t *enclen) {
+    if (v >= 0 && v <= 127) {
+        /* Single byte 0-127 integer. */
+        intenc[0] = v;
+        *enclen = 1;
+    } else if (v >= -4096 && v <= 4095) {
+        /* 13 bit integer. */
+        if (v < 0) v = ((int64_t)1<<13)+v;
+        intenc[0] = (v>>8)|LP_ENCODING_13BIT_INT;
+        intenc[1] = v&0xff;
+        *enclen = 2;
+    } else if (v >= -32768 && v <= 32767) {
+        /* 16 bit integer. */
+        if (v < 0) v = ((int64_t)1<<16)+v;
+        intenc[0] = LP_ENCODING_16BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = v>>8;
+        *enclen = 3;
+    } else if (v >= -8388608 && v <= 8388607) {
+        /* 24 bit integer. */
+        if (v < 0) v = ((int64_t)1<<24)+v;
+        intenc[0] = LP_ENCODING_24BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = v>>16;
+        *enclen = 4;
+    } else if (v >= -2147483648 && v <= 2147483647) {
+        /* 32 bit integer. */
+        if (v < 0) v = ((int64_t)1<<32)+v;
+        intenc[0] = LP_ENCODING_32BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = (v>>16)&0xff;
+        intenc[4] = v>>24;
+        *enclen = 5;
+    } else {
+        /* 64 bit integer. */
+        uint64_t uv = v;
+        intenc[0] = LP_ENCODING_64BIT_INT;
+        intenc[1] = uv&0xff;
+        intenc[2] = (uv>>8)&0xff;
+        intenc[3] = (uv>>16)&0xff;
+        intenc[4] = (uv>>24)&0xff;
+        intenc[5] = (uv>>32)&0xff;
+        intenc[6] = (uv>>40)&0xff;
+        intenc[7] = (uv>>48)&0xff;
+        intenc[8] = uv>>56;
+        *enclen = 9;
+    }
+}
+
+/* Return LP_ENCODING_INT if the element can be represented as an integer,
+ * in which case its encoding is stored in 'intenc', otherwise return
+ * LP_ENCODING_STRING. In both cases '*enclen' is set to the length of the
+ * encoded element, without the trailing length. */
+static int lpEncodeGetType(unsigned char *ele, uint32_t size, unsigned char *intenc, uint64_t *enclen) {
+    long long v;
+
+    if (size <= 20 && string2ll((char*)ele,size,&v)) {
+        lpEncodeIntegerGetType(v,intenc,enclen);
+        return LP_ENCODING_INT;
+    } else {
+        if (size < 64) *enclen = 1+size;
+        else if (size < 4096) *enclen = 2+size;
+        else *enclen = 5+(uint64_t)size;
+        return LP_ENCODING_STRING;
+    }
+}
+
+/* Store the trailing length 'l' in 'buf', that can be NULL to just get the
+ * number of bytes needed. Returns the number of bytes used. */
+static unsigned long lpEncodeBacklen(unsigned char *buf, uint64_t l) {
+    if (l <= 127) {
+        if (buf) buf[0] = l;
+        return 1;
+    } else if (l < 16383) {
+        if (buf) {
+            buf[0] = l>>7;
+            buf[1] = (l&127)|128;
+        }
+        return 2;
+    } else if (l < 2097151) {
+        if (buf) {
+            buf[0] = l>>14;
+            buf[1] = ((l>>7)&127)|128;
+            buf[2] = (l&127)|128;
+        }
+        return 3;
+    } else if (l < 268435455) {
+        if (buf) {
+            buf[0] = l>>21;
+            buf[1] = ((l>>14)&127)|128;
+            buf[2] = ((l>>7)&127)|128;
+            buf[3] = (l&127)|128;
+        }
+        return 4;
+    } else {
+        if (buf) {
+            buf[0] = l>>28;
+            buf[1] = ((l>>21)&127)|128;
+            buf[2] = ((l>>14)&127)|128;
+            buf[3] = ((l>>7)&127)|128;
+            buf[4] = (l&127)|128;
+        }
+        return 5;
+    }
+}
+
+/* Decode the trailing length of an element, 'p' points to its last byte.
+ * Returns UINT64_MAX if the length is invalid. */
+static uint64_t lpDecodeBacklen(unsigned char *p) {
+    uint64_t val = 0;
+    uint64_t shift = 0;
+    do {
+        val |= (uint64_t)(p[0] & 127) << shift;
+        if (!(p[0] & 128)) break;
+        shift += 7;
+        p--;
+        if (shift > 28) return UINT64_MAX;
+    } while(1);
+    return val;
+}
+
+/* Encode the string element 's' of length 'len' in 'buf', that must be
+ * big enough, as computed by lpEncodeGetType(). */
+static void lpEncodeString(unsigned char *buf, unsigned char *s, uint32_t len) {
+    if (len < 64) {
+        buf[0] = len | LP_ENCODING_6BIT_STR;
+        memcpy(buf+1,s,len);
+    } else if (len < 4096) {
+        buf[0] = (len >> 8) | LP_ENCODING_12BIT_STR;
+        buf[1] = len & 0xff;
+        memcpy(buf+2,s,len);
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        buf[1] = len & 0xff;
+        buf[2] = (len >> 8) & 0xff;
+        buf[3] = (len >> 16) & 0xff;
+        buf[4] = (len >> 24) & 0xff;
+        memcpy(buf+5,s,len);
+    }
+}
+
+/* Return the length of the encoding type plus the element data of the
+ * element at 'p', without the trailing length. Returns 0 for an invalid
+ * encoding. The element is assumed to be valid. */
+static uint32_t lpCurrentEncodedSizeUnsafe(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1+LP_ENCODING_6BIT_STR_LEN(p);
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2+LP_ENCODING_12BIT_STR_LEN(p);
+    switch (p[0]) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR: return 5+LP_ENCODING_32BIT_STR_LEN(p);
+    case LP_EOF: return 1;
+    }
+    return 0;
+}
+
+/* Return the number of bytes needed to read the length of the element at
+ * 'p' with lpCurrentEncodedSizeUnsafe(). */
+static uint32_t lpCurrentEncodedSizeBytes(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1;
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 1;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2;
+    if (p[0] == LP_ENCODING_32BIT_STR) return 5;
+    return 1;
+}
+
+/* Skip the element at 'p', returning a pointer to the next one, that may
+ * be the end of the listpack. */
+static unsigned char *lpSkip(unsigned char *p) {
+    unsigned long entrylen = lpCurrentEncodedSizeUnsafe(p);
+    entrylen += lpEncodeBacklen(NULL,entrylen);
+    return p+entrylen;
+}
+
+/* Return a pointer to the element after 'p', or NULL if 'p' is the last
+ * element. */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    assert(p);
+    p = lpSkip(p);
+    assert(p < lp+lpGetTotalBytes(lp));
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return a pointer to the element before 'p', or NULL if 'p' is the first
+ * element. 'p' can also point to the end of the listpack, in which case the
+ * last element is returned. */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    assert(p);
+    if (p-lp == LP_HDR_SIZE) return NULL;
+    p--; /* Seek the last byte of the trailing length of the previous entry. */
+    uint64_t prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    p -= prevlen-1; /* Seek the first byte of the previous entry. */
+    assert(p >= lp+LP_HDR_SIZE);
+    return p;
+}
+
+/* Return a pointer to the first element of the listpack, or NULL if the
+ * listpack is empty. */
+unsigned char *lpFirst(unsigned char *lp) {
+    unsigned char *p = lp+LP_HDR_SIZE;
+    if (p[0] == LP_EOF) return NULL;
+    return p;
+}
+
+/* Return a pointer to the last element of the listpack, or NULL if the
+ * listpack is empty. */
+unsigned char *lpLast(unsigned char *lp) {
+    unsigned char *p = lp+lpGetTotalBytes(lp)-1; /* Seek EOF element. */
+    return lpPrev(lp,p);
+}
+
+/* Return the number of elements of the listpack. When the number is not
+ * stored in the header the listpack is scanned, and the header is updated
+ * if the number fits. */
+unsigned long lpLength(unsigned char *lp) {
+    uint32_t numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN) return numele;
+
+    uint32_t count = 0;
+    unsigned char *p = lpFirst(lp);
+    while (p) {
+        count++;
+        p = lpNext(lp,p);
+    }
+
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Decode the element at 'p'. For strings, a pointer to the string is
+ * returned and its length is stored in '*count'. For integers, if 'intbuf'
+ * is not NULL the integer is converted to a string stored in 'intbuf', that
+ * must be at least LP_INTBUF_SIZE bytes, and returned as a string, otherwise
+ * NULL is returned and the integer is stored in '*count'. If 'entry_size' is
+ * not NULL, it is set to the total length of the element, so that the caller
+ * can skip it cheaply. */
+static inline unsigned char *lpGetWithSize(unsigned char *p, int64_t *count, unsigned char *intbuf, uint64_t *entry_size) {
+    int64_t val;
+    uint64_t uval, negstart, negmax;
+
+    assert(p); /* assertion for valgrind (avoid NPD) */
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
+        negstart = UINT64_MAX; /* 7 bit ints are always positive. */
+        negmax = 0;
+        uval = p[0] & 0x7f;
+        if (entry_size) *entry_size = 2;
+    } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+        *count = LP_ENCODING_6BIT_STR_LEN(p);
+        if (entry_size) *entry_size = 1+*count+lpEncodeBacklen(NULL,*count+1);
+        return p+1;
+    } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
+        uval = ((p[0]&0x1f)<<8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+        if (entry_size) *entry_size = 3;
+    } else if (p[0] == LP_ENCODING_16BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8;
+        negstart = (uint64_t)1<<15;
+        negmax = UINT16_MAX;
+        if (entry_size) *entry_size = 4;
+    } else if (p[0] == LP_ENCODING_24BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16;
+        negstart = (uint64_t)1<<23;
+        negmax = UINT32_MAX>>8;
+        if (entry_size) *entry_size = 5;
+    } else if (p[0] == LP_ENCODING_32BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 |
+               (uint64_t)p[4]<<24;
+        negstart = (uint64_t)1<<31;
+        negmax = UINT32_MAX;
+        if (entry_size) *entry_size = 6;
+    } else if (p[0] == LP_ENCODING_64BIT_INT) {
+        uval = (uint64_t)p[1] |
+               (uint64_t)p[2]<<8 |
+               (uint64_t)p[3]<<16 |
+               (uint64_t)p[4]<<24 |
+               (uint64_t)p[5]<<32 |
+               (uint64_t)p[6]<<40 |
+               (uint64_t)p[7]<<48 |
+               (uint64_t)p[8]<<56;
+        negstart = (uint64_t)1<<63;
+        negmax = UINT64_MAX;
+        if (entry_size) *entry_size = 10;
+    } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+        *count = LP_ENCODING_12BIT_STR_LEN(p);
+        if (entry_size) *entry_size = 2+*count+lpEncodeBacklen(NULL,*count+2);
+        return p+2;
+    } else if (p[0] == LP_ENCODING_32BIT_STR) {
+        *count = LP_ENCODING_32BIT_STR_LEN(p);
+        if (entry_size) *entry_size = 5+*count+lpEncodeBacklen(NULL,*count+5);
+        return p+5;
+    } else {
+        uval = 12345678900000000ULL + p[0];
+        negstart = UINT64_MAX;
+        negmax = 0;
+    }
+
+    /* We reach this code path only for integer encodings.
+     * Convert the unsigned value to the signed one using two's complement
+     * rule. */
+    if (uval >= negstart) {
+        /* This three steps conversion should avoid undefined behaviors
+         * in the unsigned -> signed conversion. */
+        uval = negmax-uval;
+        val = uval;
+        val = -val-1;
+    } else {
+        val = uval;
+    }
+
+    /* Return the string representation of the integer or the value itself
+     * depending on intbuf being NULL or not. */
+    if (intbuf) {
+        *count = ll2string((char*)intbuf,LP_INTBUF_SIZE,(long long)val);
+        return intbuf;
+    } else {
+        *count = val;
+        return NULL;
+    }
+}
+
+/* Return the element at 'p', see lpGetWithSize() for the semantics of
+ * 'count' and 'intbuf'. */
+unsigned char *lpGet(unsigned char *p, int64_t *count, unsigned char *intbuf) {
+    return lpGetWithSize(p,count,intbuf,NULL);
+}
+
+/* Like lpGet(), but with the same prototype of ziplistGet(): strings are
+ * returned with their length in '*slen', while for integers NULL is returned
+ * and the value is stored in '*lval'. */
+unsigned char *lpGetValue(unsigned char *p, unsigned int *slen, long long *lval) {
+    unsigned char *vstr;
+    int64_t ele_len;
+
+    vstr = lpGet(p,&ele_len,NULL);
+    if (vstr) {
+        *slen = ele_len;
+    } else {
+        *lval = ele_len;
+    }
+    return vstr;
+}
+
+/* Insert, replace or delete an element. This is the low level function used
+ * by all the other insertion and deletion functions.
+ *
+ * The element can be passed as a string 'elestr' of length 'size', that is
+ * encoded as an integer when possible, or as an already encoded integer
+ * 'eleint' of length 'size'. If both are NULL the element at 'p' is deleted.
+ *
+ * 'where' is LP_BEFORE or LP_AFTER to insert before or after the element
+ * at 'p', or LP_REPLACE to replace it. 'p' can point to the end of the
+ * listpack to append with LP_BEFORE.
+ *
+ * If 'newp' is not NULL it is set to the inserted element, or, in case of
+ * deletion, to the element that followed the deleted one, or NULL if the
+ * deleted element was the last one.
+ *
+ * Returns NULL if the listpack would grow over 4GB, otherwise the new
+ * pointer to the listpack, as it may be reallocated. */
+static unsigned char *lpInsert(unsigned char *lp, unsigned char *elestr, unsigned char *eleint,
+                               uint32_t size, unsigned char *p, int where, unsigned char **newp)
+{
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    unsigned char backlen[LP_MAX_BACKLEN_SIZE];
+
+    uint64_t enclen; /* The length of the encoded element. */
+    int delete = (elestr == NULL && eleint == NULL);
+
+    /* when deletion, it is conceptually replacing the element with a
+     * zero-length element. So whatever we get passed as 'where', set
+     * it to LP_REPLACE. */
+    if (delete) where = LP_REPLACE;
+
+    /* If we need to insert after the current element, we just jump to the
+     * next element (that could be the EOF one) and handle the case of
+     * inserting before. So the function will actually deal with just two
+     * cases: LP_BEFORE and LP_REPLACE. */
+    if (where == LP_AFTER) {
+        p = lpSkip(p);
+        where = LP_BEFORE;
+    }
+
+    /* Store the offset of the element 'p', so that we can obtain its
+     * address again after a reallocation. */
+    unsigned long poff = p-lp;
+
+    int enctype;
+    if (elestr) {
+        /* Calling lpEncodeGetType() results into the encoded version of the
+         * element to be stored into 'intenc' in case it is representable as
+         * an integer: in that case, the function returns LP_ENCODING_INT.
+         * Otherwise if LP_ENCODING_STRING is returned, we'll have to call
+         * lpEncodeString() to actually write the encoded string on place
+         * later. */
+        enctype = lpEncodeGetType(elestr,size,intenc,&enclen);
+        if (enctype == LP_ENCODING_INT) eleint = intenc;
+    } else if (eleint) {
+        enctype = LP_ENCODING_INT;
+        enclen = size; /* 'size' is the length of the encoded integer. */
+    } else {
+        enctype = -1;
+        enclen = 0;
+    }
+
+    /* We need to also encode the backward-parsable length of the element
+     * and append it to the end: this allows to traverse the listpack from
+     * the end to the start. */
+    unsigned long backlen_size = (!delete) ? lpEncodeBacklen(backlen,enclen) : 0;
+    uint64_t old_listpack_bytes = lpGetTotalBytes(lp);
+    uint32_t replaced_len = 0;
+    if (where == LP_REPLACE) {
+        replaced_len = lpCurrentEncodedSizeUnsafe(p);
+        replaced_len += lpEncodeBacklen(NULL,replaced_len);
+    }
+
+    uint64_t new_listpack_bytes = old_listpack_bytes + enclen + backlen_size
+                                  - replaced_len;
+    if (new_listpack_bytes > UINT32_MAX) return NULL;
+
+    /* We now need to reallocate in order to make space or shrink the
+     * allocation (in case 'when' value is LP_REPLACE and the new element is
+     * smaller). However we do that before memmoving the memory to
+     * make room for the new element if the final allocation will get
+     * larger, or we do it after if the final allocation will get smaller. */
+
+    unsigned char *dst = lp + poff; /* May be updated after reallocation. */
+
+    /* Realloc before: we need more room. */
+    if (new_listpack_bytes > old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp + poff;
+    }
+
+    /* Setup the listpack relocating the elements to make the exact room
+     * we need to store the new one. */
+    if (where == LP_BEFORE) {
+        memmove(dst+enclen+backlen_size,dst,old_listpack_bytes-poff);
+    } else { /* LP_REPLACE. */
+        memmove(dst+enclen+backlen_size,
+                dst+replaced_len,
+                old_listpack_bytes-poff-replaced_len);
+    }
+
+    /* Realloc after: we need to free space. */
+    if (new_listpack_bytes < old_listpack_bytes) {
+        lp = zrealloc(lp,new_listpack_bytes);
+        dst = lp + poff;
+    }
+
+    /* Store the entry. */
+    if (newp) {
+        *newp = dst;
+        /* In case of deletion, set 'newp' to NULL if the next element is
+         * the EOF element. */
+        if (delete && dst[0] == LP_EOF) *newp = NULL;
+    }
+    if (!delete) {
+        if (enctype == LP_ENCODING_INT) {
+            memcpy(dst,eleint,enclen);
+        } else {
+            lpEncodeString(dst,elestr,size);
+        }
+        dst += enclen;
+        memcpy(dst,backlen,backlen_size);
+        dst += backlen_size;
+    }
+
+    /* Update header. */
+    if (where != LP_REPLACE || delete) {
+        uint32_t num_elements = lpGetNumElements(lp);
+        if (num_elements != LP_HDR_NUMELE_UNKNOWN) {
+            if (!delete)
+                lpSetNumElements(lp,num_elements+1);
+            else
+                lpSetNumElements(lp,num_elements-1);
+        }
+    }
+    lpSetTotalBytes(lp,new_listpack_bytes);
+    return lp;
+}
+
+/* Insert the string 's' of length 'slen' before, after or in place of the
+ * element at 'p', according to 'where'. See lpInsert() for the details. */
+unsigned char *lpInsertString(unsigned char *lp, unsigned char *s, uint32_t slen,
+                              unsigned char *p, int where, unsigned char **newp)
+{
+    return lpInsert(lp,s,NULL,slen,p,where,newp);
+}
+
+/* Like lpInsertString(), but for an integer value. */
+unsigned char *lpInsertInteger(unsigned char *lp, long long lval,
+                               unsigned char *p, int where, unsigned char **newp)
+{
+    uint64_t enclen;
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+
+    lpEncodeIntegerGetType(lval,intenc,&enclen);
+    return lpInsert(lp,NULL,intenc,enclen,p,where,newp);
+}
+
+/* Add a string element at the head of the listpack. */
+unsigned char *lpPrepend(unsigned char *lp, unsigned char *s, uint32_t slen) {
+    unsigned char *p = lpFirst(lp);
+    if (!p) return lpAppend(lp,s,slen);
+    return lpInsert(lp,s,NULL,slen,p,LP_BEFORE,NULL);
+}
+
+/* Add an integer element at the head of the listpack. */
+unsigned char *lpPrependInteger(unsigned char *lp, long long lval) {
+    unsigned char *p = lpFirst(lp);
+    if (!p) return lpAppendInteger(lp,lval);
+    return lpInsertInteger(lp,lval,p,LP_BEFORE,NULL);
+}
+
+/* Add a string element at the tail of the listpack. */
+unsigned char *lpAppend(unsigned char *lp, unsigned char *s, uint32_t slen) {
+    uint64_t listpack_bytes = lpGetTotalBytes(lp);
+    unsigned char *eofptr = lp + listpack_bytes - 1;
+    return lpInsert(lp,s,NULL,slen,eofptr,LP_BEFORE,NULL);
+}
+
+/* Add an integer element at the tail of the listpack. */
+unsigned char *lpAppendInteger(unsigned char *lp, long long lval) {
+    uint64_t listpack_bytes = lpGetTotalBytes(lp);
+    unsigned char *eofptr = lp + listpack_bytes - 1;
+    return lpInsertInteger(lp,lval,eofptr,LP_BEFORE,NULL);
+}
+
+/* Replace the element at '*p' with the string 's'. '*p' is updated to point
+ * to the new element. */
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *s, uint32_t slen) {
+    return lpInsert(lp,s,NULL,slen,*p,LP_REPLACE,p);
+}
+
+/* Replace the element at '*p' with the integer 'lval'. '*p' is updated to
+ * point to the new element. */
+unsigned char *lpReplaceInteger(unsigned char *lp, unsigned char **p, long long lval) {
+    return lpInsertInteger(lp,lval,*p,LP_REPLACE,p);
+}
+
+/* Remove the element at 'p'. If 'newp' is not NULL, it is set to the next
+ * element, or NULL if the deleted element was the last one. */
+unsigned char *lpDelete(unsigned char *lp, unsigned char *p, unsigned char **newp) {
+    return lpInsert(lp,NULL,NULL,0,p,LP_REPLACE,newp);
+}
+
+/* Delete 'num' elements starting at '*p'. '*p' is updated to the element
+ * that follows the deleted ones, or NULL if they were the last ones. */
+unsigned char *lpDeleteRangeWithEntry(unsigned char *lp, unsigned char **p, unsigned long num) {
+    size_t bytes = lpBytes(lp);
+    unsigned long deleted = 0;
+    unsigned char *eofptr = lp + bytes - 1;
+    unsigned char *first, *tail;
+    first = tail = *p;
+
+    if (num == 0) return lp; /* Nothing to delete, return ASAP. */
+
+    /* Find the next entry to the last entry that needs to be deleted.
+     * lpLength may be unreliable due to corrupt data, so we cannot
+     * treat 'num' as the number of elements to be deleted. */
+    while (num--) {
+        deleted++;
+        tail = lpSkip(tail);
+        if (tail[0] == LP_EOF) break;
+    }
+
+    /* Store the offset of the element 'first', so that we can obtain its
+     * address again after a reallocation. */
+    unsigned long poff = first-lp;
+
+    /* Move tail to the front of the listpack */
+    memmove(first,tail,eofptr-tail+1);
+    lpSetTotalBytes(lp,bytes-(tail-first));
+    uint32_t numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(lp,numele-deleted);
+    lp = lpShrinkToFit(lp);
+
+    /* Store the entry. */
+    *p = lp+poff;
+    if ((*p)[0] == LP_EOF) *p = NULL;
+
+    return lp;
+}
+
+/* Delete 'num' elements starting at the element with the specified index,
+ * that can be negative to count from the tail. */
+unsigned char *lpDeleteRange(unsigned char *lp, long index, unsigned long num) {
+    unsigned char *p;
+
+    if (num == 0) return lp; /* Nothing to delete, return ASAP. */
+    if ((p = lpSeek(lp,index)) == NULL) return lp;
+    return lpDeleteRangeWithEntry(lp,&p,num);
+}
+
+/* Merge two listpacks, 'first' and 'second', appending 'second' to 'first'.
+ * The largest listpack is reallocated to contain the other one, which is
+ * freed, so that the memory to move is minimized.
+ *
+ * On success the merged listpack is returned, '*first' is set to it and
+ * '*second' to NULL if 'first' was the largest one, otherwise '*second' is
+ * set to it and '*first' to NULL. Returns NULL if the listpacks can't be
+ * merged. */
+unsigned char *lpMerge(unsigned char **first, unsigned char **second) {
+    /* If any params are null, we can't merge, so NULL. */
+    if (first == NULL || *first == NULL || second == NULL || *second == NULL)
+        return NULL;
+
+    /* Can't merge same list into itself. */
+    if (*first == *second)
+        return NULL;
+
+    size_t first_bytes = lpBytes(*first);
+    unsigned long first_len = lpLength(*first);
+
+    size_t second_bytes = lpBytes(*second);
+    unsigned long second_len = lpLength(*second);
+
+    int append;
+    unsigned char *source, *target;
+    size_t target_bytes, source_bytes;
+    /* Pick the largest listpack so we can resize easily in-place.
+     * We must also track if we are now appending or prepending to
+     * the target listpack. */
+    if (first_bytes >= second_bytes) {
+        /* retain first, append second to first. */
+        target = *first;
+        target_bytes = first_bytes;
+        source = *second;
+        source_bytes = second_bytes;
+        append = 1;
+    } else {
+        /* else, retain second, prepend first to second. */
+        target = *second;
+        target_bytes = second_bytes;
+        source = *first;
+        source_bytes = first_bytes;
+        append = 0;
+    }
+
+    /* Calculate final bytes (subtract one pair of metadata) */
+    unsigned long long lpbytes = (unsigned long long)first_bytes +
+                                 second_bytes - LP_HDR_SIZE - 1;
+    assert(lpbytes < UINT32_MAX); /* larger values can't be stored */
+    unsigned long lplength = first_len + second_len;
+
+    /* Combined lp length should be limited within UINT16_MAX */
+    lplength = lplength < UINT16_MAX ? lplength : UINT16_MAX;
+
+    /* Extend target to new lpbytes then append or prepend source. */
+    target = zrealloc(target,lpbytes);
+    if (append) {
+        /* append == appending to target */
+        /* Copy source after target (copying over original [END]):
+         *   [TARGET - END, SOURCE - HEADER] */
+        memcpy(target+target_bytes-1,
+               source+LP_HDR_SIZE,
+               source_bytes-LP_HDR_SIZE);
+    } else {
+        /* !append == prepending to target */
+        /* Move target *contents* exactly size of (source - [END]),
+         * then copy source into vacated space (source - [END]):
+         *   [SOURCE - END, TARGET - HEADER] */
+        memmove(target+source_bytes-1,
+                target+LP_HDR_SIZE,
+                target_bytes-LP_HDR_SIZE);
+        memcpy(target,source,source_bytes-1);
+    }
+
+    lpSetNumElements(target,lplength);
+    lpSetTotalBytes(target,lpbytes);
+
+    /* Now free and NULL out what we didn't realloc */
+    if (append) {
+        zfree(*second);
+        *second = NULL;
+        *first = target;
+    } else {
+        zfree(*first);
+        *first = NULL;
+        *second = target;
+    }
+    return target;
+}
+
+/* Return the total number of bytes the listpack is composed of. */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+/* Seek the element at the specified index, that can be negative to count
+ * from the tail (-1 is the last element). Returns NULL if the index is out
+ * of range. */
+unsigned char *lpSeek(unsigned char *lp, long index) {
+    int forward = 1; /* Seek forward by default. */
+
+    /* We want to seek from left to right or the other way around
+     * depending on the listpack length and the element position.
+     * However if the listpack length cannot be obtained in constant time,
+     * we always seek from left to right. */
+    uint32_t numele = lpGetNumElements(lp);
+    if (numele != LP_HDR_NUMELE_UNKNOWN) {
+        if (index < 0) index = (long)numele+index;
+        if (index < 0) return NULL; /* Index still < 0 means out of range. */
+        if (index >= (long)numele) return NULL; /* Out of range the other side. */
+        /* We want to scan right-to-left if the element we are looking for
+         * is past the half of the listpack. */
+        if (index > (long)numele/2) {
+            forward = 0;
+            /* Right to left scanning always expects a negative index. Convert
+             * our index to negative form. */
+            index -= numele;
+        }
+    } else {
+        /* If the listpack length is unspecified, for negative indexes we
+         * want to always scan right-to-left. */
+        if (index < 0) forward = 0;
+    }
+
+    /* Forward and backward scanning is trivially based on lpNext()/lpPrev(). */
+    if (forward) {
+        unsigned char *ele = lpFirst(lp);
+        while (index > 0 && ele) {
+            ele = lpNext(lp,ele);
+            index--;
+        }
+        return ele;
+    } else {
+        unsigned char *ele = lpLast(lp);
+        while (index < -1 && ele) {
+            ele = lpPrev(lp,ele);
+            index++;
+        }
+        return ele;
+    }
+}
+
+/* Return 1 if the 'len' bytes at 'a' and 'b' are equal. lpFind() calls this
+ * for every element having the length of the searched string, that are
+ * mostly short: for them the cost of calling memcmp() dominates, so we
+ * compare 32 or 16 bytes at a time with AVX2 or SSE2 when the compiler
+ * targets them, and whole words otherwise. The last chunk overlaps the
+ * previous one instead of being compared byte by byte, so no byte outside
+ * the two strings is ever read. */
+static inline int lpStringsEqual(const unsigned char *a, const unsigned char *b, uint32_t len) {
+    uint32_t j;
+
+    if (len > 128) return memcmp(a,b,len) == 0;
+#if defined(__AVX2__)
+    if (len >= 32) {
+        for (j = 0; j+32 < len; j += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a+j));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b+j));
+            if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va,vb)) != UINT32_MAX)
+                return 0;
+        }
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a+len-32));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b+len-32));
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va,vb)) == UINT32_MAX;
+    }
+#endif
+#if defined(__SSE2__)
+    if (len >= 16) {
+        for (j = 0; j+16 < len; j += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a+j));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b+j));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(va,vb)) != 0xFFFF) return 0;
+        }
+        __m128i va = _mm_loadu_si128((const __m128i*)(a+len-16));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b+len-16));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(va,vb)) == 0xFFFF;
+    }
+#endif
+    if (len >= 8) {
+        uint64_t wa, wb;
+        for (j = 0; j+8 < len; j += 8) {
+            memcpy(&wa,a+j,8);
+            memcpy(&wb,b+j,8);
+            if (wa != wb) return 0;
+        }
+        memcpy(&wa,a+len-8,8);
+        memcpy(&wb,b+len-8,8);
+        return wa == wb;
+    } else if (len >= 4) {
+        uint32_t wa1, wb1, wa2, wb2;
+        memcpy(&wa1,a,4);
+        memcpy(&wb1,b,4);
+        memcpy(&wa2,a+len-4,4);
+        memcpy(&wb2,b+len-4,4);
+        return wa1 == wb1 && wa2 == wb2;
+    } else if (len > 0) {
+        /* 1 to 3 bytes: the first, middle and last one cover them all. */
+        return a[0] == b[0] && a[len>>1] == b[len>>1] && a[len-1] == b[len-1];
+    }
+    return 1;
+}
+
+/* Find the element equal to the string 's' of length 'slen', starting at
+ * 'p', and skipping 'skip' elements between every comparison (for instance
+ * 1 to only compare the fields of a listpack of field-value pairs). Returns
+ * NULL if the element is not found.
+ *
+ * Small strings and small integers, by far the most common elements of the
+ * listpacks backing hashes and sorted sets, are recognized and skipped
+ * looking only at their first byte. */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s,
+                      uint32_t slen, unsigned int skip)
+{
+    int skipcnt = 0;
+    unsigned char vencoding = 0;
+    unsigned char *value;
+    int64_t ll, vll = 0;
+    uint64_t entry_size = 123456789; /* initialized to avoid warning. */
+
+    assert(p >= lp+LP_HDR_SIZE && p < lp+lpBytes(lp));
+    while (p) {
+        if (skipcnt == 0) {
+            if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+                /* The 1 byte trailing length of the element is included. */
+                ll = LP_ENCODING_6BIT_STR_LEN(p);
+                value = p+1;
+                entry_size = ll+2;
+            } else {
+                value = lpGetWithSize(p,&ll,NULL,&entry_size);
+            }
+            if (value) {
+                if (slen == ll && lpStringsEqual(value,s,slen)) {
+                    return p;
+                }
+            } else {
+                /* Find out if the searched field can be encoded. Note that
+                 * we do it only the first time, once done vencoding is set
+                 * to non-zero and vll is set to the integer value. */
+                if (vencoding == 0) {
+                    long long v;
+                    /* If the entry can be encoded as integer we set it to
+                     * 1, else set it to UCHAR_MAX, so that we don't retry
+                     * again the next time. */
+                    if (slen > 20 || !string2ll((char*)s,slen,&v)) {
+                        vencoding = UCHAR_MAX;
+                    } else {
+                        vencoding = 1;
+                        vll = v;
+                    }
+                }
+
+                /* Compare current entry with specified entry, do it only
+                 * if vencoding != UCHAR_MAX because if there is no encoding
+                 * possible for the field it can't be a valid integer. */
+                if (vencoding != UCHAR_MAX && ll == vll) {
+                    return p;
+                }
+            }
+
+            /* Reset skip count */
+            skipcnt = skip;
+            p += entry_size;
+        } else {
+            /* Skip entry */
+            skipcnt--;
+            if (LP_ENCODING_IS_7BIT_UINT(p[0]))
+                p += 2;
+            else if (LP_ENCODING_IS_6BIT_STR(p[0]))
+                p += LP_ENCODING_6BIT_STR_LEN(p)+2;
+            else if (LP_ENCODING_IS_13BIT_INT(p[0]))
+                p += 3;
+            else
+                p = lpSkip(p);
+        }
+
+        if (p[0] == LP_EOF) break;
+    }
+
+    return NULL;
+}
+
+/* Return 1 if the element at 'p' is equal to the string 's' of length
+ * 'slen', 0 otherwise. */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, uint32_t slen) {
+    unsigned char buf[LP_INTBUF_SIZE];
+    unsigned char *value;
+    int64_t sz;
+
+    if (p[0] == LP_EOF) return 0;
+    value = lpGet(p,&sz,buf);
+    return (slen == sz) && lpStringsEqual(value,s,slen);
+}
+
+/* Validate the element at '*pp', that must be within the first 'lpbytes'
+ * bytes of the listpack, and advance '*pp' to the next element. Returns 0
+ * if the element is not valid. */
+static int lpValidateNext(unsigned char *lp, unsigned char **pp, size_t lpbytes) {
+#define OUT_OF_RANGE(p) ((p) < lp + LP_HDR_SIZE || (p) > lp + lpbytes - 1)
+    unsigned char *p = *pp;
+    if (!p) return 0;
+
+    /* Before accessing p, make sure it's valid. */
+    if (OUT_OF_RANGE(p)) return 0;
+
+    if (*p == LP_EOF) {
+        *pp = NULL;
+        return 1;
+    }
+
+    /* Check that we can read the encoded size. */
+    uint32_t lenbytes = lpCurrentEncodedSizeBytes(p);
+    if (!lenbytes) return 0;
+
+    /* Make sure the encoded entry length doesn't reach outside the edge of
+     * the listpack. */
+    if (OUT_OF_RANGE(p + lenbytes)) return 0;
+
+    /* Get the entry length and encoded backlen. */
+    unsigned long entrylen = lpCurrentEncodedSizeUnsafe(p);
+    if (!entrylen) return 0;
+    unsigned long encodedBacklen = lpEncodeBacklen(NULL,entrylen);
+    entrylen += encodedBacklen;
+
+    /* Make sure the entry doesn't reach outside the edge of the listpack. */
+    if (OUT_OF_RANGE(p + entrylen)) return 0;
+
+    /* Move to the next entry. */
+    p += entrylen;
+
+    /* Make sure the encoded length at the end patches the one at the
+     * beginning. */
+    uint64_t prevlen = lpDecodeBacklen(p-1);
+    if (prevlen + encodedBacklen != entrylen) return 0;
+
+    *pp = p;
+    return 1;
+#undef OUT_OF_RANGE
+}
+
+/* Validate the integrity of a listpack of 'size' bytes, for instance loaded
+ * from an RDB file. The header is always checked, while the single elements
+ * are only checked when 'deep' is true. Returns 1 if the listpack is valid,
+ * 0 otherwise. */
+int lpValidateIntegrity(unsigned char *lp, size_t size, int deep) {
+    /* Check that we can actually read the header. (and EOF) */
+    if (size < LP_HDR_SIZE + 1) return 0;
+
+    /* Check that the encoded size in the header must match the allocated
+     * size. */
+    size_t bytes = lpGetTotalBytes(lp);
+    if (bytes != size) return 0;
+
+    /* The last byte must be the terminator. */
+    if (lp[size-1] != LP_EOF) return 0;
+
+    if (!deep) return 1;
+
+    /* Validate the individual entries. */
+    uint32_t count = 0;
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned char *p = lp + LP_HDR_SIZE;
+    while (p && p[0] != LP_EOF) {
+        if (!lpValidateNext(lp,&p,bytes)) return 0;
+        count++;
+    }
+
+    /* Make sure 'p' really does point to the end of the listpack. */
+    if (p != lp + size - 1) return 0;
+
+    /* Check that the count in the header is correct */
+    if (numele != LP_HDR_NUMELE_UNKNOWN && numele != count) return 0;
+
+    return 1;
+}
+
+/* Print the listpack on stdout, for debugging. */
+void lpRepr(unsigned char *lp) {
+    unsigned char *p, *vstr;
+    int64_t vlen;
+    unsigned char intbuf[LP_INTBUF_SIZE];
+    int index = 0;
+
+    printf("{total bytes %zu} {num entries %lu}\n",lpBytes(lp),lpLength(lp));
+
+    p = lpFirst(lp);
+    while(p) {
+        uint32_t encoded_size_bytes = lpCurrentEncodedSizeBytes(p);
+        uint32_t encoded_size = lpCurrentEncodedSizeUnsafe(p);
+        unsigned long back_len = lpEncodeBacklen(NULL,encoded_size);
+        printf(
+            "{\n"
+                "\taddr: 0x%08lx,\n"
+                "\tindex: %2d,\n"
+                "\toffset: %1lu,\n"
+                "\thdr+entrylen+backlen: %2lu,\n"
+                "\thdrlen: %3u,\n"
+                "\tbacklen: %2lu,\n"
+                "\tpayload: %1u\n",
+            (long unsigned)p,
+            index,
+            (unsigned long) (p-lp),
+            encoded_size + back_len,
+            encoded_size_bytes,
+            back_len,
+            encoded_size - encoded_size_bytes);
+        printf("\tbytes: ");
+        for (unsigned int i = 0; i < (encoded_size + back_len); i++) {
+            printf("%02x|",p[i]);
+        }
+        printf("\n");
+
+        vstr = lpGet(p,&vlen,intbuf);
+        printf("\t[str]");
+        if (vlen > 40) {
+            if (fwrite(vstr,40,1,stdout) == 0) perror("fwrite");
+            printf("...");
+        } else {
+            if (fwrite(vstr,vlen,1,stdout) == 0) perror("fwrite");
+        }
+        printf("\n}\n");
+        index++;
+        p = lpNext(lp,p);
+    }
+    printf("{end}\n\n");
+}
+
+#ifdef REDIS_TEST
+
+#include <sys/time.h>
+
+static char *mixlist[] = {"hello", "foo", "quux", "1024"};
+static char *intlist[] = {"4294967296", "-100", "100", "128000",
+                          "non integer", "much much longer non integer"};
+
+static unsigned char *createList(void) {
+    unsigned char *lp = lpNew(0);
+    lp = lpAppend(lp,(unsigned char*)mixlist[1],strlen(mixlist[1]));
+    lp = lpAppend(lp,(unsigned char*)mixlist[2],strlen(mixlist[2]));
+    lp = lpPrepend(lp,(unsigned char*)mixlist[0],strlen(mixlist[0]));
+    lp = lpAppend(lp,(unsigned char*)mixlist[3],strlen(mixlist[3]));
+    return lp;
+}
+
+static unsigned char *createIntList(void) {
+    unsigned char *lp = lpNew(0);
+    lp = lpAppend(lp,(unsigned char*)intlist[2],strlen(intlist[2]));
+    lp = lpAppend(lp,(unsigned char*)intlist[3],strlen(intlist[3]));
+    lp = lpPrepend(lp,(unsigned char*)intlist[1],strlen(intlist[1]));
+    lp = lpPrepend(lp,(unsigned char*)intlist[0],strlen(intlist[0]));
+    lp = lpAppend(lp,(unsigned char*)intlist[4],strlen(intlist[4]));
+    lp = lpAppend(lp,(unsigned char*)intlist[5],strlen(intlist[5]));
+    return lp;
+}
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Check that the element at 'p' is equal to 's'. */
+static void verifyEntry(unsigned char *p, char *s) {
+    assert(lpCompare(p,(unsigned char*)s,strlen(s)));
+}
+
+/* Check that the listpack contains exactly the elements 'expected'. */
+static void verifyList(unsigned char *lp, char **expected, int count) {
+    unsigned char *p = lpFirst(lp);
+    int j;
+
+    assert(lpLength(lp) == (unsigned long)count);
+    assert(lpValidateIntegrity(lp,lpBytes(lp),1));
+    for (j = 0; j < count; j++) {
+        verifyEntry(p,expected[j]);
+        p = lpNext(lp,p);
+    }
+    assert(p == NULL);
+
+    /* The same walking the listpack backward. */
+    p = lpLast(lp);
+    for (j = count-1; j >= 0; j--) {
+        verifyEntry(p,expected[j]);
+        p = lpPrev(lp,p);
+    }
+    assert(p == NULL);
+}
+
+/* Return a random string of up to 'maxlen' bytes, that is sometimes a
+ * number. */
+static int randstring(char *target, int maxlen) {
+    int len, j;
+
+    if (rand() % 4 == 0) {
+        long long v;
+        switch (rand() % 4) {
+        case 0: v = rand() % 128; break;
+        case 1: v = (rand() % 10000) - 5000; break;
+        case 2: v = ((long long)rand() << 20) - rand(); break;
+        default: v = ((long long)(rand() % 1000000) << 32) - rand(); break;
+        }
+        return ll2string(target,maxlen,v);
+    }
+    len = rand() % maxlen;
+    for (j = 0; j < len; j++) target[j] = 'a' + rand() % 26;
+    return len;
+}
+
+/* Reference implementation of lpFind(), decoding every element. */
+static unsigned char *lpFindSlow(unsigned char *lp, unsigned char *p,
+                                 unsigned char *s, uint32_t slen,
+                                 unsigned int skip)
+{
+    unsigned int skipcnt = 0;
+    while (p) {
+        if (skipcnt == 0) {
+            if (lpCompare(p,s,slen)) return p;
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpNext(lp,p);
+    }
+    return NULL;
+}
+
+int listpackTest(int argc, char *argv[]) {
+    unsigned char *lp, *p, *vstr;
+    int64_t vlen;
+    unsigned char intbuf[LP_INTBUF_SIZE];
+
+    /* If an argument is given, use it as the random seed. */
+    if (argc == 4)
+        srand(atoi(argv[3]));
+
+    printf("Create int list: ");
+    {
+        lp = createIntList();
+        verifyList(lp,intlist,6);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Create list: ");
+    {
+        lp = createList();
+        char *expected[] = {"hello", "foo", "quux", "1024"};
+        verifyList(lp,expected,4);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Get element at index: ");
+    {
+        lp = createList();
+        verifyEntry(lpSeek(lp,0),"hello");
+        verifyEntry(lpSeek(lp,3),"1024");
+        verifyEntry(lpSeek(lp,-1),"1024");
+        verifyEntry(lpSeek(lp,-4),"hello");
+        assert(lpSeek(lp,4) == NULL);
+        assert(lpSeek(lp,-5) == NULL);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Integer encodings: ");
+    {
+        long long values[] = {0, 127, 128, -1, 4095, -4096, 4096, -4097,
+                              32767, -32768, 32768, 8388607, -8388608,
+                              2147483647, -2147483648LL, 2147483648LL,
+                              LLONG_MAX, LLONG_MIN};
+        int count = sizeof(values)/sizeof(values[0]);
+        int j;
+
+        lp = lpNew(0);
+        for (j = 0; j < count; j++) {
+            char buf[LP_INTBUF_SIZE];
+            int len = ll2string(buf,sizeof(buf),values[j]);
+            if (j % 2) lp = lpAppendInteger(lp,values[j]);
+            else lp = lpAppend(lp,(unsigned char*)buf,len);
+        }
+        assert(lpValidateIntegrity(lp,lpBytes(lp),1));
+        p = lpFirst(lp);
+        for (j = 0; j < count; j++) {
+            vstr = lpGet(p,&vlen,NULL);
+            assert(vstr == NULL && vlen == values[j]);
+            p = lpNext(lp,p);
+        }
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Insert, replace and delete: ");
+    {
+        lp = createList();
+        p = lpSeek(lp,1);
+        lp = lpInsertString(lp,(unsigned char*)"bar",3,p,LP_AFTER,&p);
+        verifyEntry(p,"bar");
+        p = lpSeek(lp,0);
+        lp = lpInsertInteger(lp,-10,p,LP_BEFORE,&p);
+        verifyEntry(p,"-10");
+        char *expected[] = {"-10", "hello", "foo", "bar", "quux", "1024"};
+        verifyList(lp,expected,6);
+
+        p = lpSeek(lp,2);
+        lp = lpReplace(lp,&p,(unsigned char*)"zap",3);
+        verifyEntry(p,"zap");
+        p = lpSeek(lp,-1);
+        lp = lpReplaceInteger(lp,&p,1<<20);
+        verifyEntry(p,"1048576");
+        char *expected2[] = {"-10", "hello", "zap", "bar", "quux", "1048576"};
+        verifyList(lp,expected2,6);
+
+        p = lpSeek(lp,1);
+        lp = lpDelete(lp,p,&p);
+        verifyEntry(p,"zap");
+        p = lpSeek(lp,-1);
+        lp = lpDelete(lp,p,&p);
+        assert(p == NULL);
+        char *expected3[] = {"-10", "zap", "bar", "quux"};
+        verifyList(lp,expected3,4);
+
+        lp = lpDeleteRange(lp,1,2);
+        char *expected4[] = {"-10", "quux"};
+        verifyList(lp,expected4,2);
+        lp = lpDeleteRange(lp,-1,10);
+        verifyList(lp,expected4,1);
+        p = lpFirst(lp);
+        lp = lpDeleteRangeWithEntry(lp,&p,1);
+        assert(p == NULL && lpFirst(lp) == NULL && lpLength(lp) == 0);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Find: ");
+    {
+        lp = createIntList();
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"128000",6,0);
+        verifyEntry(p,"128000");
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"non integer",11,0);
+        verifyEntry(p,"non integer");
+        assert(lpFind(lp,lpFirst(lp),(unsigned char*)"128000",6,1) == NULL);
+        verifyEntry(lpFind(lp,lpFirst(lp),(unsigned char*)"100",3,1),"100");
+        p = lpFind(lp,lpFirst(lp),(unsigned char*)"-100",4,0);
+        verifyEntry(p,"-100");
+        assert(lpFind(lp,lpFirst(lp),(unsigned char*)"0100",4,0) == NULL);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Find against a reference implementation: ");
+    {
+        char buf[200];
+        int iter, j;
+
+        for (iter = 0; iter < 200; iter++) {
+            int count = 1 + rand() % 64;
+
+            lp = lpNew(0);
+            for (j = 0; j < count; j++) {
+                int len = randstring(buf,sizeof(buf)/(1+rand()%4));
+                lp = lpAppend(lp,(unsigned char*)buf,len);
+            }
+            for (j = 0; j < 100; j++) {
+                unsigned int skip = rand() % 3;
+                int len;
+
+                if (rand() % 2) {
+                    /* Search an existing element, maybe altering its
+                     * last byte. */
+                    vstr = lpGet(lpSeek(lp,rand()%count),&vlen,intbuf);
+                    len = vlen;
+                    memcpy(buf,vstr,len);
+                    if (len && rand() % 2) buf[len-1]++;
+                } else {
+                    len = randstring(buf,sizeof(buf));
+                }
+                assert(lpFind(lp,lpFirst(lp),(unsigned char*)buf,len,skip) ==
+                       lpFindSlow(lp,lpFirst(lp),(unsigned char*)buf,len,skip));
+            }
+            lpFree(lp);
+        }
+        printf("OK\n");
+    }
+
+    printf("Benchmark lpFind: ");
+    {
+        char buf[64];
+        char *fields[128];
+        int flens[128];
+        int j, k, found = 0;
+        long long start, fast, slow;
+
+        /* A listpack like the ones backing small hashes, 128 field-value
+         * pairs, searched by field. */
+        lp = lpNew(0);
+        for (j = 0; j < 128; j++) {
+            flens[j] = snprintf(buf,sizeof(buf),"user:%d:%s",j,
+                                (j % 3) ? "last_login" : "name");
+            fields[j] = zmalloc(flens[j]);
+            memcpy(fields[j],buf,flens[j]);
+            lp = lpAppend(lp,(unsigned char*)fields[j],flens[j]);
+            lp = lpAppendInteger(lp,j*1000);
+        }
+
+        start = usec();
+        for (k = 0; k < 2000; k++) {
+            for (j = 0; j < 128; j++) {
+                if (lpFind(lp,lpFirst(lp),(unsigned char*)fields[j],
+                           flens[j],1)) found++;
+            }
+        }
+        fast = usec()-start;
+        start = usec();
+        for (k = 0; k < 2000; k++) {
+            for (j = 0; j < 128; j++) {
+                if (lpFindSlow(lp,lpFirst(lp),(unsigned char*)fields[j],
+                               flens[j],1)) found++;
+            }
+        }
+        slow = usec()-start;
+        assert(found == 2*2000*128);
+        for (j = 0; j < 128; j++) zfree(fields[j]);
+        lpFree(lp);
+        printf("OK (%lld usec, %lld usec decoding every element)\n",
+               fast, slow);
+    }
+
+    printf("Merge: ");
+    {
+        unsigned char *lp1 = createList(), *lp2 = createIntList();
+        unsigned char *first = lp1, *second = lp2;
+        char *expected[] = {"hello", "foo", "quux", "1024",
+                            "4294967296", "-100", "100", "128000",
+                            "non integer", "much much longer non integer"};
+
+        lp = lpMerge(&first,&second);
+        assert(first == NULL && second == lp);
+        verifyList(lp,expected,10);
+        lpFree(lp);
+
+        lp1 = createList();
+        lp2 = lpNew(0);
+        first = lp1;
+        second = lp2;
+        lp = lpMerge(&first,&second);
+        assert(first == lp && second == NULL);
+        verifyList(lp,expected,4);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    printf("Long strings and unknown length: ");
+    {
+        char buf[70000];
+        long long start = usec();
+        int j;
+
+        memset(buf,'x',sizeof(buf));
+        lp = lpNew(0);
+        for (j = 0; j < 70000; j++) {
+            int len = j < 3 ? (int[]){63, 4095, 65535}[j] : j % 10;
+            lp = lpAppend(lp,(unsigned char*)buf,len);
+        }
+        assert(lpValidateIntegrity(lp,lpBytes(lp),1));
+        assert(lpLength(lp) == 70000);
+        vstr = lpGet(lpSeek(lp,1),&vlen,intbuf);
+        assert(vlen == 4095 && vstr[0] == 'x');
+        vstr = lpGet(lpSeek(lp,2),&vlen,intbuf);
+        assert(vlen == 65535 && vstr[0] == 'x');
+        lp = lpDeleteRange(lp,0,10000);
+        assert(lpLength(lp) == 60000);
+        lpFree(lp);
+        printf("OK (%lld usec)\n", usec()-start);
+    }
+
+    printf("Stress with random operations: ");
+    {
+        char *elements[1000];
+        int lens[1000];
+        int count = 0, iter, j;
+
+        lp = lpNew(0);
+        for (iter = 0; iter < 20000; iter++) {
+            char buf[512];
+            int len = randstring(buf,sizeof(buf)/(1+rand()%8));
+            int op = rand() % 3;
+
+            if (op == 0 && count < 1000) {
+                int pos = count ? rand() % (count+1) : 0;
+                if (pos == count)
+                    lp = lpAppend(lp,(unsigned char*)buf,len);
+                else
+                    lp = lpInsertString(lp,(unsigned char*)buf,len,
+                                        lpSeek(lp,pos),LP_BEFORE,NULL);
+                memmove(elements+pos+1,elements+pos,sizeof(char*)*(count-pos));
+                memmove(lens+pos+1,lens+pos,sizeof(int)*(count-pos));
+                elements[pos] = zmalloc(len+1);
+                memcpy(elements[pos],buf,len);
+                lens[pos] = len;
+                count++;
+            } else if (op == 1 && count) {
+                int pos = rand() % count;
+                p = lpSeek(lp,pos);
+                lp = lpReplace(lp,&p,(unsigned char*)buf,len);
+                zfree(elements[pos]);
+                elements[pos] = zmalloc(len+1);
+                memcpy(elements[pos],buf,len);
+                lens[pos] = len;
+            } else if (count) {
+                int pos = rand() % count;
+                lp = lpDelete(lp,lpSeek(lp,pos),NULL);
+                zfree(elements[pos]);
+                memmove(elements+pos,elements+pos+1,sizeof(char*)*(count-pos-1));
+                memmove(lens+pos,lens+pos+1,sizeof(int)*(count-pos-1));
+                count--;
+            }
+        }
+
+        assert(lpValidateIntegrity(lp,lpBytes(lp),1));
+        assert(lpLength(lp) == (unsigned long)count);
+        p = lpFirst(lp);
+        for (j = 0; j < count; j++) {
+            assert(lpCompare(p,(unsigned char*)elements[j],lens[j]));
+            p = lpNext(lp,p);
+        }
+        for (j = 0; j < count; j++) zfree(elements[j]);
+        lpFree(lp);
+        printf("OK\n");
+    }
+
+    return 0;
+}
+
+#endif
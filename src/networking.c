@@ -33,7 +33,23 @@
 #include <math.h>
 #include <ctype.h>
 
-static void setProtocolError(const char *errstr, client *c, long pos);
+static void setProtocolError(const char *errstr, client *c);
+int postponeClientRead(client *c);
+
+/* Threaded I/O state, see the "Threaded I/O" section at the end of this
+ * file. io_threads_op is IO_THREADS_OP_IDLE unless a batch of clients is
+ * being served by the I/O threads: in that window freeing a client
+ * synchronously is not safe, and the async free queue is shared. */
+#define IO_THREADS_OP_IDLE 0
+#define IO_THREADS_OP_READ 1
+#define IO_THREADS_OP_WRITE 2
+static int io_threads_op = IO_THREADS_OP_IDLE;
+static pthread_mutex_t async_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t querybuf_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set while processEventsWhileBlocked() runs, since in that context the
+ * postponed reads would never be handled by beforeSleep(). */
+static int processing_events_while_blocked = 0;
 
 /* Return the size consumed from the allocator, for the specified SDS string,
  * including internal fragmentation. This function is used in order to compute
@@ -54,13 +70,25 @@ size_t getStringObjectSdsUsedMemory(robj *o) {
     }
 }
 
-/* Client.reply list dup and free methods. */
+/* Client.reply list dup and free methods. The nodes of the list are string
+ * objects: either chunks of protocol owned by the client, or large values
+ * referenced without copying them, see _addReplyObjectToList(). */
 void *dupClientReplyValue(void *o) {
-    return sdsdup(o);
+    incrRefCount((robj*)o);
+    return o;
 }
 
 void freeClientReplyValue(void *o) {
-    sdsfree(o);
+    /* NULL is the placeholder of addDeferredMultiBulkLength(). */
+    if (o) decrRefCount((robj*)o);
+}
+
+/* Release the shared reply objects that an I/O thread finished sending to
+ * the client, see _writevToClient(). */
+static void releaseClientReplyUnref(client *c) {
+    if (c->reply_unref == NULL) return;
+    listRelease(c->reply_unref);
+    c->reply_unref = NULL;
 }
 
 int listMatchObjects(void *a, void *b) {
@@ -96,12 +124,15 @@ client *createClient(int fd) {
     c->name = NULL;
     c->bufpos = 0;
     c->querybuf = sdsempty();
+    c->qb_pos = 0;
     c->pending_querybuf = sdsempty();
     c->querybuf_peak = 0;
     c->reqtype = 0;
     c->argc = 0;
     c->argv = NULL;
     c->cmd = c->lastcmd = NULL;
+    c->cached_cmd = NULL;
+    c->cached_cmd_name = NULL;
     c->multibulklen = 0;
     c->bulklen = -1;
     c->sentlen = 0;
@@ -119,6 +150,7 @@ client *createClient(int fd) {
     c->slave_capa = SLAVE_CAPA_NONE;
     c->reply = listCreate();
     c->reply_bytes = 0;
+    c->reply_unref = NULL;
     c->obuf_soft_limit_reached_time = 0;
     listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
@@ -162,6 +194,25 @@ client *createClient(int fd) {
  * Typically gets called every time a reply is built, before adding more
  * data to the clients output buffers. If the function returns C_ERR no
  * data should be appended to the output buffers. */
+/* Put the client in the queue of clients that should write their output
+ * buffers to the socket before returning to the event loop, unless it is
+ * already there or it is a slave that can't receive writes yet. */
+void clientInstallWriteHandler(client *c) {
+    if (!(c->flags & CLIENT_PENDING_WRITE) &&
+        (c->replstate == REPL_STATE_NONE ||
+         (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
+    {
+        /* Here instead of installing the write handler, we just flag the
+         * client and put it into a list of clients that have something
+         * to write to the socket. This way before re-entering the event
+         * loop, we can try to directly write to the client sockets avoiding
+         * a system call. We'll only really install the write handler if
+         * we'll not be able to write the whole reply at once. */
+        c->flags |= CLIENT_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
+    }
+}
+
 int prepareClientToWrite(client *c) {
     /* If it's the Lua client we always return ok without installing any
      * handler since there is no socket at all. */
@@ -180,21 +231,13 @@ int prepareClientToWrite(client *c) {
     /* Schedule the client to write the output buffers to the socket only
      * if not already done (there were no pending writes already and the client
      * was yet not flagged), and, for slaves, if the slave can actually
-     * receive writes at this stage. */
-    if (!clientHasPendingReplies(c) &&
-        !(c->flags & CLIENT_PENDING_WRITE) &&
-        (c->replstate == REPL_STATE_NONE ||
-         (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
-    {
-        /* Here instead of installing the write handler, we just flag the
-         * client and put it into a list of clients that have something
-         * to write to the socket. This way before re-entering the event
-         * loop, we can try to directly write to the client sockets avoiding
-         * a system call. We'll only really install the write handler if
-         * we'll not be able to write the whole reply at once. */
-        c->flags |= CLIENT_PENDING_WRITE;
-        listAddNodeHead(server.clients_pending_write,c);
-    }
+     * receive writes at this stage.
+     *
+     * If the client is being served by an I/O thread we can't touch the
+     * global list: the main thread will install the handler once the
+     * thread is done (see handleClientsWithPendingReadsUsingThreads()). */
+    if (!clientHasPendingReplies(c) && !(c->flags & CLIENT_PENDING_READ))
+        clientInstallWriteHandler(c);
 
     /* Authorize the caller to queue in the output buffer of this client. */
     return C_OK;
@@ -221,85 +264,80 @@ int _addReplyToBuffer(client *c, const char *s, size_t len) {
     return C_OK;
 }
 
+/* Return the last chunk of the reply list if 'len' more bytes can be
+ * appended to it, otherwise NULL. Only chunks owned just by this client can
+ * be modified in place: values referenced by the reply list, or chunks
+ * shared with copyClientOutputBuffer(), are never touched. */
+static robj *_replyListTailForAppend(client *c, size_t len) {
+    listNode *ln = listLast(c->reply);
+    robj *tail;
+
+    if (ln == NULL) return NULL;
+    tail = listNodeValue(ln);
+
+    /* If tail == NULL it was set via addDeferredMultiBulkLength(). */
+    if (tail == NULL || tail->refcount != 1 ||
+        tail->encoding != OBJ_ENCODING_RAW) return NULL;
+    if (sdslen(tail->ptr)+len > PROTO_REPLY_CHUNK_BYTES) return NULL;
+    return tail;
+}
+
+/* Add the string object 'o' to the reply list. Large values are not copied:
+ * the list just takes a reference to the object, and the value is written
+ * to the socket directly from its own memory. This is safe since the code
+ * modifying strings in place always unshares objects with refcount > 1
+ * first, see dbUnshareStringValue(). Fake clients (Lua, modules) collect
+ * their reply in other ways, so they always get a copy. */
 void _addReplyObjectToList(client *c, robj *o) {
+    size_t len = sdslen(o->ptr);
+    robj *tail;
+
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        sds s = sdsdup(o->ptr);
-        listAddNodeTail(c->reply,s);
-        c->reply_bytes += sdslen(s);
+    if (len >= PROTO_REPLY_ZERO_COPY_BYTES && c->fd != -1) {
+        incrRefCount(o);
+        listAddNodeTail(c->reply,o);
+    } else if ((tail = _replyListTailForAppend(c,len)) != NULL) {
+        tail->ptr = sdscatlen(tail->ptr,o->ptr,len);
     } else {
-        listNode *ln = listLast(c->reply);
-        sds tail = listNodeValue(ln);
-
-        /* Append to this object when possible. If tail == NULL it was
-         * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+sdslen(o->ptr) <= PROTO_REPLY_CHUNK_BYTES) {
-            tail = sdscatsds(tail,o->ptr);
-            listNodeValue(ln) = tail;
-            c->reply_bytes += sdslen(o->ptr);
-        } else {
-            sds s = sdsdup(o->ptr);
-            listAddNodeTail(c->reply,s);
-            c->reply_bytes += sdslen(s);
-        }
+        listAddNodeTail(c->reply,createObject(OBJ_STRING,sdsdup(o->ptr)));
     }
+    c->reply_bytes += len;
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
 /* This method takes responsibility over the sds. When it is no longer
  * needed it will be free'd, otherwise it ends up in a robj. */
 void _addReplySdsToList(client *c, sds s) {
+    size_t len = sdslen(s);
+    robj *tail;
+
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) {
         sdsfree(s);
         return;
     }
 
-    if (listLength(c->reply) == 0) {
-        listAddNodeTail(c->reply,s);
-        c->reply_bytes += sdslen(s);
+    if ((tail = _replyListTailForAppend(c,len)) != NULL) {
+        tail->ptr = sdscatsds(tail->ptr,s);
+        sdsfree(s);
     } else {
-        listNode *ln = listLast(c->reply);
-        sds tail = listNodeValue(ln);
-
-        /* Append to this object when possible. If tail == NULL it was
-         * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+sdslen(s) <= PROTO_REPLY_CHUNK_BYTES) {
-            tail = sdscatsds(tail,s);
-            listNodeValue(ln) = tail;
-            c->reply_bytes += sdslen(s);
-            sdsfree(s);
-        } else {
-            listAddNodeTail(c->reply,s);
-            c->reply_bytes += sdslen(s);
-        }
+        listAddNodeTail(c->reply,createObject(OBJ_STRING,s));
     }
+    c->reply_bytes += len;
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
 void _addReplyStringToList(client *c, const char *s, size_t len) {
+    robj *tail;
+
     if (c->flags & CLIENT_CLOSE_AFTER_REPLY) return;
 
-    if (listLength(c->reply) == 0) {
-        sds node = sdsnewlen(s,len);
-        listAddNodeTail(c->reply,node);
-        c->reply_bytes += len;
+    if ((tail = _replyListTailForAppend(c,len)) != NULL) {
+        tail->ptr = sdscatlen(tail->ptr,s,len);
     } else {
-        listNode *ln = listLast(c->reply);
-        sds tail = listNodeValue(ln);
-
-        /* Append to this object when possible. If tail == NULL it was
-         * set via addDeferredMultiBulkLength(). */
-        if (tail && sdslen(tail)+len <= PROTO_REPLY_CHUNK_BYTES) {
-            tail = sdscatlen(tail,s,len);
-            listNodeValue(ln) = tail;
-            c->reply_bytes += len;
-        } else {
-            sds node = sdsnewlen(s,len);
-            listAddNodeTail(c->reply,node);
-            c->reply_bytes += len;
-        }
+        listAddNodeTail(c->reply,createObject(OBJ_STRING,sdsnewlen(s,len)));
     }
+    c->reply_bytes += len;
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
@@ -451,23 +489,26 @@ void *addDeferredMultiBulkLength(client *c) {
 /* Populate the length object and try gluing it to the next chunk. */
 void setDeferredMultiBulkLength(client *c, void *node, long length) {
     listNode *ln = (listNode*)node;
-    sds len, next;
+    robj *len, *next;
 
     /* Abort when *node is NULL: when the client should not accept writes
      * we return NULL in addDeferredMultiBulkLength() */
     if (node == NULL) return;
 
-    len = sdscatprintf(sdsnewlen("*",1),"%ld\r\n",length);
+    len = createObject(OBJ_STRING,
+        sdscatprintf(sdsnewlen("*",1),"%ld\r\n",length));
     listNodeValue(ln) = len;
-    c->reply_bytes += sdslen(len);
+    c->reply_bytes += sdslen(len->ptr);
     if (ln->next != NULL) {
         next = listNodeValue(ln->next);
 
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next != NULL) {
-            len = sdscatsds(len,next);
+        /* Only glue when the next node is non-NULL and is a chunk of
+         * protocol: referenced values are not worth copying. */
+        if (next != NULL && next->refcount == 1 &&
+            sdslen(next->ptr) <= PROTO_REPLY_CHUNK_BYTES)
+        {
+            len->ptr = sdscatsds(len->ptr,next->ptr);
             listDelNode(c->reply,ln->next);
-            listNodeValue(ln) = len;
             /* No need to update c->reply_bytes: we are just moving the same
              * amount of bytes from one node to another. */
         }
@@ -643,6 +684,30 @@ void copyClientOutputBuffer(client *dst, client *src) {
     dst->reply_bytes = src->reply_bytes;
 }
 
+/* Replace the values referenced by the reply lists of the clients with
+ * private copies. This is needed before handing a whole dataset to the
+ * lazyfree threads, which can't update the reference count of objects
+ * still shared with the main thread. */
+void unshareClientsReplyObjects(void) {
+    listIter li, ri;
+    listNode *ln, *rn;
+
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+
+        listRewind(c->reply,&ri);
+        while((rn = listNext(&ri))) {
+            robj *o = listNodeValue(rn);
+
+            if (o == NULL || o->refcount == 1 ||
+                sdslen(o->ptr) < PROTO_REPLY_ZERO_COPY_BYTES) continue;
+            listNodeValue(rn) = createObject(OBJ_STRING,sdsdup(o->ptr));
+            decrRefCount(o);
+        }
+    }
+}
+
 /* Return true if the specified client has pending reply buffers to write to
  * the socket. */
 int clientHasPendingReplies(client *c) {
@@ -819,6 +884,14 @@ void unlinkClient(client *c) {
         c->flags &= ~CLIENT_PENDING_WRITE;
     }
 
+    /* Remove from the list of pending reads if needed. */
+    if (c->flags & CLIENT_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        serverAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+        c->flags &= ~CLIENT_PENDING_READ;
+    }
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & CLIENT_UNBLOCKED) {
@@ -876,6 +949,7 @@ void freeClient(client *c) {
 
     /* Free data structures. */
     listRelease(c->reply);
+    releaseClientReplyUnref(c);
     freeClientArgv(c);
 
     /* Unlink the client: this will close the socket, remove the I/O
@@ -930,7 +1004,25 @@ void freeClient(client *c) {
 void freeClientAsync(client *c) {
     if (c->flags & CLIENT_CLOSE_ASAP || c->flags & CLIENT_LUA) return;
     c->flags |= CLIENT_CLOSE_ASAP;
-    listAddNodeTail(server.clients_to_close,c);
+    if (io_threads_op == IO_THREADS_OP_IDLE) {
+        listAddNodeTail(server.clients_to_close,c);
+    } else {
+        /* Clients served by different I/O threads may be scheduled for
+         * release at the same time. */
+        pthread_mutex_lock(&async_free_queue_mutex);
+        listAddNodeTail(server.clients_to_close,c);
+        pthread_mutex_unlock(&async_free_queue_mutex);
+    }
+}
+
+/* Used by the read and write handlers to release a client on errors. While
+ * the I/O threads are running the client can only be scheduled to be freed
+ * later, since freeClient() touches global state. */
+static void freeClientFromIOHandler(client *c) {
+    if (io_threads_op == IO_THREADS_OP_IDLE)
+        freeClient(c);
+    else
+        freeClientAsync(c);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -944,51 +1036,103 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
+/* Write with a single writev() call the pending output of the client: the
+ * static buffer followed by the nodes of the reply list, up to IOV_MAX
+ * buffers or NET_MAX_WRITES_PER_EVENT bytes (more if a single node is
+ * bigger). Then consume what was written, possibly in the middle of a
+ * node, updating c->sentlen. Returns the value returned by writev(). */
+static ssize_t _writevToClient(int fd, client *c) {
+    struct iovec iov[IOV_MAX];
+    int iovcnt = 0;
+    size_t iovbytes = 0, offset = c->sentlen, objlen;
+    ssize_t nwritten, remaining;
+    listIter li;
+    listNode *ln;
+    robj *o;
+
+    if (c->bufpos > 0) {
+        iov[iovcnt].iov_base = c->buf+c->sentlen;
+        iov[iovcnt].iov_len = c->bufpos-c->sentlen;
+        iovbytes += iov[iovcnt++].iov_len;
+        offset = 0;
+    }
+    listRewind(c->reply,&li);
+    while(iovcnt < IOV_MAX && iovbytes < NET_MAX_WRITES_PER_EVENT &&
+          (ln = listNext(&li)) != NULL)
+    {
+        o = listNodeValue(ln);
+        objlen = sdslen(o->ptr);
+        if (objlen == 0) continue;
+        iov[iovcnt].iov_base = (char*)o->ptr+offset;
+        iov[iovcnt].iov_len = objlen-offset;
+        iovbytes += iov[iovcnt++].iov_len;
+        offset = 0;
+    }
+
+    /* Only empty nodes are pending: nothing to write, but the loop below
+     * still releases them. */
+    if (iovcnt == 0) {
+        nwritten = 0;
+    } else {
+        nwritten = writev(fd,iov,iovcnt);
+        if (nwritten <= 0) return nwritten;
+    }
+
+    remaining = nwritten;
+    if (c->bufpos > 0) {
+        if ((size_t)remaining < (size_t)c->bufpos-c->sentlen) {
+            c->sentlen += remaining;
+            return nwritten;
+        }
+        /* The buffer was sent, set bufpos to zero to continue with the
+         * remainder of the reply. */
+        remaining -= c->bufpos-c->sentlen;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+    while(listLength(c->reply)) {
+        ln = listFirst(c->reply);
+        o = listNodeValue(ln);
+        objlen = sdslen(o->ptr);
+        if ((size_t)remaining < objlen-c->sentlen) {
+            c->sentlen += remaining;
+            break;
+        }
+
+        /* The object on head was fully sent, go to the next one. The
+         * reference counts of objects shared with other clients or with
+         * the dataset can only be updated by the main thread: when called
+         * from an I/O thread such objects are moved to c->reply_unref. */
+        remaining -= objlen-c->sentlen;
+        if (o->refcount > 1 && io_threads_op != IO_THREADS_OP_IDLE) {
+            if (c->reply_unref == NULL) {
+                c->reply_unref = listCreate();
+                listSetFreeMethod(c->reply_unref,freeClientReplyValue);
+            }
+            listAddNodeTail(c->reply_unref,o);
+            listNodeValue(ln) = NULL;
+        }
+        listDelNode(c->reply,ln);
+        c->sentlen = 0;
+        c->reply_bytes -= objlen;
+        /* If there are no longer objects in the list, we expect
+         * the count of reply bytes to be exactly zero. */
+        if (listLength(c->reply) == 0)
+            serverAssert(c->reply_bytes == 0);
+    }
+    return nwritten;
+}
+
 /* Write data in output buffers to client. Return C_OK if the client
  * is still valid after the call, C_ERR if it was freed. */
 int writeToClient(int fd, client *c, int handler_installed) {
     ssize_t nwritten = 0, totwritten = 0;
-    size_t objlen;
-    sds o;
 
     while(clientHasPendingReplies(c)) {
-        if (c->bufpos > 0) {
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if ((int)c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
-            }
-        } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o);
+        nwritten = _writevToClient(fd,c);
+        if (nwritten <= 0) break;
+        totwritten += nwritten;
 
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                continue;
-            }
-
-            nwritten = write(fd, o + c->sentlen, objlen - c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objlen;
-                /* If there are no longer objects in the list, we expect
-                 * the count of reply bytes to be exactly zero. */
-                if (listLength(c->reply) == 0)
-                    serverAssert(c->reply_bytes == 0);
-            }
-        }
         /* Note that we avoid to send more than NET_MAX_WRITES_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -1006,14 +1150,14 @@ int writeToClient(int fd, client *c, int handler_installed) {
              zmalloc_used_memory() < server.maxmemory) &&
             !(c->flags & CLIENT_SLAVE)) break;
     }
-    server.stat_net_output_bytes += totwritten;
+    atomicIncr(server.stat_net_output_bytes,totwritten);
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
         } else {
             serverLog(LL_VERBOSE,
                 "Error writing to client: %s", strerror(errno));
-            freeClient(c);
+            freeClientFromIOHandler(c);
             return C_ERR;
         }
     }
@@ -1030,7 +1174,7 @@ int writeToClient(int fd, client *c, int handler_installed) {
 
         /* Close connection after entire reply has been sent. */
         if (c->flags & CLIENT_CLOSE_AFTER_REPLY) {
-            freeClient(c);
+            freeClientFromIOHandler(c);
             return C_ERR;
         }
     }
@@ -1116,34 +1260,34 @@ void resetClient(client *c) {
  */
 int processInlineBuffer(client *c) {
     char *newline;
-    int argc, j;
+    int argc, j, linefeed_chars = 1;
     sds *argv, aux;
     size_t querylen;
 
     /* Search for end of line */
     // 实际上RESP协议定制的分隔符必须是'\r\n'，这也反应了协议的设计原则之一简单
-    newline = strchr(c->querybuf,'\n');
+    newline = strchr(c->querybuf+c->qb_pos,'\n');
 
     /* Nothing to do without a \r\n */
     // 如果没有CRLF则直接认为这串字节流还未读取完成，返回-1并在外循环再读取
     if (newline == NULL) {
         // 不能无休止读取字节流
-        if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+        if (sdslen(c->querybuf)-c->qb_pos > PROTO_INLINE_MAX_SIZE) {
             addReplyError(c,"Protocol error: too big inline request");
-            setProtocolError("too big inline request",c,0);
+            setProtocolError("too big inline request",c);
         }
         return C_ERR;
     }
 
     /* Handle the \r\n case. */
     // 处理'\r\n'，newline往前移一个字符
-    if (newline && newline != c->querybuf && *(newline-1) == '\r')
-        newline--;
+    if (newline != c->querybuf+c->qb_pos && *(newline-1) == '\r')
+        newline--, linefeed_chars++;
 
     /* Split the input buffer up to the \r\n */
     // 计算实际有效字节流长度并将其转换SDS字符串
-    querylen = newline-(c->querybuf);
-    aux = sdsnewlen(c->querybuf,querylen);
+    querylen = newline-(c->querybuf+c->qb_pos);
+    aux = sdsnewlen(c->querybuf+c->qb_pos,querylen);
     // 将字符串分割为一组入参，该函数里包含了各种空格、水平制动符、换行符的处理
     // RESP内置命令来讲就是以空格分割字符串，其中分割后的第一个字符串就是命令名称
     // 后续也就是根据这个命令名称到'redisCommandTable'中查找具体命令执行函数
@@ -1152,7 +1296,7 @@ int processInlineBuffer(client *c) {
     // 这里设计就稍显丑陋了'sdssplitargs()'函数返回NULL时一定就是因为字符串中引号数量不对
     if (argv == NULL) {
         addReplyError(c,"Protocol error: unbalanced quotes in request");
-        setProtocolError("unbalanced quotes in inline request",c,0);
+        setProtocolError("unbalanced quotes in inline request",c);
         return C_ERR;
     }
 
@@ -1166,7 +1310,7 @@ int processInlineBuffer(client *c) {
     /* Leave data after the first line of the query in the buffer */
     // 可以使用'\r\n'分割一次性传递多个命令过来
     // 所以丢弃掉已处理完成的字符串，再次走外循环处理剩下的
-    sdsrange(c->querybuf,querylen+2,-1);
+    c->qb_pos += querylen+linefeed_chars;
 
     /* Setup argv array on client structure */
     // 如果解析出来的参数不为空则将参数转换为robj结构体
@@ -1191,19 +1335,21 @@ int processInlineBuffer(client *c) {
     return C_OK;
 }
 
-/* Helper function. Trims query buffer to make the function that processes
- * multi bulk requests idempotent. */
+/* Helper function. Logs the protocol error and flags the client to be
+ * closed once the error reply is sent. */
 #define PROTO_DUMP_LEN 128
-static void setProtocolError(const char *errstr, client *c, long pos) {
+static void setProtocolError(const char *errstr, client *c) {
     if (server.verbosity <= LL_VERBOSE) {
         sds client = catClientInfoString(sdsempty(),c);
 
         /* Sample some protocol to given an idea about what was inside. */
         char buf[256];
-        if (sdslen(c->querybuf) < PROTO_DUMP_LEN) {
-            snprintf(buf,sizeof(buf),"Query buffer during protocol error: '%s'", c->querybuf);
+        char *qb = c->querybuf+c->qb_pos;
+        size_t qblen = sdslen(c->querybuf)-c->qb_pos;
+        if (qblen < PROTO_DUMP_LEN) {
+            snprintf(buf,sizeof(buf),"Query buffer during protocol error: '%s'", qb);
         } else {
-            snprintf(buf,sizeof(buf),"Query buffer during protocol error: '%.*s' (... more %zu bytes ...) '%.*s'", PROTO_DUMP_LEN/2, c->querybuf, sdslen(c->querybuf)-PROTO_DUMP_LEN, PROTO_DUMP_LEN/2, c->querybuf+sdslen(c->querybuf)-PROTO_DUMP_LEN/2);
+            snprintf(buf,sizeof(buf),"Query buffer during protocol error: '%.*s' (... more %zu bytes ...) '%.*s'", PROTO_DUMP_LEN/2, qb, qblen-PROTO_DUMP_LEN, PROTO_DUMP_LEN/2, qb+qblen-PROTO_DUMP_LEN/2);
         }
 
         /* Remove non printable chars. */
@@ -1219,7 +1365,6 @@ static void setProtocolError(const char *errstr, client *c, long pos) {
         sdsfree(client);
     }
     c->flags |= CLIENT_CLOSE_AFTER_REPLY;
-    sdsrange(c->querybuf,pos,-1);
 }
 
 /* Process the query buffer for client 'c', setting up the client argument
@@ -1244,12 +1389,21 @@ static void setProtocolError(const char *errstr, client *c, long pos) {
  * 返回值
  *      解析成功返回0，解析失败或还未读取完成-1
  */
-int processMultibulkBuffer(client *c) {
+int processMultibulkBuffer(client *c, respScanner *scanner) {
     char *newline = NULL;
-    long pos = 0;
+    long pos = c->qb_pos, cr;
     int ok;
     long long ll;
 
+    /* The line ends are located with a scanner that indexes the buffer
+     * once for all the commands of the batch: start again if the buffer
+     * was trimmed or reallocated since the previous command. */
+    if (scanner->buf != c->querybuf ||
+        scanner->len != sdslen(c->querybuf))
+    {
+        respScannerInit(scanner,c->querybuf,sdslen(c->querybuf));
+    }
+
     // 外循环的第一次读取字节流
     if (c->multibulklen == 0) {
         /* The client should have been reset */
@@ -1259,15 +1413,16 @@ int processMultibulkBuffer(client *c) {
         /* Multi bulk length cannot be read without a \r\n */
         // 不论是内置命令还是RESP任何传输格式，都是使用'\r\n'作为分割
         // 使用单'\n'或者'\n\r'等都会引发不可预料的异常
-        newline = strchr(c->querybuf,'\r');
+        cr = respScannerNextCR(scanner,pos);
         // 和内置命令一样，未读取完则返回让外循环继续读取，但限制最大读取长度
-        if (newline == NULL) {
-            if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+        if (cr == -1) {
+            if (sdslen(c->querybuf)-pos > PROTO_INLINE_MAX_SIZE) {
                 addReplyError(c,"Protocol error: too big mbulk count string");
-                setProtocolError("too big mbulk count string",c,0);
+                setProtocolError("too big mbulk count string",c);
             }
             return C_ERR;
         }
+        newline = c->querybuf+cr;
 
         /* Buffer should also contain \n */
         if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
@@ -1276,20 +1431,20 @@ int processMultibulkBuffer(client *c) {
         /* We know for sure there is a whole line since newline != NULL,
          * so go ahead and find out the multi bulk length. */
         // 调这个函数了，第一个字节当然是'*'
-        serverAssertWithInfo(c,NULL,c->querybuf[0] == '*');
+        serverAssertWithInfo(c,NULL,c->querybuf[pos] == '*');
         // 解析实际命令长度，也就是第一行中'*'号的数字，最长为1M个元素
-        ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
+        ok = respParseLength(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
         if (!ok || ll > 1024*1024) {
             addReplyError(c,"Protocol error: invalid multibulk length");
-            setProtocolError("invalid mbulk count",c,pos);
+            setProtocolError("invalid mbulk count",c);
             return C_ERR;
         }
 
         pos = (newline-c->querybuf)+2;
         // 这一个普通命令是个空命令，直接跳过
         if (ll <= 0) {
-            // 去除掉已经解析过的字节，让外循环开始解析接下来的字节
-            sdsrange(c->querybuf,pos,-1);
+            // 跳过已经解析过的字节，让外循环开始解析接下来的字节
+            c->qb_pos = pos;
             return C_OK;
         }
 
@@ -1308,16 +1463,17 @@ int processMultibulkBuffer(client *c) {
         /* Read bulk length if unknown */
         // 读取Bulk Strings的实际字符串长度，也就是该元素第一行'$'符号后面的数字
         if (c->bulklen == -1) {
-            newline = strchr(c->querybuf+pos,'\r');
-            if (newline == NULL) {
-                if (sdslen(c->querybuf) > PROTO_INLINE_MAX_SIZE) {
+            cr = respScannerNextCR(scanner,pos);
+            if (cr == -1) {
+                if (sdslen(c->querybuf)-pos > PROTO_INLINE_MAX_SIZE) {
                     addReplyError(c,
                         "Protocol error: too big bulk count string");
-                    setProtocolError("too big bulk count string",c,0);
+                    setProtocolError("too big bulk count string",c);
                     return C_ERR;
                 }
                 break;
             }
+            newline = c->querybuf+cr;
 
             /* Buffer should also contain \n */
             // '\r\n'，不重复讲了
@@ -1329,15 +1485,15 @@ int processMultibulkBuffer(client *c) {
                 addReplyErrorFormat(c,
                     "Protocol error: expected '$', got '%c'",
                     c->querybuf[pos]);
-                setProtocolError("expected $ but got something else",c,pos);
+                setProtocolError("expected $ but got something else",c);
                 return C_ERR;
             }
 
             // 把Bulk Strings格式的长度读出来，这样可以一次性就取出实际字符串
-            ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
+            ok = respParseLength(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
             if (!ok || ll < 0 || ll > server.proto_max_bulk_len) {
                 addReplyError(c,"Protocol error: invalid bulk length");
-                setProtocolError("invalid bulk length",c,pos);
+                setProtocolError("invalid bulk length",c);
                 return C_ERR;
             }
 
@@ -1359,6 +1515,8 @@ int processMultibulkBuffer(client *c) {
                 // 除了字符串本身还需要存放'\r\n'
                 if (qblen < (size_t)ll+2)
                     c->querybuf = sdsMakeRoomFor(c->querybuf,ll+2-qblen);
+                /* The buffer moved: the scanner bitmap is stale. */
+                respScannerInit(scanner,c->querybuf,sdslen(c->querybuf));
             }
             c->bulklen = ll;
         }
@@ -1386,6 +1544,7 @@ int processMultibulkBuffer(client *c) {
                 c->querybuf = sdsnewlen(NULL,c->bulklen+2);
                 sdsclear(c->querybuf);
                 pos = 0;
+                respScannerInit(scanner,c->querybuf,0);
             } else {
                 // 直接将buffer中字节拷贝出来构建新的robj结构体
                 c->argv[c->argc++] =
@@ -1397,9 +1556,10 @@ int processMultibulkBuffer(client *c) {
         }
     }
 
-    /* Trim to pos */
-    // 保证丢弃调已经处理过的字节
-    if (pos) sdsrange(c->querybuf,pos,-1);
+    /* The parsed part of the buffer is trimmed by processInputBuffer(),
+     * once for all the commands of the batch. */
+    // 记录已经处理过的字节，由外循环统一丢弃
+    c->qb_pos = pos;
 
     /* We're done when c->multibulk == 0 */
     // 如果数组里的元素都处理完毕返回0，否则代表还剩余元素没处理完
@@ -1413,7 +1573,16 @@ int processMultibulkBuffer(client *c) {
 /* This function is called every time, in the client structure 'c', there is
  * more query buffer to process, because we read more data from the socket
  * or because a client was blocked and later reactivated, so there could be
- * pending query buffer, already representing a full command, to process. */
+ * pending query buffer, already representing a full command, to process.
+ *
+ * All the commands available in the buffer are parsed and executed back to
+ * back: the parsed commands are skipped advancing c->qb_pos, and the buffer
+ * is trimmed just once at the end, instead of moving the rest of the
+ * pipeline to the start of the buffer after every command. The replies of
+ * the whole batch are written together before returning to the event loop.
+ *
+ * Returns C_ERR if the client was freed while executing the commands, so
+ * that the caller must not access it anymore, otherwise C_OK. */
 /*
  * 处理请求的字节流，这是Redis读取请求并处理命令的主要逻辑
  *
@@ -1421,13 +1590,23 @@ int processMultibulkBuffer(client *c) {
  *      1. c: 客户端
  *
  */
-void processInputBuffer(client *c) {
-    server.current_client = c;
-    /* Keep processing while there is something in the input buffer */
+int processInputBuffer(client *c) {
+    /* When called from an I/O thread we only parse: global state such as
+     * the current client or the pause state can't be touched. */
+    int io_thread = c->flags & CLIENT_PENDING_READ;
+    respScanner scanner;
+
+    respScannerInit(&scanner,NULL,0);
+    if (!io_thread) server.current_client = c;
+    /* Keep processing while there is something in the input buffer, or
+     * a command already parsed by an I/O thread waiting to be executed. */
     // 只要字节流里还有内容
-    while(sdslen(c->querybuf)) {
+    while((c->querybuf && c->qb_pos < sdslen(c->querybuf)) ||
+          c->flags & CLIENT_PENDING_COMMAND)
+    {
         /* Return if clients are paused. */
-        if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
+        if (!io_thread && !(c->flags & CLIENT_SLAVE) && clientsArePaused())
+            break;
 
         /* Immediately abort if the client is in the middle of something. */
         if (c->flags & CLIENT_BLOCKED) break;
@@ -1442,32 +1621,44 @@ void processInputBuffer(client *c) {
         /* Determine request type when unknown. */
         // 通过字节流第一个字符来判断是什么格式，Redis只接收两种格式的命令
         // 如果以'*'开头则代表是Bulk String数组，其它则都认为是内置命令格式
-        if (!c->reqtype) {
-            if (c->querybuf[0] == '*') {
-                c->reqtype = PROTO_REQ_MULTIBULK;
-            } else {
-                c->reqtype = PROTO_REQ_INLINE;
+        if (!(c->flags & CLIENT_PENDING_COMMAND)) {
+            if (!c->reqtype) {
+                if (c->querybuf[c->qb_pos] == '*') {
+                    c->reqtype = PROTO_REQ_MULTIBULK;
+                } else {
+                    c->reqtype = PROTO_REQ_INLINE;
+                }
             }
-        }
 
-        // 根据不同类型调用不同的解析函数
-        if (c->reqtype == PROTO_REQ_INLINE) {
-            if (processInlineBuffer(c) != C_OK) break;
-        } else if (c->reqtype == PROTO_REQ_MULTIBULK) {
-            if (processMultibulkBuffer(c) != C_OK) break;
-        } else {
-            serverPanic("Unknown request type");
+            // 根据不同类型调用不同的解析函数
+            if (c->reqtype == PROTO_REQ_INLINE) {
+                if (processInlineBuffer(c) != C_OK) break;
+            } else if (c->reqtype == PROTO_REQ_MULTIBULK) {
+                if (processMultibulkBuffer(c,&scanner) != C_OK) break;
+            } else {
+                serverPanic("Unknown request type");
+            }
         }
 
         /* Multibulk processing could see a <= 0 length. */
         if (c->argc == 0) {
             resetClient(c);
         } else {
+            /* If we are in the context of an I/O thread, we can't really
+             * execute the command here. All we can do is to flag the client
+             * as one that needs to process the command. */
+            if (io_thread) {
+                c->flags |= CLIENT_PENDING_COMMAND;
+                break;
+            }
+            c->flags &= ~CLIENT_PENDING_COMMAND;
+
             /* Only reset the client when the command was executed. */
             if (processCommand(c) == C_OK) {
                 if (c->flags & CLIENT_MASTER && !(c->flags & CLIENT_MULTI)) {
                     /* Update the applied replication offset of our master. */
-                    c->reploff = c->read_reploff - sdslen(c->querybuf);
+                    c->reploff = c->read_reploff - sdslen(c->querybuf) +
+                                 c->qb_pos;
                 }
 
                 /* Don't reset the client structure for clients blocked in a
@@ -1480,10 +1671,85 @@ void processInputBuffer(client *c) {
             /* freeMemoryIfNeeded may flush slave output buffers. This may
              * result into a slave, that may be the active client, to be
              * freed. */
-            if (server.current_client == NULL) break;
+            if (server.current_client == NULL) return C_ERR;
         }
     }
-    server.current_client = NULL;
+
+    /* Trim the commands processed in this batch. */
+    if (c->qb_pos) {
+        sdsrange(c->querybuf,c->qb_pos,-1);
+        c->qb_pos = 0;
+    }
+    if (!io_thread) server.current_client = NULL;
+    return C_OK;
+}
+
+/* -----------------------------------------------------------------------------
+ * Query buffers pool
+ *
+ * Clients with no pending input after their commands are processed give
+ * their query buffer back to a pool shared by all the clients, and set
+ * c->querybuf to NULL. When new data arrives a buffer is taken again from the
+ * pool, so that the memory used by the query buffers depends on the number of
+ * clients actually sending commands and not on the connected ones.
+ * -------------------------------------------------------------------------- */
+
+/* Resize the pool according to server.querybuf_pool_size, releasing the
+ * buffers that no longer fit. */
+void resizeQueryBufferPool(void) {
+    while(server.querybuf_pool_len > server.querybuf_pool_size) {
+        sds qb = server.querybuf_pool[--server.querybuf_pool_len];
+        server.querybuf_pool_memory -= sdsAllocSize(qb);
+        sdsfree(qb);
+    }
+    if (server.querybuf_pool_size) {
+        server.querybuf_pool = zrealloc(server.querybuf_pool,
+            sizeof(sds)*server.querybuf_pool_size);
+    } else {
+        zfree(server.querybuf_pool);
+        server.querybuf_pool = NULL;
+    }
+}
+
+/* Give a query buffer to a client that has none, reusing one of the pool
+ * when possible. This may be called by the I/O threads reading from
+ * different clients at the same time. */
+static void clientAcquireQueryBuffer(client *c) {
+    int locked = io_threads_op != IO_THREADS_OP_IDLE;
+
+    if (locked) pthread_mutex_lock(&querybuf_pool_mutex);
+    if (server.querybuf_pool_len) {
+        c->querybuf = server.querybuf_pool[--server.querybuf_pool_len];
+        server.querybuf_pool_memory -= sdsAllocSize(c->querybuf);
+        server.stat_querybuf_pool_hits++;
+    } else {
+        server.stat_querybuf_pool_misses++;
+    }
+    if (locked) pthread_mutex_unlock(&querybuf_pool_mutex);
+    if (c->querybuf == NULL) c->querybuf = sdsempty();
+}
+
+/* Give the query buffer of the client back to the pool if the client has no
+ * pending input. Buffers grown for big arguments are just released. The
+ * master keeps its buffer, that is used to compute the replication offset.
+ * This is only called by the main thread while the I/O threads are idle. */
+void clientReleaseQueryBuffer(client *c) {
+    size_t size;
+
+    if (server.querybuf_pool_size == 0 || c->querybuf == NULL ||
+        sdslen(c->querybuf) || c->multibulklen ||
+        c->flags & CLIENT_MASTER) return;
+
+    size = sdsAllocSize(c->querybuf);
+    if (size <= PROTO_IOBUF_POOL_MAX_SIZE &&
+        server.querybuf_pool_len < server.querybuf_pool_size)
+    {
+        server.querybuf_pool[server.querybuf_pool_len++] = c->querybuf;
+        server.querybuf_pool_memory += size;
+    } else {
+        sdsfree(c->querybuf);
+    }
+    c->querybuf = NULL;
 }
 
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
@@ -1493,6 +1759,11 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     UNUSED(el);
     UNUSED(mask);
 
+    /* Check if we want to read from the client later when exiting from
+     * the event loop. This is the case if threaded I/O is enabled. */
+    if (postponeClientRead(c)) return;
+
+    if (c->querybuf == NULL) clientAcquireQueryBuffer(c);
     readlen = PROTO_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1517,12 +1788,12 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             return;
         } else {
             serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
+            freeClientFromIOHandler(c);
             return;
         }
     } else if (nread == 0) {
         serverLog(LL_VERBOSE, "Client closed connection");
-        freeClient(c);
+        freeClientFromIOHandler(c);
         return;
     } else if (c->flags & CLIENT_MASTER) {
         /* Append the query buffer to the pending (not applied) buffer
@@ -1535,7 +1806,7 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     sdsIncrLen(c->querybuf,nread);
     c->lastinteraction = server.unixtime;
     if (c->flags & CLIENT_MASTER) c->read_reploff += nread;
-    server.stat_net_input_bytes += nread;
+    atomicIncr(server.stat_net_input_bytes,nread);
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -1543,7 +1814,7 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         serverLog(LL_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
-        freeClient(c);
+        freeClientFromIOHandler(c);
         return;
     }
 
@@ -1554,10 +1825,13 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
      * corresponding part of the replication stream, will be propagated to
      * the sub-slaves and to the replication backlog. */
     if (!(c->flags & CLIENT_MASTER)) {
-        processInputBuffer(c);
+        if (processInputBuffer(c) == C_ERR) return;
+        /* I/O threads just parse the buffer: it is released after the
+         * commands are executed, in handleClientsWithPendingReadsUsingThreads(). */
+        if (io_threads_op == IO_THREADS_OP_IDLE) clientReleaseQueryBuffer(c);
     } else {
         size_t prev_offset = c->reploff;
-        processInputBuffer(c);
+        if (processInputBuffer(c) == C_ERR) return;
         size_t applied = c->reploff - prev_offset;
         if (applied) {
             replicationFeedSlavesFromMasterStream(server.slaves,
@@ -1579,7 +1853,8 @@ void getClientsMaxBuffers(unsigned long *longest_output_list,
         c = listNodeValue(ln);
 
         if (listLength(c->reply) > lol) lol = listLength(c->reply);
-        if (sdslen(c->querybuf) > bib) bib = sdslen(c->querybuf);
+        if (c->querybuf && sdslen(c->querybuf) > bib)
+            bib = sdslen(c->querybuf);
     }
     *longest_output_list = lol;
     *biggest_input_buffer = bib;
@@ -1664,8 +1939,9 @@ sds catClientInfoString(sds s, client *client) {
         (int) dictSize(client->pubsub_channels),
         (int) listLength(client->pubsub_patterns),
         (client->flags & CLIENT_MULTI) ? client->mstate.count : -1,
-        (unsigned long long) sdslen(client->querybuf),
-        (unsigned long long) sdsavail(client->querybuf),
+        (unsigned long long) (client->querybuf ?
+            sdslen(client->querybuf)-client->qb_pos : 0),
+        (unsigned long long) (client->querybuf ? sdsavail(client->querybuf) : 0),
         (unsigned long long) client->bufpos,
         (unsigned long long) listLength(client->reply),
         (unsigned long long) getClientOutputBufferMemoryUsage(client),
@@ -1948,7 +2224,7 @@ void rewriteClientCommandArgument(client *c, int i, robj *newval) {
  * the caller wishes. The main usage of this function currently is
  * enforcing the client output length limits. */
 unsigned long getClientOutputBufferMemoryUsage(client *c) {
-    unsigned long list_item_size = sizeof(listNode)+5;
+    unsigned long list_item_size = sizeof(listNode)+sizeof(robj)+5;
     /* The +5 above means we assume an sds16 hdr, may not be true
      * but is not going to be a problem. */
 
@@ -2148,6 +2424,8 @@ int clientsArePaused(void) {
 int processEventsWhileBlocked(void) {
     int iterations = 4; /* See the function top-comment. */
     int count = 0;
+
+    processing_events_while_blocked = 1;
     while (iterations--) {
         int events = 0;
         events += aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
@@ -2155,5 +2433,320 @@ int processEventsWhileBlocked(void) {
         if (!events) break;
         count += events;
     }
+    processing_events_while_blocked = 0;
     return count;
 }
+
+/* ==========================================================================
+ * Threaded I/O
+ * ========================================================================== */
+
+/* When io-threads is greater than one, reading from and writing to the
+ * client sockets can be performed by a pool of threads, while commands are
+ * still executed by the main thread only. The main thread distributes the
+ * clients that are ready to be served among the threads (taking one slice
+ * for itself), then waits for all of them to finish before touching the
+ * clients again, so a client is never accessed by two threads at the same
+ * time and no locking is needed on the client structure. */
+typedef struct ioThread {
+    pthread_t tid;
+    pthread_mutex_t mutex;  /* Held by the main thread to stop the thread. */
+    list *clients;          /* Clients to serve in the current batch. */
+    unsigned long pending;  /* Clients of the batch not yet served. */
+    pthread_mutex_t pending_mutex; /* Only used if atomics are missing. */
+} ioThread;
+
+static ioThread io_threads[IO_THREADS_MAX_NUM];
+
+static unsigned long getIOPendingCount(int i) {
+    unsigned long count;
+    atomicGetWithSync(io_threads[i].pending,count);
+    return count;
+}
+
+static void setIOPendingCount(int i, unsigned long count) {
+    atomicSetWithSync(io_threads[i].pending,count);
+}
+
+void *IOThreadMain(void *myid) {
+    /* The ID is the thread number (from 0 to server.io_threads_num-1), and is
+     * used by the thread to just manipulate a single sub-array of clients. */
+    long id = (unsigned long)myid;
+    ioThread *t = &io_threads[id];
+    listIter li;
+    listNode *ln;
+    int j;
+
+    while(1) {
+        /* Wait for start: spin for a while before checking the mutex, the
+         * main thread holds it when there is no work to do. */
+        for (j = 0; j < 1000000; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+
+        /* Give the main thread a chance to stop this thread. */
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&t->mutex);
+            pthread_mutex_unlock(&t->mutex);
+            continue;
+        }
+
+        serverAssert(getIOPendingCount(id) != 0);
+
+        /* Process: note that the main thread will never touch our list
+         * before we drop the pending count to 0. */
+        listRewind(t->clients,&li);
+        while((ln = listNext(&li))) {
+            client *c = listNodeValue(ln);
+            if (io_threads_op == IO_THREADS_OP_WRITE) {
+                writeToClient(c->fd,c,0);
+            } else if (io_threads_op == IO_THREADS_OP_READ) {
+                readQueryFromClient(server.el,c->fd,c,0);
+            } else {
+                serverPanic("io_threads_op value is unknown");
+            }
+        }
+        listEmpty(t->clients);
+        setIOPendingCount(id,0);
+    }
+}
+
+/* Initialize the data structures needed for threaded I/O. */
+void initThreadedIO(void) {
+    int i;
+
+    server.io_threads_active = 0; /* We start with threads not active. */
+
+    /* Don't spawn any thread if the user selected a single thread:
+     * we'll handle I/O directly from the main thread. */
+    if (server.io_threads_num == 1) return;
+
+    if (server.io_threads_num > IO_THREADS_MAX_NUM) {
+        serverLog(LL_WARNING,"Fatal: too many I/O threads configured. "
+                             "The maximum number is %d.", IO_THREADS_MAX_NUM);
+        exit(1);
+    }
+
+    /* Spawn and initialize the I/O threads. */
+    for (i = 0; i < server.io_threads_num; i++) {
+        ioThread *t = &io_threads[i];
+
+        /* Things we do for all the threads including the main thread. */
+        t->clients = listCreate();
+        t->pending = 0;
+        pthread_mutex_init(&t->pending_mutex,NULL);
+        if (i == 0) continue; /* Thread 0 is the main thread. */
+
+        /* Things we do only for the additional threads. */
+        pthread_mutex_init(&t->mutex,NULL);
+        pthread_mutex_lock(&t->mutex); /* Thread will be stopped. */
+        if (pthread_create(&t->tid,NULL,IOThreadMain,(void*)(long)i) != 0) {
+            serverLog(LL_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+    }
+}
+
+void startThreadedIO(void) {
+    int j;
+
+    serverAssert(server.io_threads_active == 0);
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads[j].mutex);
+    server.io_threads_active = 1;
+}
+
+void stopThreadedIO(void) {
+    int j;
+
+    /* We may have still clients with pending reads when this function
+     * is called: handle them before deactivating threads. */
+    handleClientsWithPendingReadsUsingThreads();
+    serverAssert(server.io_threads_active == 1);
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads[j].mutex);
+    server.io_threads_active = 0;
+}
+
+/* This function checks if there are not enough pending clients to justify
+ * taking the I/O threads active: in that case I/O threads are stopped if
+ * currently active. We track the pending writes as a measure of clients
+ * we need to handle in parallel, however the I/O threading is disabled
+ * globally for reads as well if we have too little pending clients.
+ *
+ * The function returns 0 if the I/O threading should be used becuase there
+ * are enough active threads, otherwise 1 is returned and the I/O threads
+ * could be possibly stopped (if already active) as a side effect. */
+int stopThreadedIOIfNeeded(void) {
+    int pending = listLength(server.clients_pending_write);
+
+    /* Return ASAP if I/O threads are disabled (single threaded mode). */
+    if (server.io_threads_num == 1) return 1;
+
+    if (pending < (server.io_threads_num*2)) {
+        if (server.io_threads_active) stopThreadedIO();
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Assign the clients of the list 'l' to the I/O threads in a round robin
+ * fashion. Clients scheduled to be closed are just skipped. */
+static void distributeClientsToIOThreads(list *l) {
+    listIter li;
+    listNode *ln;
+    int item_id = 0;
+
+    listRewind(l,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (c->flags & CLIENT_CLOSE_ASAP) continue;
+        int target_id = item_id % server.io_threads_num;
+        listAddNodeTail(io_threads[target_id].clients,c);
+        item_id++;
+    }
+}
+
+/* Start the batch of the given type, serve the slice assigned to the main
+ * thread, and wait for the other threads to finish. */
+static void runIOThreadsBatch(int op) {
+    listIter li;
+    listNode *ln;
+    int j;
+
+    io_threads_op = op;
+    for (j = 1; j < server.io_threads_num; j++) {
+        int count = listLength(io_threads[j].clients);
+        setIOPendingCount(j,count);
+    }
+
+    /* Also use the main thread to process a slice of clients. */
+    listRewind(io_threads[0].clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (op == IO_THREADS_OP_WRITE)
+            writeToClient(c->fd,c,0);
+        else
+            readQueryFromClient(server.el,c->fd,c,0);
+    }
+    listEmpty(io_threads[0].clients);
+
+    /* Wait for all the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+        for (j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+    io_threads_op = IO_THREADS_OP_IDLE;
+}
+
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+    listIter li;
+    listNode *ln;
+
+    if (processed == 0) return 0; /* Return ASAP if there are no clients. */
+
+    /* If I/O threads are disabled or we have few clients to serve, don't
+     * use I/O threads, but the boring synchronous code. */
+    if (server.io_threads_num == 1 || stopThreadedIOIfNeeded()) {
+        return handleClientsWithPendingWrites();
+    }
+
+    /* Start threads if needed. */
+    if (!server.io_threads_active) startThreadedIO();
+
+    /* Distribute the clients across N different lists. The clients stay
+     * in the pending list until the batch is done, however they are
+     * no longer flagged, so that unlinkClient() will not search them. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        c->flags &= ~CLIENT_PENDING_WRITE;
+    }
+    distributeClientsToIOThreads(server.clients_pending_write);
+    runIOThreadsBatch(IO_THREADS_OP_WRITE);
+
+    /* Run the list of clients again to release the shared objects the
+     * threads sent, and to install the write handler where needed. */
+    listRewind(server.clients_pending_write,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        releaseClientReplyUnref(c);
+
+        /* Install the write handler if there are pending writes in some
+         * of the clients. */
+        if (!(c->flags & CLIENT_CLOSE_ASAP) &&
+            clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                sendReplyToClient, c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    listEmpty(server.clients_pending_write);
+
+    /* Update processed count on server */
+    server.stat_io_writes_processed += processed;
+    return processed;
+}
+
+/* Return 1 if we want to handle the client read later using threaded I/O.
+ * This is called by the readable handler of the event loop.
+ * As a side effect of calling this function the client is put in the
+ * pending read clients and flagged as such. */
+int postponeClientRead(client *c) {
+    if (server.io_threads_active &&
+        server.io_threads_do_reads &&
+        !processing_events_while_blocked &&
+        !(c->flags & (CLIENT_MASTER|CLIENT_SLAVE|CLIENT_PENDING_READ)))
+    {
+        c->flags |= CLIENT_PENDING_READ;
+        listAddNodeHead(server.clients_pending_read,c);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* When threaded I/O is also enabled for the reading + parsing side, the
+ * readable handler will just put normal clients into a queue of clients to
+ * process (instead of serving them synchronously). This function runs
+ * the queue using the I/O threads, and process them in order to accumulate
+ * the reads in the buffers, and also parse the first command available
+ * rendering it in the client structures. */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+
+    if (!server.io_threads_active || !server.io_threads_do_reads) return 0;
+    if (processed == 0) return 0;
+
+    /* Distribute the clients across N different lists. */
+    distributeClientsToIOThreads(server.clients_pending_read);
+    runIOThreadsBatch(IO_THREADS_OP_READ);
+
+    /* Run the list of clients again to process the new buffers. The
+     * commands executed may free other clients of the list, so we always
+     * restart from the head. */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        client *c = listNodeValue(ln);
+
+        c->flags &= ~CLIENT_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        if (processInputBuffer(c) == C_ERR) continue;
+        clientReleaseQueryBuffer(c);
+
+        /* We may have pending replies if a thread readQueryFromClient()
+         * produced replies and did not install a write handler (it can't). */
+        if (!(c->flags & CLIENT_PENDING_WRITE) && clientHasPendingReplies(c))
+            clientInstallWriteHandler(c);
+    }
+
+    /* Update processed count on server */
+    server.stat_io_reads_processed += processed;
+    return processed;
+}
@@ -1,4 +1,4 @@
-/* quicklist.c - A doubly linked list of ziplists
+/* quicklist.c - A doubly linked list of listpacks
  *
  * Copyright (c) 2014, Matt Stancliff <matt@genges.com>
  * All rights reserved.
@@ -32,8 +32,9 @@
 #include "quicklist.h"
 #include "zmalloc.h"
 #include "ziplist.h"
+#include "listpack.h"
 #include "util.h" /* for ll2string */
-#include "lzf.h"
+#include "codec.h"
 
 #if defined(REDIS_TEST) || defined(REDIS_TEST_VERBOSE)
 #include <stdio.h> /* for printf (debug printing), snprintf (genstr) */
@@ -46,11 +47,11 @@
 /* Optimization levels for size-based filling */
 static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
 
-/* Maximum size in bytes of any multi-element ziplist.
- * Larger values will live in their own isolated ziplists. */
+/* Maximum size in bytes of any multi-element listpack.
+ * Larger values will live in their own isolated listpacks. */
 #define SIZE_SAFETY_LIMIT 8192
 
-/* Minimum ziplist size in bytes for attempting compression. */
+/* Minimum listpack size in bytes for attempting compression. */
 #define MIN_COMPRESS_BYTES 48
 
 /* Minimum size reduction in bytes to store compressed quicklistNode data.
@@ -58,6 +59,22 @@ static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
  * resulted in a larger size than the original data. */
 #define MIN_COMPRESS_IMPROVE 8
 
+/* Codec used to compress nodes, see quicklistSetCompressCodec(). */
+static int compress_codec = CODEC_LZF;
+
+/* Set the codec used from now on to compress the nodes of every quicklist.
+ * Already compressed nodes keep their codec: the encoding of every node
+ * tells how to decompress it. */
+void quicklistSetCompressCodec(int codec) {
+    compress_codec = codec;
+}
+
+/* Return the codec of a compressed node. */
+int quicklistNodeCodec(const quicklistNode *node) {
+    return node->encoding == QUICKLIST_NODE_ENCODING_ZSTD ? CODEC_ZSTD :
+                                                            CODEC_LZF;
+}
+
 /* If not verbose testing, remove all debug printing. */
 #ifndef REDIS_TEST_VERBOSE
 #define D(...)
@@ -108,7 +125,7 @@ quicklist *quicklistCreate(void) {
     quicklist->len = 0;
     quicklist->count = 0;
     quicklist->compress = 0;
-    // -2代表ziplist的大小不超过8kb
+    // -2代表listpack的大小不超过8kb
     quicklist->fill = -2;
     return quicklist;
 }
@@ -134,12 +151,12 @@ void quicklistSetFill(quicklist *quicklist, int fill) {
 }
 
 /*
- * 设置快速链表的ziplist长度最大值和压缩深度
+ * 设置快速链表的listpack长度最大值和压缩深度
  *
  * 参数列表
  *      1. quicklist: 待设置的快速链表
- *      2. fill: ziplist长度最大值对应编码
- *      3. depth: 压缩深度，指ziplist两头共有多少个节点不需要压缩
+ *      2. fill: listpack长度最大值对应编码
+ *      3. depth: 压缩深度，指listpack两头共有多少个节点不需要压缩
  */
 void quicklistSetOptions(quicklist *quicklist, int fill, int depth) {
     quicklistSetFill(quicklist, fill);
@@ -151,8 +168,8 @@ void quicklistSetOptions(quicklist *quicklist, int fill, int depth) {
  * 创建一个快速链表
  *
  * 参数列表
- *      1. fill: ziplist长度最大值,默认-2代表最长为8kb
- *      2. compress: 压缩深度，指ziplist两头共有多少个节点不需要压缩
+ *      1. fill: listpack长度最大值,默认-2代表最长为8kb
+ *      2. compress: 压缩深度，指listpack两头共有多少个节点不需要压缩
  *
  * 返回值
  *      新的快速链表的指针
@@ -171,7 +188,7 @@ REDIS_STATIC quicklistNode *quicklistCreateNode(void) {
     node->sz = 0;
     node->next = node->prev = NULL;
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
-    node->container = QUICKLIST_NODE_CONTAINER_ZIPLIST;
+    node->container = QUICKLIST_NODE_CONTAINER_PACKED;
     node->recompress = 0;
     return node;
 }
@@ -206,7 +223,7 @@ void quicklistRelease(quicklist *quicklist) {
     while (len--) {
         next = current->next;
 
-        // 先释放快速列表节点包含的数据节点(ziplist)
+        // 先释放快速列表节点包含的数据节点(listpack)
         zfree(current->zl);
         // 对于单线程来说，这里似乎必要设置count了
         quicklist->count -= current->count;
@@ -219,9 +236,9 @@ void quicklistRelease(quicklist *quicklist) {
     zfree(quicklist);
 }
 
-/* Compress the ziplist in 'node' and update encoding details.
- * Returns 1 if ziplist compressed successfully.
- * Returns 0 if compression failed or if ziplist too small to compress. */
+/* Compress the listpack in 'node' and update encoding details.
+ * Returns 1 if listpack compressed successfully.
+ * Returns 0 if compression failed or if listpack too small to compress. */
 REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
 #ifdef REDIS_TEST
     node->attempted_compress = 1;
@@ -234,17 +251,18 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
     quicklistLZF *lzf = zmalloc(sizeof(*lzf) + node->sz);
 
     /* Cancel if compression fails or doesn't compress small enough */
-    if (((lzf->sz = lzf_compress(node->zl, node->sz, lzf->compressed,
-                                 node->sz)) == 0) ||
+    if (((lzf->sz = codecCompress(compress_codec, node->zl, node->sz,
+                                  lzf->compressed, node->sz)) == 0) ||
         lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
-        /* lzf_compress aborts/rejects compression if value not compressable. */
+        /* codecCompress rejects compression if value not compressable. */
         zfree(lzf);
         return 0;
     }
     lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
     zfree(node->zl);
     node->zl = (unsigned char *)lzf;
-    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    node->encoding = compress_codec == CODEC_ZSTD ?
+                     QUICKLIST_NODE_ENCODING_ZSTD : QUICKLIST_NODE_ENCODING_LZF;
     node->recompress = 0;
     return 1;
 }
@@ -257,7 +275,7 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
         }                                                                      \
     } while (0)
 
-/* Uncompress the ziplist in 'node' and update encoding details.
+/* Uncompress the listpack in 'node' and update encoding details.
  * Returns 1 on successful decode, 0 on failure to decode. */
 REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 #ifdef REDIS_TEST
@@ -266,7 +284,8 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 
     void *decompressed = zmalloc(node->sz);
     quicklistLZF *lzf = (quicklistLZF *)node->zl;
-    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+    if (codecDecompress(quicklistNodeCodec(node), lzf->compressed, lzf->sz,
+                        decompressed, node->sz) == 0) {
         /* Someone requested decompress, but we can't decompress.  Not good. */
         zfree(decompressed);
         return 0;
@@ -280,7 +299,7 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Decompress only compressed nodes. */
 #define quicklistDecompressNode(_node)                                         \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && quicklistNodeIsCompressed(_node)) {                     \
             __quicklistDecompressNode((_node));                                \
         }                                                                      \
     } while (0)
@@ -288,16 +307,17 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Force node to not be immediately re-compresable */
 #define quicklistDecompressNodeForUse(_node)                                   \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && quicklistNodeIsCompressed(_node)) {                     \
             __quicklistDecompressNode((_node));                                \
             (_node)->recompress = 1;                                           \
         }                                                                      \
     } while (0)
 
-/* Extract the raw LZF data from this quicklistNode.
- * Pointer to LZF data is assigned to '*data'.
- * Return value is the length of compressed LZF data. */
-size_t quicklistGetLzf(const quicklistNode *node, void **data) {
+/* Extract the raw compressed data from this quicklistNode, the codec is
+ * returned by quicklistNodeCodec().
+ * Pointer to compressed data is assigned to '*data'.
+ * Return value is the length of compressed data. */
+size_t quicklistGetCompressed(const quicklistNode *node, void **data) {
     quicklistLZF *lzf = (quicklistLZF *)node->zl;
     *data = lzf->compressed;
     return lzf->sz;
@@ -466,11 +486,11 @@ _quicklistNodeSizeMeetsOptimizationRequirement(const size_t sz,
 
 /*
  * 判断当前快速链表节点是否能够再添加值
- * fill规定了一个快速链表节点对应的数据节点(ziplist)最多能包含的真实数据个数
+ * fill规定了一个快速链表节点对应的数据节点(listpack)最多能包含的真实数据个数
  *
  * 参数列表
  *      1. node: 待评估的快速链表节点
- *      2. fill: 节点对应的ziplist最多能包含的数据项个数
+ *      2. fill: 节点对应的listpack最多能包含的数据项个数
  *      3. sz: 新插入的数据的长度
  *
  * 返回值
@@ -482,23 +502,25 @@ REDIS_STATIC int _quicklistNodeAllowInsert(const quicklistNode *node,
     if (unlikely(!node))
         return 0;
 
-    int ziplist_overhead;
-    /* size of previous offset */
-    if (sz < 254)
-        ziplist_overhead = 1;
+    int lp_overhead;
+    /* size of the encoding header */
+    if (sz < 64)
+        lp_overhead = 1;
+    else if (likely(sz < 4096))
+        lp_overhead = 2;
     else
-        ziplist_overhead = 5;
+        lp_overhead = 5;
 
-    /* size of forward offset */
-    if (sz < 64)
-        ziplist_overhead += 1;
-    else if (likely(sz < 16384))
-        ziplist_overhead += 2;
+    /* size of the trailing backlen, which counts the header too */
+    if (sz + lp_overhead < 128)
+        lp_overhead += 1;
+    else if (likely(sz + lp_overhead < 16384))
+        lp_overhead += 2;
     else
-        ziplist_overhead += 5;
+        lp_overhead += 3;
 
     /* new_sz overestimates if 'sz' encodes to an integer type */
-    unsigned int new_sz = node->sz + sz + ziplist_overhead;
+    unsigned int new_sz = node->sz + sz + lp_overhead;
     if (likely(_quicklistNodeSizeMeetsOptimizationRequirement(new_sz, fill)))
         return 1;
     else if (!sizeMeetsSafetyLimit(new_sz))
@@ -515,9 +537,9 @@ REDIS_STATIC int _quicklistNodeAllowMerge(const quicklistNode *a,
     if (!a || !b)
         return 0;
 
-    /* approximate merged ziplist size (- 11 to remove one ziplist
+    /* approximate merged listpack size (- 7 to remove one listpack
      * header/trailer) */
-    unsigned int merge_sz = a->sz + b->sz - 11;
+    unsigned int merge_sz = a->sz + b->sz - 7;
     if (likely(_quicklistNodeSizeMeetsOptimizationRequirement(merge_sz, fill)))
         return 1;
     else if (!sizeMeetsSafetyLimit(merge_sz))
@@ -530,7 +552,7 @@ REDIS_STATIC int _quicklistNodeAllowMerge(const quicklistNode *a,
 
 #define quicklistNodeUpdateSz(node)                                            \
     do {                                                                       \
-        (node)->sz = ziplistBlobLen((node)->zl);                               \
+        (node)->sz = lpBytes((node)->zl);                                      \
     } while (0)
 
 /* Add new entry to head node of quicklist.
@@ -554,14 +576,13 @@ int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
     // 首先需要判断当前快速链表节点是否能够再添加值
     if (likely(
             _quicklistNodeAllowInsert(quicklist->head, quicklist->fill, sz))) {
-        // 能的话则将值插入到当前节点对应的ziplist中即可
-        quicklist->head->zl =
-            ziplistPush(quicklist->head->zl, value, sz, ZIPLIST_HEAD);
+        // 能的话则将值插入到当前节点对应的listpack中即可
+        quicklist->head->zl = lpPrepend(quicklist->head->zl, value, sz);
         quicklistNodeUpdateSz(quicklist->head);
     } else {
         // 不能则创建一个新的快速链表节点并将值插入
         quicklistNode *node = quicklistCreateNode();
-        node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+        node->zl = lpPrepend(lpNew(0), value, sz);
 
         quicklistNodeUpdateSz(node);
         _quicklistInsertNodeBefore(quicklist, quicklist->head, node);
@@ -591,12 +612,11 @@ int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
     // likely是条件大概率为真时的语法优化写法
     if (likely(
             _quicklistNodeAllowInsert(quicklist->tail, quicklist->fill, sz))) {
-        quicklist->tail->zl =
-            ziplistPush(quicklist->tail->zl, value, sz, ZIPLIST_TAIL);
+        quicklist->tail->zl = lpAppend(quicklist->tail->zl, value, sz);
         quicklistNodeUpdateSz(quicklist->tail);
     } else {
         quicklistNode *node = quicklistCreateNode();
-        node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_TAIL);
+        node->zl = lpAppend(lpNew(0), value, sz);
 
         quicklistNodeUpdateSz(node);
         _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
@@ -606,15 +626,15 @@ int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
     return (orig_tail != quicklist->tail);
 }
 
-/* Create new node consisting of a pre-formed ziplist.
- * Used for loading RDBs where entire ziplists have been stored
+/* Create new node consisting of a pre-formed listpack.
+ * Used for loading RDBs where entire listpacks have been stored
  * to be retrieved later. */
-void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl) {
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *zl) {
     quicklistNode *node = quicklistCreateNode();
 
     node->zl = zl;
-    node->count = ziplistLen(node->zl);
-    node->sz = ziplistBlobLen(zl);
+    node->count = lpLength(node->zl);
+    node->sz = lpBytes(zl);
 
     _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
     quicklist->count += node->count;
@@ -622,8 +642,8 @@ void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl) {
 
 /* Append all values of ziplist 'zl' individually into 'quicklist'.
  *
- * This allows us to restore old RDB ziplists into new quicklists
- * with smaller ziplist sizes than the saved RDB ziplist.
+ * This allows us to restore old RDB ziplists, either plain lists or the
+ * nodes of old quicklists, into quicklists of listpacks.
  *
  * Returns 'quicklist' argument. Frees passed-in ziplist 'zl' */
 /*
@@ -729,12 +749,13 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
  *       already had to get *p from an uncompressed node somewhere.
  *
  * Returns 1 if the entire node was deleted, 0 if node still exists.
- * Also updates in/out param 'p' with the next offset in the ziplist. */
+ * Also updates in/out param 'p' with the next entry in the listpack, or
+ * NULL if the deleted entry was the last one. */
 REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
                                    unsigned char **p) {
     int gone = 0;
 
-    node->zl = ziplistDelete(node->zl, p);
+    node->zl = lpDelete(node->zl, *p, p);
     node->count--;
     if (node->count == 0) {
         gone = 1;
@@ -750,7 +771,7 @@ REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
 /* Delete one element represented by 'entry'
  *
  * 'entry' stores enough metadata to delete the proper position in
- * the correct ziplist in the correct quicklist node. */
+ * the correct listpack in the correct quicklist node. */
 void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
     quicklistNode *prev = entry->node->prev;
     quicklistNode *next = entry->node->next;
@@ -776,7 +797,7 @@ void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
      *   - [1, 2, 3] => delete offset 1 => [1, 3]: next element still offset 1
      *   - [1, 2, 3] => delete offset 0 => [2, 3]: next element still offset 0
      *  if we deleted the last element at offet N and now
-     *  length of this ziplist is N-1, the next call into
+     *  length of this listpack is N-1, the next call into
      *  quicklistNext() will jump to the next node. */
 }
 
@@ -789,8 +810,7 @@ int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
     quicklistEntry entry;
     if (likely(quicklistIndex(quicklist, index, &entry))) {
         /* quicklistIndex provides an uncompressed node */
-        entry.node->zl = ziplistDelete(entry.node->zl, &entry.zi);
-        entry.node->zl = ziplistInsert(entry.node->zl, entry.zi, data, sz);
+        entry.node->zl = lpReplace(entry.node->zl, &entry.zi, data, sz);
         quicklistNodeUpdateSz(entry.node);
         quicklistCompress(quicklist, entry.node);
         return 1;
@@ -799,9 +819,9 @@ int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
     }
 }
 
-/* Given two nodes, try to merge their ziplists.
+/* Given two nodes, try to merge their listpacks.
  *
- * This helps us not have a quicklist with 3 element ziplists if
+ * This helps us not have a quicklist with 3 element listpacks if
  * our fill factor can handle much higher levels.
  *
  * Note: 'a' must be to the LEFT of 'b'.
@@ -812,15 +832,15 @@ int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
  *
  * Returns the input node picked to merge against or NULL if
  * merging was not possible. */
-REDIS_STATIC quicklistNode *_quicklistZiplistMerge(quicklist *quicklist,
+REDIS_STATIC quicklistNode *_quicklistListpackMerge(quicklist *quicklist,
                                                    quicklistNode *a,
                                                    quicklistNode *b) {
     D("Requested merge (a,b) (%u, %u)", a->count, b->count);
 
     quicklistDecompressNode(a);
     quicklistDecompressNode(b);
-    if ((ziplistMerge(&a->zl, &b->zl))) {
-        /* We merged ziplists! Now remove the unused quicklistNode. */
+    if ((lpMerge(&a->zl, &b->zl))) {
+        /* We merged listpacks! Now remove the unused quicklistNode. */
         quicklistNode *keep = NULL, *nokeep = NULL;
         if (!a->zl) {
             nokeep = a;
@@ -829,7 +849,7 @@ REDIS_STATIC quicklistNode *_quicklistZiplistMerge(quicklist *quicklist,
             nokeep = b;
             keep = a;
         }
-        keep->count = ziplistLen(keep->zl);
+        keep->count = lpLength(keep->zl);
         quicklistNodeUpdateSz(keep);
 
         nokeep->count = 0;
@@ -842,7 +862,7 @@ REDIS_STATIC quicklistNode *_quicklistZiplistMerge(quicklist *quicklist,
     }
 }
 
-/* Attempt to merge ziplists within two nodes on either side of 'center'.
+/* Attempt to merge listpacks within two nodes on either side of 'center'.
  *
  * We attempt to merge:
  *   - (center->prev->prev, center->prev)
@@ -870,19 +890,19 @@ REDIS_STATIC void _quicklistMergeNodes(quicklist *quicklist,
 
     /* Try to merge prev_prev and prev */
     if (_quicklistNodeAllowMerge(prev, prev_prev, fill)) {
-        _quicklistZiplistMerge(quicklist, prev_prev, prev);
+        _quicklistListpackMerge(quicklist, prev_prev, prev);
         prev_prev = prev = NULL; /* they could have moved, invalidate them. */
     }
 
     /* Try to merge next and next_next */
     if (_quicklistNodeAllowMerge(next, next_next, fill)) {
-        _quicklistZiplistMerge(quicklist, next, next_next);
+        _quicklistListpackMerge(quicklist, next, next_next);
         next = next_next = NULL; /* they could have moved, invalidate them. */
     }
 
     /* Try to merge center node and previous node */
     if (_quicklistNodeAllowMerge(center, center->prev, fill)) {
-        target = _quicklistZiplistMerge(quicklist, center->prev, center);
+        target = _quicklistListpackMerge(quicklist, center->prev, center);
         center = NULL; /* center could have been deleted, invalidate it. */
     } else {
         /* else, we didn't merge here, but target needs to be valid below. */
@@ -891,7 +911,7 @@ REDIS_STATIC void _quicklistMergeNodes(quicklist *quicklist,
 
     /* Use result of center merge (or original) to merge with next node. */
     if (_quicklistNodeAllowMerge(target, target->next, fill)) {
-        _quicklistZiplistMerge(quicklist, target, target->next);
+        _quicklistListpackMerge(quicklist, target, target->next);
     }
 }
 
@@ -921,7 +941,7 @@ REDIS_STATIC quicklistNode *_quicklistSplitNode(quicklistNode *node, int offset,
     quicklistNode *new_node = quicklistCreateNode();
     new_node->zl = zmalloc(zl_sz);
 
-    /* Copy original ziplist so we can split it */
+    /* Copy original listpack so we can split it */
     memcpy(new_node->zl, node->zl, zl_sz);
 
     /* -1 here means "continue deleting until the list ends" */
@@ -933,12 +953,12 @@ REDIS_STATIC quicklistNode *_quicklistSplitNode(quicklistNode *node, int offset,
     D("After %d (%d); ranges: [%d, %d], [%d, %d]", after, offset, orig_start,
       orig_extent, new_start, new_extent);
 
-    node->zl = ziplistDeleteRange(node->zl, orig_start, orig_extent);
-    node->count = ziplistLen(node->zl);
+    node->zl = lpDeleteRange(node->zl, orig_start, orig_extent);
+    node->count = lpLength(node->zl);
     quicklistNodeUpdateSz(node);
 
-    new_node->zl = ziplistDeleteRange(new_node->zl, new_start, new_extent);
-    new_node->count = ziplistLen(new_node->zl);
+    new_node->zl = lpDeleteRange(new_node->zl, new_start, new_extent);
+    new_node->count = lpLength(new_node->zl);
     quicklistNodeUpdateSz(new_node);
 
     D("After split lengths: orig (%d), new (%d)", node->count, new_node->count);
@@ -960,7 +980,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         /* we have no reference node, so let's create only node in the list */
         D("No node given!");
         new_node = quicklistCreateNode();
-        new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+        new_node->zl = lpPrepend(lpNew(0), value, sz);
         __quicklistInsertNode(quicklist, NULL, new_node, after);
         new_node->count++;
         quicklist->count++;
@@ -975,7 +995,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
     }
 
     if (after && (entry->offset == node->count)) {
-        D("At Tail of current ziplist");
+        D("At Tail of current listpack");
         at_tail = 1;
         if (!_quicklistNodeAllowInsert(node->next, fill, sz)) {
             D("Next node is full too.");
@@ -996,19 +1016,16 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
     if (!full && after) {
         D("Not full, inserting after current position.");
         quicklistDecompressNodeForUse(node);
-        unsigned char *next = ziplistNext(node->zl, entry->zi);
-        if (next == NULL) {
-            node->zl = ziplistPush(node->zl, value, sz, ZIPLIST_TAIL);
-        } else {
-            node->zl = ziplistInsert(node->zl, next, value, sz);
-        }
+        node->zl = lpInsertString(node->zl, value, sz, entry->zi, LP_AFTER,
+                                  NULL);
         node->count++;
         quicklistNodeUpdateSz(node);
         quicklistRecompressOnly(quicklist, node);
     } else if (!full && !after) {
         D("Not full, inserting before current position.");
         quicklistDecompressNodeForUse(node);
-        node->zl = ziplistInsert(node->zl, entry->zi, value, sz);
+        node->zl = lpInsertString(node->zl, value, sz, entry->zi, LP_BEFORE,
+                                  NULL);
         node->count++;
         quicklistNodeUpdateSz(node);
         quicklistRecompressOnly(quicklist, node);
@@ -1018,7 +1035,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         D("Full and tail, but next isn't full; inserting next node head");
         new_node = node->next;
         quicklistDecompressNodeForUse(new_node);
-        new_node->zl = ziplistPush(new_node->zl, value, sz, ZIPLIST_HEAD);
+        new_node->zl = lpPrepend(new_node->zl, value, sz);
         new_node->count++;
         quicklistNodeUpdateSz(new_node);
         quicklistRecompressOnly(quicklist, new_node);
@@ -1028,7 +1045,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         D("Full and head, but prev isn't full, inserting prev node tail");
         new_node = node->prev;
         quicklistDecompressNodeForUse(new_node);
-        new_node->zl = ziplistPush(new_node->zl, value, sz, ZIPLIST_TAIL);
+        new_node->zl = lpAppend(new_node->zl, value, sz);
         new_node->count++;
         quicklistNodeUpdateSz(new_node);
         quicklistRecompressOnly(quicklist, new_node);
@@ -1038,7 +1055,7 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
          *   - create new node and attach to quicklist */
         D("\tprovisioning new node...");
         new_node = quicklistCreateNode();
-        new_node->zl = ziplistPush(ziplistNew(), value, sz, ZIPLIST_HEAD);
+        new_node->zl = lpPrepend(lpNew(0), value, sz);
         new_node->count++;
         quicklistNodeUpdateSz(new_node);
         __quicklistInsertNode(quicklist, node, new_node, after);
@@ -1048,8 +1065,8 @@ REDIS_STATIC void _quicklistInsert(quicklist *quicklist, quicklistEntry *entry,
         D("\tsplitting node...");
         quicklistDecompressNodeForUse(node);
         new_node = _quicklistSplitNode(node, entry->offset, after);
-        new_node->zl = ziplistPush(new_node->zl, value, sz,
-                                   after ? ZIPLIST_HEAD : ZIPLIST_TAIL);
+        new_node->zl = after ? lpPrepend(new_node->zl, value, sz) :
+                               lpAppend(new_node->zl, value, sz);
         new_node->count++;
         quicklistNodeUpdateSz(new_node);
         __quicklistInsertNode(quicklist, node, new_node, after);
@@ -1076,7 +1093,7 @@ void quicklistInsertAfter(quicklist *quicklist, quicklistEntry *entry,
  *
  * Returns 1 if entries were deleted, 0 if nothing was deleted. */
 /*
- * 删除指定范围的数据节点(ziplist中的节点)
+ * 删除指定范围的数据节点(listpack中的节点)
  * 这些待删除的节点可能在多个quicklistNode中，所以可能需要解析多个quicklistNode
  *
  * 参数列表
@@ -1107,7 +1124,7 @@ int quicklistDelRange(quicklist *quicklist, const long start,
     }
 
     quicklistEntry entry;
-    // 首先获取到指定起始位置的ziplist、实际数据项、quicklistNode等信息(都存放在工具型结构体quicklistEntry中)
+    // 首先获取到指定起始位置的listpack、实际数据项、quicklistNode等信息(都存放在工具型结构体quicklistEntry中)
     if (!quicklistIndex(quicklist, start, &entry))
         return 0;
 
@@ -1125,11 +1142,11 @@ int quicklistDelRange(quicklist *quicklist, const long start,
         int delete_entire_node = 0;
         if (entry.offset == 0 && extent >= node->count) {
             /* If we are deleting more than the count of this node, we
-             * can just delete the entire node without ziplist math. */
+             * can just delete the entire node without listpack math. */
             // 首先当前循环删除的起始位置正好是quicklistNode的首部
             // 并且要删除的节点数量大于当前quicklistNode所包含的节点数量则先删除当前quicklistNode中所有节点
             delete_entire_node = 1;
-            // 删除数量等于当前quicklistNode所包含ziplist对应的数据节点数量
+            // 删除数量等于当前quicklistNode所包含listpack对应的数据节点数量
             del = node->count;
         } else if (entry.offset >= 0 && extent >= node->count) {
             /* If deleting more nodes after this one, calculate delete based
@@ -1156,7 +1173,7 @@ int quicklistDelRange(quicklist *quicklist, const long start,
             /* else, we are deleting less than the extent of this node, so
              * use extent directly. */
             // 当前quicklistNode所包含数据节点数量足够删除了
-            // 那就在当前quicklistNode对应的ziplist中删除指定个数据节点即可
+            // 那就在当前quicklistNode对应的listpack中删除指定个数据节点即可
             del = extent;
         }
 
@@ -1170,8 +1187,8 @@ int quicklistDelRange(quicklist *quicklist, const long start,
         } else {
             // 将当前quicklistNode节点解压开来以便使用
             quicklistDecompressNodeForUse(node);
-            // 在当前节点包含的ziplist中删除指定个数据节点
-            node->zl = ziplistDeleteRange(node->zl, entry.offset, del);
+            // 在当前节点包含的listpack中删除指定个数据节点
+            node->zl = lpDeleteRange(node->zl, entry.offset, del);
             // 更新当前quicklistNode结构体中的"数据节点个数"成员变量
             quicklistNodeUpdateSz(node);
             node->count -= del;
@@ -1192,9 +1209,9 @@ int quicklistDelRange(quicklist *quicklist, const long start,
     return 1;
 }
 
-/* Passthrough to ziplistCompare() */
+/* Passthrough to lpCompare() */
 int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len) {
-    return ziplistCompare(p1, p2, p2_len);
+    return lpCompare(p1, p2, p2_len);
 }
 
 /* Returns a quicklist iterator 'iter'. After the initialization every
@@ -1324,22 +1341,22 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
     int offset_update = 0;
 
     if (!iter->zi) {
-        // 如果没有还未获取到ziplist的具体数据节点则使用偏移址获取
-        // 发生在两个快速链表节点切换时，也就是换到下一个ziplist时
+        // 如果没有还未获取到listpack的具体数据节点则使用偏移址获取
+        // 发生在两个快速链表节点切换时，也就是换到下一个listpack时
         /* If !zi, use current index. */
-        // 首先需要将新的ziplist解压
+        // 首先需要将新的listpack解压
         quicklistDecompressNodeForUse(iter->current);
         // 之后获取到到指定真实数据节点
-        iter->zi = ziplistIndex(iter->current->zl, iter->offset);
+        iter->zi = lpSeek(iter->current->zl, iter->offset);
     } else {
         /* else, use existing iterator offset and get prev/next as necessary. */
-        // 如果没有切换ziplist那就在现有的ziplist中通过ziplist节点特性寻找下一个数据节点
-        // ziplist中的节点记录了上一个节点的长度和当前节点的长度所以既可以往前遍历也可以往后遍历
+        // 如果没有切换listpack那就在现有的listpack中通过listpack节点特性寻找下一个数据节点
+        // listpack中的节点在尾部记录了自身的长度所以既可以往前遍历也可以往后遍历
         if (iter->direction == AL_START_HEAD) {
-            nextFn = ziplistNext;
+            nextFn = lpNext;
             offset_update = 1;
         } else if (iter->direction == AL_START_TAIL) {
-            nextFn = ziplistPrev;
+            nextFn = lpPrev;
             offset_update = -1;
         }
         iter->zi = nextFn(iter->current->zl, iter->zi);
@@ -1350,20 +1367,20 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
     entry->offset = iter->offset;
 
     if (iter->zi) {
-        /* Populate value from existing ziplist position */
-        // 如果当前ziplist有效(还有数据)则直接取当前ziplist下一个值即可
-        ziplistGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+        /* Populate value from existing listpack position */
+        // 如果当前listpack有效(还有数据)则直接取当前listpack下一个值即可
+        entry->value = lpGetValue(entry->zi, &entry->sz, &entry->longval);
         return 1;
     } else {
-        /* We ran out of ziplist entries.
+        /* We ran out of listpack entries.
          * Pick next node, update offset, then re-run retrieval. */
-        // 当前ziplist无效(其数据节点已遍历完)则获取下一个quicklistNode中的ziplist
+        // 当前listpack无效(其数据节点已遍历完)则获取下一个quicklistNode中的listpack
         quicklistCompress(iter->quicklist, iter->current);
         if (iter->direction == AL_START_HEAD) {
             /* Forward traversal */
             // 从前往后遍历
             D("Jumping to start of next node");
-            // 获取下一个quicklistNode并将迭代器指向的当前ziplist置空
+            // 获取下一个quicklistNode并将迭代器指向的当前listpack置空
             iter->current = iter->current->next;
             iter->offset = 0;
         } else if (iter->direction == AL_START_TAIL) {
@@ -1373,7 +1390,7 @@ int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
             iter->current = iter->current->prev;
             iter->offset = -1;
         }
-        // 将迭代器当前有效的ziplist置空以便递归调用时知道是要重新从quicklistNode中取出ziplist
+        // 将迭代器当前有效的listpack置空以便递归调用时知道是要重新从quicklistNode中取出listpack
         iter->zi = NULL;
         return quicklistNext(iter, entry);
     }
@@ -1394,7 +1411,7 @@ quicklist *quicklistDup(quicklist *orig) {
          current = current->next) {
         quicklistNode *node = quicklistCreateNode();
 
-        if (current->encoding == QUICKLIST_NODE_ENCODING_LZF) {
+        if (quicklistNodeIsCompressed(current)) {
             quicklistLZF *lzf = (quicklistLZF *)current->zl;
             size_t lzf_sz = sizeof(*lzf) + lzf->sz;
             node->zl = zmalloc(lzf_sz);
@@ -1430,7 +1447,7 @@ quicklist *quicklistDup(quicklist *orig) {
  * 参数列表
  *      1. quicklist: 待操作的链表
  *      2. idx: 节点位置序号，大于0表示从链表头开始索引，小于代表从链表尾部开始索引
- *              注意这个序号是所有ziplist的所有节点的序号，不是quicklist节点的序号
+ *              注意这个序号是所有listpack的所有节点的序号，不是quicklist节点的序号
  *      3. entry: 出参，如果找到节点则将节点的属性设置到该entry中
  *
  * 返回值
@@ -1465,13 +1482,13 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
     // 编译器和linux系统的一种优化语法糖
     // 当条件为真的可能性很大时使用该写法可以提高执行效率
     while (likely(n)) {
-        // 这个循环只能算出想要的节点在哪个ziplist中，后续再从ziplist取出真正节点
+        // 这个循环只能算出想要的节点在哪个listpack中，后续再从listpack取出真正节点
         if ((accum + n->count) > index) {
             break;
         } else {
             D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
               accum);
-            // 每个快速列表的节点都记录了它附带的ziplist中的节点个数
+            // 每个快速列表的节点都记录了它附带的listpack中的节点个数
             accum += n->count;
             n = forward ? n->next : n->prev;
         }
@@ -1486,7 +1503,7 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
       accum, index, index - accum, (-index) - 1 + accum);
 
     entry->node = n;
-    // 设置在当前ziplist中还要偏移多少个位置才是真正的数据节点
+    // 设置在当前listpack中还要偏移多少个位置才是真正的数据节点
     if (forward) {
         /* forward = normal head-to-tail offset. */
         entry->offset = index - accum;
@@ -1496,14 +1513,14 @@ int quicklistIndex(const quicklist *quicklist, const long long idx,
         entry->offset = (-index) - 1 + accum;
     }
 
-    // 解压当前节点的ziplist，由于是将该节点给调用者使用，所以解压之后不再重新压缩
+    // 解压当前节点的listpack，由于是将该节点给调用者使用，所以解压之后不再重新压缩
     // 由调用者根据重压缩标志决定是否需要再压缩
     quicklistDecompressNodeForUse(entry->node);
     // 获取实际的数据节点首部指针
-    entry->zi = ziplistIndex(entry->node->zl, entry->offset);
+    entry->zi = lpSeek(entry->node->zl, entry->offset);
     // 到此已找到数据节点，现把数据节点中的实际数据取出并根据编码类型设置不同属性
     // 值得注意的是调用者通过entry的value属性是否有值来判断实际数据是否是字符串编码
-    ziplistGet(entry->zi, &entry->value, &entry->sz, &entry->longval);
+    entry->value = lpGetValue(entry->zi, &entry->sz, &entry->longval);
     /* The caller will use our result, so we don't re-compress here.
      * The caller can recompress or delete the node as needed. */
     return 1;
@@ -1521,16 +1538,16 @@ void quicklistRotate(quicklist *quicklist) {
         return;
 
     /* First, get the tail entry */
-    // 获取最后一个节点包含的ziplist的最后一个元素
-    unsigned char *p = ziplistIndex(quicklist->tail->zl, -1);
+    // 获取最后一个节点包含的listpack的最后一个元素
+    unsigned char *p = lpSeek(quicklist->tail->zl, -1);
     unsigned char *value;
     long long longval;
     unsigned int sz;
     char longstr[32] = {0};
     // 取出数据节点对应的真实数据值
-    ziplistGet(p, &value, &sz, &longval);
+    value = lpGetValue(p, &sz, &longval);
 
-    /* If value found is NULL, then ziplistGet populated longval instead */
+    /* If value found is NULL, then lpGetValue populated longval instead */
     // 真实数据有两种编码方式，value被设置则说明是字符串编码方式否则是整型编码方式
     if (!value) {
         /* Write the longval as a string so we can re-add it */
@@ -1543,12 +1560,12 @@ void quicklistRotate(quicklist *quicklist) {
     // 把值插入到链表头部
     quicklistPushHead(quicklist, value, sz);
 
-    /* If quicklist has only one node, the head ziplist is also the
-     * tail ziplist and PushHead() could have reallocated our single ziplist,
+    /* If quicklist has only one node, the head listpack is also the
+     * tail listpack and PushHead() could have reallocated our single listpack,
      * which would make our pre-existing 'p' unusable. */
     if (quicklist->len == 1) {
         // 如果正好链表仅有一个元素，插入节点时会导致列表内存重新申请
-        p = ziplistIndex(quicklist->tail->zl, -1);
+        p = lpSeek(quicklist->tail->zl, -1);
     }
 
     /* Remove tail entry. */
@@ -1612,9 +1629,10 @@ int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
     }
 
     // 找到指定的数据节点
-    p = ziplistIndex(node->zl, pos);
+    p = lpSeek(node->zl, pos);
     // 获取数据节点值
-    if (ziplistGet(p, &vstr, &vlen, &vlong)) {
+    if (p) {
+        vstr = lpGetValue(p, &vlen, &vlong);
         // 根据不同的数据值编码类型设置出参
         if (vstr) {
             if (data)
@@ -1753,9 +1771,9 @@ static void ql_info(quicklist *ql) {
     printf("Container length: %lu\n", ql->len);
     printf("Container size: %lu\n", ql->count);
     if (ql->head)
-        printf("\t(zsize head: %d)\n", ziplistLen(ql->head->zl));
+        printf("\t(zsize head: %lu)\n", lpLength(ql->head->zl));
     if (ql->tail)
-        printf("\t(zsize tail: %d)\n", ziplistLen(ql->tail->zl));
+        printf("\t(zsize tail: %lu)\n", lpLength(ql->tail->zl));
     printf("\n");
 #else
     UNUSED(ql);
@@ -1853,18 +1871,18 @@ static int _ql_verify(quicklist *ql, uint32_t len, uint32_t count,
     }
 
     if (ql->head && head_count != ql->head->count &&
-        head_count != ziplistLen(ql->head->zl)) {
+        head_count != lpLength(ql->head->zl)) {
         yell("quicklist head count wrong: expected %d, "
-             "got cached %d vs. actual %d",
-             head_count, ql->head->count, ziplistLen(ql->head->zl));
+             "got cached %d vs. actual %lu",
+             head_count, ql->head->count, lpLength(ql->head->zl));
         errors++;
     }
 
     if (ql->tail && tail_count != ql->tail->count &&
-        tail_count != ziplistLen(ql->tail->zl)) {
+        tail_count != lpLength(ql->tail->zl)) {
         yell("quicklist tail count wrong: expected %d, "
-             "got cached %u vs. actual %d",
-             tail_count, ql->tail->count, ziplistLen(ql->tail->zl));
+             "got cached %u vs. actual %lu",
+             tail_count, ql->tail->count, lpLength(ql->tail->zl));
         errors++;
     }
 
@@ -1884,7 +1902,7 @@ static int _ql_verify(quicklist *ql, uint32_t len, uint32_t count,
                     errors++;
                 }
             } else {
-                if (node->encoding != QUICKLIST_NODE_ENCODING_LZF &&
+                if (!quicklistNodeIsCompressed(node) &&
                     !node->attempted_compress) {
                     yell("Incorrect non-compression: node %d is NOT "
                          "compressed at depth %d ((%u, %u); total "
@@ -2018,7 +2036,7 @@ int quicklistTest(int argc, char *argv[]) {
                 quicklist *ql = quicklistNew(f, options[_i]);
                 quicklistPushHead(ql, "hello", 6);
                 quicklistRotate(ql);
-                /* Ignore compression verify because ziplist is
+                /* Ignore compression verify because listpack is
                  * too small to compress. */
                 ql_verify(ql, 1, 1, 1, 1);
                 quicklistRelease(ql);
@@ -2919,7 +2937,7 @@ int quicklistTest(int argc, char *argv[]) {
                                     node->sz);
                             }
                         } else {
-                            if (node->encoding != QUICKLIST_NODE_ENCODING_LZF) {
+                            if (!quicklistNodeIsCompressed(node)) {
                                 ERR("Incorrect non-compression: node %d is NOT "
                                     "compressed at depth %d ((%u, %u); total "
                                     "nodes: %u; size: %u; attempted: %d)",
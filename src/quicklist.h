@@ -33,11 +33,11 @@
 
 /* Node, quicklist, and Iterator are the only data structures used currently. */
 
-/* quicklistNode is a 32 byte struct describing a ziplist for a quicklist.
+/* quicklistNode is a 32 byte struct describing a listpack for a quicklist.
  * We use bit fields keep the quicklistNode at 32 bytes.
  * count: 16 bits, max 65536 (max zl bytes is 65k, so max count actually < 32k).
- * encoding: 2 bits, RAW=1, LZF=2.
- * container: 2 bits, NONE=1, ZIPLIST=2.
+ * encoding: 2 bits, RAW=1, LZF=2, ZSTD=3.
+ * container: 2 bits, NONE=1, PACKED=2.
  * recompress: 1 bit, bool, true if node is temporarry decompressed for usage.
  * attempted_compress: 1 bit, boolean, used for verifying during testing.
  * extra: 12 bits, free for future use; pads out the remainder of 32 bits */
@@ -49,18 +49,18 @@ typedef struct quicklistNode {
     struct quicklistNode *prev;
     // 后一个节点
     struct quicklistNode *next;
-    // ziplist首部指针，各个节点的实际数据项存储在ziplist中(连续内存空间的压缩列表)
+    // listpack首部指针，各个节点的实际数据项存储在listpack中(连续内存空间的紧凑列表)
     unsigned char *zl;
-    // ziplist占用的总内存大小，不论压缩与否都是存储实际的总内存大小
-    unsigned int sz;             /* ziplist size in bytes */
-    // ziplist的数据项的个数
-    unsigned int count : 16;     /* count of items in ziplist */
+    // listpack占用的总内存大小，不论压缩与否都是存储实际的总内存大小
+    unsigned int sz;             /* listpack size in bytes */
+    // listpack的数据项的个数
+    unsigned int count : 16;     /* count of items in listpack */
     // 该节点是否被压缩过了，1代表没压缩，2代表使用LZF算法压缩过了
     // 可能以后会有别的压缩算法，目前则只有这一种压缩算法
-    unsigned int encoding : 2;   /* RAW==1 or LZF==2 */
-    // 该节点使用何种方式来存储数据，1代表没存储数据，2代表使用ziplist存储数据
-    // 这个节点目前看来都是2，即使用ziplist来存储数据，后续可能会有别的方式
-    unsigned int container : 2;  /* NONE==1 or ZIPLIST==2 */
+    unsigned int encoding : 2;   /* RAW==1, LZF==2 or ZSTD==3 */
+    // 该节点使用何种方式来存储数据，1代表没存储数据，2代表使用listpack存储数据
+    // 这个节点目前看来都是2，即使用listpack来存储数据，后续可能会有别的方式
+    unsigned int container : 2;  /* NONE==1 or PACKED==2 */
     // 这个节点是否需要重新压缩？
     // 某些情况下需要临时解压下这个节点，有这个标记则会找机会再重新进行压缩
     unsigned int recompress : 1; /* was this node previous compressed? */
@@ -72,7 +72,8 @@ typedef struct quicklistNode {
 
 /* quicklistLZF is a 4+N byte struct holding 'sz' followed by 'compressed'.
  * 'sz' is byte length of 'compressed' field.
- * 'compressed' is LZF data with total (compressed) length 'sz'
+ * 'compressed' is LZF data with total (compressed) length 'sz', or data
+ * compressed with another codec according to quicklistNode->encoding.
  * NOTE: uncompressed length is stored in quicklistNode->sz.
  * When quicklistNode->zl is compressed, node->zl points to a quicklistLZF */
 typedef struct quicklistLZF {
@@ -92,17 +93,17 @@ typedef struct quicklist {
     quicklistNode *head;
     // 尾部节点
     quicklistNode *tail;
-    // 不是quicklistNode的个数，而是各个节点中所含的所有ziplist中的zlentry的个数
-    unsigned long count;        /* total count of all entries in all ziplists */
+    // 不是quicklistNode的个数，而是各个节点中所含的所有listpack中的数据项的个数
+    unsigned long count;        /* total count of all entries in all listpacks */
     // quicklistNode的个数
     unsigned long len;          /* number of quicklistNodes */
-    // 每个节点中的实际数据节点的个数(目前都是用ziplist存储所以也就是ziplist中zlentry的个数)
+    // 每个节点中的实际数据节点的个数(目前都是用listpack存储所以也就是listpack中数据项的个数)
     int fill : 16;              /* fill factor for individual nodes */
     // 最大压缩深度
     unsigned int compress : 16; /* depth of end nodes not to compress;0=off */
 } quicklist;
 
-// 和adlist类似的链表迭代器，但是结合了ziplist的特性
+// 和adlist类似的链表迭代器，但是结合了listpack的特性
 typedef struct quicklistIter {
     // 正在遍历的快速链表
     const quicklist *quicklist;
@@ -110,8 +111,8 @@ typedef struct quicklistIter {
     quicklistNode *current;
     // 迭代器当前真实数据节点的首部指针
     unsigned char *zi;
-    // 当前数据节点在当前ziplist中的偏移量
-    long offset; /* offset in current ziplist */
+    // 当前数据节点在当前listpack中的偏移量
+    long offset; /* offset in current listpack */
     // 迭代方向 0 代表从前往后 1反之
     int direction;
 } quicklistIter;
@@ -123,7 +124,7 @@ typedef struct quicklistEntry {
     const quicklist *quicklist;
     // 对应的节点
     quicklistNode *node;
-    // 在ziplist中的实际的数据节点的首部指针
+    // 在listpack中的实际的数据节点的首部指针
     unsigned char *zi;
     // 如果实际数据是字符串编码类型则值设置在该属性中
     unsigned char *value;
@@ -141,16 +142,17 @@ typedef struct quicklistEntry {
 /* quicklist node encodings */
 #define QUICKLIST_NODE_ENCODING_RAW 1
 #define QUICKLIST_NODE_ENCODING_LZF 2
+#define QUICKLIST_NODE_ENCODING_ZSTD 3
 
 /* quicklist compression disable */
 #define QUICKLIST_NOCOMPRESS 0
 
 /* quicklist container formats */
 #define QUICKLIST_NODE_CONTAINER_NONE 1
-#define QUICKLIST_NODE_CONTAINER_ZIPLIST 2
+#define QUICKLIST_NODE_CONTAINER_PACKED 2
 
 #define quicklistNodeIsCompressed(node)                                        \
-    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
+    ((node)->encoding != QUICKLIST_NODE_ENCODING_RAW)
 
 /* Prototypes */
 quicklist *quicklistCreate(void);
@@ -163,7 +165,7 @@ int quicklistPushHead(quicklist *quicklist, void *value, const size_t sz);
 int quicklistPushTail(quicklist *quicklist, void *value, const size_t sz);
 void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
                    int where);
-void quicklistAppendZiplist(quicklist *quicklist, unsigned char *zl);
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *zl);
 quicklist *quicklistAppendValuesFromZiplist(quicklist *quicklist,
                                             unsigned char *zl);
 quicklist *quicklistCreateFromZiplist(int fill, int compress,
@@ -194,7 +196,9 @@ int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
                  unsigned int *sz, long long *slong);
 unsigned long quicklistCount(const quicklist *ql);
 int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
-size_t quicklistGetLzf(const quicklistNode *node, void **data);
+size_t quicklistGetCompressed(const quicklistNode *node, void **data);
+int quicklistNodeCodec(const quicklistNode *node);
+void quicklistSetCompressCodec(int codec);
 
 #ifdef REDIS_TEST
 int quicklistTest(int argc, char *argv[]);
@@ -29,6 +29,7 @@
 
 #include "server.h"
 #include "lzf.h"    /* LZF compression library */
+#include "codec.h"  /* Compression codecs */
 #include "zipmap.h"
 #include "endianconv.h"
 
@@ -283,13 +284,14 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-ssize_t rdbSaveLzfBlob(rio *rdb, void *data, size_t compress_len,
-                       size_t original_len) {
+/* Save data compressed with the specified codec, see codec.h. */
+ssize_t rdbSaveCompressedBlob(rio *rdb, int codec, void *data,
+                              size_t compress_len, size_t original_len) {
     unsigned char byte;
     ssize_t n, nwritten = 0;
 
     /* Data compressed! Let's save it on disk */
-    byte = (RDB_ENCVAL<<6)|RDB_ENC_LZF;
+    byte = (RDB_ENCVAL<<6)|(codec == CODEC_ZSTD ? RDB_ENC_ZSTD : RDB_ENC_LZF);
     if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
     nwritten += n;
 
@@ -308,7 +310,10 @@ writeerr:
     return -1;
 }
 
-ssize_t rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+/* Save the string compressed with the codec selected by the
+ * rdb-compression-codec option. Returns 0 if the string can't be
+ * compressed enough to be worth it. */
+ssize_t rdbSaveCompressedStringObject(rio *rdb, unsigned char *s, size_t len) {
     size_t comprlen, outlen;
     void *out;
 
@@ -316,20 +321,22 @@ ssize_t rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
     if (len <= 4) return 0;
     outlen = len-4;
     if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    comprlen = lzf_compress(s, len, out, outlen);
+    comprlen = codecCompress(server.rdb_compression_codec, s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
-    ssize_t nwritten = rdbSaveLzfBlob(rdb, out, comprlen, len);
+    ssize_t nwritten = rdbSaveCompressedBlob(rdb, server.rdb_compression_codec,
+                                             out, comprlen, len);
     zfree(out);
     return nwritten;
 }
 
-/* Load an LZF compressed string in RDB format. The returned value
- * changes according to 'flags'. For more info check the
+/* Load a string compressed with the specified codec in RDB format. The
+ * returned value changes according to 'flags'. For more info check the
  * rdbGenericLoadStringObject() function. */
-void *rdbLoadLzfStringObject(rio *rdb, int flags, size_t *lenptr) {
+void *rdbLoadCompressedStringObject(rio *rdb, int codec, int flags,
+                                    size_t *lenptr) {
     int plain = flags & RDB_LOAD_PLAIN;
     int sds = flags & RDB_LOAD_SDS;
     uint64_t len, clen;
@@ -350,8 +357,9 @@ void *rdbLoadLzfStringObject(rio *rdb, int flags, size_t *lenptr) {
 
     /* Load the compressed representation and uncompress it to target. */
     if (rioRead(rdb,c,clen) == 0) goto err;
-    if (lzf_decompress(c,clen,val,len) == 0) {
-        if (rdbCheckMode) rdbCheckSetError("Invalid LZF compressed string");
+    if (codecDecompress(codec,c,clen,val,len) == 0) {
+        if (rdbCheckMode) rdbCheckSetError("Invalid %s compressed string",
+            codec == CODEC_ZSTD ? "Zstandard" : "LZF");
         goto err;
     }
     zfree(c);
@@ -385,10 +393,10 @@ ssize_t rdbSaveRawString(rio *rdb, unsigned char *s, size_t len) {
         }
     }
 
-    /* Try LZF compression - under 20 bytes it's unable to compress even
+    /* Try compression - under 20 bytes it's unable to compress even
      * aaaaaaaaaaaaaaaaaa so skip it */
     if (server.rdb_compression && len > 20) {
-        n = rdbSaveLzfStringObject(rdb,s,len);
+        n = rdbSaveCompressedStringObject(rdb,s,len);
         if (n == -1) return -1;
         if (n > 0) return n;
         /* Return value of 0 means data can't be compressed, save the old way */
@@ -429,6 +437,11 @@ ssize_t rdbSaveStringObject(rio *rdb, robj *obj) {
      * object is already integer encoded. */
     if (obj->encoding == OBJ_ENCODING_INT) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
+    } else if (obj->encoding == OBJ_ENCODING_COMPRESSED) {
+        sds s = compressedStringToSds(obj);
+        ssize_t retval = rdbSaveRawString(rdb,(unsigned char*)s,sdslen(s));
+        sdsfree(s);
+        return retval;
     } else {
         serverAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
@@ -463,7 +476,9 @@ void *rdbGenericLoadStringObject(rio *rdb, int flags, size_t *lenptr) {
         case RDB_ENC_INT32:
             return rdbLoadIntegerObject(rdb,len,flags,lenptr);
         case RDB_ENC_LZF:
-            return rdbLoadLzfStringObject(rdb,flags,lenptr);
+            return rdbLoadCompressedStringObject(rdb,CODEC_LZF,flags,lenptr);
+        case RDB_ENC_ZSTD:
+            return rdbLoadCompressedStringObject(rdb,CODEC_ZSTD,flags,lenptr);
         default:
             rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
         }
@@ -598,7 +613,7 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         return rdbSaveType(rdb,RDB_TYPE_STRING);
     case OBJ_LIST:
         if (o->encoding == OBJ_ENCODING_QUICKLIST)
-            return rdbSaveType(rdb,RDB_TYPE_LIST_QUICKLIST);
+            return rdbSaveType(rdb,RDB_TYPE_LIST_QUICKLIST_2);
         else
             serverPanic("Unknown list encoding");
     case OBJ_SET:
@@ -609,15 +624,15 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else
             serverPanic("Unknown set encoding");
     case OBJ_ZSET:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_ZSET_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_ZSET_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_SKIPLIST)
             return rdbSaveType(rdb,RDB_TYPE_ZSET_2);
         else
             serverPanic("Unknown sorted set encoding");
     case OBJ_HASH:
-        if (o->encoding == OBJ_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == OBJ_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,RDB_TYPE_HASH_LISTPACK);
         else if (o->encoding == OBJ_ENCODING_HT)
             return rdbSaveType(rdb,RDB_TYPE_HASH);
         else
@@ -657,10 +672,25 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
             nwritten += n;
 
             while(node) {
-                if (quicklistNodeIsCompressed(node)) {
+                if (quicklistNodeIsCompressed(node) &&
+                    (quicklistNodeCodec(node) == CODEC_LZF ||
+                     server.rdb_compression_codec == CODEC_ZSTD))
+                {
+                    /* Save the node as it is, unless it would introduce
+                     * Zstandard data in a file that should not use it. */
+                    void *data;
+                    size_t compress_len = quicklistGetCompressed(node, &data);
+                    if ((n = rdbSaveCompressedBlob(rdb,quicklistNodeCodec(node),data,compress_len,node->sz)) == -1) return -1;
+                    nwritten += n;
+                } else if (quicklistNodeIsCompressed(node)) {
+                    unsigned char *zl = zmalloc(node->sz);
                     void *data;
-                    size_t compress_len = quicklistGetLzf(node, &data);
-                    if ((n = rdbSaveLzfBlob(rdb,data,compress_len,node->sz)) == -1) return -1;
+                    size_t compress_len = quicklistGetCompressed(node, &data);
+                    if (codecDecompress(CODEC_ZSTD,data,compress_len,zl,node->sz) == 0)
+                        serverPanic("Corrupted quicklist node");
+                    n = rdbSaveRawString(rdb,zl,node->sz);
+                    zfree(zl);
+                    if (n == -1) return -1;
                     nwritten += n;
                 } else {
                     if ((n = rdbSaveRawString(rdb,node->zl,node->sz)) == -1) return -1;
@@ -689,17 +719,22 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
             }
             dictReleaseIterator(di);
         } else if (o->encoding == OBJ_ENCODING_INTSET) {
-            size_t l = intsetBlobLen((intset*)o->ptr);
-
-            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
+            /* Large intsets are kept in chunks in memory, but they are
+             * always saved as a single flat intset. */
+            intset *is = intsetToBlob(o->ptr);
+            size_t l = intsetBlobLen(is);
+
+            n = rdbSaveRawString(rdb,(unsigned char*)is,l);
+            if (is != o->ptr) zfree(is);
+            if (n == -1) return -1;
             nwritten += n;
         } else {
             serverPanic("Unknown set encoding");
         }
     } else if (o->type == OBJ_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -734,8 +769,8 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == OBJ_HASH) {
         /* Save a hash value */
-        if (o->encoding == OBJ_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == OBJ_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -874,6 +909,159 @@ int rdbSaveInfoAuxFields(rio *rdb, int flags, rdbSaveInfo *rsi) {
     return 1;
 }
 
+/* State of the chunked layout while saving, see RDB_OPCODE_CHUNK. */
+typedef struct rdbChunkWriter {
+    rio buf;            /* The pairs of the current chunk are saved here. */
+    int dbid;           /* DB of the current chunk. */
+    uint64_t keys;      /* Number of pairs in the current chunk. */
+    size_t start;       /* Offset of the RDB start in the target rio. */
+    sds index;          /* Index entries of the chunks already saved. */
+    uint64_t chunks;    /* Number of chunks already saved. */
+} rdbChunkWriter;
+
+static void rdbChunkWriterInit(rdbChunkWriter *cw, rio *rdb) {
+    rioInitWithBuffer(&cw->buf,sdsempty());
+    cw->dbid = 0;
+    cw->keys = 0;
+    cw->start = rdb->processed_bytes;
+    cw->index = sdsempty();
+    cw->chunks = 0;
+}
+
+static void rdbChunkWriterFree(rdbChunkWriter *cw) {
+    sdsfree(cw->buf.io.buffer.ptr);
+    sdsfree(cw->index);
+}
+
+/* Append a 64 bit little endian integer to 's'. */
+static sds rdbChunkCatUint64(sds s, uint64_t v) {
+    memrev64ifbe(&v);
+    return sdscatlen(s,&v,sizeof(v));
+}
+
+/* Write the payload of a chunk. When 'combine' is true 'crc' is the CRC64
+ * of the payload, and it is combined with the checksum of the file instead
+ * of computing it again while writing. */
+static int rdbWriteChunkPayload(rio *rdb, void *p, size_t len, uint64_t crc,
+                                int combine)
+{
+    void (*update_cksum)(struct _rio *, const void *, size_t);
+    int retval;
+
+    if (!combine) return rdbWriteRaw(rdb,p,len);
+    update_cksum = rdb->update_cksum;
+    rdb->update_cksum = NULL;
+    retval = rdbWriteRaw(rdb,p,len);
+    rdb->update_cksum = update_cksum;
+    if (retval != -1) rdb->cksum = crc64_combine(rdb->cksum,crc,len);
+    return retval;
+}
+
+/* Write the pairs accumulated so far as a chunk, and add it to the index.
+ * Returns -1 on error, 0 on success. */
+static int rdbSaveChunk(rio *rdb, rdbChunkWriter *cw) {
+    sds raw = cw->buf.io.buffer.ptr;
+    size_t rawlen = sdslen(raw), storedlen = rawlen;
+    size_t offset = rdb->processed_bytes;
+    unsigned char *stored = (unsigned char*)raw, *out = NULL;
+    uint64_t crc = 0, hdrcrc;
+    int combine;
+
+    if (cw->keys == 0) return 0;
+
+    /* We require at least four bytes compression for this to be worth it */
+    if (server.rdb_compression && rawlen > 4) {
+        size_t comprlen;
+
+        out = zmalloc(rawlen-4);
+        comprlen = lzf_compress(raw,rawlen,out,rawlen-4);
+        if (comprlen != 0) {
+            stored = out;
+            storedlen = comprlen;
+        }
+    }
+    if (server.rdb_checksum) crc = crc64(0,stored,storedlen);
+    hdrcrc = crc;
+    memrev64ifbe(&hdrcrc);
+
+    /* The payload was already checksummed above: instead of scanning it
+     * again, fold its CRC into the checksum of the whole file. */
+    combine = server.rdb_checksum && rdb->update_cksum;
+    if (rdbSaveType(rdb,RDB_OPCODE_CHUNK) == -1 ||
+        rdbSaveLen(rdb,cw->dbid) == -1 ||
+        rdbSaveLen(rdb,cw->keys) == -1 ||
+        rdbSaveLen(rdb,rawlen) == -1 ||
+        rdbSaveLen(rdb,storedlen) == -1 ||
+        rdbWriteRaw(rdb,&hdrcrc,sizeof(hdrcrc)) == -1 ||
+        rdbWriteChunkPayload(rdb,stored,storedlen,combine ? crc : 0,
+                             combine) == -1)
+    {
+        zfree(out);
+        return -1;
+    }
+    zfree(out);
+
+    cw->index = rdbChunkCatUint64(cw->index,offset-cw->start);
+    cw->index = rdbChunkCatUint64(cw->index,rdb->processed_bytes-offset);
+    cw->index = rdbChunkCatUint64(cw->index,cw->dbid);
+    cw->index = rdbChunkCatUint64(cw->index,cw->keys);
+    cw->chunks++;
+
+    sdsclear(raw);
+    cw->buf.io.buffer.pos = 0;
+    cw->keys = 0;
+    return 0;
+}
+
+/* Like rdbSaveKeyValuePair() but the pair is added to the current chunk of
+ * the specified DB, that is written once it reaches rdb-chunk-size. */
+static int rdbChunkSaveKeyValuePair(rio *rdb, rdbChunkWriter *cw, int dbid,
+                                    robj *key, robj *val,
+                                    long long expiretime, long long now)
+{
+    int compression = server.rdb_compression, retval;
+
+    if (dbid != cw->dbid) {
+        if (rdbSaveChunk(rdb,cw) == -1) return -1;
+        cw->dbid = dbid;
+    }
+
+    /* Module values are saved out of the chunks, since the loading threads
+     * can't call the module to decode them. */
+    if (val->type == OBJ_MODULE)
+        return rdbSaveKeyValuePair(rdb,key,val,expiretime,now);
+
+    /* Chunks are compressed as a whole: don't waste time compressing the
+     * single strings as well. */
+    server.rdb_compression = 0;
+    retval = rdbSaveKeyValuePair(&cw->buf,key,val,expiretime,now);
+    server.rdb_compression = compression;
+    if (retval == 1) cw->keys++;
+
+    if (sdslen(cw->buf.io.buffer.ptr) >= server.rdb_chunk_size &&
+        rdbSaveChunk(rdb,cw) == -1) return -1;
+    return retval;
+}
+
+/* Write the "chunk-index" AUX field. The value is written verbatim, without
+ * trying any encoding, so that its trailer is the last thing before the EOF
+ * opcode. */
+static int rdbSaveChunkIndex(rio *rdb, rdbChunkWriter *cw) {
+    sds index = cw->index;
+
+    index = rdbChunkCatUint64(index,cw->chunks);
+    index = sdscatlen(index,RDB_CHUNK_INDEX_MAGIC,
+                      RDB_CHUNK_INDEX_TRAILER_LEN-sizeof(uint64_t));
+    cw->index = index;
+
+    if (rdbSaveType(rdb,RDB_OPCODE_AUX) == -1) return -1;
+    if (rdbSaveRawString(rdb,(unsigned char*)RDB_CHUNK_INDEX_AUX,
+                         strlen(RDB_CHUNK_INDEX_AUX)) == -1) return -1;
+    if (rdbSaveLen(rdb,sdslen(index)) == -1) return -1;
+    if (rdbWriteRaw(rdb,index,sdslen(index)) == -1) return -1;
+    return 0;
+}
+
 /* Produces a dump of the database in RDB format sending it to the specified
  * Redis I/O channel. On success C_OK is returned, otherwise C_ERR
  * is returned and part of the output, or all the output, can be
@@ -881,19 +1069,25 @@ int rdbSaveInfoAuxFields(rio *rdb, int flags, rdbSaveInfo *rsi) {
  *
  * When the function returns C_ERR and if 'error' is not NULL, the
  * integer pointed by 'error' is set to the value of errno just after the I/O
- * error. */
+ * error.
+ *
+ * When rdb-chunked is enabled the key-value pairs are saved using the
+ * chunked layout, see RDB_OPCODE_CHUNK. */
 int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
     dictIterator *di = NULL;
     dictEntry *de;
     char magic[10];
-    int j;
+    int j, chunked = server.rdb_chunked;
     long long now = mstime();
     uint64_t cksum;
     size_t processed = 0;
+    rdbChunkWriter cw;
 
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
-    snprintf(magic,sizeof(magic),"REDIS%04d",RDB_VERSION);
+    if (chunked) rdbChunkWriterInit(&cw,rdb);
+    snprintf(magic,sizeof(magic),"REDIS%04d",
+        chunked ? RDB_VERSION_CHUNKED : RDB_VERSION);
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
     if (rdbSaveInfoAuxFields(rdb,flags,rsi) == -1) goto werr;
 
@@ -931,7 +1125,13 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
 
             initStaticStringObject(key,keystr);
             expire = getExpire(db,&key);
-            if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1) goto werr;
+            if (chunked) {
+                if (rdbChunkSaveKeyValuePair(rdb,&cw,j,&key,o,expire,now)
+                    == -1) goto werr;
+            } else {
+                if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1)
+                    goto werr;
+            }
 
             /* When this RDB is produced as part of an AOF rewrite, move
              * accumulated diff from parent to child while rewriting in
@@ -944,8 +1144,9 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
             }
         }
         dictReleaseIterator(di);
+        di = NULL;
+        if (chunked && rdbSaveChunk(rdb,&cw) == -1) goto werr;
     }
-    di = NULL; /* So that we don't release it again on error. */
 
     /* If we are storing the replication information on disk, persist
      * the script cache as well: on successful PSYNC after a restart, we need
@@ -959,6 +1160,14 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
                 goto werr;
         }
         dictReleaseIterator(di);
+        di = NULL;
+    }
+
+    /* The chunk index must be the last field before the EOF opcode. */
+    if (chunked) {
+        if (rdbSaveChunkIndex(rdb,&cw) == -1) goto werr;
+        rdbChunkWriterFree(&cw);
+        chunked = 0; /* So that we don't free it again on error. */
     }
 
     /* EOF opcode */
@@ -974,6 +1183,7 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
 werr:
     if (error) *error = errno;
     if (di) dictReleaseIterator(di);
+    if (chunked) rdbChunkWriterFree(&cw);
     return C_ERR;
 }
 
@@ -1067,10 +1277,12 @@ int rdbSaveBackground(char *filename, rdbSaveInfo *rsi) {
     pid_t childpid;
     long long start;
 
-    if (server.aof_child_pid != -1 || server.rdb_child_pid != -1) return C_ERR;
+    if (server.aof_child_pid != -1 || server.rdb_child_pid != -1 ||
+        server.rdb_forkless_in_progress) return C_ERR;
 
     server.dirty_before_bgsave = server.dirty;
     server.lastbgsave_try = time(NULL);
+    if (server.rdb_forkless) return rdbForklessStart(filename,rsi);
     openChildInfoPipe();
 
     start = ustime();
@@ -1123,6 +1335,307 @@ void rdbRemoveTempFile(pid_t childpid) {
     unlink(tmpfile);
 }
 
+/* -----------------------------------------------------------------------------
+ * Forkless background saving
+ *
+ * When rdb-forkless is enabled, BGSAVE (and the other background saves with
+ * a disk target) does not fork a child: the main process writes the RDB file
+ * itself, incrementally, spending at most rdb-forkless-step-us microseconds
+ * every millisecond in rdbForklessTimeProc(). The keys are visited with
+ * dictScan(), so the keyspace can be modified between two steps.
+ *
+ * The RDB file must contain the dataset as it was when the save started,
+ * like the one produced by a child. To do so the main thread calls
+ * rdbForklessTouchKey() before a key is modified, created or deleted: if the
+ * scan did not visit the key yet, its current value is written immediately,
+ * and the key is added to a per DB set of keys the scan should skip. Keys
+ * created after the start of the save are added to the same set, without
+ * writing anything.
+ *
+ * Whether the scan already visited a key is known comparing its hash with
+ * the scan cursor, see dictScanPosition(). The same comparison is used to
+ * skip the elements dictScan() returns twice when a table shrinks.
+ *
+ * Keys saved ahead of the scan may belong to a DB other than the one being
+ * scanned: a SELECTDB opcode is emitted every time the DB changes, which
+ * the RDB loader already handles.
+ * -------------------------------------------------------------------------- */
+
+static struct {
+    FILE *fp;
+    rio rdb;
+    char tmpfile[256];
+    sds filename;               /* Final name of the RDB file. */
+    rdbSaveInfo rsi;
+    int has_rsi;                /* True if 'rsi' was provided. */
+    long long now;              /* Start time: keys expired by then are
+                                   not saved. */
+    long long timer_id;         /* Time event driving the save, or -1. */
+    int db;                     /* DB being scanned. */
+    unsigned long cursor;       /* dictScan() cursor of the DB. */
+    unsigned long position;     /* dictScanPosition() of the cursor. */
+    int selected_db;            /* Last DB selected in the RDB file. */
+    dict **skip;                /* Per DB keys the scan should not save. */
+    long long saved_keys;       /* Keys saved by the scan. */
+    long long saved_ahead_keys; /* Keys saved before being modified. */
+    int error;                  /* errno of the first write error. */
+} rdbForkless;
+
+/* Append the key 'keystr' with value 'o' of the DB 'db' to the RDB file,
+ * selecting the DB first if needed. */
+static int rdbForklessSaveKey(redisDb *db, sds keystr, robj *o) {
+    rio *rdb = &rdbForkless.rdb;
+    robj key;
+
+    if (rdbForkless.selected_db != db->id) {
+        if (rdbSaveType(rdb,RDB_OPCODE_SELECTDB) == -1) return C_ERR;
+        if (rdbSaveLen(rdb,db->id) == -1) return C_ERR;
+        rdbForkless.selected_db = db->id;
+    }
+    initStaticStringObject(key,keystr);
+    if (rdbSaveKeyValuePair(rdb,&key,o,keyGetExpire(keystr),
+                            rdbForkless.now) == -1) return C_ERR;
+    return C_OK;
+}
+
+/* Return true if the scan already visited the position 'pos' of the DB
+ * 'db'. */
+static int rdbForklessVisited(redisDb *db, unsigned long pos) {
+    if (db->id != rdbForkless.db) return db->id < rdbForkless.db;
+    return pos < rdbForkless.position;
+}
+
+/* Called before the key 'key' of the DB 'db' is created, modified or
+ * deleted: if a forkless save is in progress, and the key was not saved
+ * yet, save it now with its current value, so that the RDB file reflects
+ * the dataset at the time the save started. */
+void rdbForklessTouchKey(redisDb *db, sds key) {
+    dictEntry *de;
+    dict *skip;
+
+    if (!server.rdb_forkless_in_progress || rdbForkless.error) return;
+    if (rdbForklessVisited(db,dictScanPosition(dictHashKey(db->dict,key))))
+        return;
+    skip = rdbForkless.skip[db->id];
+    if (dictFind(skip,key)) return;
+    if ((de = dictFind(db->dict,key)) != NULL) {
+        if (rdbForklessSaveKey(db,dictGetKey(de),dictGetVal(de)) == C_ERR) {
+            rdbForkless.error = errno ? errno : EIO;
+            return;
+        }
+        rdbForkless.saved_ahead_keys++;
+    }
+    dictAdd(skip,sdsdup(key),NULL);
+}
+
+/* dictScan() callback saving the keys the scan visits for the first time. */
+static void rdbForklessScanCallback(void *privdata, const dictEntry *de) {
+    redisDb *db = privdata;
+    sds key = dictGetKey(de);
+
+    if (rdbForkless.error) return;
+    if (dictScanPosition(dictHashKey(db->dict,key)) < rdbForkless.position)
+        return; /* Already returned before the table shrunk. */
+    if (dictFind(rdbForkless.skip[db->id],key)) return;
+    if (rdbForklessSaveKey(db,key,dictGetVal(de)) == C_ERR) {
+        rdbForkless.error = errno ? errno : EIO;
+        return;
+    }
+    rdbForkless.saved_keys++;
+}
+
+/* Scan the keyspace for at most 'budget' microseconds. Returns 1 when all
+ * the DBs were saved, 0 if there is more work to do. */
+static int rdbForklessScan(long long budget) {
+    long long start = ustime();
+    int iterations = 0;
+
+    while (rdbForkless.db < server.dbnum) {
+        redisDb *db = server.db+rdbForkless.db;
+
+        rdbForkless.cursor = dictScan(db->dict,rdbForkless.cursor,
+                                      rdbForklessScanCallback,NULL,db);
+        if (rdbForkless.error) return 0;
+        if (rdbForkless.cursor == 0) {
+            /* DB completed: the keys saved ahead of the scan can't be
+             * touched again. */
+            dictRelease(rdbForkless.skip[rdbForkless.db]);
+            rdbForkless.skip[rdbForkless.db] = NULL;
+            rdbForkless.db++;
+            rdbForkless.position = 0;
+        } else {
+            rdbForkless.position = dictScanPosition(rdbForkless.cursor);
+        }
+        if ((++iterations & 15) == 0 && ustime()-start >= budget) return 0;
+    }
+    return 1;
+}
+
+/* Write the trailer of the RDB file and move it to its final name. */
+static int rdbForklessFinish(void) {
+    rio *rdb = &rdbForkless.rdb;
+    uint64_t cksum;
+
+    /* Persist the script cache as well, see rdbSaveRio(). */
+    if (rdbForkless.has_rsi && dictSize(server.lua_scripts)) {
+        dictIterator *di = dictGetIterator(server.lua_scripts);
+        dictEntry *de;
+
+        while((de = dictNext(di)) != NULL) {
+            robj *body = dictGetVal(de);
+            if (rdbSaveAuxField(rdb,"lua",3,body->ptr,sdslen(body->ptr)) == -1)
+            {
+                dictReleaseIterator(di);
+                return C_ERR;
+            }
+        }
+        dictReleaseIterator(di);
+    }
+    if (rdbSaveType(rdb,RDB_OPCODE_EOF) == -1) return C_ERR;
+    cksum = rdb->cksum;
+    memrev64ifbe(&cksum);
+    if (rioWrite(rdb,&cksum,8) == 0) return C_ERR;
+
+    if (fflush(rdbForkless.fp) == EOF) return C_ERR;
+    if (fsync(fileno(rdbForkless.fp)) == -1) return C_ERR;
+    if (fclose(rdbForkless.fp) == EOF) {
+        rdbForkless.fp = NULL;
+        return C_ERR;
+    }
+    rdbForkless.fp = NULL;
+    if (rename(rdbForkless.tmpfile,rdbForkless.filename) == -1) return C_ERR;
+    return C_OK;
+}
+
+/* Release the state of the forkless save, handling its termination like
+ * backgroundSaveDoneHandlerDisk() does for a child. 'status' is C_OK on
+ * success, C_ERR on error, or -1 if the save was stopped on purpose. */
+static void rdbForklessDone(int status) {
+    int j;
+
+    if (rdbForkless.timer_id != -1) {
+        aeDeleteTimeEvent(server.el,rdbForkless.timer_id);
+        rdbForkless.timer_id = -1;
+    }
+    if (rdbForkless.fp) fclose(rdbForkless.fp);
+    if (status != C_OK) unlink(rdbForkless.tmpfile);
+    for (j = 0; j < server.dbnum; j++)
+        if (rdbForkless.skip[j]) dictRelease(rdbForkless.skip[j]);
+    zfree(rdbForkless.skip);
+    sdsfree(rdbForkless.filename);
+
+    if (status == C_OK) {
+        serverLog(LL_NOTICE,
+            "Forkless background saving terminated with success "
+            "(%lld keys saved ahead of the scan)",
+            rdbForkless.saved_ahead_keys);
+        server.dirty = server.dirty - server.dirty_before_bgsave;
+        server.lastsave = time(NULL);
+        server.lastbgsave_status = C_OK;
+    } else if (status == C_ERR) {
+        serverLog(LL_WARNING,"Forkless background saving error: %s",
+            strerror(rdbForkless.error ? rdbForkless.error : errno));
+        server.lastbgsave_status = C_ERR;
+    } else {
+        serverLog(LL_WARNING,"Forkless background saving interrupted");
+    }
+    server.rdb_forkless_in_progress = 0;
+    server.rdb_save_time_last = time(NULL)-server.rdb_save_time_start;
+    server.rdb_save_time_start = -1;
+    updateSlavesWaitingBgsave(status == C_OK ? C_OK : C_ERR,
+                              RDB_CHILD_TYPE_DISK);
+}
+
+/* Time event performing a step of the forkless save. */
+static int rdbForklessTimeProc(struct aeEventLoop *eventLoop, long long id,
+                               void *clientData)
+{
+    mstime_t latency;
+    int done;
+
+    UNUSED(eventLoop);
+    UNUSED(id);
+    UNUSED(clientData);
+
+    latencyStartMonitor(latency);
+    done = rdbForklessScan(server.rdb_forkless_step_us);
+    latencyEndMonitor(latency);
+    latencyAddSampleIfNeeded("rdb-forkless-step",latency);
+    if (!done && !rdbForkless.error) return 1;
+
+    /* The time event is removed returning AE_NOMORE. */
+    rdbForkless.timer_id = -1;
+    if (!rdbForkless.error && rdbForklessFinish() == C_OK) {
+        rdbForklessDone(C_OK);
+    } else {
+        if (!rdbForkless.error) rdbForkless.error = errno;
+        rdbForklessDone(C_ERR);
+    }
+    return AE_NOMORE;
+}
+
+/* Start a forkless save of the dataset to 'filename', see the top comment
+ * of this section. Returns C_ERR if the save could not be started. */
+int rdbForklessStart(char *filename, rdbSaveInfo *rsi) {
+    char magic[10];
+    int j;
+
+    snprintf(rdbForkless.tmpfile,sizeof(rdbForkless.tmpfile),
+        "temp-forkless-%d.rdb", (int) getpid());
+    rdbForkless.fp = fopen(rdbForkless.tmpfile,"w");
+    if (!rdbForkless.fp) {
+        server.lastbgsave_status = C_ERR;
+        serverLog(LL_WARNING,"Can't save in background: fopen: %s",
+            strerror(errno));
+        return C_ERR;
+    }
+    rioInitWithFile(&rdbForkless.rdb,rdbForkless.fp);
+    if (server.rdb_checksum)
+        rdbForkless.rdb.update_cksum = rioGenericUpdateChecksum;
+    snprintf(magic,sizeof(magic),"REDIS%04d",RDB_VERSION);
+    if (rdbWriteRaw(&rdbForkless.rdb,magic,9) == -1 ||
+        rdbSaveInfoAuxFields(&rdbForkless.rdb,RDB_SAVE_NONE,rsi) == -1)
+    {
+        server.lastbgsave_status = C_ERR;
+        serverLog(LL_WARNING,"Can't save in background: write: %s",
+            strerror(errno));
+        fclose(rdbForkless.fp);
+        unlink(rdbForkless.tmpfile);
+        return C_ERR;
+    }
+
+    rdbForkless.filename = sdsnew(filename);
+    rdbForkless.has_rsi = rsi != NULL;
+    if (rsi) rdbForkless.rsi = *rsi;
+    rdbForkless.now = mstime();
+    rdbForkless.db = 0;
+    rdbForkless.cursor = 0;
+    rdbForkless.position = 0;
+    rdbForkless.selected_db = -1;
+    rdbForkless.skip = zmalloc(sizeof(dict*)*server.dbnum);
+    for (j = 0; j < server.dbnum; j++)
+        rdbForkless.skip[j] = dictCreate(&setDictType,NULL);
+    rdbForkless.saved_keys = 0;
+    rdbForkless.saved_ahead_keys = 0;
+    rdbForkless.error = 0;
+    rdbForkless.timer_id = aeCreateTimeEvent(server.el,1,
+        rdbForklessTimeProc,NULL,NULL);
+    serverAssert(rdbForkless.timer_id != AE_ERR);
+
+    serverLog(LL_NOTICE,"Forkless background saving started");
+    server.rdb_save_time_start = time(NULL);
+    server.rdb_forkless_in_progress = 1;
+    return C_OK;
+}
+
+/* Stop the forkless save in progress, if any, without producing the file.
+ * Used when the dataset is replaced as a whole (FLUSHALL, SWAPDB, ...),
+ * and on shutdown, where a BGSAVE child would be killed. */
+void rdbForklessStop(void) {
+    if (!server.rdb_forkless_in_progress) return;
+    rdbForklessDone(-1);
+}
+
 /* This function is called by rdbLoadObject() when the code is in RDB-check
  * mode and we find a module value of type 2 that can be parsed without
  * the need of the actual module. The value is parsed for errors, finally
@@ -1162,6 +1675,26 @@ robj *rdbLoadCheckModuleValue(rio *rdb, char *modulename) {
     return createStringObject("module-dummy-value",18);
 }
 
+/* Hashes and sorted sets saved by older versions are ziplists: copy their
+ * elements into a listpack, which is returned, and free the ziplist. */
+static unsigned char *rdbConvertZiplistToListpack(unsigned char *zl) {
+    unsigned char *lp = lpNew(ziplistBlobLen(zl));
+    unsigned char *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll;
+
+    while (ziplistGet(p,&vstr,&vlen,&vll)) {
+        if (vstr)
+            lp = lpAppend(lp,vstr,vlen);
+        else
+            lp = lpAppendInteger(lp,vll);
+        p = ziplistNext(zl,p);
+    }
+    zfree(zl);
+    return lp;
+}
+
 /* Load a Redis object of the specified type from the specified file.
  * On success a newly allocated object is returned, otherwise NULL. */
 robj *rdbLoadObject(int rdbtype, rio *rdb) {
@@ -1266,7 +1799,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,OBJ_ENCODING_ZIPLIST);
+                zsetConvert(o,OBJ_ENCODING_LISTPACK);
     } else if (rdbtype == RDB_TYPE_HASH) {
         uint64_t len;
         int ret;
@@ -1281,8 +1814,8 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, OBJ_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == OBJ_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == OBJ_ENCODING_LISTPACK && len > 0) {
             len--;
             /* Load raw strings */
             if ((field = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL))
@@ -1290,11 +1823,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             if ((value = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL))
                 == NULL) return NULL;
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, (unsigned char*)field,
-                    sdslen(field), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, (unsigned char*)value,
-                    sdslen(value), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpAppend(o->ptr, (unsigned char*)field, sdslen(field));
+            o->ptr = lpAppend(o->ptr, (unsigned char*)value, sdslen(value));
 
             /* Convert to hash table if size threshold is exceeded */
             if (sdslen(field) > server.hash_max_ziplist_value ||
@@ -1327,26 +1858,44 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         /* All pairs should be read by now */
         serverAssert(len == 0);
-    } else if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
+    } else if (rdbtype == RDB_TYPE_LIST_QUICKLIST ||
+               rdbtype == RDB_TYPE_LIST_QUICKLIST_2)
+    {
         if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
         o = createQuicklistObject();
         quicklistSetOptions(o->ptr, server.list_max_ziplist_size,
                             server.list_compress_depth);
 
         while (len--) {
+            size_t encoded_len;
             unsigned char *zl =
-                rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,NULL);
+                rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&encoded_len);
             if (zl == NULL) return NULL;
-            quicklistAppendZiplist(o->ptr, zl);
+            if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
+                /* Nodes of old quicklists are ziplists: re-add the values
+                 * one by one so that they end up in listpacks. */
+                quicklistAppendValuesFromZiplist(o->ptr, zl);
+            } else {
+                if (!lpValidateIntegrity(zl,encoded_len,0))
+                    rdbExitReportCorruptRDB("Listpack integrity check failed.");
+                if (lpFirst(zl) == NULL) {
+                    /* Empty nodes are never saved. */
+                    rdbExitReportCorruptRDB("Empty listpack in quicklist.");
+                }
+                quicklistAppendListpack(o->ptr, zl);
+            }
         }
     } else if (rdbtype == RDB_TYPE_HASH_ZIPMAP  ||
                rdbtype == RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == RDB_TYPE_SET_INTSET   ||
                rdbtype == RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == RDB_TYPE_HASH_LISTPACK)
     {
+        size_t encoded_len;
         unsigned char *encoded =
-            rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,NULL);
+            rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&encoded_len);
         if (encoded == NULL) return NULL;
         o = createObject(OBJ_STRING,encoded); /* Obj type fixed below. */
 
@@ -1358,10 +1907,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
          * converted. */
         switch(rdbtype) {
             case RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *zl = lpNew(0);
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -1370,14 +1919,14 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        zl = lpAppend(zl, fstr, flen);
+                        zl = lpAppend(zl, vstr, vlen);
                     }
 
                     zfree(o->ptr);
                     o->ptr = zl;
                     o->type = OBJ_HASH;
-                    o->encoding = OBJ_ENCODING_ZIPLIST;
+                    o->encoding = OBJ_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
@@ -1392,20 +1941,34 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                 listTypeConvert(o,OBJ_ENCODING_QUICKLIST);
                 break;
             case RDB_TYPE_SET_INTSET:
+                if (!intsetValidateIntegrity(encoded,encoded_len,0))
+                    rdbExitReportCorruptRDB("Intset integrity check failed.");
                 o->type = OBJ_SET;
                 o->encoding = OBJ_ENCODING_INTSET;
                 if (intsetLen(o->ptr) > server.set_max_intset_entries)
                     setTypeConvert(o,OBJ_ENCODING_HT);
                 break;
             case RDB_TYPE_ZSET_ZIPLIST:
+            case RDB_TYPE_ZSET_LISTPACK:
+                if (rdbtype == RDB_TYPE_ZSET_ZIPLIST) {
+                    o->ptr = rdbConvertZiplistToListpack(o->ptr);
+                } else if (!lpValidateIntegrity(o->ptr,encoded_len,0)) {
+                    rdbExitReportCorruptRDB("Listpack integrity check failed.");
+                }
                 o->type = OBJ_ZSET;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
                     zsetConvert(o,OBJ_ENCODING_SKIPLIST);
                 break;
             case RDB_TYPE_HASH_ZIPLIST:
+            case RDB_TYPE_HASH_LISTPACK:
+                if (rdbtype == RDB_TYPE_HASH_ZIPLIST) {
+                    o->ptr = rdbConvertZiplistToListpack(o->ptr);
+                } else if (!lpValidateIntegrity(o->ptr,encoded_len,0)) {
+                    rdbExitReportCorruptRDB("Listpack integrity check failed.");
+                }
                 o->type = OBJ_HASH;
-                o->encoding = OBJ_ENCODING_ZIPLIST;
+                o->encoding = OBJ_ENCODING_LISTPACK;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
                     hashTypeConvert(o, OBJ_ENCODING_HT);
                 break;
@@ -1458,6 +2021,54 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
     return o;
 }
 
+/* Load the header of a chunk, see RDB_OPCODE_CHUNK, that follows the
+ * opcode. Returns -1 on short read, 0 otherwise. */
+int rdbLoadChunkHeader(rio *rdb, rdbChunkHeader *hdr) {
+    if ((hdr->dbid = rdbLoadLen(rdb,NULL)) == RDB_LENERR ||
+        (hdr->keys = rdbLoadLen(rdb,NULL)) == RDB_LENERR ||
+        (hdr->rawlen = rdbLoadLen(rdb,NULL)) == RDB_LENERR ||
+        (hdr->storedlen = rdbLoadLen(rdb,NULL)) == RDB_LENERR ||
+        rioRead(rdb,&hdr->crc,sizeof(hdr->crc)) == 0) return -1;
+    memrev64ifbe(&hdr->crc);
+
+    /* Every key-value pair takes at least two bytes. */
+    if (hdr->keys > hdr->rawlen || hdr->storedlen > hdr->rawlen) {
+        rdbExitReportCorruptRDB("Invalid chunk header: %llu keys, "
+            "%llu bytes, %llu stored bytes",
+            (unsigned long long)hdr->keys,
+            (unsigned long long)hdr->rawlen,
+            (unsigned long long)hdr->storedlen);
+    }
+    return 0;
+}
+
+/* Verify the checksum of a chunk payload as stored in the file, and
+ * decompress it if needed. The function takes ownership of 'stored' and
+ * returns the raw payload. If the chunk is corrupted NULL is returned and
+ * '*err' is set to the reason. */
+sds rdbChunkPayload(rdbChunkHeader *hdr, sds stored, const char **err) {
+    sds raw;
+
+    if (server.rdb_checksum && hdr->crc != 0 &&
+        crc64(0,(unsigned char*)stored,sdslen(stored)) != hdr->crc)
+    {
+        *err = "CRC error";
+        sdsfree(stored);
+        return NULL;
+    }
+    if (hdr->storedlen == hdr->rawlen) return stored;
+
+    raw = sdsnewlen(NULL,hdr->rawlen);
+    if (lzf_decompress(stored,hdr->storedlen,raw,hdr->rawlen) != hdr->rawlen) {
+        *err = "Invalid LZF compressed payload";
+        sdsfree(raw);
+        sdsfree(stored);
+        return NULL;
+    }
+    sdsfree(stored);
+    return raw;
+}
+
 /* Mark that we are loading in the global state and setup the fields
  * needed to provide loading stats. */
 void startLoading(FILE *fp) {
@@ -1486,11 +2097,492 @@ void stopLoading(void) {
     server.loading = 0;
 }
 
+/* -----------------------------------------------------------------------------
+ * Parallel loading
+ *
+ * When rdb-load-threads is greater than one, rdbLoadRio() does not decode
+ * the values by itself. The main thread reads the file and the keys, and
+ * frames every value walking its serialized form without building it: the
+ * bytes read meanwhile are captured by rdbLoadProgressCallback(). Framed
+ * records are grouped in batches that a pool of threads decodes calling
+ * rdbLoadObject() against the captured bytes (this is where LZF
+ * decompression and the construction of ziplists, skiplists and hash tables
+ * happen), while the main thread goes on reading. Decoded batches are added
+ * to the keyspace by the main thread in the same order they were read.
+ *
+ * Module values are still decoded by the main thread, since module code is
+ * not expected to run in other threads.
+ *
+ * Chunks of the chunked layout (see RDB_OPCODE_CHUNK) don't need framing:
+ * every chunk is a batch of its own, verified, decompressed and decoded by
+ * a single thread.
+ * -------------------------------------------------------------------------- */
+
+#define RDB_LOAD_BATCH_RECORDS 1024         /* Max records per batch. */
+#define RDB_LOAD_BATCH_BYTES (1024*1024)    /* Max framed bytes per batch. */
+#define RDB_LOAD_BATCHES_PER_THREAD 4       /* Max batches in flight. */
+
+typedef struct rdbLoadRecord {
+    redisDb *db;
+    robj *key;
+    long long expiretime;
+    int type;
+    sds raw;            /* Serialized value, NULL once decoded. */
+    robj *val;          /* Decoded value. */
+} rdbLoadRecord;
+
+/* A chunk as read from the file, before verifying and decoding it. */
+typedef struct rdbLoadChunk {
+    rdbChunkHeader hdr;
+    redisDb *db;
+    off_t offset;       /* Offset of the chunk, for error reporting. */
+    sds payload;        /* Payload as stored in the file. */
+} rdbLoadChunk;
+
+typedef struct rdbLoadBatch {
+    rdbLoadRecord *records;
+    int count;
+    size_t bytes;
+    rdbLoadChunk *chunk; /* If not NULL, the records are in this chunk. */
+    int decoded;        /* Set by the decoding thread under the mutex. */
+} rdbLoadBatch;
+
+static struct {
+    int numthreads;
+    pthread_t threads[RDB_LOAD_THREADS_MAX_NUM];
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   /* Signaled when a batch is queued. */
+    pthread_cond_t done_cond;   /* Signaled when a batch is decoded. */
+    list *queued;               /* Batches waiting for a decoding thread. */
+    list *inflight;             /* Batches not yet added, in file order.
+                                   Only accessed by the main thread. */
+    rdbLoadBatch *current;      /* Batch the main thread is filling. */
+    int stop;                   /* Ask the threads to exit. */
+    sds capture;                /* If not NULL, bytes read are appended here. */
+    int nocksum;                /* Don't update the checksum of the file. */
+} rdbLoader;
+
+/* Check if the key already expired. This function is used when loading
+ * an RDB file from disk, either at startup, or when an RDB was received
+ * from the master. In the latter case, the master is responsible for key
+ * expiry. If we would expire keys here, the snapshot taken by the master
+ * may not be reflected on the slave. */
+static int rdbLoadIsExpired(long long expiretime, long long now) {
+    return server.masterhost == NULL && expiretime != -1 && expiretime < now;
+}
+
+/* Add a loaded key to the database, taking ownership of 'key' and 'val'.
+ * Keys already expired are discarded. */
+static void rdbLoadAddKey(redisDb *db, robj *key, robj *val,
+                          long long expiretime, long long now)
+{
+    if (rdbLoadIsExpired(expiretime,now)) {
+        decrRefCount(key);
+        decrRefCount(val);
+        return;
+    }
+    /* Add the new object in the hash table */
+    dbAdd(db,key,val);
+
+    /* Set the expire time if needed */
+    if (expiretime != -1) setExpire(NULL,db,key,expiretime);
+
+    decrRefCount(key);
+}
+
+/* Consume 'len' bytes of the stream. When framing a value the bytes are
+ * kept anyway by the capture performed in rdbLoadProgressCallback(). */
+static int rdbLoadSkip(rio *rdb, uint64_t len) {
+    char buf[PROTO_IOBUF_LEN];
+
+    while(len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (rioRead(rdb,buf,n) == 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Like rdbGenericLoadStringObject() but without creating the string:
+ * compressed payloads are not decompressed. */
+static int rdbLoadSkipString(rio *rdb) {
+    int isencoded;
+    uint64_t len;
+
+    if (rdbLoadLenByRef(rdb,&isencoded,&len) == -1) return -1;
+    if (isencoded) {
+        switch(len) {
+        case RDB_ENC_INT8: return rdbLoadSkip(rdb,1);
+        case RDB_ENC_INT16: return rdbLoadSkip(rdb,2);
+        case RDB_ENC_INT32: return rdbLoadSkip(rdb,4);
+        case RDB_ENC_LZF:
+        case RDB_ENC_ZSTD:
+            if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return -1;
+            if (rdbLoadLen(rdb,NULL) == RDB_LENERR) return -1;
+            return rdbLoadSkip(rdb,len);
+        default:
+            rdbExitReportCorruptRDB("Unknown RDB string encoding type %d",len);
+        }
+    }
+    return rdbLoadSkip(rdb,len);
+}
+
+/* Walk the serialized value of the specified type, consuming exactly the
+ * bytes rdbLoadObject() would read. Module types are not handled here.
+ * Returns -1 on short read, 0 otherwise. */
+static int rdbLoadSkipObject(int rdbtype, rio *rdb) {
+    uint64_t len;
+    unsigned char dlen;
+
+    switch(rdbtype) {
+    case RDB_TYPE_STRING:
+    case RDB_TYPE_HASH_ZIPMAP:
+    case RDB_TYPE_LIST_ZIPLIST:
+    case RDB_TYPE_SET_INTSET:
+    case RDB_TYPE_ZSET_ZIPLIST:
+    case RDB_TYPE_HASH_ZIPLIST:
+    case RDB_TYPE_ZSET_LISTPACK:
+    case RDB_TYPE_HASH_LISTPACK:
+        return rdbLoadSkipString(rdb);
+    case RDB_TYPE_LIST:
+    case RDB_TYPE_SET:
+    case RDB_TYPE_LIST_QUICKLIST:
+    case RDB_TYPE_LIST_QUICKLIST_2:
+    case RDB_TYPE_HASH:
+    case RDB_TYPE_ZSET:
+    case RDB_TYPE_ZSET_2:
+        if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return -1;
+        while(len--) {
+            if (rdbLoadSkipString(rdb) == -1) return -1;
+            if (rdbtype == RDB_TYPE_HASH) {
+                if (rdbLoadSkipString(rdb) == -1) return -1;
+            } else if (rdbtype == RDB_TYPE_ZSET_2) {
+                if (rdbLoadSkip(rdb,sizeof(double)) == -1) return -1;
+            } else if (rdbtype == RDB_TYPE_ZSET) {
+                /* See rdbLoadDoubleValue(). */
+                if (rioRead(rdb,&dlen,1) == 0) return -1;
+                if (dlen < 253 && rdbLoadSkip(rdb,dlen) == -1) return -1;
+            }
+        }
+        return 0;
+    default:
+        rdbExitReportCorruptRDB("Unknown RDB encoding type %d",rdbtype);
+        return -1; /* Never reached. */
+    }
+}
+
+/* Verify, decompress and decode the key-value pairs of a chunk. */
+static void rdbLoadDecodeChunk(rdbLoadBatch *batch) {
+    rdbLoadChunk *chunk = batch->chunk;
+    const char *err;
+    rio payload;
+    sds raw;
+    uint64_t j;
+
+    if ((raw = rdbChunkPayload(&chunk->hdr,chunk->payload,&err)) == NULL) {
+        rdbExitReportCorruptRDB("%s in the chunk at offset %lld",
+            err, (long long)chunk->offset);
+    }
+    rioInitWithBuffer(&payload,raw);
+    batch->records = zmalloc(sizeof(rdbLoadRecord)*chunk->hdr.keys);
+    for (j = 0; j < chunk->hdr.keys; j++) {
+        rdbLoadRecord *rec = batch->records+j;
+
+        rec->db = chunk->db;
+        rec->expiretime = -1;
+        rec->raw = NULL;
+        rec->type = rdbLoadType(&payload);
+        if (rec->type == RDB_OPCODE_EXPIRETIME_MS) {
+            rec->expiretime = rdbLoadMillisecondTime(&payload);
+            rec->type = rdbLoadType(&payload);
+        }
+        if (!rdbIsObjectType(rec->type) ||
+            (rec->key = rdbLoadStringObject(&payload)) == NULL ||
+            (rec->val = rdbLoadObject(rec->type,&payload)) == NULL)
+        {
+            rdbExitReportCorruptRDB(
+                "Invalid key-value pair in the chunk at offset %lld",
+                (long long)chunk->offset);
+        }
+        batch->count++;
+    }
+    sdsfree(raw);
+    zfree(chunk);
+    batch->chunk = NULL;
+}
+
+/* Decode every record of the batch. Called by the loading threads, or by
+ * the main thread for chunks when no loading thread is used. */
+static void rdbLoadDecodeBatch(rdbLoadBatch *batch) {
+    int j;
+
+    if (batch->chunk) {
+        rdbLoadDecodeChunk(batch);
+        return;
+    }
+    for (j = 0; j < batch->count; j++) {
+        rdbLoadRecord *rec = batch->records+j;
+        rio payload;
+
+        if (rec->raw == NULL) continue; /* Decoded by the main thread. */
+        rioInitWithBuffer(&payload,rec->raw);
+        if ((rec->val = rdbLoadObject(rec->type,&payload)) == NULL)
+            rdbExitReportCorruptRDB("Short read decoding a framed value");
+        sdsfree(rec->raw);
+        rec->raw = NULL;
+    }
+}
+
+static void *rdbLoadThreadMain(void *arg) {
+    sigset_t sigset;
+    UNUSED(arg);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        serverLog(LL_WARNING,
+            "Warning: can't mask SIGALRM in RDB loading thread: %s",
+            strerror(errno));
+
+    pthread_mutex_lock(&rdbLoader.mutex);
+    while(1) {
+        listNode *ln;
+        rdbLoadBatch *batch;
+
+        /* The loop always starts with the lock hold. */
+        if (listLength(rdbLoader.queued) == 0) {
+            if (rdbLoader.stop) break;
+            pthread_cond_wait(&rdbLoader.work_cond,&rdbLoader.mutex);
+            continue;
+        }
+        ln = listFirst(rdbLoader.queued);
+        batch = ln->value;
+        listDelNode(rdbLoader.queued,ln);
+        pthread_mutex_unlock(&rdbLoader.mutex);
+
+        rdbLoadDecodeBatch(batch);
+
+        pthread_mutex_lock(&rdbLoader.mutex);
+        batch->decoded = 1;
+        pthread_cond_signal(&rdbLoader.done_cond);
+    }
+    pthread_mutex_unlock(&rdbLoader.mutex);
+    return NULL;
+}
+
+static void rdbLoadThreadsStart(int numthreads) {
+    int j;
+
+    pthread_mutex_init(&rdbLoader.mutex,NULL);
+    pthread_cond_init(&rdbLoader.work_cond,NULL);
+    pthread_cond_init(&rdbLoader.done_cond,NULL);
+    rdbLoader.queued = listCreate();
+    rdbLoader.inflight = listCreate();
+    rdbLoader.current = NULL;
+    rdbLoader.stop = 0;
+    rdbLoader.numthreads = numthreads;
+    for (j = 0; j < numthreads; j++) {
+        if (pthread_create(&rdbLoader.threads[j],NULL,
+                           rdbLoadThreadMain,NULL) != 0)
+        {
+            serverLog(LL_WARNING,"Fatal: Can't create RDB loading threads.");
+            exit(1);
+        }
+    }
+    serverLog(LL_NOTICE,"Decoding RDB values with %d threads", numthreads);
+}
+
+static rdbLoadBatch *rdbLoadCreateBatch(void) {
+    rdbLoadBatch *batch = zmalloc(sizeof(*batch));
+
+    batch->records = NULL;
+    batch->count = 0;
+    batch->bytes = 0;
+    batch->chunk = NULL;
+    batch->decoded = 0;
+    return batch;
+}
+
+/* Add the records of a decoded batch to the keyspace, and free it. */
+static void rdbLoadAddBatch(rdbLoadBatch *batch, long long now) {
+    int j;
+
+    for (j = 0; j < batch->count; j++) {
+        rdbLoadRecord *rec = batch->records+j;
+        rdbLoadAddKey(rec->db,rec->key,rec->val,rec->expiretime,now);
+    }
+    zfree(batch->records);
+    zfree(batch);
+}
+
+/* Add to the keyspace, in order, the batches at the head of the in flight
+ * list that were already decoded. If more than 'maxinflight' batches are
+ * in flight, wait for the oldest ones to be decoded. */
+static void rdbLoadAddBatches(unsigned long maxinflight, long long now) {
+    while(listLength(rdbLoader.inflight)) {
+        listNode *ln = listFirst(rdbLoader.inflight);
+        rdbLoadBatch *batch = ln->value;
+
+        pthread_mutex_lock(&rdbLoader.mutex);
+        if (!batch->decoded &&
+            listLength(rdbLoader.inflight) <= maxinflight)
+        {
+            pthread_mutex_unlock(&rdbLoader.mutex);
+            break;
+        }
+        while(!batch->decoded)
+            pthread_cond_wait(&rdbLoader.done_cond,&rdbLoader.mutex);
+        pthread_mutex_unlock(&rdbLoader.mutex);
+
+        listDelNode(rdbLoader.inflight,ln);
+        rdbLoadAddBatch(batch,now);
+    }
+}
+
+/* Hand a batch to the loading threads. If it is the batch being filled,
+ * a new one will be created for the next records. */
+static void rdbLoadSubmitBatch(rdbLoadBatch *batch, long long now) {
+    if (batch == NULL) return;
+    if (batch == rdbLoader.current) rdbLoader.current = NULL;
+    listAddNodeTail(rdbLoader.inflight,batch);
+    pthread_mutex_lock(&rdbLoader.mutex);
+    listAddNodeTail(rdbLoader.queued,batch);
+    pthread_cond_signal(&rdbLoader.work_cond);
+    pthread_mutex_unlock(&rdbLoader.mutex);
+    rdbLoadAddBatches(rdbLoader.numthreads*RDB_LOAD_BATCHES_PER_THREAD,now);
+}
+
+/* Add all the pending records to the keyspace and terminate the threads. */
+static void rdbLoadThreadsStop(long long now) {
+    int j;
+
+    rdbLoadSubmitBatch(rdbLoader.current,now);
+    rdbLoadAddBatches(0,now);
+
+    pthread_mutex_lock(&rdbLoader.mutex);
+    rdbLoader.stop = 1;
+    pthread_cond_broadcast(&rdbLoader.work_cond);
+    pthread_mutex_unlock(&rdbLoader.mutex);
+    for (j = 0; j < rdbLoader.numthreads; j++)
+        pthread_join(rdbLoader.threads[j],NULL);
+
+    listRelease(rdbLoader.queued);
+    listRelease(rdbLoader.inflight);
+    pthread_mutex_destroy(&rdbLoader.mutex);
+    pthread_cond_destroy(&rdbLoader.work_cond);
+    pthread_cond_destroy(&rdbLoader.done_cond);
+    rdbLoader.numthreads = 0;
+}
+
+/* Read the value of 'key' and queue it for decoding by the loading threads.
+ * Takes ownership of 'key'. Returns -1 on short read, 0 otherwise. */
+static int rdbLoadQueueValue(rio *rdb, redisDb *db, robj *key, int type,
+                             long long expiretime, long long now)
+{
+    rdbLoadBatch *batch;
+    rdbLoadRecord *rec;
+    robj *val = NULL;
+    sds raw = NULL;
+
+    if (type == RDB_TYPE_MODULE || type == RDB_TYPE_MODULE_2) {
+        if ((val = rdbLoadObject(type,rdb)) == NULL) return -1;
+    } else {
+        rdbLoader.capture = sdsempty();
+        if (rdbLoadSkipObject(type,rdb) == -1) return -1;
+        raw = rdbLoader.capture;
+        rdbLoader.capture = NULL;
+    }
+
+    /* Don't waste time decoding values that would be discarded anyway. */
+    if (rdbLoadIsExpired(expiretime,now)) {
+        decrRefCount(key);
+        if (val) decrRefCount(val);
+        sdsfree(raw);
+        return 0;
+    }
+
+    if (rdbLoader.current == NULL) {
+        rdbLoader.current = rdbLoadCreateBatch();
+        rdbLoader.current->records =
+            zmalloc(sizeof(rdbLoadRecord)*RDB_LOAD_BATCH_RECORDS);
+    }
+    batch = rdbLoader.current;
+    rec = batch->records+batch->count++;
+    rec->db = db;
+    rec->key = key;
+    rec->expiretime = expiretime;
+    rec->type = type;
+    rec->raw = raw;
+    rec->val = val;
+    if (raw) batch->bytes += sdslen(raw);
+
+    if (batch->count == RDB_LOAD_BATCH_RECORDS ||
+        batch->bytes >= RDB_LOAD_BATCH_BYTES) rdbLoadSubmitBatch(batch,now);
+    return 0;
+}
+
+/* Read a chunk, see RDB_OPCODE_CHUNK, and add its key-value pairs to the
+ * keyspace, or queue it for decoding by the loading threads.
+ * Returns -1 on short read, 0 otherwise. */
+static int rdbLoadReadChunk(rio *rdb, long long now) {
+    rdbLoadChunk *chunk = zmalloc(sizeof(*chunk));
+    rdbLoadBatch *batch;
+
+    chunk->offset = rdb->processed_bytes-1;
+    if (rdbLoadChunkHeader(rdb,&chunk->hdr) == -1) {
+        zfree(chunk);
+        return -1;
+    }
+    if (chunk->hdr.dbid >= (unsigned)server.dbnum) {
+        serverLog(LL_WARNING,
+            "FATAL: Data file was created with a Redis "
+            "server configured to handle more than %d "
+            "databases. Exiting\n", server.dbnum);
+        exit(1);
+    }
+    chunk->db = server.db+chunk->hdr.dbid;
+    chunk->payload = sdsnewlen(NULL,chunk->hdr.storedlen);
+
+    /* The payload is verified against the CRC of the chunk anyway, so
+     * the checksum of the file is obtained combining the two instead of
+     * scanning the payload twice. */
+    rdbLoader.nocksum = server.rdb_checksum && chunk->hdr.crc != 0;
+    if (chunk->hdr.storedlen &&
+        rioRead(rdb,chunk->payload,chunk->hdr.storedlen) == 0)
+    {
+        rdbLoader.nocksum = 0;
+        sdsfree(chunk->payload);
+        zfree(chunk);
+        return -1;
+    }
+    if (rdbLoader.nocksum) {
+        rdb->cksum = crc64_combine(rdb->cksum,chunk->hdr.crc,
+                                   chunk->hdr.storedlen);
+        rdbLoader.nocksum = 0;
+    }
+
+    batch = rdbLoadCreateBatch();
+    batch->chunk = chunk;
+    if (rdbLoader.numthreads) {
+        /* Records framed before the chunk must be added first. */
+        rdbLoadSubmitBatch(rdbLoader.current,now);
+        rdbLoadSubmitBatch(batch,now);
+    } else {
+        rdbLoadDecodeBatch(batch);
+        rdbLoadAddBatch(batch,now);
+    }
+    return 0;
+}
+
 /* Track loading progress in order to serve client's from time to time
    and if needed calculate rdb checksum  */
 void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
-    if (server.rdb_checksum)
+    if (server.rdb_checksum && !rdbLoader.nocksum)
         rioGenericUpdateChecksum(r, buf, len);
+    if (rdbLoader.capture)
+        rdbLoader.capture = sdscatlen(rdbLoader.capture, buf, len);
     if (server.loading_process_events_interval_bytes &&
         (r->processed_bytes + len)/server.loading_process_events_interval_bytes > r->processed_bytes/server.loading_process_events_interval_bytes)
     {
@@ -1524,11 +2616,13 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
         return C_ERR;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
+    if (!rdbIsSupportedVersion(rdbver)) {
         serverLog(LL_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
         return C_ERR;
     }
+    if (server.rdb_load_threads_num > 1)
+        rdbLoadThreadsStart(server.rdb_load_threads_num);
 
     while(1) {
         robj *key, *val;
@@ -1557,6 +2651,10 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
         } else if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
+        } else if (type == RDB_OPCODE_CHUNK) {
+            /* CHUNK: a group of key-value pairs, see rdb.h. */
+            if (rdbLoadReadChunk(rdb,now) == -1) goto eoferr;
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_SELECTDB) {
             /* SELECTDB: Select the specified database. */
             if ((dbid = rdbLoadLen(rdb,NULL)) == RDB_LENERR)
@@ -1607,6 +2705,9 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
                 }
             } else if (!strcasecmp(auxkey->ptr,"repl-offset")) {
                 if (rsi) rsi->repl_offset = strtoll(auxval->ptr,NULL,10);
+            } else if (!strcasecmp(auxkey->ptr,RDB_CHUNK_INDEX_AUX)) {
+                /* The index is only needed to locate the chunks without
+                 * reading the file sequentially, like we do. */
             } else if (!strcasecmp(auxkey->ptr,"lua")) {
                 /* Load the script back in memory. */
                 if (luaCreateFunction(NULL,server.lua,auxval) == NULL) {
@@ -1628,26 +2729,16 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
 
         /* Read key */
         if ((key = rdbLoadStringObject(rdb)) == NULL) goto eoferr;
-        /* Read value */
-        if ((val = rdbLoadObject(type,rdb)) == NULL) goto eoferr;
-        /* Check if the key already expired. This function is used when loading
-         * an RDB file from disk, either at startup, or when an RDB was
-         * received from the master. In the latter case, the master is
-         * responsible for key expiry. If we would expire keys here, the
-         * snapshot taken by the master may not be reflected on the slave. */
-        if (server.masterhost == NULL && expiretime != -1 && expiretime < now) {
-            decrRefCount(key);
-            decrRefCount(val);
+        /* Read value, or let the loading threads decode it. */
+        if (rdbLoader.numthreads) {
+            if (rdbLoadQueueValue(rdb,db,key,type,expiretime,now) == -1)
+                goto eoferr;
             continue;
         }
-        /* Add the new object in the hash table */
-        dbAdd(db,key,val);
-
-        /* Set the expire time if needed */
-        if (expiretime != -1) setExpire(NULL,db,key,expiretime);
-
-        decrRefCount(key);
+        if ((val = rdbLoadObject(type,rdb)) == NULL) goto eoferr;
+        rdbLoadAddKey(db,key,val,expiretime,now);
     }
+    if (rdbLoader.numthreads) rdbLoadThreadsStop(now);
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5 && server.rdb_checksum) {
         uint64_t cksum, expected = rdb->cksum;
@@ -1997,7 +3088,7 @@ int rdbSaveToSlavesSockets(rdbSaveInfo *rsi) {
 }
 
 void saveCommand(client *c) {
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
         return;
     }
@@ -2028,7 +3119,7 @@ void bgsaveCommand(client *c) {
     rdbSaveInfo rsi, *rsiptr;
     rsiptr = rdbPopulateSaveInfo(&rsi);
 
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_forkless_in_progress) {
         addReplyError(c,"Background save already in progress");
     } else if (server.aof_child_pid != -1) {
         if (schedule) {
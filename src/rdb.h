@@ -37,8 +37,24 @@
 #include "server.h"
 
 /* The current RDB version. When the format changes in a way that is no longer
- * backward compatible this number gets incremented. */
-#define RDB_VERSION 8
+ * backward compatible this number gets incremented.
+ *
+ * Versions from 10 to 999 are left to upstream Redis releases, that use
+ * some of the type and opcode numbers of this file with a different
+ * meaning: files with those versions are refused, and since the versions
+ * used here are greater than the upstream ones, upstream servers refuse
+ * our files too instead of misparsing them. */
+#define RDB_VERSION 1000
+
+/* Files using the chunked layout (see RDB_OPCODE_CHUNK) are marked with this
+ * version, so that older servers refuse them instead of failing on the
+ * unknown opcode. Everything else is the same as RDB_VERSION. */
+#define RDB_VERSION_CHUNKED 1001
+
+/* Test if an RDB file with version 'v' can be loaded. */
+#define rdbIsSupportedVersion(v) (((v) >= 1 && (v) <= 9) || \
+                                  (v) == RDB_VERSION || \
+                                  (v) == RDB_VERSION_CHUNKED)
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -68,6 +84,7 @@
 #define RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define RDB_ENC_ZSTD 4        /* string compressed with Zstandard */
 
 /* Dup object types to RDB object types. Only reason is readability (are we
  * dealing with RDB types or with in-memory object types?). */
@@ -89,12 +106,18 @@
 #define RDB_TYPE_ZSET_ZIPLIST  12
 #define RDB_TYPE_HASH_ZIPLIST  13
 #define RDB_TYPE_LIST_QUICKLIST 14
+/* 15 is reserved for streams. */
+#define RDB_TYPE_HASH_LISTPACK 16
+#define RDB_TYPE_ZSET_LISTPACK 17
+#define RDB_TYPE_LIST_QUICKLIST_2 18 /* Quicklist of listpacks. */
 /* NOTE: WHEN ADDING NEW RDB TYPE, UPDATE rdbIsObjectType() BELOW */
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 7) || (t >= 9 && t <= 14))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 7) || (t >= 9 && t <= 14) || \
+                            (t >= 16 && t <= 18))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+#define RDB_OPCODE_CHUNK      200 /* Far from the upstream opcodes. */
 #define RDB_OPCODE_AUX        250
 #define RDB_OPCODE_RESIZEDB   251
 #define RDB_OPCODE_EXPIRETIME_MS 252
@@ -102,6 +125,35 @@
 #define RDB_OPCODE_SELECTDB   254
 #define RDB_OPCODE_EOF        255
 
+/* Chunked layout. When rdb-chunked is enabled the key-value pairs of every
+ * DB are grouped into chunks that can be verified and decoded independently:
+ *
+ * RDB_OPCODE_CHUNK <dbid> <keys> <rawlen> <storedlen> <crc64> <payload>
+ *
+ * All the fields but the crc64 (8 bytes, little endian) are RDB lengths.
+ * The payload is a sequence of 'keys' key-value pairs in the usual format
+ * (expire, type, key, value), LZF compressed as a whole if 'storedlen' is
+ * smaller than 'rawlen'. The crc64 is computed on the stored payload, and
+ * is zero if checksums are disabled.
+ *
+ * The last field before RDB_OPCODE_EOF is the "chunk-index" AUX field. Its
+ * value has one entry for every chunk, made of four 64 bit little endian
+ * integers (offset from the start of the RDB, length, dbid, keys), followed
+ * by the number of entries and the magic string below. So the index can be
+ * located reading backward from the end of the file. */
+#define RDB_CHUNK_INDEX_AUX "chunk-index"
+#define RDB_CHUNK_INDEX_MAGIC "RDBCHIDX"
+#define RDB_CHUNK_INDEX_ENTRY_LEN 32
+#define RDB_CHUNK_INDEX_TRAILER_LEN 16
+
+typedef struct rdbChunkHeader {
+    uint64_t dbid;
+    uint64_t keys;
+    uint64_t rawlen;
+    uint64_t storedlen;
+    uint64_t crc;
+} rdbChunkHeader;
+
 /* Module serialized values sub opcodes */
 #define RDB_MODULE_OPCODE_EOF   0   /* End of module value. */
 #define RDB_MODULE_OPCODE_SINT  1   /* Signed integer. */
@@ -132,6 +184,9 @@ int rdbLoad(char *filename, rdbSaveInfo *rsi);
 int rdbSaveBackground(char *filename, rdbSaveInfo *rsi);
 int rdbSaveToSlavesSockets(rdbSaveInfo *rsi);
 void rdbRemoveTempFile(pid_t childpid);
+int rdbForklessStart(char *filename, rdbSaveInfo *rsi);
+void rdbForklessStop(void);
+void rdbForklessTouchKey(redisDb *db, sds key);
 int rdbSave(char *filename, rdbSaveInfo *rsi);
 ssize_t rdbSaveObject(rio *rdb, robj *o);
 size_t rdbSavedObjectLen(robj *o);
@@ -147,6 +202,8 @@ int rdbLoadBinaryDoubleValue(rio *rdb, double *val);
 int rdbSaveBinaryFloatValue(rio *rdb, float val);
 int rdbLoadBinaryFloatValue(rio *rdb, float *val);
 int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi);
+int rdbLoadChunkHeader(rio *rdb, rdbChunkHeader *hdr);
+sds rdbChunkPayload(rdbChunkHeader *hdr, sds stored, const char **err);
 rdbSaveInfo *rdbPopulateSaveInfo(rdbSaveInfo *rsi);
 
 #endif
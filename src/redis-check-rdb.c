@@ -44,6 +44,9 @@ struct {
     unsigned long keys;             /* Number of keys processed. */
     unsigned long expires;          /* Number of keys with an expire. */
     unsigned long already_expired;  /* Number of keys already expired. */
+    unsigned long chunks;           /* Number of chunks processed. */
+    unsigned long bad_chunks;       /* Number of corrupted chunks. */
+    sds chunk_index;                /* Chunk index read from the footer. */
     int doing;                      /* The state while reading the RDB. */
     int error_set;                  /* True if error is populated. */
     char error[1024];
@@ -59,6 +62,7 @@ struct {
 #define RDB_CHECK_DOING_CHECK_SUM 5
 #define RDB_CHECK_DOING_READ_LEN 6
 #define RDB_CHECK_DOING_READ_AUX 7
+#define RDB_CHECK_DOING_READ_CHUNK 8
 
 char *rdb_check_doing_string[] = {
     "start",
@@ -68,7 +72,8 @@ char *rdb_check_doing_string[] = {
     "read-object-value",
     "check-sum",
     "read-len",
-    "read-aux"
+    "read-aux",
+    "read-chunk"
 };
 
 char *rdb_type_string[] = {
@@ -85,7 +90,11 @@ char *rdb_type_string[] = {
     "set-intset",
     "zset-ziplist",
     "hash-ziplist",
-    "quicklist"
+    "quicklist",
+    "",
+    "hash-listpack",
+    "zset-listpack",
+    "quicklist-v2"
 };
 
 /* Show a few stats collected into 'rdbstate' */
@@ -93,6 +102,9 @@ void rdbShowGenericInfo(void) {
     printf("[info] %lu keys read\n", rdbstate.keys);
     printf("[info] %lu expires\n", rdbstate.expires);
     printf("[info] %lu already expired\n", rdbstate.already_expired);
+    if (rdbstate.chunks)
+        printf("[info] %lu chunks, %lu corrupted\n",
+            rdbstate.chunks, rdbstate.bad_chunks);
 }
 
 /* Called on RDB errors. Provides details about the RDB and the offset
@@ -172,6 +184,139 @@ void rdbCheckSetupSignals(void) {
     sigaction(SIGILL, &act, NULL);
 }
 
+/* Read the chunk index from the end of the file, see RDB_OPCODE_CHUNK,
+ * so that corrupted chunks can be reported with their position in the
+ * index. On success the index entries are stored in rdbstate.chunk_index,
+ * otherwise it is left NULL. The file position is not modified. */
+void rdbCheckLoadChunkIndex(FILE *fp) {
+    unsigned char trailer[RDB_CHUNK_INDEX_TRAILER_LEN];
+    off_t pos = ftello(fp), end, start;
+    uint64_t count;
+
+    /* The trailer is followed by the EOF opcode and the checksum. */
+    if (fseeko(fp,0,SEEK_END) == -1) goto noindex;
+    end = ftello(fp)-1-8;
+    if (end < RDB_CHUNK_INDEX_TRAILER_LEN) goto noindex;
+    if (fseeko(fp,end-RDB_CHUNK_INDEX_TRAILER_LEN,SEEK_SET) == -1 ||
+        fread(trailer,sizeof(trailer),1,fp) != 1) goto noindex;
+    if (memcmp(trailer+sizeof(count),RDB_CHUNK_INDEX_MAGIC,
+               sizeof(trailer)-sizeof(count)) != 0) goto noindex;
+    memcpy(&count,trailer,sizeof(count));
+    memrev64ifbe(&count);
+    start = end-RDB_CHUNK_INDEX_TRAILER_LEN-
+            (off_t)count*RDB_CHUNK_INDEX_ENTRY_LEN;
+    if (count > (uint64_t)end/RDB_CHUNK_INDEX_ENTRY_LEN || start < 0)
+        goto noindex;
+
+    rdbstate.chunk_index = sdsnewlen(NULL,count*RDB_CHUNK_INDEX_ENTRY_LEN);
+    if (fseeko(fp,start,SEEK_SET) == -1 ||
+        (count && fread(rdbstate.chunk_index,
+                        sdslen(rdbstate.chunk_index),1,fp) != 1))
+    {
+        sdsfree(rdbstate.chunk_index);
+        rdbstate.chunk_index = NULL;
+        goto noindex;
+    }
+    rdbCheckInfo("Chunk index with %llu chunks found at offset %lld",
+        (unsigned long long)count, (long long)start);
+    fseeko(fp,pos,SEEK_SET);
+    return;
+
+noindex:
+    rdbCheckInfo("No chunk index found at the end of the file");
+    fseeko(fp,pos,SEEK_SET);
+}
+
+/* Return the field 'field' of the index entry 'j', or -1 if there is no
+ * such entry. */
+long long rdbCheckChunkIndexField(unsigned long j, int field) {
+    uint64_t v;
+
+    if (rdbstate.chunk_index == NULL ||
+        (j+1)*RDB_CHUNK_INDEX_ENTRY_LEN > sdslen(rdbstate.chunk_index))
+        return -1;
+    memcpy(&v,rdbstate.chunk_index+j*RDB_CHUNK_INDEX_ENTRY_LEN+
+              field*sizeof(uint64_t),sizeof(v));
+    memrev64ifbe(&v);
+    return v;
+}
+
+/* Check a chunk, see RDB_OPCODE_CHUNK. A chunk with a bad checksum is
+ * reported and skipped, so that all the corrupted chunks of the file are
+ * located in a single pass. Returns -1 on short read, 0 otherwise. */
+int rdbCheckChunk(rio *rdb, long long now) {
+    rdbChunkHeader hdr;
+    long long offset = rdb->processed_bytes-1, indexed;
+    unsigned long j = rdbstate.chunks++;
+    const char *err;
+    sds payload;
+    rio r;
+    uint64_t i;
+
+    rdbstate.doing = RDB_CHECK_DOING_READ_CHUNK;
+    if (rdbLoadChunkHeader(rdb,&hdr) == -1) return -1;
+    payload = sdsnewlen(NULL,hdr.storedlen);
+    if (hdr.storedlen && rioRead(rdb,payload,hdr.storedlen) == 0) {
+        sdsfree(payload);
+        return -1;
+    }
+    indexed = rdbCheckChunkIndexField(j,0);
+    if (rdbstate.chunk_index && indexed != offset) {
+        rdbCheckInfo("Chunk #%lu: the index says offset %lld", j, indexed);
+    }
+    if ((payload = rdbChunkPayload(&hdr,payload,&err)) == NULL) {
+        printf("--- CORRUPTED CHUNK ---\n");
+        rdbCheckInfo("Chunk #%lu at offset %lld (DB %llu, %llu keys): %s",
+            j, offset, (unsigned long long)hdr.dbid,
+            (unsigned long long)hdr.keys, err);
+        rdbstate.bad_chunks++;
+        return 0;
+    }
+
+    /* Check the key-value pairs inside the chunk. */
+    rioInitWithBuffer(&r,payload);
+    for (i = 0; i < hdr.keys; i++) {
+        long long expiretime = -1;
+        int type;
+        robj *key, *val;
+
+        rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+        if ((type = rdbLoadType(&r)) == RDB_OPCODE_EXPIRETIME_MS) {
+            rdbstate.doing = RDB_CHECK_DOING_READ_EXPIRE;
+            expiretime = rdbLoadMillisecondTime(&r);
+            rdbstate.doing = RDB_CHECK_DOING_READ_TYPE;
+            type = rdbLoadType(&r);
+        }
+        if (!rdbIsObjectType(type)) {
+            rdbCheckError("Invalid object type in chunk #%lu: %d", j, type);
+            sdsfree(payload);
+            return -1;
+        }
+        rdbstate.key_type = type;
+        rdbstate.doing = RDB_CHECK_DOING_READ_KEY;
+        if ((key = rdbLoadStringObject(&r)) == NULL) goto shortpayload;
+        rdbstate.key = key;
+        rdbstate.keys++;
+        rdbstate.doing = RDB_CHECK_DOING_READ_OBJECT_VALUE;
+        if ((val = rdbLoadObject(type,&r)) == NULL) goto shortpayload;
+        if (server.masterhost == NULL && expiretime != -1 && expiretime < now)
+            rdbstate.already_expired++;
+        if (expiretime != -1) rdbstate.expires++;
+        rdbstate.key = NULL;
+        decrRefCount(key);
+        decrRefCount(val);
+        rdbstate.key_type = -1;
+    }
+    sdsfree(payload);
+    return 0;
+
+shortpayload:
+    rdbCheckSetError("Short payload in chunk #%lu at offset %lld",
+        j, offset);
+    sdsfree(payload);
+    return -1;
+}
+
 /* Check the specified RDB file. Return 0 if the RDB looks sane, otherwise
  * 1 is returned.
  * The file is specified as a filename in 'rdbfilename' if 'fp' is not NULL,
@@ -196,10 +341,13 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
         goto err;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
+    if (!rdbIsSupportedVersion(rdbver)) {
         rdbCheckError("Can't handle RDB format version %d",rdbver);
         goto err;
     }
+    /* The index is at the end of the file only if this is not the preamble
+     * of an AOF file. */
+    if (rdbver == RDB_VERSION_CHUNKED && closefile) rdbCheckLoadChunkIndex(fp);
 
     startLoading(fp);
     while(1) {
@@ -234,6 +382,10 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
         } else if (type == RDB_OPCODE_EOF) {
             /* EOF: End of file, exit the main loop. */
             break;
+        } else if (type == RDB_OPCODE_CHUNK) {
+            /* CHUNK: a group of key-value pairs, see rdb.h. */
+            if (rdbCheckChunk(&rdb,now) == -1) goto eoferr;
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_SELECTDB) {
             /* SELECTDB: Select the specified database. */
             rdbstate.doing = RDB_CHECK_DOING_READ_LEN;
@@ -262,8 +414,25 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
             if ((auxkey = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
             if ((auxval = rdbLoadStringObject(&rdb)) == NULL) goto eoferr;
 
-            rdbCheckInfo("AUX FIELD %s = '%s'",
-                (char*)auxkey->ptr, (char*)auxval->ptr);
+            if (!strcasecmp(auxkey->ptr,RDB_CHUNK_INDEX_AUX)) {
+                size_t len = sdslen(auxval->ptr);
+                unsigned long entries = (len < RDB_CHUNK_INDEX_TRAILER_LEN) ?
+                    0 : (len-RDB_CHUNK_INDEX_TRAILER_LEN)/
+                        RDB_CHUNK_INDEX_ENTRY_LEN;
+                rdbCheckInfo("AUX FIELD %s = %lu chunks",
+                    (char*)auxkey->ptr, entries);
+                if (entries != rdbstate.chunks) {
+                    rdbCheckError("The chunk index has %lu entries, "
+                                  "but %lu chunks were found",
+                                  entries, rdbstate.chunks);
+                    decrRefCount(auxkey);
+                    decrRefCount(auxval);
+                    goto err;
+                }
+            } else {
+                rdbCheckInfo("AUX FIELD %s = '%s'",
+                    (char*)auxkey->ptr, (char*)auxval->ptr);
+            }
             decrRefCount(auxkey);
             decrRefCount(auxval);
             continue; /* Read type again. */
@@ -296,6 +465,13 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
         decrRefCount(val);
         rdbstate.key_type = -1;
     }
+    /* The checksum of the whole file can't match if some chunk is
+     * corrupted: report the chunks instead. */
+    if (rdbstate.bad_chunks) {
+        rdbCheckError("%lu corrupted chunks found", rdbstate.bad_chunks);
+        goto err;
+    }
+
     /* Verify the checksum if RDB version is >= 5 */
     if (rdbver >= 5 && server.rdb_checksum) {
         uint64_t cksum, expected = rdb.cksum;
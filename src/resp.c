@@ -0,0 +1,231 @@
+/* RESP tokenizer helpers used by the multibulk request parser.
+ *
+ * The multibulk parser needs to find where each line of a request ends
+ * many times for every command: a SET is made of seven lines. Searching
+ * every line with strchr() or memchr() means paying the setup of a
+ * vectorized search to find a '\r' that is usually a few bytes away, so
+ * instead the buffer is indexed one 64 bytes block at a time, and the
+ * following line ends are found in the block bitmap.
+ */
+
+#include "resp.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void respScannerInit(respScanner *s, const char *buf, size_t len) {
+    s->buf = buf;
+    s->len = len;
+    s->block = (size_t)-1; /* No block loaded yet. */
+    s->mask = 0;
+}
+
+/* Compute the '\r' bitmap of the 64 bytes block at offset 'block'. The
+ * last block of the buffer is copied into a zero padded one, so that no
+ * byte after the end of the buffer is read, and bits past it are never
+ * set. */
+void respScannerLoad(respScanner *s, size_t block) {
+    const char *p = s->buf+block;
+    char tail[64];
+
+    if (s->len-block < 64) {
+        memset(tail,0,sizeof(tail));
+        memcpy(tail,p,s->len-block);
+        p = tail;
+    }
+    s->block = block;
+#if defined(__AVX2__)
+    {
+        __m256i cr = _mm256_set1_epi8('\r');
+        __m256i lo = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(p+32));
+        s->mask = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo,cr)) |
+                  (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi,cr)) << 32;
+    }
+#elif defined(__SSE2__)
+    {
+        __m128i cr = _mm_set1_epi8('\r');
+        uint64_t mask = 0;
+        int j;
+
+        for (j = 0; j < 4; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p+j*16));
+            mask |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v,cr)) << (j*16);
+        }
+        s->mask = mask;
+    }
+#else
+    {
+        uint64_t mask = 0;
+        int j;
+
+        for (j = 0; j < 64; j++)
+            if (p[j] == '\r') mask |= (uint64_t)1 << j;
+        s->mask = mask;
+    }
+#endif
+}
+
+#ifdef REDIS_TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <time.h>
+
+static long long usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
+
+/* Tokenize a buffer of multibulk requests like processMultibulkBuffer()
+ * does, using either strchr() and string2ll(), as the parser did before,
+ * or the scanner. Return the number of arguments, and set '*sum' to the
+ * sum of their lengths, or return -1 on protocol errors. */
+static long respBenchTokenize(const char *buf, size_t len, int scanner,
+                              long long *sum)
+{
+    respScanner s;
+    size_t pos = 0;
+    long args = 0;
+
+    respScannerInit(&s,buf,len);
+    *sum = 0;
+    while (pos < len) {
+        long long count, bulklen;
+        const char *newline;
+
+        if (scanner) {
+            long cr = respScannerNextCR(&s,pos);
+            if (cr == -1) return -1;
+            newline = buf+cr;
+            if (!respParseLength(buf+pos+1,newline-(buf+pos+1),&count))
+                return -1;
+        } else {
+            newline = strchr(buf+pos,'\r');
+            if (newline == NULL) return -1;
+            if (!string2ll(buf+pos+1,newline-(buf+pos+1),&count))
+                return -1;
+        }
+        pos = (newline-buf)+2;
+        while (count--) {
+            if (scanner) {
+                long cr = respScannerNextCR(&s,pos);
+                if (cr == -1) return -1;
+                newline = buf+cr;
+                if (!respParseLength(buf+pos+1,newline-(buf+pos+1),&bulklen))
+                    return -1;
+            } else {
+                newline = strchr(buf+pos,'\r');
+                if (newline == NULL) return -1;
+                if (!string2ll(buf+pos+1,newline-(buf+pos+1),&bulklen))
+                    return -1;
+            }
+            pos = (newline-buf)+2+bulklen+2;
+            *sum += bulklen;
+            args++;
+        }
+    }
+    return args;
+}
+
+/* Fill 'buf' with pipelined SET and GET commands, like the traffic of
+ * redis-benchmark, and return the number of bytes used. */
+static size_t respBenchFill(char *buf, size_t size, size_t valuelen) {
+    size_t len = 0;
+    int j = 0;
+    char value[1024];
+
+    assert(valuelen < sizeof(value));
+    memset(value,'x',valuelen);
+    value[valuelen] = '\0';
+    while (1) {
+        char cmd[2048], key[32];
+        int cmdlen, keylen = snprintf(key,sizeof(key),"key:%08d",j);
+
+        if (j % 2)
+            cmdlen = snprintf(cmd,sizeof(cmd),
+                "*3\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%zu\r\n%s\r\n",
+                keylen,key,valuelen,value);
+        else
+            cmdlen = snprintf(cmd,sizeof(cmd),
+                "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n",keylen,key);
+        if (len+cmdlen >= size) break;
+        memcpy(buf+len,cmd,cmdlen);
+        len += cmdlen;
+        j++;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+int respTest(int argc, char *argv[]) {
+    char buf[16*1024+1];
+    size_t valuelens[] = {3, 64, 512};
+    int j, iter = 50000;
+    long long start;
+
+    ((void) argc);
+    ((void) argv);
+
+    printf("Scanner finds every '\\r' in random buffers: ");
+    srand(time(NULL));
+    for (j = 0; j < 1000; j++) {
+        size_t len = rand() % 300, pos, i;
+        respScanner s;
+
+        for (i = 0; i < len; i++) buf[i] = "ab\r\n"[rand() % 4];
+        /* A '\r' past the end must not be found. */
+        buf[len] = '\r';
+        respScannerInit(&s,buf,len);
+        for (pos = 0; pos <= len+1; pos += 1+rand()%8) {
+            char *p = pos < len ? memchr(buf+pos,'\r',len-pos) : NULL;
+            long expected = p ? p-buf : -1;
+            assert(respScannerNextCR(&s,pos) == expected);
+        }
+    }
+    printf("ok\n");
+
+    printf("Lengths are parsed like string2ll(): ");
+    {
+        char *lengths[] = {"0", "1", "42", "512", "007", "-1", "-", "",
+            "12a", "999999999999999999", "9999999999999999999",
+            "99999999999999999999", "1 "};
+        for (j = 0; j < (int)(sizeof(lengths)/sizeof(char*)); j++) {
+            long long a = 0, b = 0;
+            size_t len = strlen(lengths[j]);
+            int oka = respParseLength(lengths[j],len,&a);
+            int okb = string2ll(lengths[j],len,&b);
+            assert(oka == okb && (!oka || a == b));
+        }
+    }
+    printf("ok\n");
+
+    for (j = 0; j < (int)(sizeof(valuelens)/sizeof(size_t)); j++) {
+        size_t len = respBenchFill(buf,sizeof(buf),valuelens[j]);
+        long long sum1, sum2, elapsed1, elapsed2;
+        long args1, args2;
+        int i;
+
+        args1 = respBenchTokenize(buf,len,0,&sum1);
+        args2 = respBenchTokenize(buf,len,1,&sum2);
+        assert(args1 > 0 && args1 == args2 && sum1 == sum2);
+
+        start = usec();
+        for (i = 0; i < iter; i++) respBenchTokenize(buf,len,0,&sum1);
+        elapsed1 = usec()-start;
+        start = usec();
+        for (i = 0; i < iter; i++) respBenchTokenize(buf,len,1,&sum2);
+        elapsed2 = usec()-start;
+        printf("Tokenizing %zu bytes of SET/GET with %zu bytes values "
+               "(%ld args), %d times: strchr %lld usec, scanner %lld usec\n",
+               len, valuelens[j], args1, iter, elapsed1, elapsed2);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,77 @@
+/* RESP tokenizer helpers used by the multibulk request parser. */
+
+#ifndef __RESP_H
+#define __RESP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "util.h"
+
+/* Locates the '\r' bytes of a buffer. The buffer is indexed 64 bytes at a
+ * time: a single pass over a block computes a bitmap of all the '\r' it
+ * contains, so the following lines of the same block, that for small
+ * commands are several, are found with a bit scan. Blocks are indexed
+ * only when a search reaches them, so the payload of the bulk arguments
+ * the parser skips is never scanned. */
+typedef struct respScanner {
+    const char *buf;    /* Buffer being scanned. */
+    size_t len;         /* Number of bytes of the buffer. */
+    size_t block;       /* Offset of the block described by 'mask'. */
+    uint64_t mask;      /* Bit N is set if buf[block+N] is '\r'. */
+} respScanner;
+
+void respScannerInit(respScanner *s, const char *buf, size_t len);
+void respScannerLoad(respScanner *s, size_t block);
+
+/* Return the offset of the first '\r' at 'pos' or after it, or -1 if
+ * there is none in the buffer. */
+static inline long respScannerNextCR(respScanner *s, size_t pos) {
+#if defined(__SSE2__)
+    while (pos < s->len) {
+        size_t block = pos & ~(size_t)63;
+        uint64_t mask;
+
+        if (block != s->block) respScannerLoad(s,block);
+        mask = s->mask >> (pos & 63);
+        if (mask) return pos + __builtin_ctzll(mask);
+        pos = block+64;
+    }
+    return -1;
+#else
+    /* Without SIMD instructions the libc memchr() is the fastest option. */
+    const char *p;
+
+    if (pos >= s->len) return -1;
+    p = memchr(s->buf+pos,'\r',s->len-pos);
+    return p ? p-s->buf : -1;
+#endif
+}
+
+/* Parse the length of a multibulk or of a bulk, that is the 'len' bytes
+ * at 'p' between the type byte and the "\r\n". Return 1 on success and
+ * 0 on failure, exactly like string2ll(). Lengths are almost always a few
+ * digits with no sign, that are accumulated without the overflow checks
+ * (18 digits always fit a long long), anything else is handled by
+ * string2ll(). */
+static inline int respParseLength(const char *p, size_t len, long long *ll) {
+    if (len > 0 && len <= 18 && p[0] >= '1' && p[0] <= '9') {
+        long long v = 0;
+        size_t j;
+
+        for (j = 0; j < len; j++) {
+            unsigned int digit = (unsigned char)p[j] - '0';
+            if (digit > 9) return 0;
+            v = v*10 + digit;
+        }
+        *ll = v;
+        return 1;
+    }
+    return string2ll(p,len,ll);
+}
+
+#ifdef REDIS_TEST
+int respTest(int argc, char *argv[]);
+#endif
+
+#endif
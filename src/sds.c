@@ -203,6 +203,45 @@ sds sdsnewlen(const void *init, size_t initlen) {
     return s;
 }
 
+/* Like sdsnewlen(), but the allocation also has SDS_PREFIX_LEN bytes before
+ * the header, initialized to zero, where the caller can store some metadata
+ * together with the string. The prefix is accessed with sdsprefix().
+ *
+ * Prefixed strings can be read, duplicated (the copy has no prefix) and
+ * freed like any other sds string, but they must never be resized, since
+ * the functions reallocating the string are not aware of the prefix. */
+sds sdsnewlenprefixed(const void *init, size_t initlen) {
+    char type = sdsReqType(initlen);
+    int hdrlen;
+    char *p;
+    sds s;
+
+    /* There is no room for the SDS_PREFIXED flag in SDS_TYPE_5. */
+    if (type == SDS_TYPE_5) type = SDS_TYPE_8;
+    hdrlen = sdsHdrSize(type);
+    p = s_malloc(SDS_PREFIX_LEN+hdrlen+initlen+1);
+    if (p == NULL) return NULL;
+    memset(p,0,SDS_PREFIX_LEN);
+    s = p+SDS_PREFIX_LEN+hdrlen;
+    s[-1] = type | SDS_PREFIXED;
+    sdssetlen(s,initlen);
+    sdssetalloc(s,initlen);
+    if (initlen) {
+        if (init)
+            memcpy(s,init,initlen);
+        else
+            memset(s,0,initlen);
+    }
+    s[initlen] = '\0';
+    return s;
+}
+
+/* Return the address of the prefix of a string created with
+ * sdsnewlenprefixed(). */
+void *sdsprefix(const sds s) {
+    return s-sdsHdrSize(s[-1])-SDS_PREFIX_LEN;
+}
+
 /* Create an empty (zero length) sds string. Even in this case the string
  * always has an implicit null term. */
 /*
@@ -255,7 +294,7 @@ sds sdsdup(const sds s) {
 void sdsfree(sds s) {
     if (s == NULL) return;
     // 算出整个SDS首地址（即sdshdr结构体首地址）
-    s_free((char*)s-sdsHdrSize(s[-1]));
+    s_free(sdsAllocPtr(s));
 }
 
 /* Set the sds string length to the length as obtained with strlen(), so
@@ -405,15 +444,17 @@ sds sdsRemoveFreeSpace(sds s) {
  * 2) The string.
  * 3) The free buffer at the end if any.
  * 4) The implicit null term.
+ * 5) The prefix of strings created with sdsnewlenprefixed().
  */
 size_t sdsAllocSize(sds s) {
     size_t alloc = sdsalloc(s);
-    return sdsHdrSize(s[-1])+alloc+1;
+    return (sdsisprefixed(s) ? SDS_PREFIX_LEN : 0)+sdsHdrSize(s[-1])+alloc+1;
 }
 
 /* Return the pointer of the actual SDS allocation (normally SDS strings
  * are referenced by the start of the string buffer). */
 void *sdsAllocPtr(sds s) {
+    if (sdsisprefixed(s)) return sdsprefix(s);
     return (void*) (s-sdsHdrSize(s[-1]));
 }
 
@@ -98,6 +98,11 @@ struct __attribute__ ((__packed__)) sdshdr64 {
 #define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
 // 在sdsnew()函数中有提到，因为initlen<32所以flags里面直接就存有字符串长度
 #define SDS_TYPE_5_LEN(f) ((f)>>SDS_TYPE_BITS)
+/* Strings created with sdsnewlenprefixed() have this flag set, and
+ * SDS_PREFIX_LEN bytes of user data before the header. The flag is never
+ * set in SDS_TYPE_5 strings, that use the unused flags bits for the length. */
+#define SDS_PREFIXED 128
+#define SDS_PREFIX_LEN 8
 
 /**
  * 计算sds对应字符串的长度，实际取的是该字符串所在sdshdr结构体中的len属性的值
@@ -260,7 +265,14 @@ static inline void sdssetalloc(sds s, size_t newlen) {
     }
 }
 
+static inline int sdsisprefixed(const sds s) {
+    unsigned char flags = s[-1];
+    return (flags&SDS_TYPE_MASK) != SDS_TYPE_5 && (flags&SDS_PREFIXED);
+}
+
 sds sdsnewlen(const void *init, size_t initlen);
+sds sdsnewlenprefixed(const void *init, size_t initlen);
+void *sdsprefix(const sds s);
 sds sdsnew(const char *init);
 sds sdsempty(void);
 sds sdsdup(const sds s);
@@ -257,6 +257,7 @@ struct redisCommand redisCommandTable[] = {
     {"pexpireat",pexpireatCommand,3,"wF",0,NULL,1,1,1,0,0},
     {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0},
     {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
+    {"scanrange",scanrangeCommand,-3,"rR",0,NULL,0,0,0,0,0},
     {"dbsize",dbsizeCommand,1,"rF",0,NULL,0,0,0,0,0},
     {"auth",authCommand,2,"sltF",0,NULL,0,0,0,0,0},
     {"ping",pingCommand,-1,"tF",0,NULL,0,0,0,0,0},
@@ -631,7 +632,8 @@ dictType dbDictType = {
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictObjectDestructor   /* val destructor */
+    dictObjectDestructor,       /* val destructor */
+    1                           /* open addressing */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -667,7 +669,7 @@ dictType commandTableDictType = {
     NULL                        /* val destructor */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 // 双重哈希表
 dictType hashDictType = {
     dictSdsHash,                /* hash function */
@@ -791,6 +793,65 @@ int incrementallyRehash(int dbid) {
     return 0;
 }
 
+/* The rehashing performed in serverCron() is limited to one millisecond
+ * every cron loop, so a very large hash table can stay half rehashed (with
+ * both the tables allocated, and lookups probing both) for minutes. This
+ * function is called at every event loop iteration before sleeping, and
+ * spends up to server.active_rehashing_budget_us microseconds moving buckets
+ * of the DBs hash tables that are rehashing.
+ *
+ * To avoid using too much CPU when the event loop iterates very fast, the
+ * time used is also capped to ACTIVE_REHASH_CYCLE_TIME_PERC percent of every
+ * cron period. */
+void activeRehashCycle(void) {
+    static unsigned int rehash_db = 0;  /* Next DB to test. */
+    static long long window_start = 0;  /* Start of the current cron period. */
+    static long long window_used = 0;   /* Time used in the current period. */
+    long long start, budget, window;
+    int j;
+
+    if (!server.activerehashing || server.active_rehashing_budget_us == 0)
+        return;
+
+    /* Don't rehash if there is a child saving the DB: it would cause a lot
+     * of copy-on-write of memory pages. */
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    start = ustime();
+    window = 1000000/server.hz;
+    if (start - window_start >= window) {
+        window_start = start;
+        window_used = 0;
+    }
+    budget = window*ACTIVE_REHASH_CYCLE_TIME_PERC/100 - window_used;
+    if (budget > server.active_rehashing_budget_us)
+        budget = server.active_rehashing_budget_us;
+    if (budget <= 0) return;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+(rehash_db % server.dbnum);
+        dict *d = NULL;
+        long long elapsed;
+
+        if (dictIsRehashing(db->dict)) d = db->dict;
+        else if (dictIsRehashing(db->expires)) d = db->expires;
+
+        if (d == NULL) {
+            /* Nothing to do in this DB, try the next one. */
+            rehash_db++;
+            continue;
+        }
+
+        elapsed = ustime()-start;
+        if (elapsed >= budget) break;
+        dictRehashMicroseconds(d,budget-elapsed);
+
+        /* If the table is still rehashing we used all our time. */
+        if (dictIsRehashing(d)) break;
+    }
+    window_used += ustime()-start;
+}
+
 /* This function is called once a background process of some kind terminates,
  * as we want to avoid resizing the hash tables when there is a child in order
  * to play well with copy-on-write (otherwise when a resize happens lots of
@@ -874,9 +935,13 @@ int clientsCronHandleTimeout(client *c, mstime_t now_ms) {
  *
  * The function always returns 0 as it never terminates the client. */
 int clientsCronResizeQueryBuffer(client *c) {
-    size_t querybuf_size = sdsAllocSize(c->querybuf);
+    size_t querybuf_size;
     time_t idletime = server.unixtime - c->lastinteraction;
 
+    /* The client gave its buffer back to the pool. */
+    if (c->querybuf == NULL) return 0;
+    querybuf_size = sdsAllocSize(c->querybuf);
+
     /* There are two conditions to resize the query buffer:
      * 1) Query buffer is > BIG_ARG and too big for latest peak.
      * 2) Client is inactive and the buffer is bigger than 1k. */
@@ -951,6 +1016,12 @@ void databasesCron(void) {
     if (server.active_defrag_enabled)
         activeDefragCycle();
 
+    /* Compress string values gradually, but not while a child is saving
+     * the DB, to avoid copy-on-write. */
+    if (server.string_compression &&
+        server.rdb_child_pid == -1 && server.aof_child_pid == -1)
+        stringCompressionCycle();
+
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
@@ -1042,6 +1113,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
                 server.stat_net_input_bytes);
         trackInstantaneousMetric(STATS_METRIC_NET_OUTPUT,
                 server.stat_net_output_bytes);
+        trackInstantaneousMetric(STATS_METRIC_LAZYFREE,
+                lazyfreeGetFreedObjectsCount());
     }
 
     /* We have just LRU_BITS bits per object for LRU information.
@@ -1151,7 +1224,8 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     } else {
         /* If there is not a background saving/rewrite in progress check if
          * we have to save/rewrite now. */
-         for (j = 0; j < server.saveparamslen; j++) {
+         for (j = 0; j < server.saveparamslen &&
+                     !server.rdb_forkless_in_progress; j++) {
             struct saveparam *sp = server.saveparams+j;
 
             /* Save if we reached the given amount of changes,
@@ -1237,7 +1311,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
      * make sure when refactoring this file to keep this order. This is useful
      * because we want to give priority to RDB savings for replication. */
     if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
-        server.rdb_bgsave_scheduled &&
+        !server.rdb_forkless_in_progress && server.rdb_bgsave_scheduled &&
         (server.unixtime-server.lastbgsave_try > CONFIG_BGSAVE_RETRY_DELAY ||
          server.lastbgsave_status == C_OK))
     {
@@ -1257,6 +1331,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 void beforeSleep(struct aeEventLoop *eventLoop) {
     UNUSED(eventLoop);
 
+    /* We should handle pending reads clients ASAP after event loop. */
+    handleClientsWithPendingReadsUsingThreads();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1268,6 +1345,10 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     if (server.active_expire_enabled && server.masterhost == NULL)
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
 
+    /* Move forward the rehashing of the keyspace hash tables, if any, using
+     * a small time slice. */
+    activeRehashCycle();
+
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
     if (server.get_ack_from_slaves) {
@@ -1300,7 +1381,11 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     flushAppendOnlyFile(0);
 
     /* Handle writes with pending output buffers. */
-    handleClientsWithPendingWrites();
+    handleClientsWithPendingWritesUsingThreads();
+
+    /* Close clients that need to be closed asynchronous: with threaded
+     * I/O this is where clients failing a read or write are released. */
+    if (server.io_threads_num > 1) freeClientsInAsyncFreeQueue();
 
     /* Before we are going to sleep, let the threads access the dataset by
      * releasing the GIL. Redis main thread will not touch anything at this
@@ -1419,6 +1504,8 @@ void initServerConfig(void) {
     pthread_mutex_init(&server.next_client_id_mutex,NULL);
     pthread_mutex_init(&server.lruclock_mutex,NULL);
     pthread_mutex_init(&server.unixtime_mutex,NULL);
+    pthread_mutex_init(&server.stat_net_input_bytes_mutex,NULL);
+    pthread_mutex_init(&server.stat_net_output_bytes_mutex,NULL);
 
     getRandomHexChars(server.runid,CONFIG_RUN_ID_SIZE);
     server.runid[CONFIG_RUN_ID_SIZE] = '\0';
@@ -1442,6 +1529,9 @@ void initServerConfig(void) {
     server.tcpkeepalive = CONFIG_DEFAULT_TCP_KEEPALIVE;
     server.active_expire_enabled = 1;
     server.active_defrag_enabled = CONFIG_DEFAULT_ACTIVE_DEFRAG;
+    server.string_compression = CONFIG_DEFAULT_STRING_COMPRESSION;
+    server.string_compression_min_size = CONFIG_DEFAULT_STRING_COMPRESSION_MIN_SIZE;
+    server.string_compression_max_size = CONFIG_DEFAULT_STRING_COMPRESSION_MAX_SIZE;
     server.active_defrag_ignore_bytes = CONFIG_DEFAULT_DEFRAG_IGNORE_BYTES;
     server.active_defrag_threshold_lower = CONFIG_DEFAULT_DEFRAG_THRESHOLD_LOWER;
     server.active_defrag_threshold_upper = CONFIG_DEFAULT_DEFRAG_THRESHOLD_UPPER;
@@ -1481,9 +1571,17 @@ void initServerConfig(void) {
     server.aof_filename = zstrdup(CONFIG_DEFAULT_AOF_FILENAME);
     server.requirepass = NULL;
     server.rdb_compression = CONFIG_DEFAULT_RDB_COMPRESSION;
+    server.rdb_compression_codec = CONFIG_DEFAULT_RDB_COMPRESSION_CODEC;
     server.rdb_checksum = CONFIG_DEFAULT_RDB_CHECKSUM;
+    server.rdb_forkless = CONFIG_DEFAULT_RDB_FORKLESS;
+    server.rdb_forkless_step_us = CONFIG_DEFAULT_RDB_FORKLESS_STEP_US;
+    server.rdb_load_threads_num = CONFIG_DEFAULT_RDB_LOAD_THREADS_NUM;
+    server.rdb_chunked = CONFIG_DEFAULT_RDB_CHUNKED;
+    server.rdb_chunk_size = CONFIG_DEFAULT_RDB_CHUNK_SIZE;
     server.stop_writes_on_bgsave_err = CONFIG_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = CONFIG_DEFAULT_ACTIVE_REHASHING;
+    server.active_rehashing_budget_us = CONFIG_DEFAULT_ACTIVE_REHASHING_BUDGET_US;
+    server.keyspace_index = CONFIG_DEFAULT_KEYSPACE_INDEX;
     server.active_defrag_running = 0;
     server.notify_keyspace_events = 0;
     server.maxclients = CONFIG_DEFAULT_MAX_CLIENTS;
@@ -1497,7 +1595,10 @@ void initServerConfig(void) {
     server.hash_max_ziplist_value = OBJ_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_size = OBJ_LIST_MAX_ZIPLIST_SIZE;
     server.list_compress_depth = OBJ_LIST_COMPRESS_DEPTH;
+    server.list_compress_codec = OBJ_LIST_COMPRESS_CODEC;
     server.set_max_intset_entries = OBJ_SET_MAX_INTSET_ENTRIES;
+    server.set_ops_threads_num = CONFIG_DEFAULT_SET_OPS_THREADS_NUM;
+    server.set_ops_threads_debug_fail = 0;
     server.zset_max_ziplist_entries = OBJ_ZSET_MAX_ZIPLIST_ENTRIES;
     server.zset_max_ziplist_value = OBJ_ZSET_MAX_ZIPLIST_VALUE;
     server.hll_sparse_max_bytes = CONFIG_DEFAULT_HLL_SPARSE_MAX_BYTES;
@@ -1517,6 +1618,11 @@ void initServerConfig(void) {
     server.lazyfree_lazy_eviction = CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION;
     server.lazyfree_lazy_expire = CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE;
     server.lazyfree_lazy_server_del = CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
+    server.lazyfree_lazy_user_del = CONFIG_DEFAULT_LAZYFREE_LAZY_USER_DEL;
+    server.lazyfree_threads_num = CONFIG_DEFAULT_LAZYFREE_THREADS_NUM;
+    server.io_threads_num = CONFIG_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = CONFIG_DEFAULT_IO_THREADS_DO_READS;
+    server.querybuf_pool_size = CONFIG_DEFAULT_QUERYBUF_POOL_SIZE;
     server.always_show_logo = CONFIG_DEFAULT_ALWAYS_SHOW_LOGO;
     server.lua_time_limit = LUA_SCRIPT_TIME_LIMIT;
 
@@ -1877,6 +1983,10 @@ void resetServerStats(void) {
     }
     server.stat_net_input_bytes = 0;
     server.stat_net_output_bytes = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_querybuf_pool_hits = 0;
+    server.stat_querybuf_pool_misses = 0;
+    server.stat_io_writes_processed = 0;
     server.aof_delayed_fsync = 0;
 }
 
@@ -1899,6 +2009,11 @@ void initServer(void) {
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
+    server.querybuf_pool = NULL;
+    server.querybuf_pool_len = 0;
+    server.querybuf_pool_memory = 0;
+    resizeQueryBufferPool();
+    server.clients_pending_read = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
     server.unblocked_clients = listCreate();
     server.ready_keys = listCreate();
@@ -1948,6 +2063,7 @@ void initServer(void) {
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
+        server.db[j].keys_index = server.keyspace_index ? raxNew() : NULL;
         server.db[j].id = j;
         server.db[j].avg_ttl = 0;
     }
@@ -1958,6 +2074,7 @@ void initServer(void) {
     listSetMatchMethod(server.pubsub_patterns,listMatchPubsubPattern);
     server.cronloops = 0;
     server.rdb_child_pid = -1;
+    server.rdb_forkless_in_progress = 0;
     server.aof_child_pid = -1;
     server.rdb_child_type = RDB_CHILD_TYPE_NONE;
     server.rdb_bgsave_scheduled = 0;
@@ -2042,6 +2159,8 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    initThreadedIO();
+    setOpsThreadsStart();
     server.initial_memory_usage = zmalloc_used_memory();
 }
 
@@ -2165,6 +2284,61 @@ struct redisCommand *lookupCommandOrOriginal(sds name) {
     return cmd;
 }
 
+/* Like lookupCommand(), but first check the command the client resolved
+ * the previous time: clients mostly send the same commands again and
+ * again, and comparing the name with the cached one is cheaper than
+ * hashing it to lookup the command table. */
+struct redisCommand *lookupClientCommand(client *c, sds name) {
+    dictEntry *de;
+
+    if (c->cached_cmd &&
+        sdslen(name) == sdslen(c->cached_cmd_name) &&
+        !strcasecmp(name,c->cached_cmd_name))
+    {
+        return c->cached_cmd;
+    }
+    de = dictFind(server.commands,name);
+    if (!de) return NULL;
+    c->cached_cmd = dictGetVal(de);
+    c->cached_cmd_name = dictGetKey(de);
+    return c->cached_cmd;
+}
+
+/* Forget the commands cached by lookupClientCommand(). Called when commands
+ * are removed from the command table. */
+void resetClientsCommandCache(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li)) != NULL) {
+        client *c = listNodeValue(ln);
+        c->cached_cmd = NULL;
+        c->cached_cmd_name = NULL;
+    }
+}
+
+/* Return the id of the option in the table 'opts' matching the argument
+ * 'arg', case insensitively, or -1 if it is not one of the options. The
+ * length of the argument is checked first, so most of the options are
+ * skipped without looking at the argument at all, and since the option
+ * names are only made of letters, OR-ing 0x20 to a byte lowercases it
+ * without turning any other byte into a lowercase letter. */
+int matchCommandOption(robj *arg, const commandOption *opts) {
+    const char *p = arg->ptr;
+    size_t len, j;
+
+    if (!sdsEncodedObject(arg)) return -1;
+    len = sdslen(arg->ptr);
+    for (; opts->name; opts++) {
+        if (opts->len != len) continue;
+        for (j = 0; j < len; j++)
+            if ((p[j] | 0x20) != opts->name[j]) break;
+        if (j == len) return opts->id;
+    }
+    return -1;
+}
+
 /* Propagate the specified command (in the context of the specified database id)
  * to AOF and Slaves.
  *
@@ -2405,7 +2579,7 @@ int processCommand(client *c) {
      * go through checking for replication and QUIT will cause trouble
      * when FORCE_REPLICATION is enabled and would be implemented in
      * a regular command proc. */
-    if (!strcasecmp(c->argv[0]->ptr,"quit")) {
+    if (sdslen(c->argv[0]->ptr) == 4 && !strcasecmp(c->argv[0]->ptr,"quit")) {
         addReply(c,shared.ok);
         c->flags |= CLIENT_CLOSE_AFTER_REPLY;
         return C_ERR;
@@ -2413,7 +2587,7 @@ int processCommand(client *c) {
 
     /* Now lookup the command and check ASAP about trivial error conditions
      * such as wrong arity, bad command name and so forth. */
-    c->cmd = c->lastcmd = lookupCommand(c->argv[0]->ptr);
+    c->cmd = c->lastcmd = lookupClientCommand(c,c->argv[0]->ptr);
     if (!c->cmd) {
         flagTransaction(c);
         addReplyErrorFormat(c,"unknown command '%s'",
@@ -2620,6 +2794,7 @@ int prepareForShutdown(int flags) {
         kill(server.rdb_child_pid,SIGUSR1);
         rdbRemoveTempFile(server.rdb_child_pid);
     }
+    rdbForklessStop();
 
     if (server.aof_state != AOF_OFF) {
         /* Kill the AOF saving child as the AOF we already have may be longer
@@ -3021,6 +3196,9 @@ sds genRedisInfoString(char *section) {
         size_t total_system_mem = server.system_memory_size;
         const char *evict_policy = evictPolicyToString();
         long long memory_lua = (long long)lua_gc(server.lua,LUA_GCCOUNT,0)*1024;
+        double compressed_strings_ratio;
+        size_t compressed_strings =
+            stringCompressionStats(&compressed_strings_ratio);
         struct redisMemOverhead *mh = getMemoryOverheadData();
 
         /* Peak memory is updated from time to time by serverCron() so it
@@ -3061,7 +3239,15 @@ sds genRedisInfoString(char *section) {
             "mem_fragmentation_ratio:%.2f\r\n"
             "mem_allocator:%s\r\n"
             "active_defrag_running:%d\r\n"
-            "lazyfree_pending_objects:%zu\r\n",
+            "lazyfree_pending_objects:%zu\r\n"
+            "lazyfree_pending_jobs:%llu\r\n"
+            "compressed_strings:%zu\r\n"
+            "compressed_strings_ratio:%.2f\r\n"
+            "string_compression_dict_memory:%zu\r\n"
+            "querybuf_pool_buffers:%d\r\n"
+            "querybuf_pool_memory:%zu\r\n"
+            "querybuf_pool_hits:%lld\r\n"
+            "querybuf_pool_misses:%lld\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -3083,7 +3269,15 @@ sds genRedisInfoString(char *section) {
             mh->fragmentation,
             ZMALLOC_LIB,
             server.active_defrag_running,
-            lazyfreeGetPendingObjectsCount()
+            lazyfreeGetPendingObjectsCount(),
+            bioPendingJobsOfType(BIO_LAZY_FREE),
+            compressed_strings,
+            compressed_strings_ratio,
+            stringCompressionDictMemory(),
+            server.querybuf_pool_len,
+            server.querybuf_pool_memory,
+            server.stat_querybuf_pool_hits,
+            server.stat_querybuf_pool_misses
         );
         freeMemoryOverheadData(mh);
     }
@@ -3111,11 +3305,12 @@ sds genRedisInfoString(char *section) {
             "aof_last_cow_size:%zu\r\n",
             server.loading,
             server.dirty,
-            server.rdb_child_pid != -1,
+            server.rdb_child_pid != -1 || server.rdb_forkless_in_progress,
             (intmax_t)server.lastsave,
             (server.lastbgsave_status == C_OK) ? "ok" : "err",
             (intmax_t)server.rdb_save_time_last,
-            (intmax_t)((server.rdb_child_pid == -1) ?
+            (intmax_t)((server.rdb_child_pid == -1 &&
+                        !server.rdb_forkless_in_progress) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
             server.stat_rdb_cow_bytes,
             server.aof_state != AOF_OFF,
@@ -3206,7 +3401,13 @@ sds genRedisInfoString(char *section) {
             "active_defrag_hits:%lld\r\n"
             "active_defrag_misses:%lld\r\n"
             "active_defrag_key_hits:%lld\r\n"
-            "active_defrag_key_misses:%lld\r\n",
+            "active_defrag_key_misses:%lld\r\n"
+            "io_threads_active:%d\r\n"
+            "io_threaded_reads_processed:%lld\r\n"
+            "io_threaded_writes_processed:%lld\r\n"
+            "lazyfree_threads:%d\r\n"
+            "lazyfreed_objects:%zu\r\n"
+            "instantaneous_lazyfreed_per_sec:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
@@ -3230,7 +3431,13 @@ sds genRedisInfoString(char *section) {
             server.stat_active_defrag_hits,
             server.stat_active_defrag_misses,
             server.stat_active_defrag_key_hits,
-            server.stat_active_defrag_key_misses);
+            server.stat_active_defrag_key_misses,
+            server.io_threads_active,
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed,
+            server.lazyfree_threads_num,
+            lazyfreeGetFreedObjectsCount(),
+            getInstantaneousMetric(STATS_METRIC_LAZYFREE));
     }
 
     /* Replication */
@@ -3411,13 +3618,23 @@ sds genRedisInfoString(char *section) {
         info = sdscatprintf(info, "# Keyspace\r\n");
         for (j = 0; j < server.dbnum; j++) {
             long long keys, vkeys;
+            dict *d = server.db[j].dict, *e = server.db[j].expires;
 
-            keys = dictSize(server.db[j].dict);
-            vkeys = dictSize(server.db[j].expires);
+            keys = dictSize(d);
+            vkeys = dictSize(e);
             if (keys || vkeys) {
                 info = sdscatprintf(info,
-                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
+                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld",
                     j, keys, vkeys, server.db[j].avg_ttl);
+                /* Report the percentage of buckets already moved for the
+                 * tables that are in the middle of a rehashing. */
+                if (dictIsRehashing(d))
+                    info = sdscatprintf(info,",keys_rehashing=%.2f",
+                        dictRehashProgress(d));
+                if (dictIsRehashing(e))
+                    info = sdscatprintf(info,",expires_rehashing=%.2f",
+                        dictRehashProgress(e));
+                info = sdscat(info,"\r\n");
             }
         }
     }
@@ -3792,6 +4009,8 @@ int main(int argc, char **argv) {
     if (argc == 3 && !strcasecmp(argv[1], "test")) {
         if (!strcasecmp(argv[2], "ziplist")) {
             return ziplistTest(argc, argv);
+        } else if (!strcasecmp(argv[2], "listpack")) {
+            return listpackTest(argc, argv);
         } else if (!strcasecmp(argv[2], "quicklist")) {
             quicklistTest(argc, argv);
         } else if (!strcasecmp(argv[2], "intset")) {
@@ -3808,6 +4027,8 @@ int main(int argc, char **argv) {
             return endianconvTest(argc, argv);
         } else if (!strcasecmp(argv[2], "crc64")) {
             return crc64Test(argc, argv);
+        } else if (!strcasecmp(argv[2], "resp")) {
+            return respTest(argc, argv);
         }
 
         return -1; /* test not found */
@@ -3826,6 +4047,7 @@ int main(int argc, char **argv) {
     getRandomHexChars(hashseed,sizeof(hashseed));
     // 初始化Hash函数种子，将通过hashseed字符串来构建siphash函数
     dictSetHashFunctionSeed((uint8_t*)hashseed);
+    crc64_init();
     // 检测是否为哨兵模式
     server.sentinel_mode = checkForSentinelMode(argc,argv);
     initServerConfig();
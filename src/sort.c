@@ -184,6 +184,26 @@ int sortCompare(const void *s1, const void *s2) {
     return server.sort_desc ? -cmp : cmp;
 }
 
+/* Options of the SORT command. */
+#define SORT_OPT_ASC 0
+#define SORT_OPT_DESC 1
+#define SORT_OPT_ALPHA 2
+#define SORT_OPT_LIMIT 3
+#define SORT_OPT_STORE 4
+#define SORT_OPT_BY 5
+#define SORT_OPT_GET 6
+
+static const commandOption sortOptions[] = {
+    COMMAND_OPTION("asc",SORT_OPT_ASC),
+    COMMAND_OPTION("desc",SORT_OPT_DESC),
+    COMMAND_OPTION("alpha",SORT_OPT_ALPHA),
+    COMMAND_OPTION("limit",SORT_OPT_LIMIT),
+    COMMAND_OPTION("store",SORT_OPT_STORE),
+    COMMAND_OPTION("by",SORT_OPT_BY),
+    COMMAND_OPTION("get",SORT_OPT_GET),
+    COMMAND_OPTION_END
+};
+
 /* The SORT command is the most complex command in Redis. Warning: this code
  * is optimized for speed and a bit less for readability */
 void sortCommand(client *c) {
@@ -225,13 +245,14 @@ void sortCommand(client *c) {
     /* The SORT command has an SQL-alike syntax, parse it */
     while(j < c->argc) {
         int leftargs = c->argc-j-1;
-        if (!strcasecmp(c->argv[j]->ptr,"asc")) {
+        int opt = matchCommandOption(c->argv[j],sortOptions);
+        if (opt == SORT_OPT_ASC) {
             desc = 0;
-        } else if (!strcasecmp(c->argv[j]->ptr,"desc")) {
+        } else if (opt == SORT_OPT_DESC) {
             desc = 1;
-        } else if (!strcasecmp(c->argv[j]->ptr,"alpha")) {
+        } else if (opt == SORT_OPT_ALPHA) {
             alpha = 1;
-        } else if (!strcasecmp(c->argv[j]->ptr,"limit") && leftargs >= 2) {
+        } else if (opt == SORT_OPT_LIMIT && leftargs >= 2) {
             if ((getLongFromObjectOrReply(c, c->argv[j+1], &limit_start, NULL)
                  != C_OK) ||
                 (getLongFromObjectOrReply(c, c->argv[j+2], &limit_count, NULL)
@@ -241,10 +262,10 @@ void sortCommand(client *c) {
                 break;
             }
             j+=2;
-        } else if (!strcasecmp(c->argv[j]->ptr,"store") && leftargs >= 1) {
+        } else if (opt == SORT_OPT_STORE && leftargs >= 1) {
             storekey = c->argv[j+1];
             j++;
-        } else if (!strcasecmp(c->argv[j]->ptr,"by") && leftargs >= 1) {
+        } else if (opt == SORT_OPT_BY && leftargs >= 1) {
             sortby = c->argv[j+1];
             /* If the BY pattern does not contain '*', i.e. it is constant,
              * we don't need to sort nor to lookup the weight keys. */
@@ -260,7 +281,7 @@ void sortCommand(client *c) {
                 }
             }
             j++;
-        } else if (!strcasecmp(c->argv[j]->ptr,"get") && leftargs >= 1) {
+        } else if (opt == SORT_OPT_GET && leftargs >= 1) {
             if (server.cluster_enabled) {
                 addReplyError(c,"GET option of SORT denied in Cluster mode.");
                 syntax_error++;
@@ -28,6 +28,7 @@
  */
 
 #include "server.h"
+#include <pthread.h>
 
 /*-----------------------------------------------------------------------------
  * Set Commands
@@ -254,7 +255,7 @@ void setTypeConvert(robj *setobj, int enc) {
         setTypeReleaseIterator(si);
 
         setobj->encoding = OBJ_ENCODING_HT;
-        zfree(setobj->ptr);
+        intsetFree(setobj->ptr);
         setobj->ptr = d;
     } else {
         serverPanic("Unsupported set conversion");
@@ -791,16 +792,286 @@ int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
     return 0;
 }
 
+#define SET_OP_UNION 0
+#define SET_OP_DIFF 1
+#define SET_OP_INTER 2
+
+/* Sets with at least this many elements to test against the other sets are
+ * split across the set operations threads, if enabled. */
+#define SET_OPS_PARALLEL_MIN_SIZE 65536
+
+/* An element of a set: an SDS string, or an integer when "ele" is NULL. */
+typedef struct setMember {
+    sds ele;
+    int64_t llele;
+} setMember;
+
+/* Like setTypeIsMember(), but the element can also be an integer, as
+ * returned by setTypeNext() for intsets. Integers are tested against hash
+ * tables converting them into "*buf", that is reused across calls instead
+ * of allocating a new string for every element. */
+static int setTypeIsMemberAux(robj *set, sds ele, int64_t llele, sds *buf) {
+    long long llval;
+
+    if (set->encoding == OBJ_ENCODING_HT) {
+        if (ele == NULL) {
+            char tmp[LONG_STR_SIZE];
+            int len = ll2string(tmp,sizeof(tmp),llele);
+            *buf = sdscpylen(*buf,tmp,len);
+            ele = *buf;
+        }
+        return dictFind((dict*)set->ptr,ele) != NULL;
+    } else if (set->encoding == OBJ_ENCODING_INTSET) {
+        if (ele == NULL) return intsetFind((intset*)set->ptr,llele);
+        if (isSdsRepresentableAsLongLong(ele,&llval) == C_OK)
+            return intsetFind((intset*)set->ptr,llval);
+        return 0;
+    } else {
+        serverPanic("Unknown set encoding");
+    }
+    return 0;
+}
+
+/* Return 1 if the element is in all the "numsets" sets (SET_OP_INTER), or
+ * in none of them (SET_OP_DIFF). */
+static int setMemberFilter(robj **sets, unsigned long numsets, int op,
+                           sds ele, int64_t llele, sds *buf)
+{
+    unsigned long j;
+
+    for (j = 0; j < numsets; j++) {
+        int found = setTypeIsMemberAux(sets[j],ele,llele,buf);
+        if (op == SET_OP_INTER ? !found : found) return 0;
+    }
+    return 1;
+}
+
+/* A slice of the members of a set, filtered by a set operations thread. */
+typedef struct setFilterJob {
+    robj **sets;
+    unsigned long numsets;
+    int op;
+    setMember *members;
+    unsigned char *keep;    /* Set to 1 for the members to keep. */
+    unsigned long start, end;
+} setFilterJob;
+
+static void setFilterSlice(setFilterJob *job) {
+    sds buf = sdsempty();
+    unsigned long j;
+
+    for (j = job->start; j < job->end; j++) {
+        setMember *m = job->members+j;
+        job->keep[j] = setMemberFilter(job->sets,job->numsets,job->op,
+                                       m->ele,m->llele,&buf);
+    }
+    sdsfree(buf);
+}
+
+/* The set operations threads. They are started when set-ops-threads is
+ * configured and are never stopped: when the option is lowered the extra
+ * threads just stay idle. setops_jobs[j] is the slice assigned to the
+ * thread 'j', or NULL when it is idle, and setops_pending counts the
+ * slices not yet filtered. All of them are protected by setops_mutex. */
+static pthread_t setops_threads[SET_OPS_THREADS_MAX_NUM];
+static int setops_threads_num = 0;
+static setFilterJob *setops_jobs[SET_OPS_THREADS_MAX_NUM];
+static int setops_pending = 0;
+static pthread_mutex_t setops_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t setops_newjob_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t setops_done_cond = PTHREAD_COND_INITIALIZER;
+
+static void *setOpsThreadMain(void *arg) {
+    long id = (long) arg;
+    sigset_t sigset;
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        serverLog(LL_WARNING,
+            "Warning: can't mask SIGALRM in set operations thread: %s",
+            strerror(errno));
+
+    pthread_mutex_lock(&setops_mutex);
+    while(1) {
+        setFilterJob *job = setops_jobs[id];
+
+        if (job == NULL) {
+            pthread_cond_wait(&setops_newjob_cond,&setops_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&setops_mutex);
+        setFilterSlice(job);
+        pthread_mutex_lock(&setops_mutex);
+        setops_jobs[id] = NULL;
+        if (--setops_pending == 0) pthread_cond_signal(&setops_done_cond);
+    }
+    return NULL;
+}
+
+/* Start the threads needed to split the set operations in
+ * server.set_ops_threads_num slices, the first one being always filtered
+ * by the main thread. Failing to create a thread is not fatal: the slices
+ * without a thread are filtered by the main thread too. */
+void setOpsThreadsStart(void) {
+    while (setops_threads_num < server.set_ops_threads_num-1) {
+        void *arg = (void*)(long) setops_threads_num;
+        int err = server.set_ops_threads_debug_fail ? EAGAIN :
+                  pthread_create(&setops_threads[setops_threads_num],NULL,
+                                 setOpsThreadMain,arg);
+        if (err != 0) {
+            serverLog(LL_WARNING,
+                "Can't create set operations thread: %s. "
+                "Only %d of %d threads are running, the main thread will "
+                "do the rest of the work.", strerror(err),
+                setops_threads_num+1, server.set_ops_threads_num);
+            break;
+        }
+        setops_threads_num++;
+    }
+}
+
+/* Add an element to "dstset" or, when it is NULL, reply it to the client. */
+static void setFilterEmit(client *c, robj *dstset, sds ele, int64_t llele,
+                          sds *buf)
+{
+    if (dstset) {
+        if (ele == NULL) {
+            char tmp[LONG_STR_SIZE];
+            int len = ll2string(tmp,sizeof(tmp),llele);
+            *buf = sdscpylen(*buf,tmp,len);
+            ele = *buf;
+        }
+        setTypeAdd(dstset,ele);
+    } else {
+        if (ele)
+            addReplyBulkCBuffer(c,ele,sdslen(ele));
+        else
+            addReplyBulkLongLong(c,llele);
+    }
+}
+
+/* Test every element of "set" against the "numsets" sets in "sets", and
+ * add to "dstset", or reply to the client when "dstset" is NULL, the ones
+ * that are in all of them (SET_OP_INTER) or in none of them (SET_OP_DIFF).
+ * Return the number of elements kept.
+ *
+ * When the set is very large the membership tests are split across
+ * server.set_ops_threads_num slices, filtered by the main thread and by
+ * the set operations threads. This is safe because the main thread
+ * waits for them, so nothing else can access the sets meanwhile, and
+ * because rehashing is paused, like safe iterators do, so that lookups
+ * don't modify the hash tables. */
+static unsigned long setFilterMembers(client *c, robj *set, robj **sets,
+                                      unsigned long numsets, int op,
+                                      robj *dstset)
+{
+    unsigned long size = setTypeSize(set), count = 0, j;
+    int numthreads = server.set_ops_threads_num;
+    setTypeIterator *si;
+    sds ele, buf = sdsempty();
+    int64_t llele;
+
+    if (numthreads > 1 && numsets > 0 && size >= SET_OPS_PARALLEL_MIN_SIZE) {
+        setFilterJob jobs[SET_OPS_THREADS_MAX_NUM];
+        setMember *members = zmalloc(sizeof(setMember)*size);
+        unsigned char *keep = zmalloc(size);
+        unsigned long n = 0;
+        int t;
+
+        /* The HT elements are referenced, not copied: the set can't change
+         * until we are done. */
+        si = setTypeInitIterator(set);
+        while(setTypeNext(si,&ele,&llele) != -1) {
+            members[n].ele = si->encoding == OBJ_ENCODING_HT ? ele : NULL;
+            members[n].llele = llele;
+            n++;
+        }
+        setTypeReleaseIterator(si);
+
+        for (j = 0; j < numsets; j++)
+            if (sets[j]->encoding == OBJ_ENCODING_HT)
+                dictPauseRehashing((dict*)sets[j]->ptr);
+        for (t = 0; t < numthreads; t++) {
+            setFilterJob *job = jobs+t;
+            job->sets = sets;
+            job->numsets = numsets;
+            job->op = op;
+            job->members = members;
+            job->keep = keep;
+            job->start = n/numthreads*t;
+            job->end = t == numthreads-1 ? n : n/numthreads*(t+1);
+        }
+
+        /* The slice 't' is filtered by the thread 't-1', if running,
+         * otherwise by the main thread, like the first slice. */
+        pthread_mutex_lock(&setops_mutex);
+        for (t = 1; t < numthreads && t <= setops_threads_num; t++) {
+            setops_jobs[t-1] = jobs+t;
+            setops_pending++;
+        }
+        pthread_cond_broadcast(&setops_newjob_cond);
+        pthread_mutex_unlock(&setops_mutex);
+        setFilterSlice(jobs);
+        for (t = setops_threads_num+1; t < numthreads; t++)
+            setFilterSlice(jobs+t);
+        pthread_mutex_lock(&setops_mutex);
+        while (setops_pending)
+            pthread_cond_wait(&setops_done_cond,&setops_mutex);
+        pthread_mutex_unlock(&setops_mutex);
+        for (j = 0; j < numsets; j++)
+            if (sets[j]->encoding == OBJ_ENCODING_HT)
+                dictResumeRehashing((dict*)sets[j]->ptr);
+
+        for (j = 0; j < n; j++) {
+            if (!keep[j]) continue;
+            setFilterEmit(c,dstset,members[j].ele,members[j].llele,&buf);
+            count++;
+        }
+        zfree(members);
+        zfree(keep);
+    } else {
+        si = setTypeInitIterator(set);
+        while(setTypeNext(si,&ele,&llele) != -1) {
+            if (si->encoding == OBJ_ENCODING_INTSET) ele = NULL;
+            if (!setMemberFilter(sets,numsets,op,ele,llele,&buf)) continue;
+            setFilterEmit(c,dstset,ele,llele,&buf);
+            count++;
+        }
+        setTypeReleaseIterator(si);
+    }
+    sdsfree(buf);
+    return count;
+}
+
+/* Compute the union or the difference of sets that are all intsets (or
+ * missing keys, that are NULL) merging their sorted elements. */
+static intset *setOpIntsets(robj **sets, int setnum, int op) {
+    intset *is = intsetNew(), *res;
+    int j;
+
+    for (j = 0; j < setnum; j++) {
+        if (!sets[j]) continue;
+        if (op == SET_OP_UNION || j == 0)
+            res = intsetUnion(is,sets[j]->ptr);
+        else
+            res = intsetDifference(is,sets[j]->ptr);
+        intsetFree(is);
+        is = res;
+        if (op == SET_OP_DIFF && intsetLen(is) == 0) break;
+    }
+    return is;
+}
+
 void sinterGenericCommand(client *c, robj **setkeys,
                           unsigned long setnum, robj *dstkey) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
-    setTypeIterator *si;
-    robj *dstset = NULL;
-    sds elesds;
-    int64_t intobj;
+    robj *dstset = NULL, *first;
+    intset *is = NULL;
     void *replylen = NULL;
-    unsigned long j, cardinality = 0;
-    int encoding;
+    unsigned long j, numsets = 0, cardinality = 0;
 
     for (j = 0; j < setnum; j++) {
         robj *setobj = dstkey ?
@@ -844,55 +1115,33 @@ void sinterGenericCommand(client *c, robj **setkeys,
 
     /* Iterate all the elements of the first (smallest) set, and test
      * the element against all the other sets, if at least one set does
-     * not include the element it is discarded */
-    si = setTypeInitIterator(sets[0]);
-    while((encoding = setTypeNext(si,&elesds,&intobj)) != -1) {
-        for (j = 1; j < setnum; j++) {
-            if (sets[j] == sets[0]) continue;
-            if (encoding == OBJ_ENCODING_INTSET) {
-                /* intset with intset is simple... and fast */
-                if (sets[j]->encoding == OBJ_ENCODING_INTSET &&
-                    !intsetFind((intset*)sets[j]->ptr,intobj))
-                {
-                    break;
-                /* in order to compare an integer with an object we
-                 * have to use the generic function, creating an object
-                 * for this */
-                } else if (sets[j]->encoding == OBJ_ENCODING_HT) {
-                    elesds = sdsfromlonglong(intobj);
-                    if (!setTypeIsMember(sets[j],elesds)) {
-                        sdsfree(elesds);
-                        break;
-                    }
-                    sdsfree(elesds);
-                }
-            } else if (encoding == OBJ_ENCODING_HT) {
-                if (!setTypeIsMember(sets[j],elesds)) {
-                    break;
-                }
-            }
-        }
-
-        /* Only take action when all sets contain the member */
-        if (j == setnum) {
-            if (!dstkey) {
-                if (encoding == OBJ_ENCODING_HT)
-                    addReplyBulkCBuffer(c,elesds,sdslen(elesds));
-                else
-                    addReplyBulkLongLong(c,intobj);
-                cardinality++;
-            } else {
-                if (encoding == OBJ_ENCODING_INTSET) {
-                    elesds = sdsfromlonglong(intobj);
-                    setTypeAdd(dstset,elesds);
-                    sdsfree(elesds);
-                } else {
-                    setTypeAdd(dstset,elesds);
-                }
-            }
+     * not include the element it is discarded.
+     *
+     * When the smallest set is an intset, the other intsets are intersected
+     * with it first merging their sorted elements, and only the elements of
+     * the result are tested against the remaining sets. The sets to test
+     * are moved at the start of sets+1. */
+    for (j = 1; j < setnum; j++) {
+        if (sets[j] == sets[0]) continue;
+        if (sets[0]->encoding == OBJ_ENCODING_INTSET &&
+            sets[j]->encoding == OBJ_ENCODING_INTSET)
+        {
+            intset *res = intsetIntersect(is ? is : sets[0]->ptr,
+                                          sets[j]->ptr);
+            if (is) intsetFree(is);
+            is = res;
+        } else {
+            sets[1+numsets++] = sets[j];
         }
     }
-    setTypeReleaseIterator(si);
+    if (is) {
+        first = createObject(OBJ_SET,is);
+        first->encoding = OBJ_ENCODING_INTSET;
+    } else {
+        first = sets[0];
+    }
+    cardinality = setFilterMembers(c,first,sets+1,numsets,SET_OP_INTER,dstset);
+    if (first != sets[0]) decrRefCount(first);
 
     if (dstkey) {
         /* Store the resulting set into the target, if the intersection
@@ -926,10 +1175,6 @@ void sinterstoreCommand(client *c) {
     sinterGenericCommand(c,c->argv+2,c->argc-2,c->argv[1]);
 }
 
-#define SET_OP_UNION 0
-#define SET_OP_DIFF 1
-#define SET_OP_INTER 2
-
 void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
                               robj *dstkey, int op) {
     robj **sets = zmalloc(sizeof(robj*)*setnum);
@@ -937,7 +1182,8 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
     robj *dstset = NULL;
     sds ele;
     int j, cardinality = 0;
-    int diff_algo = 1;
+    int diff_algo = 1, allintsets = 1;
+    unsigned long maxsize = 0;
 
     for (j = 0; j < setnum; j++) {
         robj *setobj = dstkey ?
@@ -952,6 +1198,8 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
             return;
         }
         sets[j] = setobj;
+        if (setobj->encoding != OBJ_ENCODING_INTSET) allintsets = 0;
+        if (setTypeSize(setobj) > maxsize) maxsize = setTypeSize(setobj);
     }
 
     /* Select what DIFF algorithm to use.
@@ -992,9 +1240,22 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
      * this set object will be the resulting object to set into the target key*/
     dstset = createIntsetObject();
 
-    if (op == SET_OP_UNION) {
+    if (allintsets && (op == SET_OP_UNION || sets[0])) {
+        /* When all the sets are intsets the result is computed merging
+         * their sorted elements. */
+        intsetFree(dstset->ptr);
+        dstset->ptr = setOpIntsets(sets,setnum,op);
+        cardinality = intsetLen(dstset->ptr);
+        if (intsetLen(dstset->ptr) > server.set_max_intset_entries)
+            setTypeConvert(dstset,OBJ_ENCODING_HT);
+    } else if (op == SET_OP_UNION) {
         /* Union is trivial, just add every element of every set to the
-         * temporary set. */
+         * temporary set. The union is at least as large as the largest
+         * set, that is not an intset, so the hash table is created with
+         * the right size upfront instead of growing while adding. */
+        decrRefCount(dstset);
+        dstset = createSetObject();
+        dictExpand(dstset->ptr,maxsize);
         for (j = 0; j < setnum; j++) {
             if (!sets[j]) continue; /* non existing keys are like empty sets */
 
@@ -1014,21 +1275,16 @@ void sunionDiffGenericCommand(client *c, robj **setkeys, int setnum,
          *
          * This way we perform at max N*M operations, where N is the size of
          * the first set, and M the number of sets. */
-        si = setTypeInitIterator(sets[0]);
-        while((ele = setTypeNextObject(si)) != NULL) {
-            for (j = 1; j < setnum; j++) {
-                if (!sets[j]) continue; /* no key is an empty set. */
-                if (sets[j] == sets[0]) break; /* same set! */
-                if (setTypeIsMember(sets[j],ele)) break;
-            }
-            if (j == setnum) {
-                /* There is no other set with this element. Add it. */
-                setTypeAdd(dstset,ele);
-                cardinality++;
-            }
-            sdsfree(ele);
+        unsigned long numsets = 0;
+
+        for (j = 1; j < setnum; j++) {
+            if (!sets[j]) continue; /* no key is an empty set. */
+            if (sets[j] == sets[0]) break; /* same set! */
+            sets[1+numsets++] = sets[j];
         }
-        setTypeReleaseIterator(si);
+        if (j == setnum)
+            cardinality = setFilterMembers(c,sets[0],sets+1,numsets,
+                                           SET_OP_DIFF,dstset);
     } else if (op == SET_OP_DIFF && sets[0] && diff_algo == 2) {
         /* DIFF Algorithm 2:
          *
@@ -72,6 +72,14 @@ static int checkStringLength(client *c, long long size) {
 #define OBJ_SET_EX (1<<2)     /* Set if time in seconds is given */
 #define OBJ_SET_PX (1<<3)     /* Set if time in ms in given */
 
+static const commandOption setOptions[] = {
+    COMMAND_OPTION("nx",OBJ_SET_NX),
+    COMMAND_OPTION("xx",OBJ_SET_XX),
+    COMMAND_OPTION("ex",OBJ_SET_EX),
+    COMMAND_OPTION("px",OBJ_SET_PX),
+    COMMAND_OPTION_END
+};
+
 /*
  * 通用set实现,实现了set操作公共逻辑
  *
@@ -140,31 +148,19 @@ void setCommand(client *c) {
 
     // 从前往后遍历参数后续参数 set a b xxx, xxx是第4个参数开始
     for (j = 3; j < c->argc; j++) {
-        char *a = c->argv[j]->ptr;
+        int opt = matchCommandOption(c->argv[j],setOptions);
         robj *next = (j == c->argc-1) ? NULL : c->argv[j+1];
 
-        if ((a[0] == 'n' || a[0] == 'N') &&
-            (a[1] == 'x' || a[1] == 'X') && a[2] == '\0' &&
-            !(flags & OBJ_SET_XX))
-        {
+        if (opt == OBJ_SET_NX && !(flags & OBJ_SET_XX)) {
             flags |= OBJ_SET_NX;
-        } else if ((a[0] == 'x' || a[0] == 'X') &&
-                   (a[1] == 'x' || a[1] == 'X') && a[2] == '\0' &&
-                   !(flags & OBJ_SET_NX))
-        {
+        } else if (opt == OBJ_SET_XX && !(flags & OBJ_SET_NX)) {
             flags |= OBJ_SET_XX;
-        } else if ((a[0] == 'e' || a[0] == 'E') &&
-                   (a[1] == 'x' || a[1] == 'X') && a[2] == '\0' &&
-                   !(flags & OBJ_SET_PX) && next)
-        {
+        } else if (opt == OBJ_SET_EX && !(flags & OBJ_SET_PX) && next) {
             flags |= OBJ_SET_EX;
             unit = UNIT_SECONDS;
             expire = next;
             j++;
-        } else if ((a[0] == 'p' || a[0] == 'P') &&
-                   (a[1] == 'x' || a[1] == 'X') && a[2] == '\0' &&
-                   !(flags & OBJ_SET_EX) && next)
-        {
+        } else if (opt == OBJ_SET_PX && !(flags & OBJ_SET_EX) && next) {
             flags |= OBJ_SET_PX;
             unit = UNIT_MILLISECONDS;
             expire = next;
@@ -170,6 +170,19 @@ int stringmatch(const char *pattern, const char *string, int nocase) {
     return stringmatchlen(pattern,strlen(pattern),string,strlen(string),nocase);
 }
 
+/* Return the length of the literal prefix of the glob-style pattern, that
+ * is, the number of bytes before the first special character. Every string
+ * matched by the pattern (in a case sensitive way) starts with these bytes. */
+int stringmatchPrefixLen(const char *pattern, int patternLen) {
+    int j;
+
+    for (j = 0; j < patternLen; j++) {
+        char c = pattern[j];
+        if (c == '*' || c == '?' || c == '[' || c == '\\') break;
+    }
+    return j;
+}
+
 /* Convert a string representing an amount of memory into the number of
  * bytes, so for instance memtoll("1Gb") will return 1073741824 that is
  * (1024*1024*1024).
@@ -504,7 +517,7 @@ int string2ld(const char *s, size_t slen, long double *dp) {
  * required. The representation should always be parsable by strtod(3).
  * This function does not support human-friendly formatting like ld2string
  * does. It is intented mainly to be used inside t_zset.c when writing scores
- * into a ziplist representing a sorted set. */
+ * into a listpack representing a sorted set. */
 int d2string(char *buf, size_t len, double value) {
     if (isnan(value)) {
         len = snprintf(buf,len,"nan");
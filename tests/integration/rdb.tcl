@@ -21,6 +21,19 @@ start_server [list overrides [list "dir" $server_path "dbfilename" "encodings.rd
 "0","zset","zset","a","1","b","2","c","3","aa","10","bb","20","cc","30","aaa","100","bbb","200","ccc","300","aaaa","1000","cccc","123456789","bbbb","5000000000",
 "0","zset_zipped","zset","a","1","b","2","c","3",
 }
+
+  test "RDB ziplist encodings are converted to listpack on load" {
+    r select 0
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    assert_encoding quicklist list_zipped
+    set dump [csvdump r]
+    r debug reload
+    r select 0
+    assert_encoding listpack hash_zipped
+    assert_encoding listpack zset_zipped
+    assert_equal $dump [csvdump r]
+  }
 }
 
 set server_path [tmpdir "server.rdb-startup-test"]
@@ -96,3 +109,202 @@ start_server_and_kill_it [list "dir" $server_path] {
         }
     }
 }
+
+# Versions used by upstream Redis releases, with different type and opcode
+# numbers, must be refused.
+set fd [open [file join $server_path dump.rdb] w]
+fconfigure $fd -translation binary
+puts -nonewline $fd "REDIS0011\xff\x00\x00\x00\x00\x00\x00\x00\x00"
+close $fd
+
+start_server_and_kill_it [list "dir" $server_path] {
+    test {Server should not start with an RDB of an unsupported version} {
+        wait_for_condition 50 100 {
+            [string match {*Can't handle RDB format version 11*} \
+                [exec tail -10 < [dict get $srv stdout]]]
+        } else {
+            fail "Server started with an unsupported RDB version!"
+        }
+    }
+}
+
+set server_path [tmpdir "server.rdb-forkless-test"]
+set copy_path [tmpdir "server.rdb-forkless-copy"]
+
+start_server [list overrides [list "dir" $server_path "rdb-forkless" yes "rdb-forkless-step-us" 20]] {
+    test {Forkless BGSAVE saves the dataset as it was when started} {
+        # Small enough to be loaded quickly by the next server at startup,
+        # while the short steps still make the save span many iterations.
+        r debug populate 20000
+        for {set j 0} {$j < 100} {incr j} {
+            r sadd set:$j a b c $j
+            r pexpire key:$j 1000000
+        }
+        r select 1
+        r debug populate 1000
+        r select 9
+        set digest [r debug digest]
+
+        r bgsave
+        assert_equal 1 [s rdb_bgsave_in_progress]
+        assert_match {*Background save already in progress*} \
+            [catch {r bgsave} e; set e]
+
+        # Modify, delete and create keys while the save is in progress,
+        # in the DB being scanned and in the other DBs.
+        set j 0
+        while {[s rdb_bgsave_in_progress]} {
+            r set key:$j changed
+            r del key:[expr {$j+10000}]
+            r set newkey:$j foo
+            r sadd set:[expr {$j%100}] new
+            r persist key:[expr {$j%100}]
+            r select 1
+            r del key:$j
+            r set newkey:$j foo
+            r select 9
+            incr j
+        }
+        assert {$j > 10}
+        assert_equal ok [s rdb_last_bgsave_status]
+        assert {[r debug digest] ne $digest}
+        file copy [file join $server_path dump.rdb] $copy_path
+    }
+}
+
+start_server [list overrides [list "dir" $copy_path]] {
+    test {Forkless BGSAVE produces a loadable RDB file} {
+        assert_equal 20100 [r dbsize]
+        assert_equal $digest [r debug digest]
+    }
+}
+
+start_server {overrides {rdb-load-threads 4}} {
+    test {RDB load with multiple threads preserves the dataset} {
+        r debug populate 50000
+        createComplexDataset r 10000
+        # Large and compressible values, and every encoding of the
+        # aggregate types, spanning several loading batches.
+        for {set j 0} {$j < 100} {incr j} {
+            r set bigstr:$j [string repeat "abcd$j" 50000]
+            r pexpire bigstr:$j 100000000
+            for {set i 0} {$i < 200} {incr i} {
+                r rpush biglist:$j [string repeat x $i]
+                r sadd bigset:$j member:$i
+                r sadd bigintset:$j $i
+                r zadd bigzset:$j $i member:$i
+                r hset bighash:$j field:$i $i
+            }
+            r hset smallhash:$j field value
+            r zadd smallzset:$j 1.5 a -inf b
+        }
+        set digest [r debug digest]
+        set keys [r dbsize]
+        r debug reload
+        assert_equal $keys [r dbsize]
+        assert_equal $digest [r debug digest]
+        assert {[r ttl bigstr:0] > 0}
+    }
+
+    test {RDB load threads can be changed at runtime} {
+        set digest [r debug digest]
+        r config set rdb-load-threads 1
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set rdb-load-threads 2
+        r debug reload
+        assert_equal $digest [r debug digest]
+        catch {r config set rdb-load-threads 0} e
+        set e
+    } {ERR*}
+}
+
+set server_path [tmpdir "server.rdb-chunked-test"]
+
+start_server [list overrides [list "dir" $server_path "rdb-chunked" yes "rdb-chunk-size" 16kb]] {
+    test {Chunked RDB preserves the dataset} {
+        r debug populate 20000
+        createComplexDataset r 5000
+        r select 1
+        r debug populate 1000
+        r select 9
+        set digest [r debug digest]
+        r save
+
+        set fd [open [file join $server_path dump.rdb] r]
+        fconfigure $fd -translation binary
+        set magic [read $fd 9]
+        close $fd
+        assert_equal REDIS1001 $magic
+
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set rdb-load-threads 4
+        r debug reload
+        assert_equal $digest [r debug digest]
+    }
+
+    test {redis-check-rdb locates every corrupted chunk} {
+        set rdb [file join $server_path dump.rdb]
+        set fd [open $rdb r+]
+        fconfigure $fd -translation binary
+
+        # Find the chunks using the index at the end of the file, then
+        # corrupt the middle of the payload of two of them.
+        seek $fd [expr {-8-1-16}] end
+        binary scan [read $fd 16] wua8 count magic
+        assert_equal RDBCHIDX $magic
+        assert {$count > 10}
+        seek $fd [expr {-8-1-16-$count*32}] end
+        binary scan [read $fd [expr {$count*32}]] wu* index
+        foreach chunk {3 7} {
+            set offset [lindex $index [expr {$chunk*4}]]
+            set len [lindex $index [expr {$chunk*4+1}]]
+            seek $fd [expr {$offset+$len/2}]
+            puts -nonewline $fd "corrupted"
+        }
+        close $fd
+
+        catch {exec src/redis-check-rdb $rdb} output
+        assert_match {*Chunk #3 at offset*CRC error*Chunk #7 at offset*CRC error*2 corrupted chunks found*} $output
+    }
+}
+
+start_server {overrides {list-compress-depth 1 list-compress-codec zstd rdb-compression-codec zstd}} {
+    test {Zstandard compressed lists and RDB strings are preserved} {
+        for {set j 0} {$j < 50} {incr j} {
+            r set str:$j [string repeat "value $j " 1000]
+            for {set i 0} {$i < 1000} {incr i} {
+                r rpush list:$j "element $i of list $j"
+            }
+        }
+        # Nodes compressed with both codecs in the same list.
+        r config set list-compress-codec lzf
+        for {set j 0} {$j < 50} {incr j} {
+            for {set i 0} {$i < 1000} {incr i} {
+                r lpush list:$j "element -$i of list $j"
+            }
+        }
+        assert_equal "element 500 of list 7" [r lindex list:7 1500]
+        assert_equal "element -500 of list 7" [r lindex list:7 499]
+        set digest [r debug digest]
+
+        r debug reload
+        assert_equal $digest [r debug digest]
+
+        # Zstandard nodes are recompressed when the RDB must use LZF.
+        r config set rdb-compression-codec lzf
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set rdb-load-threads 4
+        r config set rdb-compression-codec zstd
+        r debug reload
+        assert_equal $digest [r debug digest]
+    }
+
+    test {Compression codecs can't be set to unknown values} {
+        catch {r config set rdb-compression-codec lz4} e
+        assert_match {ERR*} $e
+        r config get list-compress-codec
+    } {list-compress-codec lzf}
+}
@@ -16,6 +16,7 @@ set ::all_tests {
     unit/dump
     unit/auth
     unit/protocol
+    unit/networking
     unit/keyspace
     unit/scan
     unit/type/string
@@ -219,4 +219,21 @@ start_server {tags {"expire"}} {
         set ttl [r ttl foo]
         assert {$ttl <= 98 && $ttl > 90}
     }
+
+    test {PERSIST, EXPIRE and RENAME of a key with an expire} {
+        r config set appendonly no
+        r del foo bar
+        r set foo bar EX 100
+        r persist foo
+        assert_equal -1 [r ttl foo]
+        r expire foo 200
+        set ttl [r ttl foo]
+        assert {$ttl <= 200 && $ttl > 190}
+        r rename foo bar
+        set ttl [r ttl bar]
+        assert {$ttl <= 200 && $ttl > 190}
+        r persist bar
+        r debug reload
+        list [r ttl bar] [r get bar]
+    } {-1 bar}
 }
@@ -37,3 +37,91 @@ start_server {tags {"lazyfree"}} {
         }
     }
 }
+
+start_server {tags {"lazyfree"} overrides {lazyfree-threads 4}} {
+    test "FLUSHALL ASYNC with multiple lazyfree threads" {
+        assert_equal 4 [s lazyfree_threads]
+        r debug populate 300000
+        set orig_freed [s lazyfreed_objects]
+        r flushall async
+        assert_equal 0 [r dbsize]
+        wait_for_condition 50 100 {
+            [s lazyfree_pending_objects] == 0 &&
+            [s lazyfree_pending_jobs] == 0
+        } else {
+            fail "Database not released by the lazyfree threads"
+        }
+        assert_equal [expr {$orig_freed+300000}] [s lazyfreed_objects]
+    }
+
+    test "UNLINK of many big keys with multiple lazyfree threads" {
+        set args {}
+        for {set i 0} {$i < 1000} {incr i} {
+            lappend args $i
+        }
+        for {set j 0} {$j < 20} {incr j} {
+            r sadd myset$j {*}$args
+        }
+        set orig_freed [s lazyfreed_objects]
+        for {set j 0} {$j < 20} {incr j} {
+            assert_equal 1 [r unlink myset$j]
+        }
+        wait_for_condition 50 100 {
+            [s lazyfreed_objects] == $orig_freed+20
+        } else {
+            fail "Objects not released by the lazyfree threads"
+        }
+        assert_equal 0 [s lazyfree_pending_jobs]
+    }
+}
+
+start_server {tags {"lazyfree"}} {
+    proc populate_big_set {key} {
+        set args {}
+        for {set i 0} {$i < 1000} {incr i} {
+            lappend args $i
+        }
+        r del $key
+        r sadd $key {*}$args
+    }
+
+    test "DEL releases big values in background with lazyfree-lazy-user-del" {
+        r config set lazyfree-lazy-user-del yes
+        populate_big_set myset
+        set orig_freed [s lazyfreed_objects]
+        assert_equal 1 [r del myset]
+        wait_for_condition 50 100 {
+            [s lazyfreed_objects] == $orig_freed+1
+        } else {
+            fail "DEL did not release the value in background"
+        }
+        r config set lazyfree-lazy-user-del no
+    }
+
+    test "Overwritten big values are released in background with lazyfree-lazy-server-del" {
+        r config set lazyfree-lazy-server-del yes
+        populate_big_set myset
+        set orig_freed [s lazyfreed_objects]
+        r set myset foo
+        assert_equal foo [r get myset]
+        wait_for_condition 50 100 {
+            [s lazyfreed_objects] == $orig_freed+1
+        } else {
+            fail "SET did not release the old value in background"
+        }
+        r config set lazyfree-lazy-server-del no
+    }
+
+    test "Expired big values are released in background with lazyfree-lazy-expire" {
+        r config set lazyfree-lazy-expire yes
+        populate_big_set myset
+        set orig_freed [s lazyfreed_objects]
+        r pexpire myset 10
+        wait_for_condition 50 100 {
+            [s lazyfreed_objects] == $orig_freed+1
+        } else {
+            fail "The expired value was not released in background"
+        }
+        r config set lazyfree-lazy-expire no
+    }
+}
@@ -83,3 +83,48 @@ if 0 {
         }
     }
 }
+
+start_server {tags {"memefficiency"} overrides {string-compression yes}} {
+    test "String compression of similar values" {
+        set base_mem [s used_memory]
+        for {set j 0} {$j < 10000} {incr j} {
+            r set user:$j "{\"id\":$j,\"name\":\"user $j\",\"email\":\"user$j@example.com\",\"active\":true,\"tags\":\[\"customer\",\"tier-[expr {$j%3}]\"\],\"address\":{\"street\":\"$j Main Street\",\"city\":\"Springfield\"}}"
+        }
+        r set short "too short"
+        set digest [r debug digest]
+        set used [expr {[s used_memory]-$base_mem}]
+
+        wait_for_condition 100 100 {
+            [s compressed_strings] == 10000
+        } else {
+            fail "String values were not compressed"
+        }
+        assert {[s compressed_strings_ratio] > 2}
+        assert {[s string_compression_dict_memory] > 0}
+        assert {[expr {[s used_memory]-$base_mem}] < $used*3/4}
+        assert_equal compressed [r object encoding user:10]
+        assert_equal embstr [r object encoding short]
+        assert_equal $digest [r debug digest]
+    }
+
+    test "Compressed values are decompressed when accessed" {
+        set len [r strlen user:1]
+        r append user:1 foo
+        assert_equal [expr {$len+3}] [r strlen user:1]
+        assert_equal raw [r object encoding user:1]
+        assert_match {*"tier-2"*} [r get user:5]
+        assert_equal raw [r object encoding user:5]
+        assert_equal 9998 [s compressed_strings]
+    }
+
+    test "Compressed values are saved uncompressed" {
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        r config set string-compression no
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        assert_equal $digest [r debug digest]
+    }
+}
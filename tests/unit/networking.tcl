@@ -0,0 +1,230 @@
+start_server {tags {"networking"} overrides {io-threads 2 io-threads-do-reads yes}} {
+    test {CONFIG GET reports the I/O threads configuration} {
+        list [lindex [r config get io-threads] 1] \
+             [lindex [r config get io-threads-do-reads] 1]
+    } {2 yes}
+
+    test {I/O threads can't be reconfigured at runtime} {
+        catch {r config set io-threads 4} e
+        set e
+    } {*Unsupported*}
+
+    test {Pipelined commands from many clients with threaded I/O} {
+        r flushall
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        # Send all the pipelines first, so that many clients have pending
+        # output at the same time and the I/O threads get activated.
+        set j 0
+        foreach rd $clients {
+            for {set i 0} {$i < 100} {incr i} {
+                $rd set key:$j:$i val:$j:$i
+                $rd get key:$j:$i
+            }
+            $rd flush
+            incr j
+        }
+        set j 0
+        foreach rd $clients {
+            for {set i 0} {$i < 100} {incr i} {
+                assert_equal OK [$rd read]
+                assert_equal val:$j:$i [$rd read]
+            }
+            $rd close
+            incr j
+        }
+        r dbsize
+    } {1000}
+
+    test {Protocol errors are reported with threaded I/O} {
+        reconnect
+        r write "*3\r\n\$3\r\nSET\r\n\$1\r\nx\r\nfooz\r\n"
+        r flush
+        assert_error "*expected '$', got 'f'*" {r read}
+    }
+
+    test {Large values shared by many clients with threaded I/O} {
+        reconnect
+        r flushall
+        r config resetstat
+        r set big [string repeat abcd 50000]
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        # Keep the server busy while the commands are sent, so that the
+        # commands of all the clients are processed in the same event loop
+        # iteration, and the replies are written by the I/O threads.
+        set sleeper [redis_deferring_client]
+        $sleeper debug sleep 0.2
+        after 50
+        foreach rd $clients {
+            for {set i 0} {$i < 20} {incr i} {
+                $rd get big
+            }
+        }
+        $sleeper read
+        $sleeper close
+        wait_for_condition 50 100 {
+            [string match {*cmdstat_get:calls=200,*} [r info commandstats]]
+        } else {
+            fail "GET commands not processed"
+        }
+        r set big foo
+        foreach rd $clients {
+            for {set i 0} {$i < 20} {incr i} {
+                assert_equal [string repeat abcd 50000] [$rd read]
+            }
+            $rd close
+        }
+        r object refcount big
+    } {1}
+
+    test {INFO reports the I/O threads counters} {
+        reconnect
+        set info [r info stats]
+        assert_match {*io_threads_active:*} $info
+        assert_match {*io_threaded_writes_processed:*} $info
+        assert_match {*io_threaded_reads_processed:*} $info
+    }
+}
+
+start_server {tags {"networking"}} {
+    test {Big pipelined replies are delivered intact to slow readers} {
+        r del mylist
+        for {set j 0} {$j < 1000} {incr j} {
+            lappend elements [string repeat [format %04d $j] [expr {$j%50+1}]]
+        }
+        r rpush mylist {*}$elements
+        r mset a [string repeat x 20000] b [string repeat y 100000]
+
+        # Send everything before reading, so that the replies accumulate
+        # in the static buffer and many reply list nodes, and are written
+        # in many partial writes while the socket buffer is full.
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 50} {incr j} {
+            $rd lrange mylist 0 -1
+            $rd mget a b
+            $rd ping
+        }
+        $rd flush
+        after 100
+        for {set j 0} {$j < 50} {incr j} {
+            assert_equal $elements [$rd read]
+            assert_equal [list [string repeat x 20000] [string repeat y 100000]] [$rd read]
+            assert_equal PONG [$rd read]
+        }
+        $rd close
+    }
+    test {Large values are sent without copying them} {
+        set big [string repeat "0123456789" 50000]
+        r set big $big
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 100} {incr j} {
+            $rd get big
+        }
+        $rd flush
+        after 100
+        # The replies waiting in the output buffer reference the value.
+        assert {[r object refcount big] > 1}
+
+        # Modifying or deleting the key doesn't change the pending replies.
+        r append big foo
+        r setrange big 0 bar
+        assert_equal 1 [r object refcount big]
+        r set other $big
+        r del other
+        r flushall async
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal $big [$rd read]
+        }
+        $rd close
+    }
+}
+
+start_server {tags {"networking"}} {
+    test {Idle clients give their query buffer back to the pool} {
+        r config resetstat
+        set clients {}
+        for {set j 0} {$j < 10} {incr j} {
+            set rd [redis_deferring_client]
+            $rd ping
+            assert_equal PONG [$rd read]
+            lappend clients $rd
+        }
+        assert {[s querybuf_pool_buffers] > 0}
+        assert {[s querybuf_pool_hits] > 0}
+        # The buffer of every idle client is in the pool.
+        foreach line [split [string trim [r client list]] "\n"] {
+            if {![string match {*cmd=client*} $line]} {
+                assert_match {*qbuf=0 qbuf-free=0 *} $line
+            }
+        }
+        foreach rd $clients {
+            $rd set foo [string repeat x 100000]
+            assert_equal OK [$rd read]
+            $rd close
+        }
+        r get foo
+    } [string repeat x 100000]
+
+    test {Query buffers pool can be resized at runtime} {
+        r config set querybuf-pool-size 1
+        assert {[s querybuf_pool_buffers] <= 1}
+        r config set querybuf-pool-size 0
+        assert_equal 0 [s querybuf_pool_buffers]
+        set rd [redis_deferring_client]
+        $rd ping
+        assert_equal PONG [$rd read]
+        $rd close
+        assert_equal 0 [s querybuf_pool_buffers]
+        r config set querybuf-pool-size 1024
+        r config get querybuf-pool-size
+    } {querybuf-pool-size 1024}
+}
+
+start_server {tags {"networking"}} {
+    test {Clients accepted while others are killed in the same event loop iteration} {
+        for {set j 0} {$j < 10} {incr j} {
+            set victim [redis_deferring_client]
+            set sleeper [redis_deferring_client]
+            set killer [redis_deferring_client]
+            foreach c [list $victim $sleeper $killer] {
+                $c ping
+                assert_equal PONG [$c read]
+            }
+            set port [lindex [fconfigure [$victim channel] -sockname] 2]
+
+            # While the server sleeps, kill a client and connect a new one,
+            # that may get the file descriptor of the killed client.
+            $sleeper debug sleep 0.2
+            after 50
+            $killer client kill 127.0.0.1:$port
+            set fd [socket [srv 0 host] [srv 0 port]]
+            fconfigure $fd -translation binary -blocking 0
+            puts -nonewline $fd "PING\r\n"
+            flush $fd
+            assert_equal OK [$killer read]
+            assert_equal OK [$sleeper read]
+
+            # The new client is served, and the killed one sees the close.
+            set vfd [$victim channel]
+            fconfigure $vfd -blocking 0
+            wait_for_condition 50 20 {
+                [gets $fd line] > 0
+            } else {
+                fail "New client not served after a client was killed"
+            }
+            assert_equal "+PONG\r" $line
+            wait_for_condition 50 20 {
+                [string length [read $vfd]] == 0 && [eof $vfd]
+            } else {
+                fail "Killed client connection not closed"
+            }
+            close $fd
+            foreach c [list $victim $sleeper $killer] {$c close}
+        }
+    }
+}
@@ -244,3 +244,28 @@ start_server {tags {"other"}} {
         r save
     } {OK}
 }
+
+start_server {tags {"other"}} {
+    test {INFO keyspace reports the rehashing progress} {
+        r config set activerehashing no
+        r flushdb
+        # The 25th key makes the initial table of 4 buckets (6 keys each on
+        # average) grow, starting a rehashing that can't progress without
+        # lookups or active rehashing.
+        for {set j 0} {$j < 25} {incr j} {
+            r set key:$j $j
+        }
+        assert_match {*keys=25,*keys_rehashing=*} [r info keyspace]
+    }
+
+    test {Rehashing is completed before sleeping with activerehashing} {
+        r config set activerehashing-budget-us 100
+        r config set activerehashing yes
+        wait_for_condition 50 100 {
+            ![string match {*keys_rehashing*} [r info keyspace]]
+        } else {
+            fail "The main dictionary is still rehashing"
+        }
+        r dbsize
+    } {25}
+}
@@ -68,6 +68,97 @@ start_server {tags {"protocol"}} {
         assert_error "*unbalanced*" {r read}
     }
 
+    test "Deep pipelines of inline and multibulk commands" {
+        reconnect
+        r del mylist
+        set payload {}
+        for {set j 0} {$j < 1000} {incr j} {
+            if {$j % 2} {
+                append payload "*3\r\n\$5\r\nRPUSH\r\n\$6\r\nmylist\r\n"
+                append payload "\$[string length $j]\r\n$j\r\n"
+            } else {
+                append payload "rpush mylist $j\r\n"
+            }
+        }
+        # Lines terminated by just \n, and empty lines, are accepted
+        # between inline commands.
+        append payload "\r\n\nrpush mylist last\n"
+        r write $payload
+        r flush
+        for {set j 1} {$j <= 1001} {incr j} {
+            assert_equal $j [r read]
+        }
+        assert_equal [r llen mylist] 1001
+        r lrange mylist 998 -1
+    } {998 999 last}
+
+    test "Pipelined bulk arguments containing CR and LF" {
+        r del mylist
+        # Values of growing size, so that the line ends fall at every
+        # offset of the blocks the parser indexes, and a big argument in
+        # the middle of the pipeline.
+        set values {}
+        for {set j 0} {$j < 200} {incr j} {
+            lappend values [string repeat "\r\n\$3\r" $j]
+        }
+        lappend values [string repeat "x\r" 40000]
+        lappend values "\r"
+        set payload {}
+        foreach v $values {
+            append payload "*3\r\n\$5\r\nRPUSH\r\n\$6\r\nmylist\r\n"
+            append payload "\$[string length $v]\r\n$v\r\n"
+        }
+        r write $payload
+        r flush
+        for {set j 1} {$j <= [llength $values]} {incr j} {
+            assert_equal $j [r read]
+        }
+        assert_equal $values [r lrange mylist 0 -1]
+    }
+
+    test "Commands after a blocking command in a pipeline" {
+        reconnect
+        r del list1 list2
+        r write "*3\r\n\$5\r\nBLPOP\r\n\$5\r\nlist1\r\n\$1\r\n0\r\nrpush list2 a\r\nping\r\n"
+        r flush
+        set rd [redis_deferring_client]
+        $rd rpush list1 foo
+        assert_equal 1 [$rd read]
+        $rd close
+        list [r read] [r read] [r read]
+    } {{list1 foo} 1 PONG}
+
+    test "Big argument followed by more arguments in a long pipeline" {
+        reconnect
+        r del list1 biglist
+        # While the client is blocked the whole pipeline accumulates in the
+        # query buffer, so the big argument is found far from its start.
+        set payload "*3\r\n\$5\r\nBLPOP\r\n\$5\r\nlist1\r\n\$1\r\n0\r\n"
+        for {set j 0} {$j < 1000} {incr j} {
+            append payload "*3\r\n\$5\r\nRPUSH\r\n\$7\r\nbiglist\r\n\$10\r\n[format %010d $j]\r\n"
+        }
+        append payload "*3\r\n\$3\r\nSET\r\n"
+        # The length of the key puts the line after it, once the key is
+        # moved at the start of the buffer, in the same 64 bytes block
+        # where the length of the key was.
+        set bigkey [string repeat k [string length $payload]]
+        append payload "\$[string length $bigkey]\r\n$bigkey\r\n\$1\r\nv\r\n"
+        append payload "*2\r\n\$3\r\nGET\r\n\$[string length $bigkey]\r\n$bigkey\r\n"
+        r write $payload
+        r flush
+        set rd [redis_deferring_client]
+        $rd rpush list1 foo
+        assert_equal 1 [$rd read]
+        $rd close
+        assert_equal {list1 foo} [r read]
+        for {set j 1} {$j <= 1000} {incr j} {
+            assert_equal $j [r read]
+        }
+        assert_equal OK [r read]
+        assert_equal v [r read]
+        r del $bigkey
+    } {1}
+
     set c 0
     foreach seq [list "\x00" "*\x00" "$\x00"] {
         incr c
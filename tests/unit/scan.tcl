@@ -87,11 +87,11 @@ start_server {tags {"scan"}} {
         }
     }
 
-    foreach enc {ziplist hashtable} {
+    foreach enc {listpack hashtable} {
         test "HSCAN with encoding $enc" {
             # Create the Hash
             r del hash
-            if {$enc eq {ziplist}} {
+            if {$enc eq {listpack}} {
                 set count 30
             } else {
                 set count 1000
@@ -127,11 +127,11 @@ start_server {tags {"scan"}} {
         }
     }
 
-    foreach enc {ziplist skiplist} {
+    foreach enc {listpack skiplist} {
         test "ZSCAN with encoding $enc" {
             # Create the Sorted Set
             r del zset
-            if {$enc eq {ziplist}} {
+            if {$enc eq {listpack}} {
                 set count 30
             } else {
                 set count 1000
@@ -237,3 +237,122 @@ start_server {tags {"scan"}} {
         assert {$first_score != 0}
     }
 }
+
+start_server {tags {"scan"} overrides {keyspace-index yes}} {
+    proc scanrange_all {args} {
+        set min -
+        set keys {}
+        while 1 {
+            set res [r scanrange $min + {*}$args]
+            lappend keys {*}[lindex $res 1]
+            set min [lindex $res 0]
+            if {$min eq {0}} break
+        }
+        return $keys
+    }
+
+    test "KEYS and SCAN with a prefix use the keys index" {
+        r flushdb
+        r debug populate 1000
+        for {set j 0} {$j < 50} {incr j} {
+            r set user:$j $j
+        }
+        r set user: x
+        r set usr:1 x
+        assert_equal 51 [llength [r keys user:*]]
+        assert_equal {user:1 user:10 user:11 user:12 user:13 user:14 user:15 user:16 user:17 user:18 user:19} [lsort [r keys user:1*]]
+        assert_equal {user:1} [r keys user:1]
+        assert_equal {user:11 user:21 user:31 user:41} [lsort [r keys user:?1]]
+
+        # The matching keys are returned in a single call if they are
+        # not more than the iterations allowed by COUNT.
+        set res [r scan 0 match user:* count 100]
+        assert_equal 0 [lindex $res 0]
+        assert_equal [lsort [r keys user:*]] [lsort [lindex $res 1]]
+
+        # Otherwise the keyspace is scanned as usual.
+        set cur 0
+        set keys {}
+        while 1 {
+            set res [r scan $cur match user:* count 1]
+            set cur [lindex $res 0]
+            lappend keys {*}[lindex $res 1]
+            if {$cur == 0} break
+        }
+        assert_equal [lsort [r keys user:*]] [lsort -unique $keys]
+    }
+
+    test "SCANRANGE returns the keys in lexicographical order" {
+        assert_equal [lsort [r keys *]] [scanrange_all count 7]
+        assert_equal [lsort [r keys user:*]] [scanrange_all match user:* count 3]
+        assert_equal {user:20 user:21} [scanrange_all match user:2\[01\] count 1]
+
+        set res [r scanrange {[user:3} {(user:4} count 100]
+        assert_equal 0 [lindex $res 0]
+        assert_equal {user:3 user:30 user:31 user:32 user:33 user:34 user:35 user:36 user:37 user:38 user:39} [lindex $res 1]
+        assert_equal {user:30 user:31} [lindex [r scanrange {(user:3} {[user:31}] 1]
+        assert_equal {} [lindex [r scanrange + -] 1]
+        assert_equal {} [lindex [r scanrange {[z} +] 1]
+
+        set res [r scanrange - + count 2]
+        assert_equal {(key:1} [lindex $res 0]
+        assert_equal {key:0 key:1} [lindex $res 1]
+        assert_equal {key:10 key:100} [lindex [r scanrange [lindex $res 0] + count 2] 1]
+    }
+
+    test "SCANRANGE errors" {
+        assert_error {*not valid*} {r scanrange a +}
+        assert_error {*syntax*} {r scanrange - + count 0}
+        assert_error {*syntax*} {r scanrange - + foo}
+    }
+
+    test "Keys index is updated by RENAME, MOVE, SWAPDB and expires" {
+        r flushall
+        r set a 1
+        r set b 1
+        r rename a c
+        assert_equal {b c} [scanrange_all]
+        r move b 10
+        assert_equal {c} [scanrange_all]
+        r swapdb 9 10
+        assert_equal {b} [scanrange_all]
+        assert_equal {b} [r keys b*]
+        r swapdb 9 10
+        r pexpire c 1
+        r set cc 1
+        after 10
+        assert_equal {cc} [r keys c*]
+        assert_equal {cc} [scanrange_all]
+        r debug set-active-expire 0
+        r pexpire cc 1
+        after 10
+        assert_equal {} [scanrange_all]
+        r debug set-active-expire 1
+        assert_equal 0 [r dbsize]
+    }
+
+    test "Keys index is emptied by FLUSHDB and FLUSHALL ASYNC" {
+        r debug populate 100
+        r flushdb
+        assert_equal {} [scanrange_all]
+        r debug populate 100
+        r flushall async
+        assert_equal {} [scanrange_all]
+        r debug populate 100
+        assert_equal 100 [llength [scanrange_all count 1000]]
+    }
+
+    test "Keys index survives DEBUG RELOAD" {
+        r debug reload
+        assert_equal [lsort [r keys *]] [scanrange_all count 1000]
+    }
+
+    test "Keys index can be enabled and disabled at runtime" {
+        r config set keyspace-index no
+        assert_error {*keyspace-index*} {r scanrange - +}
+        assert_equal 11 [llength [r keys key:1*]]
+        r set key:new 1
+        r config set keyspace-index yes
+        assert_equal [lsort [r keys *]] [scanrange_all count 1000]
+    }
+}
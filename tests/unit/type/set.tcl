@@ -81,6 +81,150 @@ start_server {
         assert_encoding hashtable myhashset
     }
 
+    test "Large intsets are stored in chunks" {
+        r config set set-max-intset-entries 200000
+        r del bigintset1 bigintset2 bigintset3
+        for {set i 0} {$i < 100000} {incr i 1000} {
+            set args1 {}
+            set args2 {}
+            for {set j $i} {$j < $i+1000} {incr j} {
+                lappend args1 $j
+                lappend args2 [expr {$j*3-50000}]
+            }
+            r sadd bigintset1 {*}$args1
+            r sadd bigintset2 {*}$args2
+        }
+        r sadd bigintset3 -50000 4 7 99997 100000
+        assert_encoding intset bigintset1
+        assert_equal 100000 [r scard bigintset1]
+        assert_equal {1 1 0} [list [r sismember bigintset1 0] \
+            [r sismember bigintset1 99999] [r sismember bigintset1 100000]]
+        assert_equal 1 [r srem bigintset1 500]
+        assert_equal 0 [r sismember bigintset1 500]
+        assert_equal 1 [r sadd bigintset1 500]
+        r sadd bigintset1 [expr {1<<40}] [expr {-(1<<40)}]
+        assert_equal 100002 [r scard bigintset1]
+        set members [r smembers bigintset1]
+        assert_equal 100002 [llength [lsort -unique $members]]
+        assert {[r memory usage bigintset1] < 100002*4+1000}
+
+        set digest [r debug digest]
+        r debug reload
+        assert_equal $digest [r debug digest]
+        assert_encoding intset bigintset1
+        assert_encoding intset bigintset2
+    }
+
+    test "SINTER against large intsets" {
+        # Every third number from -50000 to 99999 intersects the first set.
+        set expected {}
+        for {set j 1} {$j < 100000} {incr j 3} { lappend expected $j }
+        assert_equal $expected [lsort -integer [r sinter bigintset1 bigintset2]]
+        assert_equal {4 7 99997} [lsort -integer \
+            [r sinter bigintset1 bigintset2 bigintset3]]
+        assert_equal {-50000 4 7 99997 100000} \
+            [lsort -integer [r sinter bigintset2 bigintset3]]
+        assert_equal [llength $expected] \
+            [r sinterstore dstset bigintset2 bigintset1]
+        assert_encoding intset dstset
+        assert_equal $expected [lsort -integer [r smembers dstset]]
+        r sadd bigintset3 foo
+        assert_equal {4 7 99997} \
+            [lsort -integer [r sinter bigintset3 bigintset1 bigintset2]]
+    }
+
+    test "Large intsets shrink back when elements are removed" {
+        for {set i 0} {$i < 99900} {incr i 1000} {
+            set args {}
+            for {set j $i} {$j < $i+1000 && $j < 99900} {incr j} {
+                lappend args $j
+            }
+            r srem bigintset1 {*}$args
+        }
+        assert_equal 102 [r scard bigintset1]
+        assert_equal 0 [r sismember bigintset1 99899]
+        assert_equal 1 [r sismember bigintset1 99900]
+        assert {[r memory usage bigintset1] < 1000}
+        r config set set-max-intset-entries 512
+        r sadd bigintset1 foo
+        assert_encoding hashtable bigintset1
+        assert_equal 103 [r scard bigintset1]
+        r del bigintset1 bigintset2 bigintset3 dstset
+    }
+
+    test "Set operations on very large sets use the set operations threads" {
+        r del bigset1 bigset2 bigset3 bigset4 bigintset
+        for {set i 0} {$i < 100000} {incr i 1000} {
+            set args1 {}
+            set args2 {}
+            set args3 {}
+            set args4 {}
+            for {set j $i} {$j < $i+1000} {incr j} {
+                lappend args1 e$j
+                lappend args2 e[expr {$j*2}]
+                if {$j % 5 == 0} {lappend args3 e$j}
+                if {$j % 7 == 0} {lappend args3 $j}
+                lappend args4 $j
+            }
+            r sadd bigset1 {*}$args1
+            r sadd bigset2 {*}$args2
+            r sadd bigset3 {*}$args3
+            r sadd bigset4 {*}$args4
+        }
+        r config set set-max-intset-entries 200000
+        for {set i 0} {$i < 100000} {incr i 1000} {
+            set args {}
+            for {set j $i} {$j < $i+1000} {incr j} { lappend args [expr {$j*3}] }
+            r sadd bigintset {*}$args
+        }
+        assert_encoding hashtable bigset1
+        assert_encoding hashtable bigset4
+        assert_encoding intset bigintset
+
+        # The last run can't create the threads it needs beyond the ones
+        # already running, so some slices are filtered by the main thread.
+        set results {}
+        foreach {threads fail} {1 0 4 0 8 1} {
+            r debug set-ops-threads-fail $fail
+            r config set set-ops-threads $threads
+            set res {}
+            lappend res [lsort [r sinter bigset1 bigset2]]
+            lappend res [lsort [r sinter bigset2 bigset1 bigset3]]
+            lappend res [lsort [r sinter bigintset bigset3]]
+            lappend res [lsort [r sdiff bigset1 bigset2 bigset3]]
+            lappend res [lsort [r sdiff bigset1 bigset3 bigset1]]
+            lappend res [lsort [r sinter bigintset bigset4]]
+            lappend res [lsort [r sdiff bigintset bigset4]]
+            lappend res [r sinterstore dstset bigset1 bigset2]
+            lappend res [lsort [r smembers dstset]]
+            lappend res [r sdiffstore dstset bigset1 bigset2]
+            lappend res [lsort [r smembers dstset]]
+            lappend results $res
+        }
+        assert_equal [lindex $results 0] [lindex $results 1]
+        assert_equal [lindex $results 0] [lindex $results 2]
+        assert_match {*Can't create set operations thread*Only 4 of 8*} \
+            [exec grep "set operations thread" [srv 0 stdout]]
+        lassign [lindex $results 0] inter1 inter2 inter3 diff1 diff2 \
+            inter4 diff3 card1 members1 card2 members2
+        assert_equal 50000 [llength $inter1]
+        assert_equal 10000 [llength $inter2]
+        assert_equal {0 21 42} [lrange [lsort -integer $inter3] 0 2]
+        assert_equal 4762 [llength $inter3]
+        assert_equal 40000 [llength $diff1]
+        assert_equal {} $diff2
+        assert_equal 33334 [llength $inter4]
+        assert_equal 66666 [llength $diff3]
+        assert_equal 50000 $card1
+        assert_equal $inter1 $members1
+        assert_equal 50000 $card2
+        assert_equal [lsort [r sdiff bigset1 bigset2]] $members2
+        r debug set-ops-threads-fail 0
+        r config set set-ops-threads 1
+        r config set set-max-intset-entries 512
+        r del bigset1 bigset2 bigset3 bigset4 bigintset dstset
+    }
+
     test {SREM basics - regular set} {
         create_set myset {foo bar ciao}
         assert_encoding hashtable myset
@@ -415,6 +415,18 @@ start_server {tags {"string"}} {
         assert {$ttl <= 10 && $ttl > 5}
     }
 
+    test {Extended SET options and command names are case insensitive} {
+        r del foo
+        assert_equal {OK} [r set foo bar Px 10000 nX]
+        assert_equal {} [r SET foo bar NX]
+        assert_equal {OK} [r sEt foo baz xX EX 100]
+        catch {r set foo bar nz} e
+        assert_match {*syntax*} $e
+        catch {r set foo bar nxx} e
+        assert_match {*syntax*} $e
+        list [r Get foo] [r ttl foo]
+    } {baz 100}
+
     test {GETRANGE with huge ranges, Github issue #1844} {
         r set foo bar
         r getrange foo 0 4294967297